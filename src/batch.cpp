@@ -0,0 +1,153 @@
+#include "batch.h"
+
+#include "lexer.h"
+#include "parse.h"
+#include "runtime.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+namespace batch {
+
+	namespace fs = std::filesystem;
+	using Clock = chrono::steady_clock;
+
+	namespace {
+		vector<fs::path> ReadManifest(const fs::path& manifest) {
+			ifstream input(manifest);
+			if (!input){
+				throw runtime_error("Cannot open manifest "s + manifest.string());
+			}
+
+			vector<fs::path> result;
+			const fs::path base = manifest.parent_path();
+			for (string line; getline(input, line);){
+				line.erase(find(line.begin(), line.end(), '#'), line.end());
+				const auto first = line.find_first_not_of(" \t\r"sv);
+				if (first == string::npos){
+					continue;
+				}
+				const auto last = line.find_last_not_of(" \t\r"sv);
+				fs::path script = line.substr(first, last - first + 1);
+				result.push_back(script.is_absolute() ? script : base / script);
+			}
+			return result;
+		}
+
+		chrono::nanoseconds Percentile(const vector<chrono::nanoseconds>& sorted, double fraction) {
+			if (sorted.empty()){
+				return {};
+			}
+			const auto rank = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+			return sorted[min(rank, sorted.size() - 1)];
+		}
+
+		double ToMilliseconds(chrono::nanoseconds duration) {
+			return chrono::duration<double, milli>(duration).count();
+		}
+	}
+
+	double Summary::GetThroughput() const {
+		const double seconds = chrono::duration<double>(wall_time).count();
+		return seconds > 0 ? static_cast<double>(script_count) / seconds : 0.0;
+	}
+
+	vector<fs::path> CollectScripts(const fs::path& source) {
+		if (!fs::is_directory(source)){
+			return ReadManifest(source);
+		}
+
+		vector<fs::path> result;
+		for (const auto& entry : fs::recursive_directory_iterator(source)){
+			if (entry.is_regular_file()){
+				result.push_back(entry.path());
+			}
+		}
+		sort(result.begin(), result.end());
+		return result;
+	}
+
+	ScriptResult RunScript(const fs::path& path) {
+		ScriptResult result;
+		result.path = path;
+
+		const auto start = Clock::now();
+		ostringstream output;
+		try {
+			ifstream input(path);
+			if (!input){
+				throw runtime_error("Cannot open script"s);
+			}
+			parse::Lexer lexer(input);
+			auto program = ParseProgram(lexer);
+
+			runtime::SimpleContext context{output};
+			runtime::Closure closure;
+			program->Execute(closure, context);
+		} catch (const exception& e) {
+			result.error = e.what();
+		} catch (...) {
+			result.error = "Unknown exception"s;
+		}
+		result.latency = Clock::now() - start;
+		result.output = output.str();
+		return result;
+	}
+
+	vector<ScriptResult> RunScripts(const vector<fs::path>& scripts, size_t thread_count,
+									Summary* summary) {
+		vector<ScriptResult> results(scripts.size());
+
+		const auto start = Clock::now();
+		{
+			pool::WorkStealingPool workers(thread_count);
+			for (size_t i = 0; i < scripts.size(); ++i){
+				workers.Submit([&results, &scripts, i]{
+					results[i] = RunScript(scripts[i]);
+				});
+			}
+			workers.Wait();
+		}
+		if (summary != nullptr){
+			*summary = Summarize(results, Clock::now() - start);
+		}
+		return results;
+	}
+
+	Summary Summarize(const vector<ScriptResult>& results, chrono::nanoseconds wall_time) {
+		Summary summary;
+		summary.script_count = results.size();
+		summary.wall_time = wall_time;
+
+		vector<chrono::nanoseconds> latencies;
+		latencies.reserve(results.size());
+		for (const auto& result : results){
+			latencies.push_back(result.latency);
+			if (!result.error.empty()){
+				++summary.failed_count;
+			}
+		}
+		sort(latencies.begin(), latencies.end());
+
+		summary.p50 = Percentile(latencies, 0.50);
+		summary.p90 = Percentile(latencies, 0.90);
+		summary.p99 = Percentile(latencies, 0.99);
+		summary.max = latencies.empty() ? chrono::nanoseconds{} : latencies.back();
+		return summary;
+	}
+
+	void PrintSummary(ostream& os, const Summary& summary) {
+		os << fixed << setprecision(3);
+		os << "scripts: "sv << summary.script_count << ", failed: "sv << summary.failed_count << '\n';
+		os << "wall time: "sv << ToMilliseconds(summary.wall_time) << " ms, throughput: "sv
+		   << summary.GetThroughput() << " scripts/s\n"sv;
+		os << "latency p50: "sv << ToMilliseconds(summary.p50) << " ms, p90: "sv
+		   << ToMilliseconds(summary.p90) << " ms, p99: "sv << ToMilliseconds(summary.p99)
+		   << " ms, max: "sv << ToMilliseconds(summary.max) << " ms\n"sv;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace batch {
+
+	struct ScriptResult {
+		std::filesystem::path path;
+		std::string output;
+		// Empty when the script finished successfully
+		std::string error;
+		std::chrono::nanoseconds latency{};
+	};
+
+	struct Summary {
+		size_t script_count = 0;
+		size_t failed_count = 0;
+		std::chrono::nanoseconds wall_time{};
+		std::chrono::nanoseconds p50{};
+		std::chrono::nanoseconds p90{};
+		std::chrono::nanoseconds p99{};
+		std::chrono::nanoseconds max{};
+
+		// Scripts per second of wall time
+		[[nodiscard]] double GetThroughput() const;
+	};
+
+	// A directory yields every regular file below it in path order. Any other file is a
+	// manifest: one script path per line, relative to the manifest, '#' starts a comment
+	std::vector<std::filesystem::path> CollectScripts(const std::filesystem::path& source);
+
+	// Lexes, parses and runs a single script, capturing its output and error
+	ScriptResult RunScript(const std::filesystem::path& path);
+
+	// Runs every script on a work-stealing pool. Results keep the order of the scripts
+	std::vector<ScriptResult> RunScripts(const std::vector<std::filesystem::path>& scripts,
+										 size_t thread_count, Summary* summary = nullptr);
+
+	Summary Summarize(const std::vector<ScriptResult>& results, std::chrono::nanoseconds wall_time);
+
+	void PrintSummary(std::ostream& os, const Summary& summary);
+}
@@ -0,0 +1,136 @@
+#include "batch.h"
+#include "thread_pool.h"
+#include "test_runner_p.h"
+
+#include <atomic>
+#include <fstream>
+
+using namespace std;
+
+namespace batch {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Creates an empty directory that is removed together with its content
+class TempDir {
+public:
+    explicit TempDir(const string& name)
+        : path_(fs::temp_directory_path() / name) {
+        fs::remove_all(path_);
+        fs::create_directories(path_);
+    }
+
+    ~TempDir() {
+        fs::remove_all(path_);
+    }
+
+    fs::path Write(const string& name, const string& content) const {
+        fs::path file = path_ / name;
+        fs::create_directories(file.parent_path());
+        ofstream(file) << content;
+        return file;
+    }
+
+    [[nodiscard]] const fs::path& GetPath() const {
+        return path_;
+    }
+
+private:
+    fs::path path_;
+};
+
+void TestPoolRunsEveryTask() {
+    atomic<int> counter = 0;
+    {
+        pool::WorkStealingPool workers(4);
+        for (int i = 0; i < 100; ++i) {
+            workers.Submit([&workers, &counter] {
+                ++counter;
+                for (int j = 0; j < 10; ++j) {
+                    workers.Submit([&counter] {
+                        ++counter;
+                    });
+                }
+            });
+        }
+        workers.Wait();
+        ASSERT_EQUAL(counter.load(), 1100);
+
+        workers.Submit([&counter] {
+            ++counter;
+        });
+    }
+    ASSERT_EQUAL(counter.load(), 1101);
+}
+
+void TestRunScriptsCapturesOutput() {
+    TempDir dir("mython_batch_test"s);
+    dir.Write("a.my"s, "x = 1\nprint x\n"s);
+    dir.Write("nested/b.my"s, "class A:\n  def __str__():\n    return 'A'\n\nprint A()\n"s);
+    dir.Write("c.my"s, "print 'before'\nx = y\n"s);
+
+    const auto scripts = CollectScripts(dir.GetPath());
+    ASSERT_EQUAL(scripts.size(), 3U);
+    ASSERT(scripts[0].filename() == "a.my"s);
+    ASSERT(scripts[1].filename() == "c.my"s);
+    ASSERT(scripts[2].filename() == "b.my"s);
+
+    Summary summary;
+    const auto results = RunScripts(scripts, 3, &summary);
+    ASSERT_EQUAL(results.size(), 3U);
+    ASSERT_EQUAL(results[0].output, "1\n"s);
+    ASSERT(results[0].error.empty());
+    ASSERT_EQUAL(results[1].output, "before\n"s);
+    ASSERT(!results[1].error.empty());
+    ASSERT_EQUAL(results[2].output, "A\n"s);
+    ASSERT(results[2].error.empty());
+
+    ASSERT_EQUAL(summary.script_count, 3U);
+    ASSERT_EQUAL(summary.failed_count, 1U);
+    ASSERT(summary.p50 <= summary.p90 && summary.p90 <= summary.p99 && summary.p99 <= summary.max);
+}
+
+void TestManifest() {
+    TempDir dir("mython_manifest_test"s);
+    dir.Write("scripts/one.my"s, "print 1\n"s);
+    dir.Write("scripts/two.my"s, "print 2\n"s);
+    const auto manifest = dir.Write("manifest.txt"s,
+                                    "# smoke tests\nscripts/two.my\n\n  scripts/one.my  # first\n"s);
+
+    const auto scripts = CollectScripts(manifest);
+    ASSERT_EQUAL(scripts.size(), 2U);
+
+    const auto results = RunScripts(scripts, 2);
+    ASSERT_EQUAL(results[0].output, "2\n"s);
+    ASSERT_EQUAL(results[1].output, "1\n"s);
+}
+
+void TestSummary() {
+    vector<ScriptResult> results(100);
+    for (size_t i = 0; i < results.size(); ++i) {
+        results[i].latency = chrono::milliseconds(100 - i);
+    }
+    results[7].error = "failure"s;
+
+    const Summary summary = Summarize(results, chrono::seconds(2));
+    ASSERT_EQUAL(summary.script_count, 100U);
+    ASSERT_EQUAL(summary.failed_count, 1U);
+    ASSERT(summary.p50 == chrono::milliseconds(51));
+    ASSERT(summary.p90 == chrono::milliseconds(90));
+    ASSERT(summary.p99 == chrono::milliseconds(99));
+    ASSERT(summary.max == chrono::milliseconds(100));
+    ASSERT_EQUAL(summary.GetThroughput(), 50.0);
+}
+
+}  // namespace
+
+void RunBatchTests(TestRunner& tr) {
+    RUN_TEST(tr, batch::TestPoolRunsEveryTask);
+    RUN_TEST(tr, batch::TestRunScriptsCapturesOutput);
+    RUN_TEST(tr, batch::TestManifest);
+    RUN_TEST(tr, batch::TestSummary);
+}
+
+}  // namespace batch
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+class BenchmarkRunner {
+public:
+    template <class BenchmarkFunc>
+    void RunBenchmark(BenchmarkFunc func, const std::string& benchmark_name) {
+        using namespace std::chrono;
+
+        const auto start = steady_clock::now();
+        try {
+            func();
+        } catch (std::exception& e) {
+            std::cerr << benchmark_name << " fail: " << e.what() << std::endl;
+            return;
+        }
+        const auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+        std::cerr << benchmark_name << " " << elapsed.count() << " ms" << std::endl;
+    }
+};
+
+// Measures a single run of the body and returns it in seconds
+template <class Func>
+double MeasureSeconds(Func func) {
+    using namespace std::chrono;
+
+    const auto start = steady_clock::now();
+    func();
+    return duration<double>(steady_clock::now() - start).count();
+}
+
+#define RUN_BENCHMARK(br, func) br.RunBenchmark(func, #func)
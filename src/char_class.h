@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace parse::chars {
+
+	enum Class : uint8_t {
+		DIGIT = 1,
+		LETTER = 2,
+		UNDERSCORE = 4,
+	};
+
+	// Classes of every character, as the "C" locale has them, so classifying a character
+	// is a load from the table
+	inline constexpr std::array<uint8_t, 256> CLASSES = []{
+		std::array<uint8_t, 256> result{};
+		for (int ch = '0'; ch <= '9'; ++ch){
+			result[ch] = DIGIT;
+		}
+		for (int ch = 'a'; ch <= 'z'; ++ch){
+			result[ch] = LETTER;
+			result[ch - 'a' + 'A'] = LETTER;
+		}
+		result['_'] = UNDERSCORE;
+		return result;
+	}();
+
+	constexpr bool Is(char ch, uint8_t classes) {
+		return (CLASSES[static_cast<unsigned char>(ch)] & classes) != 0;
+	}
+
+	constexpr bool IsDigit(char ch) {
+		return Is(ch, DIGIT);
+	}
+
+	constexpr bool IsIdentifierStart(char ch) {
+		return Is(ch, LETTER | UNDERSCORE);
+	}
+
+	constexpr bool IsIdentifier(char ch) {
+		return Is(ch, DIGIT | LETTER | UNDERSCORE);
+	}
+}
@@ -0,0 +1,302 @@
+#include "checkpoint.h"
+
+#include "image.h"
+#include "image_io.h"
+#include "lexer.h"
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <unordered_set>
+
+using namespace std;
+
+namespace checkpoint {
+
+	namespace detail {
+		// The fields of the instances of a run before each statement first changed them.
+		// Keeps the changed instances alive, so their addresses aren't reused
+		class Journal : public runtime::FieldJournal {
+		public:
+			// The changes from now on are made by the statement-th statement
+			void BeginStatement(size_t statement) {
+				statement_ = statement;
+				changed_.clear();
+			}
+
+			void BeforeChange(const runtime::ClassInstance& instance) override {
+				Versions& versions = versions_[&instance];
+				if (!versions.fields.empty() && versions.fields.back().first == statement_){
+					return;
+				}
+				if (!versions.owner){
+					versions.owner = instance.weak_from_this().lock();
+				}
+				versions.fields.emplace_back(statement_, instance.Fields());
+				changed_.push_back(&instance);
+			}
+
+			// The fields of the instance after the first statements
+			[[nodiscard]] const runtime::Closure& GetFields(const runtime::ClassInstance& instance,
+															size_t statements) const {
+				if (auto it = versions_.find(&instance); it != versions_.end()){
+					const auto& fields = it->second.fields;
+					auto version = lower_bound(fields.begin(), fields.end(), statements,
+											   [](const auto& entry, size_t statement) {
+												   return entry.first < statement;
+											   });
+					if (version != fields.end()){
+						return version->second;
+					}
+				}
+				return instance.Fields();
+			}
+
+			// Changed by the current statement
+			[[nodiscard]] const vector<const runtime::ClassInstance*>& GetChanged() const {
+				return changed_;
+			}
+
+		private:
+			struct Versions {
+				shared_ptr<const runtime::ClassInstance> owner;
+				// Before the statement of each, in order
+				vector<pair<size_t, runtime::Closure>> fields;
+			};
+
+			size_t statement_ = 0;
+			unordered_map<const runtime::ClassInstance*, Versions> versions_;
+			vector<const runtime::ClassInstance*> changed_;
+		};
+	}
+
+	namespace {
+		// Passes the tokens of the lexer through and appends every token the parser is done
+		// with to a key, so the key of a statement changes with its tokens only, not with
+		// comments or blank lines
+		class RecordingStream : public parse::TokenStream {
+		public:
+			explicit RecordingStream(parse::TokenStream& tokens)
+				: tokens_(tokens) {
+			}
+
+			[[nodiscard]] const parse::Token& CurrentToken() const override {
+				return tokens_.CurrentToken();
+			}
+
+			parse::Token NextToken() override {
+				AppendToken(tokens_.CurrentToken());
+				return tokens_.NextToken();
+			}
+
+			// The key of the tokens since the last call
+			string TakeKey() {
+				return std::move(key_);
+			}
+
+		private:
+			void AppendToken(const parse::Token& token) {
+				using namespace parse::token_type;
+
+				image::AppendUnsigned(key_, token.index());
+				if (const auto* number = token.TryAs<Number>()){
+					image::AppendSigned(key_, number->value);
+				}else if (const auto* id = token.TryAs<Id>()){
+					AppendString(id->value);
+				}else if (const auto* str = token.TryAs<String>()){
+					AppendString(str->value);
+				}else if (const auto* ch = token.TryAs<Char>()){
+					key_ += ch->value;
+				}
+			}
+
+			void AppendString(const string& value) {
+				image::AppendUnsigned(key_, value.size());
+				key_ += value;
+			}
+
+		private:
+			parse::TokenStream& tokens_;
+			string key_;
+		};
+
+		uint64_t HashPrefix(uint64_t previous, string key) {
+			for (int i = 0; i < 8; ++i){
+				key += static_cast<char>(previous >> (i * 8));
+			}
+			return image::HashSource(key);
+		}
+
+		// Reports the field changes of this thread to the journal while it exists
+		class JournalScope {
+		public:
+			explicit JournalScope(detail::Journal& journal)
+				: previous_(runtime::SetFieldJournal(&journal)) {
+			}
+
+			JournalScope(const JournalScope&) = delete;
+			JournalScope& operator=(const JournalScope&) = delete;
+
+			~JournalScope() {
+				runtime::SetFieldJournal(previous_);
+			}
+
+		private:
+			runtime::FieldJournal* previous_;
+		};
+
+		// Globals as they were after the first statements, sharing no instance with the run
+		runtime::Closure CopyGlobals(const runtime::Closure& globals, const detail::Journal& journal,
+									 size_t statements) {
+			vector<string> names;
+			vector<runtime::ObjectHolder> values;
+			names.reserve(globals.size());
+			values.reserve(globals.size());
+			for (const auto& [name, value] : globals){
+				names.push_back(name);
+				values.push_back(value);
+			}
+			values = runtime::DeepCopy(values, [&](const runtime::ClassInstance& instance) -> const runtime::Closure& {
+				return journal.GetFields(instance, statements);
+			});
+
+			runtime::Closure result;
+			for (size_t i = 0; i < names.size(); ++i){
+				result.emplace(std::move(names[i]), std::move(values[i]));
+			}
+			return result;
+		}
+
+		bool CanKeep(const runtime::ObjectHolder& object) {
+			return !object || object.TryAs<runtime::Number>() || object.TryAs<runtime::String>()
+				|| object.TryAs<runtime::Bool>() || object.TryAs<runtime::Class>()
+				|| object.TryAs<runtime::ClassInstance>();
+		}
+
+		// A statement can only make an object reachable by storing it in a global or a field
+		bool StoresOnlyKeptObjects(const runtime::Closure& globals, const runtime::Closure& previous,
+								   const vector<const runtime::ClassInstance*>& changed) {
+			for (const auto& [name, value] : globals){
+				auto it = previous.find(name);
+				if ((it == previous.end() || it->second.Get() != value.Get()) && !CanKeep(value)){
+					return false;
+				}
+			}
+			for (const auto* instance : changed){
+				for (const auto& [name, value] : instance->Fields()){
+					if (!CanKeep(value)){
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		bool CanCheckpoint(const runtime::ObjectHolder& object, unordered_set<const runtime::Object*>& visited) {
+			const auto* instance = object.TryAs<runtime::ClassInstance>();
+			if (instance == nullptr){
+				return CanKeep(object);
+			}
+			if (!visited.insert(instance).second){
+				return true;
+			}
+			for (const auto& [name, value] : instance->Fields()){
+				if (!CanCheckpoint(value, visited)){
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	bool CanCheckpoint(const runtime::Closure& globals) {
+		unordered_set<const runtime::Object*> visited;
+		for (const auto& [name, value] : globals){
+			if (!CanCheckpoint(value, visited)){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	Runner::RunStats Runner::Run(istream& input, ostream& output) {
+		auto program = make_shared<Program>();
+		{
+			parse::Lexer lexer(input);
+			RecordingStream tokens(lexer);
+			// Only used while parsing, the lexer it reads is gone afterwards
+			program->parser = make_unique<StatementStream>(tokens);
+			program->prefix_hashes.push_back(image::HashSource({}));
+			while (auto statement = program->parser->Next()){
+				program->statements.push_back(std::move(statement));
+				program->prefix_hashes.push_back(HashPrefix(program->prefix_hashes.back(), tokens.TakeKey()));
+			}
+		}
+
+		RunStats stats;
+		stats.statements = program->statements.size();
+		for (size_t i = program->statements.size(); i > 0; --i){
+			if (checkpoints_.count(program->prefix_hashes[i]) != 0){
+				stats.resumed_statements = i;
+				break;
+			}
+		}
+
+		auto run_output = make_shared<string>();
+		runtime::Closure globals;
+		unordered_map<uint64_t, Checkpoint> checkpoints;
+		if (stats.resumed_statements > 0){
+			const Checkpoint& resumed = checkpoints_.at(program->prefix_hashes[stats.resumed_statements]);
+			globals = CopyGlobals(resumed.globals, *resumed.journal, resumed.statements);
+			run_output->assign(*resumed.output, 0, resumed.output_size);
+			output << *run_output;
+			for (size_t i = 1; i <= stats.resumed_statements; ++i){
+				if (auto node = checkpoints_.extract(program->prefix_hashes[i])){
+					checkpoints.insert(std::move(node));
+				}
+			}
+		}
+
+		auto journal = make_shared<detail::Journal>();
+		runtime::DummyContext context;
+		bool can_checkpoint = true;
+		// Once an object that can't be kept is stored, the globals are checked as a whole
+		bool stored_unkept = false;
+		const runtime::Closure initial_globals = globals;
+		const runtime::Closure* previous_globals = &initial_globals;
+		try {
+			JournalScope scope(*journal);
+			for (size_t i = stats.resumed_statements; i < program->statements.size(); ++i){
+				journal->BeginStatement(i);
+				program->statements[i]->Execute(globals, context);
+
+				const string statement_output = context.output.str();
+				context.output.str({});
+				*run_output += statement_output;
+				output << statement_output;
+
+				// The globals after an object that can't be kept depend on it
+				if (can_checkpoint){
+					stored_unkept = stored_unkept
+						|| !StoresOnlyKeptObjects(globals, *previous_globals, journal->GetChanged());
+					can_checkpoint = !stored_unkept || CanCheckpoint(globals);
+				}
+				if (can_checkpoint){
+					Checkpoint& checkpoint = checkpoints[program->prefix_hashes[i + 1]];
+					checkpoint = Checkpoint{program, globals, journal, i + 1, run_output, run_output->size()};
+					previous_globals = &checkpoint.globals;
+				}
+			}
+		} catch (...) {
+			const string statement_output = context.output.str();
+			*run_output += statement_output;
+			output << statement_output;
+			checkpoints_ = std::move(checkpoints);
+			throw;
+		}
+
+		stats.checkpoints = checkpoints.size();
+		checkpoints_ = std::move(checkpoints);
+		return stats;
+	}
+}
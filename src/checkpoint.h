@@ -0,0 +1,68 @@
+#pragma once
+
+#include "parse.h"
+#include "runtime.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Re-running a script that has been edited near its end. After every top-level statement
+// the runner keeps a checkpoint: the globals and the output so far, keyed by a hash of the
+// tokens of the statements up to it. A later run of the script resumes from the checkpoint
+// of its longest unchanged prefix of statements instead of running them again.
+// Checkpoints share the instances of the run. A statement saves the fields of an instance
+// before it first changes them, so a checkpoint costs the globals and the changed fields
+namespace checkpoint {
+
+	namespace detail {
+		class Journal;
+	}
+
+	class Runner {
+	public:
+		struct RunStats {
+			size_t statements = 0;
+			// Not run again, their output comes from a checkpoint
+			size_t resumed_statements = 0;
+			size_t checkpoints = 0;
+		};
+
+		// Parses the whole script before running it, so a syntax error runs nothing. Keeps
+		// only the checkpoints of this run, including the one it resumed from. An error of a
+		// statement is rethrown after the output before it, the checkpoints before it are kept
+		RunStats Run(std::istream& input, std::ostream& output);
+
+	private:
+		// The statements of a run. Checkpoints refer to it, since the objects they keep are
+		// instances of the classes it declares
+		struct Program {
+			// Keeps the classes. Declared first, so it outlives the statements
+			std::unique_ptr<StatementStream> parser;
+			std::vector<std::unique_ptr<runtime::Executable>> statements;
+			// Of the first i statements at i
+			std::vector<uint64_t> prefix_hashes;
+		};
+
+		struct Checkpoint {
+			std::shared_ptr<const Program> program;
+			// Share their instances with the run, every other object is immutable
+			runtime::Closure globals;
+			// The fields the instances had after the first statements of the run
+			std::shared_ptr<const detail::Journal> journal;
+			size_t statements = 0;
+			std::shared_ptr<const std::string> output;
+			size_t output_size = 0;
+		};
+
+		std::unordered_map<uint64_t, Checkpoint> checkpoints_;
+	};
+
+	// Whether every object reachable from the globals can be kept in a checkpoint: numbers,
+	// strings, bools, classes and instances. Channels and isolates can't, as they change
+	// outside of the statements that use them
+	bool CanCheckpoint(const runtime::Closure& globals);
+}
@@ -0,0 +1,74 @@
+#include "bench_runner_p.h"
+#include "checkpoint.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace checkpoint {
+
+namespace {
+
+// A script whose statements build a linked list, then print a summary of it
+string MakeScript(int statement_count) {
+    string script = R"(
+class Node:
+  def __init__(value, next):
+    self.value = value
+    self.next = next
+
+class Sum:
+  def of(node, count):
+    if count == 0:
+      return 0
+    return node.value + self.of(node.next, count - 1)
+
+head = None
+sum = Sum()
+)"s;
+    for (int i = 0; i < statement_count; ++i) {
+        script += "head = Node("s + to_string(i) + ", head)\n"s;
+    }
+    return script;
+}
+
+// Re-running a script after editing its last statement, from scratch and from checkpoints
+void BenchmarkEditLastStatement() {
+    constexpr int RUNS = 20;
+    const string script = MakeScript(300);
+    const string edits[] = {"print sum.of(head, 300)\n"s, "print sum.of(head.next, 299)\n"s};
+
+    const double full_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < RUNS; ++i) {
+            Runner runner;
+            istringstream input(script + edits[i % 2]);
+            ostringstream output;
+            runner.Run(input, output);
+        }
+    });
+
+    Runner runner;
+    {
+        istringstream input(script + edits[1]);
+        ostringstream output;
+        runner.Run(input, output);
+    }
+    const double resumed_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < RUNS; ++i) {
+            istringstream input(script + edits[i % 2]);
+            ostringstream output;
+            runner.Run(input, output);
+        }
+    });
+
+    cerr << "  300 statements, last one edited: full run "sv << full_seconds / RUNS * 1000 << " ms, resumed "sv
+         << resumed_seconds / RUNS * 1000 << " ms"sv << endl;
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, checkpoint::BenchmarkEditLastStatement);
+}
+
+}  // namespace checkpoint
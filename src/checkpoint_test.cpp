@@ -0,0 +1,175 @@
+#include "checkpoint.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace checkpoint {
+
+namespace {
+
+const string PROGRAM = R"--(
+class Counter:
+  def __init__():
+    self.count = 0
+
+  def add(n):
+    self.count = self.count + n
+    return self.count
+
+  def __str__():
+    return "Counter(" + str(self.count) + ")"
+
+c = Counter()
+print c.add(1)
+alias = c
+print alias.add(2)
+name = "counter"
+print name, c
+)--"s;
+
+struct RunResult {
+    Runner::RunStats stats;
+    string output;
+};
+
+RunResult Run(Runner& runner, const string& source) {
+    istringstream input(source);
+    ostringstream output;
+    RunResult result;
+    result.stats = runner.Run(input, output);
+    result.output = output.str();
+    return result;
+}
+
+void TestResumesUnchangedPrefix() {
+    Runner runner;
+    const RunResult first = Run(runner, PROGRAM);
+    ASSERT_EQUAL(first.output, "1\n3\ncounter Counter(3)\n"s);
+    ASSERT_EQUAL(first.stats.statements, 7U);
+    ASSERT_EQUAL(first.stats.resumed_statements, 0U);
+    ASSERT_EQUAL(first.stats.checkpoints, 7U);
+
+    // The same script runs nothing again
+    const RunResult again = Run(runner, PROGRAM);
+    ASSERT_EQUAL(again.output, first.output);
+    ASSERT_EQUAL(again.stats.resumed_statements, 7U);
+
+    // Edits of comments and blank lines keep the tokens
+    const RunResult commented = Run(runner, "# a comment\n\n"s + PROGRAM);
+    ASSERT_EQUAL(commented.stats.resumed_statements, 7U);
+
+    const string edited = PROGRAM + "print alias.add(4), c\n"s;
+    const RunResult appended = Run(runner, edited);
+    ASSERT_EQUAL(appended.stats.resumed_statements, 7U);
+    ASSERT_EQUAL(appended.output, first.output + "7 Counter(7)\n"s);
+
+    // The instances of the checkpoint are not changed by the runs resumed from it, and
+    // alias still refers to c
+    const RunResult rerun = Run(runner, edited);
+    ASSERT_EQUAL(rerun.stats.resumed_statements, 8U);
+    ASSERT_EQUAL(rerun.output, appended.output);
+    const RunResult changed = Run(runner, PROGRAM + "print alias.add(5), c\n"s);
+    ASSERT_EQUAL(changed.stats.resumed_statements, 7U);
+    ASSERT_EQUAL(changed.output, first.output + "8 Counter(8)\n"s);
+
+    Runner fresh;
+    ASSERT_EQUAL(Run(fresh, PROGRAM + "print alias.add(5), c\n"s).output, changed.output);
+}
+
+void TestEditInTheMiddle() {
+    Runner runner;
+    Run(runner, PROGRAM);
+    string edited = PROGRAM;
+    edited.replace(edited.find("add(2)"s), 6, "add(5)"s);
+    const RunResult result = Run(runner, edited);
+    ASSERT_EQUAL(result.stats.resumed_statements, 4U);
+    ASSERT_EQUAL(result.output, "1\n6\ncounter Counter(6)\n"s);
+}
+
+// Checkpoints share the instances of the run, which the later statements change
+void TestResumesAfterChangedInstances() {
+    const string classes = R"--(
+class Node:
+  def __init__(value):
+    self.value = value
+    self.me = self
+
+  def link(other):
+    self.next = other
+    other.prev = self
+)--"s;
+    const vector<string> statements = {
+        "a = Node(1)"s,
+        "b = Node(2)"s,
+        "a.link(b)"s,
+        "a.value = 10"s,
+        "b.value = b.value + a.value"s,
+        "b = Node(3)"s,
+        "a.next.value = 5"s,
+        "a.link(b)"s,
+        "a.next.me.value = 7"s,
+        "b = a"s,
+    };
+    const string probe = "print a.value, a.me.value, a.next.value, a.next.prev.value, a.next.me.value, b.value\n"s;
+
+    string script = classes;
+    for (const string& statement : statements) {
+        script += statement + '\n';
+    }
+    // a.next is there from the third statement on
+    for (size_t count = 3; count <= statements.size(); ++count) {
+        string prefix = classes;
+        for (size_t i = 0; i < count; ++i) {
+            prefix += statements[i] + '\n';
+        }
+        Runner runner;
+        Run(runner, script);
+        const RunResult resumed = Run(runner, prefix + probe);
+        ASSERT_EQUAL(resumed.stats.resumed_statements, count + 1);
+
+        Runner fresh;
+        ASSERT_EQUAL(resumed.output, Run(fresh, prefix + probe).output);
+    }
+}
+
+void TestErrors() {
+    Runner runner;
+    Run(runner, PROGRAM);
+
+    // Nothing runs, the checkpoints stay
+    ASSERT_THROWS(Run(runner, PROGRAM + "print (\n"s), runtime_error);
+    ASSERT_EQUAL(Run(runner, PROGRAM).stats.resumed_statements, 7U);
+
+    istringstream input(PROGRAM + "print c.missing()\nprint 1\n"s);
+    ostringstream output;
+    ASSERT_THROWS(runner.Run(input, output), runtime_error);
+    ASSERT_EQUAL(output.str(), "1\n3\ncounter Counter(3)\n"s);
+    const RunResult fixed = Run(runner, PROGRAM + "print c.add(1)\nprint 1\n"s);
+    ASSERT_EQUAL(fixed.stats.resumed_statements, 7U);
+    ASSERT_EQUAL(fixed.output, "1\n3\ncounter Counter(3)\n4\n1\n"s);
+}
+
+void TestChannelsStopCheckpoints() {
+    Runner runner;
+    const string program = "x = 1\nch = Channel(2)\nch.send(x)\nprint ch.recv()\n"s;
+    const RunResult first = Run(runner, program);
+    ASSERT_EQUAL(first.output, "1\n"s);
+    ASSERT_EQUAL(first.stats.checkpoints, 1U);
+    ASSERT_EQUAL(Run(runner, program).stats.resumed_statements, 1U);
+}
+
+}  // namespace
+
+void RunCheckpointTests(TestRunner& tr) {
+    RUN_TEST(tr, checkpoint::TestResumesUnchangedPrefix);
+    RUN_TEST(tr, checkpoint::TestEditInTheMiddle);
+    RUN_TEST(tr, checkpoint::TestResumesAfterChangedInstances);
+    RUN_TEST(tr, checkpoint::TestErrors);
+    RUN_TEST(tr, checkpoint::TestChannelsStopCheckpoints);
+}
+
+}  // namespace checkpoint
@@ -0,0 +1,149 @@
+#include "pass.h"
+
+#include "statement.h"
+#include "visitor.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace passes {
+
+	namespace {
+		const string SELF = "self"s;
+
+		bool IsSubclass(const runtime::Class* cls, const runtime::Class& base) {
+			for (; cls != nullptr; cls = cls->GetParent()){
+				if (cls == &base){
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool Declares(const runtime::Class& cls, const string& method) {
+			const auto& methods = cls.GetMethods();
+			return any_of(methods.begin(), methods.end(), [&method](const runtime::Method& m) {
+				return m.name == method;
+			});
+		}
+
+		// After an assignment to self, self may not be the receiver of the call any more
+		bool AssignsSelf(const ast::Statement& body) {
+			class Finder : public ast::Visitor {
+			public:
+				using ast::Visitor::Visit;
+
+				bool Visit(const ast::Assignment& node) override {
+					found = found || node.GetVarName() == SELF;
+					return true;
+				}
+
+				// Classes declared in the body have a self of their own
+				bool Visit(const ast::ClassDefinition&) override {
+					return false;
+				}
+
+				bool found = false;
+			};
+
+			Finder finder;
+			finder.Walk(body);
+			return finder.found;
+		}
+
+		bool IsCallOnSelf(const ast::MethodCall& call) {
+			const auto* object = dynamic_cast<const ast::VariableValue*>(&call.GetObject());
+			return object != nullptr && object->GetDottedIds() == vector{SELF};
+		}
+
+		class Devirtualizer {
+		public:
+			explicit Devirtualizer(vector<runtime::Class*> classes)
+				: classes_(std::move(classes)) {
+			}
+
+			Devirtualize::Stats Run() {
+				for (auto* cls : classes_){
+					vector<const runtime::Class*> subclasses;
+					copy_if(classes_.begin(), classes_.end(), back_inserter(subclasses),
+							[cls](const runtime::Class* other) { return IsSubclass(other, *cls); });
+
+					for (auto& method : cls->GetMethods()){
+						++stats_.methods;
+						if (none_of(subclasses.begin(), subclasses.end(), [cls, &method](const runtime::Class* other) {
+								return other != cls && Declares(*other, method.name);
+							})){
+							++stats_.final_methods;
+						}
+						if (dynamic_cast<const ast::MethodBody*>(method.body.get()) != nullptr
+							&& !AssignsSelf(*method.body)){
+							BindCallsOnSelf(method.body, *cls, subclasses);
+						}
+					}
+				}
+				return stats_;
+			}
+
+		private:
+			// Any of the subclasses may be self
+			void BindCallsOnSelf(ast::Children::Slot& body, const runtime::Class& cls,
+								 const vector<const runtime::Class*>& subclasses) {
+				vector<ast::Children::Slot*> stack{&body};
+				while (!stack.empty()){
+					ast::Children::Slot& slot = *stack.back();
+					stack.pop_back();
+					if (dynamic_cast<const ast::ClassDefinition*>(slot.get()) != nullptr){
+						continue;
+					}
+					if (const auto* call = dynamic_cast<const ast::MethodCall*>(slot.get()); call && IsCallOnSelf(*call)){
+						++stats_.self_calls;
+						if (const auto* target = FindUniqueTarget(*call, cls, subclasses)){
+							++stats_.devirtualized_calls;
+							unique_ptr<ast::MethodCall> method_call(static_cast<ast::MethodCall*>(slot.release()));
+							slot = make_unique<ast::BoundMethodCall>(std::move(method_call), *target);
+						}
+					}
+					ast::Children::ForEach(*slot, [&stack](ast::Children::Slot& child) {
+						stack.push_back(&child);
+					});
+				}
+			}
+
+			static const runtime::Method* FindUniqueTarget(const ast::MethodCall& call, const runtime::Class& cls,
+														   const vector<const runtime::Class*>& subclasses) {
+				const auto* target = cls.GetMethod(call.GetMethod(), call.GetArgs().size());
+				if (target == nullptr){
+					return nullptr;
+				}
+				for (const auto* other : subclasses){
+					if (other->GetMethod(call.GetMethod(), call.GetArgs().size()) != target){
+						return nullptr;
+					}
+				}
+				return target;
+			}
+
+			vector<runtime::Class*> classes_;
+			Devirtualize::Stats stats_;
+		};
+	}
+
+	string_view Devirtualize::GetName() const {
+		return "devirtualize"sv;
+	}
+
+	void Devirtualize::Run(unique_ptr<runtime::Executable>& program) {
+		stats_ = Devirtualizer(ast::CollectClasses(*program)).Run();
+	}
+
+	string Devirtualize::GetSummary() const {
+		return to_string(stats_.devirtualized_calls) + " of "s + to_string(stats_.self_calls)
+			+ " calls on self devirtualized, "s + to_string(stats_.final_methods) + " of "s
+			+ to_string(stats_.methods) + " methods final"s;
+	}
+
+	const Devirtualize::Stats& Devirtualize::GetStats() const {
+		return stats_;
+	}
+}
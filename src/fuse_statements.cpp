@@ -0,0 +1,104 @@
+#include "pass.h"
+
+#include "statement.h"
+#include "visitor.h"
+
+using namespace std;
+
+namespace passes {
+
+	namespace {
+		using ast::Children;
+
+		bool IsConstantOrVariable(const ast::Statement& node) {
+			return dynamic_cast<const ast::NumericConst*>(&node) != nullptr
+				|| dynamic_cast<const ast::StringConst*>(&node) != nullptr
+				|| dynamic_cast<const ast::BoolConst*>(&node) != nullptr
+				|| dynamic_cast<const ast::VariableValue*>(&node) != nullptr;
+		}
+
+		// object.field = object.field + delta
+		bool IsIncrement(const ast::FieldAssignment& assignment) {
+			const auto* add = dynamic_cast<const ast::Add*>(&assignment.GetValue());
+			const auto* field = add ? dynamic_cast<const ast::VariableValue*>(&add->GetLhs()) : nullptr;
+			if (field == nullptr || !IsConstantOrVariable(add->GetRhs())){
+				return false;
+			}
+			auto ids = assignment.GetObject().GetDottedIds();
+			ids.push_back(assignment.GetFieldName());
+			return field->GetDottedIds() == ids;
+		}
+
+		bool EndsInReturn(const ast::MethodBody& body) {
+			const auto* statements = dynamic_cast<const ast::Compound*>(&body.GetBody());
+			return statements != nullptr && !statements->GetStatements().empty()
+				&& dynamic_cast<const ast::Return*>(statements->GetStatements().back().get()) != nullptr;
+		}
+
+		class StatementFuser : public ast::Rewriter {
+		public:
+			[[nodiscard]] const FuseStatements::Stats& GetStats() const {
+				return stats_;
+			}
+
+		protected:
+			unique_ptr<ast::Statement> Rewrite(unique_ptr<ast::Statement> node) override {
+				if (const auto* assignment = dynamic_cast<const ast::FieldAssignment*>(node.get())){
+					if (dynamic_cast<const ast::FieldIncrement*>(assignment) != nullptr || !IsIncrement(*assignment)){
+						return node;
+					}
+					++stats_.field_increments;
+					ast::VariableValue object(assignment->GetObject().GetDottedIds());
+					string field = assignment->GetFieldName();
+					auto children = Children::Take(*node);
+					return make_unique<ast::FieldIncrement>(std::move(object), std::move(field), std::move(children[0]));
+				}
+
+				if (const auto* body = dynamic_cast<const ast::MethodBody*>(node.get())){
+					if (dynamic_cast<const ast::ReturningMethodBody*>(body) != nullptr || !EndsInReturn(*body)){
+						return node;
+					}
+					++stats_.returning_bodies;
+					return make_unique<ast::ReturningMethodBody>(std::move(Children::Take(*node)[0]));
+				}
+
+				if (const auto* if_else = dynamic_cast<const ast::IfElse*>(node.get())){
+					const auto* condition = dynamic_cast<const ast::Comparison*>(&if_else->GetCondition());
+					const auto compare = condition ? ast::GetValueCompare<int>(condition->GetComparator()) : nullptr;
+					if (dynamic_cast<const ast::CompareBranch*>(if_else) != nullptr || compare == nullptr){
+						return node;
+					}
+					++stats_.compare_branches;
+					const bool has_else = if_else->GetElseBody() != nullptr;
+					auto children = Children::Take(*node);
+					auto else_body = has_else ? std::move(children[2]) : nullptr;
+					return make_unique<ast::CompareBranch>(compare, std::move(children[0]), std::move(children[1]),
+														   std::move(else_body));
+				}
+				return node;
+			}
+
+		private:
+			FuseStatements::Stats stats_;
+		};
+	}
+
+	string_view FuseStatements::GetName() const {
+		return "fuse-statements"sv;
+	}
+
+	void FuseStatements::Run(unique_ptr<runtime::Executable>& program) {
+		StatementFuser fuser;
+		fuser.RewriteTree(program);
+		stats_ = fuser.GetStats();
+	}
+
+	string FuseStatements::GetSummary() const {
+		return to_string(stats_.field_increments) + " field increments, "s + to_string(stats_.returning_bodies)
+			+ " returning bodies, "s + to_string(stats_.compare_branches) + " compare branches"s;
+	}
+
+	const FuseStatements::Stats& FuseStatements::GetStats() const {
+		return stats_;
+	}
+}
@@ -0,0 +1,616 @@
+#include "image.h"
+
+#include "image_io.h"
+#include "isolate.h"
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace image {
+
+	namespace fs = std::filesystem;
+
+	namespace {
+		constexpr char MAGIC[8] = {'M', 'Y', 'T', 'H', 'I', 'M', 'G', '\0'};
+		constexpr uint32_t VERSION = 1;
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t string_count;
+			uint64_t source_hash;
+			uint64_t strings_size;
+			uint64_t nodes_size;
+		};
+
+		enum class Tag : uint8_t {
+			Compound,
+			NumericConst,
+			StringConst,
+			BoolConst,
+			None,
+			VariableValue,
+			Assignment,
+			FieldAssignment,
+			Print,
+			MethodCall,
+			NewInstance,
+			Stringify,
+			Add,
+			Sub,
+			Mult,
+			Div,
+			Or,
+			And,
+			Not,
+			Comparison,
+			MethodBody,
+			Return,
+			ClassDefinition,
+			IfElse,
+			Spawn,
+		};
+
+		using ComparatorFunction = bool (*)(const runtime::ObjectHolder&, const runtime::ObjectHolder&,
+											runtime::Context&);
+
+		// The comparators the parser creates, in the order of their image codes
+		constexpr ComparatorFunction COMPARATORS[] = {
+			runtime::Equal,
+			runtime::NotEqual,
+			runtime::Less,
+			runtime::Greater,
+			runtime::LessOrEqual,
+			runtime::GreaterOrEqual,
+		};
+
+		bool IsBuiltin(const runtime::Class& cls) {
+			const auto& builtins = isolate::GetBuiltinClasses();
+			auto it = builtins.find(cls.GetName());
+			return it != builtins.end() && it->second.Get() == &cls;
+		}
+
+		class Writer {
+		public:
+			void WriteNode(const runtime::Executable& node) {  // NOLINT
+				if (const auto* p = dynamic_cast<const ast::Compound*>(&node)){
+					WriteTag(Tag::Compound);
+					WriteNodes(p->GetStatements());
+				}else if (const auto* p = dynamic_cast<const ast::VariableValue*>(&node)){
+					WriteTag(Tag::VariableValue);
+					WriteStrings(p->GetDottedIds());
+				}else if (const auto* p = dynamic_cast<const ast::MethodCall*>(&node)){
+					WriteTag(Tag::MethodCall);
+					WriteNode(p->GetObject());
+					WriteString(p->GetMethod());
+					WriteNodes(p->GetArgs());
+				}else if (const auto* p = dynamic_cast<const ast::NumericConst*>(&node)){
+					WriteTag(Tag::NumericConst);
+					WriteSigned(p->GetValue().TryAs<runtime::Number>()->GetValue());
+				}else if (const auto* p = dynamic_cast<const ast::StringConst*>(&node)){
+					WriteTag(Tag::StringConst);
+					WriteString(p->GetValue().TryAs<runtime::String>()->GetValue());
+				}else if (const auto* p = dynamic_cast<const ast::BoolConst*>(&node)){
+					WriteTag(Tag::BoolConst);
+					WriteUnsigned(p->GetValue().TryAs<runtime::Bool>()->GetValue() ? 1 : 0);
+				}else if (dynamic_cast<const ast::None*>(&node) != nullptr){
+					WriteTag(Tag::None);
+				}else if (const auto* p = dynamic_cast<const ast::Assignment*>(&node)){
+					WriteTag(Tag::Assignment);
+					WriteString(p->GetVarName());
+					WriteNode(p->GetValue());
+				}else if (const auto* p = dynamic_cast<const ast::FieldAssignment*>(&node)){
+					WriteTag(Tag::FieldAssignment);
+					WriteStrings(p->GetObject().GetDottedIds());
+					WriteString(p->GetFieldName());
+					WriteNode(p->GetValue());
+				}else if (const auto* p = dynamic_cast<const ast::Print*>(&node)){
+					WriteTag(Tag::Print);
+					WriteNodes(p->GetArgs());
+				}else if (const auto* p = dynamic_cast<const ast::NewInstance*>(&node)){
+					used_classes_.push_back(&p->GetClass());
+					WriteTag(Tag::NewInstance);
+					WriteString(p->GetClass().GetName());
+					WriteNodes(p->GetArgs());
+				}else if (const auto* p = dynamic_cast<const ast::Comparison*>(&node)){
+					WriteTag(Tag::Comparison);
+					WriteUnsigned(GetComparatorCode(p->GetComparator()));
+					WriteNode(p->GetLhs());
+					WriteNode(p->GetRhs());
+				}else if (const auto* p = dynamic_cast<const ast::BinaryOperation*>(&node)){
+					WriteTag(GetBinaryTag(*p));
+					WriteNode(p->GetLhs());
+					WriteNode(p->GetRhs());
+				}else if (const auto* p = dynamic_cast<const ast::Stringify*>(&node)){
+					WriteTag(Tag::Stringify);
+					WriteNode(p->GetArgument());
+				}else if (const auto* p = dynamic_cast<const ast::Not*>(&node)){
+					WriteTag(Tag::Not);
+					WriteNode(p->GetArgument());
+				}else if (const auto* p = dynamic_cast<const ast::IfElse*>(&node)){
+					WriteTag(Tag::IfElse);
+					WriteNode(p->GetCondition());
+					WriteNode(p->GetIfBody());
+					WriteUnsigned(p->GetElseBody() != nullptr ? 1 : 0);
+					if (p->GetElseBody() != nullptr){
+						WriteNode(*p->GetElseBody());
+					}
+				}else if (const auto* p = dynamic_cast<const ast::Return*>(&node)){
+					WriteTag(Tag::Return);
+					WriteNode(p->GetStatement());
+				}else if (const auto* p = dynamic_cast<const ast::MethodBody*>(&node)){
+					WriteTag(Tag::MethodBody);
+					WriteNode(p->GetBody());
+				}else if (const auto* p = dynamic_cast<const LazyMethodBody*>(&node)){
+					// Saved as the method body it parses to
+					WriteNode(p->GetBody());
+				}else if (const auto* p = dynamic_cast<const ast::ClassDefinition*>(&node)){
+					WriteTag(Tag::ClassDefinition);
+					WriteClass(p->GetClass());
+				}else if (const auto* p = dynamic_cast<const isolate::Spawn*>(&node)){
+					WriteTag(Tag::Spawn);
+					WriteNodes(p->GetArgs());
+				}else{
+					throw ImageError("The program contains a statement that cannot be saved"s);
+				}
+			}
+
+			// A compound of class definitions. A class comes after its base class and after the
+			// classes its methods create, as the loader declares them in order
+			void WriteClassDefinitions(const vector<const runtime::Class*>& classes) {
+				vector<string> definitions;
+				unordered_set<const runtime::Class*> visited;
+				for (const runtime::Class* cls : classes){
+					WriteClassDefinition(*cls, visited, definitions);
+				}
+
+				WriteTag(Tag::Compound);
+				WriteUnsigned(definitions.size());
+				for (const auto& definition : definitions){
+					nodes_ += definition;
+				}
+			}
+
+			void Save(uint64_t source_hash, ostream& output) const {
+				string strings;
+				strings_.Write(strings);
+
+				Header header{};
+				memcpy(header.magic, MAGIC, sizeof(MAGIC));
+				header.version = VERSION;
+				header.string_count = static_cast<uint32_t>(strings_.GetCount());
+				header.source_hash = source_hash;
+				header.strings_size = strings.size();
+				header.nodes_size = nodes_.size();
+
+				output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				output.write(strings.data(), static_cast<streamsize>(strings.size()));
+				output.write(nodes_.data(), static_cast<streamsize>(nodes_.size()));
+			}
+
+		private:
+			void WriteClassDefinition(const runtime::Class& cls, unordered_set<const runtime::Class*>& visited,  // NOLINT
+									  vector<string>& definitions) {
+				if (IsBuiltin(cls) || !visited.insert(&cls).second){
+					return;
+				}
+
+				string outer_nodes = std::move(nodes_);
+				vector<const runtime::Class*> outer_used = std::move(used_classes_);
+				nodes_.clear();
+				used_classes_.clear();
+				WriteTag(Tag::ClassDefinition);
+				WriteClass(cls);
+				string definition = std::exchange(nodes_, std::move(outer_nodes));
+				const vector<const runtime::Class*> used = std::exchange(used_classes_, std::move(outer_used));
+
+				if (cls.GetParent() != nullptr){
+					WriteClassDefinition(*cls.GetParent(), visited, definitions);
+				}
+				for (const runtime::Class* dependency : used){
+					WriteClassDefinition(*dependency, visited, definitions);
+				}
+				definitions.push_back(std::move(definition));
+			}
+
+			static uint64_t GetComparatorCode(const ast::Comparison::Comparator& comparator) {
+				if (const auto* function = comparator.target<ComparatorFunction>()){
+					for (size_t i = 0; i < size(COMPARATORS); ++i){
+						if (*function == COMPARATORS[i]){
+							return i;
+						}
+					}
+				}
+				throw ImageError("The program contains a comparison that cannot be saved"s);
+			}
+
+			static Tag GetBinaryTag(const ast::BinaryOperation& node) {
+				if (dynamic_cast<const ast::Add*>(&node) != nullptr){
+					return Tag::Add;
+				}
+				if (dynamic_cast<const ast::Sub*>(&node) != nullptr){
+					return Tag::Sub;
+				}
+				if (dynamic_cast<const ast::Mult*>(&node) != nullptr){
+					return Tag::Mult;
+				}
+				if (dynamic_cast<const ast::Div*>(&node) != nullptr){
+					return Tag::Div;
+				}
+				if (dynamic_cast<const ast::Or*>(&node) != nullptr){
+					return Tag::Or;
+				}
+				if (dynamic_cast<const ast::And*>(&node) != nullptr){
+					return Tag::And;
+				}
+				throw ImageError("The program contains an operation that cannot be saved"s);
+			}
+
+			void WriteTag(Tag tag) {
+				nodes_ += static_cast<char>(tag);
+			}
+
+			void WriteUnsigned(uint64_t value) {
+				AppendUnsigned(nodes_, value);
+			}
+
+			void WriteSigned(int64_t value) {
+				AppendSigned(nodes_, value);
+			}
+
+			void WriteString(const string& str) {
+				WriteUnsigned(strings_.Add(str));
+			}
+
+			void WriteStrings(const vector<string>& strs) {
+				WriteUnsigned(strs.size());
+				for (const auto& str : strs){
+					WriteString(str);
+				}
+			}
+
+			void WriteNodes(const vector<unique_ptr<ast::Statement>>& nodes) {  // NOLINT
+				WriteUnsigned(nodes.size());
+				for (const auto& node : nodes){
+					WriteNode(*node);
+				}
+			}
+
+			void WriteClass(const runtime::Class& cls) {  // NOLINT
+				WriteString(cls.GetName());
+				WriteUnsigned(cls.GetParent() != nullptr ? 1 : 0);
+				if (cls.GetParent() != nullptr){
+					WriteString(cls.GetParent()->GetName());
+				}
+				WriteUnsigned(cls.GetMethods().size());
+				for (const auto& method : cls.GetMethods()){
+					WriteString(method.name);
+					WriteStrings(method.formal_params);
+					WriteNode(*method.body);
+				}
+			}
+
+		private:
+			StringTable strings_;
+			string nodes_;
+			// Classes created by the nodes written so far
+			vector<const runtime::Class*> used_classes_;
+		};
+
+		class Loader {
+		public:
+			Loader(vector<string_view> strings, string_view nodes)
+				: strings_(std::move(strings))
+				, reader_(nodes)
+				, declared_classes_(isolate::GetBuiltinClasses()) {
+			}
+
+			unique_ptr<ast::Statement> LoadProgram() {
+				auto program = ReadNode();
+				if (reader_.GetRemaining() != 0){
+					throw ImageError("The image has data after the program"s);
+				}
+				return program;
+			}
+
+		private:
+			unique_ptr<ast::Statement> ReadNode() {  // NOLINT
+				switch (static_cast<Tag>(reader_.ReadByte())){
+				case Tag::Compound: {
+					auto result = make_unique<ast::Compound>();
+					for (auto& statement : ReadNodes()){
+						result->AddStatement(std::move(statement));
+					}
+					return result;
+				}
+				case Tag::NumericConst:
+					return make_unique<ast::NumericConst>(static_cast<int>(reader_.ReadSigned()));
+				case Tag::StringConst:
+					return make_unique<ast::StringConst>(ReadString());
+				case Tag::BoolConst:
+					return make_unique<ast::BoolConst>(runtime::Bool(reader_.ReadUnsigned() != 0));
+				case Tag::None:
+					return make_unique<ast::None>();
+				case Tag::VariableValue:
+					return make_unique<ast::VariableValue>(ReadStrings());
+				case Tag::Assignment: {
+					string name = ReadString();
+					return make_unique<ast::Assignment>(std::move(name), ReadNode());
+				}
+				case Tag::FieldAssignment: {
+					ast::VariableValue object(ReadStrings());
+					string field = ReadString();
+					return make_unique<ast::FieldAssignment>(std::move(object), std::move(field), ReadNode());
+				}
+				case Tag::Print:
+					return make_unique<ast::Print>(ReadNodes());
+				case Tag::MethodCall: {
+					auto object = ReadNode();
+					string method = ReadString();
+					return make_unique<ast::MethodCall>(std::move(object), std::move(method), ReadNodes());
+				}
+				case Tag::NewInstance: {
+					const runtime::Class& cls = FindClass(ReadString());
+					return make_unique<ast::NewInstance>(cls, ReadNodes());
+				}
+				case Tag::Stringify:
+					return make_unique<ast::Stringify>(ReadNode());
+				case Tag::Add:
+					return ReadBinary<ast::Add>();
+				case Tag::Sub:
+					return ReadBinary<ast::Sub>();
+				case Tag::Mult:
+					return ReadBinary<ast::Mult>();
+				case Tag::Div:
+					return ReadBinary<ast::Div>();
+				case Tag::Or:
+					return ReadBinary<ast::Or>();
+				case Tag::And:
+					return ReadBinary<ast::And>();
+				case Tag::Not:
+					return make_unique<ast::Not>(ReadNode());
+				case Tag::Comparison: {
+					const uint64_t code = reader_.ReadUnsigned();
+					if (code >= size(COMPARATORS)){
+						throw ImageError("The image contains an unknown comparison"s);
+					}
+					auto lhs = ReadNode();
+					return make_unique<ast::Comparison>(COMPARATORS[code], std::move(lhs), ReadNode());
+				}
+				case Tag::MethodBody:
+					return make_unique<ast::MethodBody>(ReadNode());
+				case Tag::Return:
+					return make_unique<ast::Return>(ReadNode());
+				case Tag::ClassDefinition:
+					return make_unique<ast::ClassDefinition>(ReadClass());
+				case Tag::IfElse: {
+					auto condition = ReadNode();
+					auto if_body = ReadNode();
+					unique_ptr<ast::Statement> else_body;
+					if (reader_.ReadUnsigned() != 0){
+						else_body = ReadNode();
+					}
+					return make_unique<ast::IfElse>(std::move(condition), std::move(if_body), std::move(else_body));
+				}
+				case Tag::Spawn:
+					return make_unique<isolate::Spawn>(ReadNodes());
+				}
+				throw ImageError("The image contains an unknown statement"s);
+			}
+
+			template <typename Operation>
+			unique_ptr<ast::Statement> ReadBinary() {  // NOLINT
+				auto lhs = ReadNode();
+				return make_unique<Operation>(std::move(lhs), ReadNode());
+			}
+
+			vector<unique_ptr<ast::Statement>> ReadNodes() {  // NOLINT
+				vector<unique_ptr<ast::Statement>> result(reader_.ReadCount());
+				for (auto& node : result){
+					node = ReadNode();
+				}
+				return result;
+			}
+
+			string ReadString() {
+				const uint64_t index = reader_.ReadUnsigned();
+				if (index >= strings_.size()){
+					throw ImageError("The image refers to an unknown string"s);
+				}
+				return string(strings_[index]);
+			}
+
+			vector<string> ReadStrings() {
+				vector<string> result(reader_.ReadCount());
+				for (auto& str : result){
+					str = ReadString();
+				}
+				return result;
+			}
+
+			const runtime::Class& FindClass(const string& name) const {
+				auto it = declared_classes_.find(name);
+				if (it == declared_classes_.end()){
+					throw ImageError("The image refers to an unknown class "s + name);
+				}
+				return *it->second.TryAs<runtime::Class>();
+			}
+
+			runtime::ObjectHolder ReadClass() {  // NOLINT
+				string name = ReadString();
+				const runtime::Class* parent = nullptr;
+				if (reader_.ReadUnsigned() != 0){
+					parent = &FindClass(ReadString());
+				}
+
+				vector<runtime::Method> methods(reader_.ReadCount());
+				for (auto& method : methods){
+					method.name = ReadString();
+					method.formal_params = ReadStrings();
+					method.body = ReadNode();
+				}
+
+				auto cls = runtime::ObjectHolder::Own(runtime::Class(name, std::move(methods), parent));
+				auto [it, inserted] = declared_classes_.insert({name, cls});
+				if (!inserted){
+					// A class of the program may shadow a builtin one
+					if (!IsBuiltin(*it->second.TryAs<runtime::Class>())){
+						throw ImageError("The image defines class "s + name + " twice"s);
+					}
+					it->second = std::move(cls);
+				}
+				return it->second;
+			}
+
+		private:
+			vector<string_view> strings_;
+			ByteReader reader_;
+			runtime::Closure declared_classes_;
+		};
+
+		string ReadFile(const fs::path& path) {
+			ifstream input(path, ios::binary);
+			if (!input){
+				throw runtime_error("Cannot open script "s + path.string());
+			}
+			return {istreambuf_iterator<char>(input), istreambuf_iterator<char>()};
+		}
+
+		// Writes a temporary file and renames it, so that a reader never sees a partial image
+		void WriteImage(const runtime::Executable& program, uint64_t source_hash, const fs::path& path) {
+			fs::path temporary = path;
+			temporary += ".tmp"s + to_string(getpid());
+			try {
+				ofstream output(temporary, ios::binary | ios::trunc);
+				SaveImage(program, source_hash, output);
+				if (!output.flush()){
+					throw ImageError("Cannot write "s + temporary.string());
+				}
+				output.close();
+				fs::rename(temporary, path);
+			} catch (...) {
+				error_code ignored;
+				fs::remove(temporary, ignored);
+				throw;
+			}
+		}
+	}
+
+	MappedFile::MappedFile(const fs::path& path) {
+		const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0){
+			throw ImageError("Cannot open "s + path.string());
+		}
+		struct stat info{};
+		if (fstat(fd, &info) != 0 || info.st_size == 0){
+			close(fd);
+			throw ImageError("Cannot map "s + path.string());
+		}
+		size_ = static_cast<size_t>(info.st_size);
+		data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data_ == MAP_FAILED){
+			throw ImageError("Cannot map "s + path.string());
+		}
+	}
+
+	MappedFile::~MappedFile() {
+		munmap(data_, size_);
+	}
+
+	string_view MappedFile::GetData() const {
+		return {static_cast<const char*>(data_), size_};
+	}
+
+	uint64_t HashSource(string_view source) {
+		uint64_t hash = 14695981039346656037ULL;
+		for (const char c : source){
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	void SaveImage(const runtime::Executable& program, uint64_t source_hash, ostream& output) {
+		Writer writer;
+		writer.WriteNode(program);
+		writer.Save(source_hash, output);
+	}
+
+	void SaveClasses(const vector<const runtime::Class*>& classes, uint64_t source_hash, ostream& output) {
+		Writer writer;
+		writer.WriteClassDefinitions(classes);
+		writer.Save(source_hash, output);
+	}
+
+	unique_ptr<runtime::Executable> LoadImage(string_view image, uint64_t source_hash) {
+		Header header{};
+		if (image.size() < sizeof(header)){
+			throw ImageError("The image is truncated"s);
+		}
+		memcpy(&header, image.data(), sizeof(header));
+		if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION){
+			throw ImageError("Not an image of this version"s);
+		}
+		if (header.source_hash != source_hash){
+			return nullptr;
+		}
+
+		ByteReader reader(image.substr(sizeof(header)));
+		ByteReader strings_reader(reader.ReadBytes(header.strings_size));
+		const string_view nodes = reader.ReadBytes(header.nodes_size);
+
+		return Loader(StringTable::Read(strings_reader, header.string_count), nodes).LoadProgram();
+	}
+
+	fs::path GetImagePath(const fs::path& script) {
+		fs::path result = script;
+		result += ".myc"sv;
+		return result;
+	}
+
+	unique_ptr<runtime::Executable> LoadProgram(const fs::path& script, bool* from_image) {
+		const string source = ReadFile(script);
+		const uint64_t source_hash = HashSource(source);
+		const fs::path image_path = GetImagePath(script);
+
+		if (from_image != nullptr){
+			*from_image = false;
+		}
+		try {
+			const MappedFile image(image_path);
+			if (auto program = LoadImage(image.GetData(), source_hash)){
+				if (from_image != nullptr){
+					*from_image = true;
+				}
+				return program;
+			}
+		} catch (const ImageError&) {
+			// A missing or damaged image is replaced like an outdated one
+		}
+
+		istringstream input(source);
+		parse::Lexer lexer(input);
+		auto program = ParseProgram(lexer);
+		try {
+			WriteImage(*program, source_hash, image_path);
+		} catch (const exception&) {
+			// The program is still usable, only the next start will be slower
+		}
+		return program;
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary images of parsed programs. An image holds the statement tree, the classes with
+// their methods and the constants of a program, together with a hash of its source:
+//
+//   header | string table | nodes
+//
+// Every string of the program is stored once in the string table and nodes refer to it
+// by index. Nodes are written in pre-order as a tag followed by their operands, integers
+// are LEB128 varints. An image is only valid for the build of the interpreter that wrote it
+namespace image {
+
+	struct ImageError : std::runtime_error {
+		using std::runtime_error::runtime_error;
+	};
+
+	// 64-bit FNV-1a
+	uint64_t HashSource(std::string_view source);
+
+	// Throws ImageError when the program contains a statement that has no image form
+	void SaveImage(const runtime::Executable& program, uint64_t source_hash, std::ostream& output);
+
+	// Writes a program that only defines the given classes, together with their base classes
+	// and the classes their methods create. Builtin classes are left out
+	void SaveClasses(const std::vector<const runtime::Class*>& classes, uint64_t source_hash,
+					 std::ostream& output);
+
+	// Returns nullptr when the image was made from another source. Throws ImageError when the
+	// image is damaged or comes from another version. Classes not defined by the program are
+	// looked up among the builtin ones
+	std::unique_ptr<runtime::Executable> LoadImage(std::string_view image, uint64_t source_hash);
+
+	// The image of a script is kept next to it, in "<script>.myc"
+	std::filesystem::path GetImagePath(const std::filesystem::path& script);
+
+	// Maps the image of the script into memory and loads it when it matches the script.
+	// Otherwise parses the script and replaces the image; a failure to write it is ignored
+	std::unique_ptr<runtime::Executable> LoadProgram(const std::filesystem::path& script,
+													 bool* from_image = nullptr);
+}
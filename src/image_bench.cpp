@@ -0,0 +1,76 @@
+#include "bench_runner_p.h"
+#include "image.h"
+#include "lexer.h"
+#include "parse.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace image {
+
+namespace {
+
+string MakeLargeScript(int class_count) {
+    string script;
+    for (int i = 0; i < class_count; ++i) {
+        const string name = "Account"s + to_string(i);
+        script += "class "s + name + ":\n"s
+                  "  def __init__(owner, balance):\n"s
+                  "    self.owner = owner\n"s
+                  "    self.balance = balance\n"s
+                  "  def deposit(amount):\n"s
+                  "    if amount > 0 and amount < 1000000:\n"s
+                  "      self.balance = self.balance + amount\n"s
+                  "    else:\n"s
+                  "      print \"rejected\", amount\n"s
+                  "    return self.balance\n"s
+                  "  def __str__():\n"s
+                  "    return self.owner + \": \" + str(self.balance)\n\n"s;
+        script += "a"s + to_string(i) + " = "s + name + "(\"owner "s + to_string(i) + "\", "s
+                  + to_string(i) + ")\n"s;
+    }
+    return script;
+}
+
+// Startup of a large script: lexing and parsing against mapping and loading its image
+void BenchmarkStartup() {
+    constexpr int RUNS = 20;
+
+    const auto script = filesystem::temp_directory_path() / "mython_image_bench.my"s;
+    const string source = MakeLargeScript(2000);
+    ofstream(script) << source;
+    filesystem::remove(GetImagePath(script));
+
+    const double parse_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < RUNS; ++i) {
+            istringstream input(source);
+            parse::Lexer lexer(input);
+            auto program = ParseProgram(lexer);
+        }
+    });
+
+    bool from_image = false;
+    LoadProgram(script, &from_image);
+    const double load_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < RUNS; ++i) {
+            auto program = LoadProgram(script, &from_image);
+        }
+    });
+
+    cerr << "  "sv << source.size() / 1024 << " KiB source, "sv << filesystem::file_size(GetImagePath(script)) / 1024
+         << " KiB image: parse "sv << parse_seconds / RUNS * 1000 << " ms, image load "sv
+         << load_seconds / RUNS * 1000 << " ms"sv << (from_image ? ""sv : " (image not used)"sv) << endl;
+
+    filesystem::remove(GetImagePath(script));
+    filesystem::remove(script);
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, image::BenchmarkStartup);
+}
+
+}  // namespace image
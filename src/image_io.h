@@ -0,0 +1,134 @@
+#pragma once
+
+#include "image.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Encoding shared by program images and heap snapshots: integers are LEB128 varints,
+// signed ones zigzag-encoded first, strings are kept in a table and referred to by index
+namespace image {
+
+	inline void AppendUnsigned(std::string& out, uint64_t value) {
+		while (value >= 0x80){
+			out += static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		out += static_cast<char>(value);
+	}
+
+	inline void AppendSigned(std::string& out, int64_t value) {
+		// Zigzag, so that small negative numbers stay short
+		AppendUnsigned(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+	}
+
+	// Bounds-checked reads, a damaged input throws ImageError
+	class ByteReader {
+	public:
+		explicit ByteReader(std::string_view data)
+			: data_(data) {
+		}
+
+		[[nodiscard]] size_t GetRemaining() const {
+			return data_.size() - position_;
+		}
+
+		std::string_view ReadBytes(size_t size) {
+			if (size > GetRemaining()){
+				throw ImageError("The image is truncated");
+			}
+			const std::string_view result = data_.substr(position_, size);
+			position_ += size;
+			return result;
+		}
+
+		uint8_t ReadByte() {
+			return static_cast<uint8_t>(ReadBytes(1).front());
+		}
+
+		uint64_t ReadUnsigned() {
+			uint64_t result = 0;
+			for (int shift = 0; shift < 64; shift += 7){
+				const uint8_t byte = ReadByte();
+				result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0){
+					return result;
+				}
+			}
+			throw ImageError("The image contains a malformed number");
+		}
+
+		int64_t ReadSigned() {
+			const uint64_t value = ReadUnsigned();
+			return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+		}
+
+		// A count of elements that take at least a byte each
+		size_t ReadCount() {
+			const uint64_t count = ReadUnsigned();
+			if (count > GetRemaining()){
+				throw ImageError("The image contains a malformed count");
+			}
+			return static_cast<size_t>(count);
+		}
+
+	private:
+		std::string_view data_;
+		size_t position_ = 0;
+	};
+
+	// Read-only private mapping of a whole file, throws ImageError when it cannot be mapped
+	class MappedFile {
+	public:
+		explicit MappedFile(const std::filesystem::path& path);
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+
+		[[nodiscard]] std::string_view GetData() const;
+
+	private:
+		void* data_ = nullptr;
+		size_t size_ = 0;
+	};
+
+	class StringTable {
+	public:
+		uint64_t Add(const std::string& str) {
+			auto [it, inserted] = indices_.emplace(str, strings_.size());
+			if (inserted){
+				strings_.push_back(&it->first);
+			}
+			return it->second;
+		}
+
+		[[nodiscard]] size_t GetCount() const {
+			return strings_.size();
+		}
+
+		// Every string as its length followed by its bytes, in the order of the indices
+		void Write(std::string& out) const {
+			for (const std::string* str : strings_){
+				AppendUnsigned(out, str->size());
+				out += *str;
+			}
+		}
+
+		// The strings point into the data
+		static std::vector<std::string_view> Read(ByteReader& reader, size_t count) {
+			std::vector<std::string_view> result(count);
+			for (auto& str : result){
+				str = reader.ReadBytes(reader.ReadUnsigned());
+			}
+			return result;
+		}
+
+	private:
+		std::unordered_map<std::string, uint64_t> indices_;
+		// Points into indices_
+		std::vector<const std::string*> strings_;
+	};
+}
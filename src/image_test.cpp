@@ -0,0 +1,197 @@
+#include "image.h"
+#include "lexer.h"
+#include "parse.h"
+#include "test_runner_p.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace image {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const string PROGRAM = R"--(
+class Shape:
+  def __init__(name):
+    self.name = name
+
+  def area():
+    return 0
+
+  def __str__():
+    return self.name + "(" + str(self.area()) + ")"
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.name = "rect"
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+class Worker:
+  def run(channel, n):
+    channel.send(n * n)
+
+r = Rect(3, -4)
+s = Shape("dot")
+print r, s, r.area() / 2 - 1
+print 1 == 1, 1 != 1, 1 < 2, 1 > 2, 1 <= 1, 1 >= 2
+print not True, True and False, False or True, None
+if r.area() < 0:
+  print "negative"
+else:
+  print "positive"
+if s.area() == 0:
+  r.w = 10
+print r.area()
+c = Channel(1)
+h = spawn(Worker(), c, 7)
+print c.recv()
+h.join()
+)--"s;
+
+unique_ptr<runtime::Executable> Parse(const string& source) {
+    istringstream input(source);
+    parse::Lexer lexer(input);
+    return ParseProgram(lexer);
+}
+
+string Run(const runtime::Executable& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program.Execute(closure, context);
+    return context.output.str();
+}
+
+string Save(const string& source) {
+    ostringstream image;
+    SaveImage(*Parse(source), HashSource(source), image);
+    return image.str();
+}
+
+void TestRoundTrip() {
+    const string image = Save(PROGRAM);
+    auto loaded = LoadImage(image, HashSource(PROGRAM));
+    ASSERT(loaded != nullptr);
+
+    const string expected = Run(*Parse(PROGRAM));
+    ASSERT_EQUAL(expected, "rect(-12) dot(0) -7\nTrue False True False True False\n"
+                           "False False True None\nnegative\n-40\n49\n"s);
+    ASSERT_EQUAL(Run(*loaded), expected);
+
+    // The loaded program saves to the same image
+    ostringstream again;
+    SaveImage(*loaded, HashSource(PROGRAM), again);
+    ASSERT_EQUAL(again.str(), image);
+
+    // So does a program whose method bodies haven't been parsed yet
+    istringstream input(PROGRAM);
+    parse::Lexer lexer(input);
+    ostringstream lazy;
+    SaveImage(*ParseProgram(lexer, ParseOptions{.lazy_methods = true}), HashSource(PROGRAM), lazy);
+    ASSERT_EQUAL(lazy.str(), image);
+}
+
+void TestProgramClassShadowsBuiltin() {
+    const string source = "class Channel:\n  def __str__():\n    return 'mine'\n\nprint Channel()\n"s;
+    auto loaded = LoadImage(Save(source), HashSource(source));
+    ASSERT(loaded != nullptr);
+    ASSERT_EQUAL(Run(*loaded), "mine\n"s);
+}
+
+void TestStringsAreStoredOnce() {
+    string source;
+    for (int i = 0; i < 100; ++i) {
+        source += "some_long_variable_name = some_long_variable_name + 1\n"s;
+    }
+    const string image = Save("some_long_variable_name = 0\n"s + source);
+    ASSERT(image.size() < source.size() / 4);
+    ASSERT_EQUAL(image.find("some_long_variable_name"s), image.rfind("some_long_variable_name"s));
+}
+
+void TestImageOfAnotherSource() {
+    const string image = Save(PROGRAM);
+    ASSERT(LoadImage(image, HashSource(PROGRAM + "\n"s)) == nullptr);
+}
+
+void TestDamagedImage() {
+    const string image = Save(PROGRAM);
+    const uint64_t hash = HashSource(PROGRAM);
+    for (size_t size = 0; size < image.size(); ++size) {
+        ASSERT_THROWS(LoadImage(string_view(image).substr(0, size), hash), ImageError);
+    }
+
+    string wrong_version = image;
+    wrong_version[8] ^= 1;
+    ASSERT_THROWS(LoadImage(wrong_version, hash), ImageError);
+
+    // A damaged image either still loads or is rejected, it is never read out of bounds
+    for (size_t i = 40; i < image.size(); ++i) {
+        string damaged = image;
+        damaged[i] = static_cast<char>(damaged[i] ^ 0x5A);
+        try {
+            LoadImage(damaged, hash);
+        } catch (const ImageError&) {
+        }
+    }
+}
+
+void TestUnsupportedStatement() {
+    struct Custom : runtime::Executable {
+        runtime::ObjectHolder Execute(runtime::Closure&, runtime::Context&) const override {
+            return {};
+        }
+    };
+    ostringstream image;
+    ASSERT_THROWS(SaveImage(Custom{}, 0, image), ImageError);
+}
+
+void TestLoadProgramKeepsImageUpToDate() {
+    const fs::path dir = fs::temp_directory_path() / "mython_image_test"s;
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const fs::path script = dir / "program.my"s;
+
+    ofstream(script) << PROGRAM;
+    bool from_image = true;
+    const string expected = Run(*LoadProgram(script, &from_image));
+    ASSERT(!from_image);
+    ASSERT(fs::exists(GetImagePath(script)));
+    ASSERT_EQUAL(Run(*LoadProgram(script, &from_image)), expected);
+    ASSERT(from_image);
+
+    ofstream(script) << "print 'changed'\n"s;
+    ASSERT_EQUAL(Run(*LoadProgram(script, &from_image)), "changed\n"s);
+    ASSERT(!from_image);
+    ASSERT_EQUAL(Run(*LoadProgram(script, &from_image)), "changed\n"s);
+    ASSERT(from_image);
+
+    // A damaged image is regenerated
+    ofstream(GetImagePath(script), ios::trunc) << "garbage"s;
+    ASSERT_EQUAL(Run(*LoadProgram(script, &from_image)), "changed\n"s);
+    ASSERT(!from_image);
+    LoadProgram(script, &from_image);
+    ASSERT(from_image);
+
+    fs::remove_all(dir);
+}
+
+}  // namespace
+
+void RunImageTests(TestRunner& tr) {
+    RUN_TEST(tr, image::TestRoundTrip);
+    RUN_TEST(tr, image::TestProgramClassShadowsBuiltin);
+    RUN_TEST(tr, image::TestStringsAreStoredOnce);
+    RUN_TEST(tr, image::TestImageOfAnotherSource);
+    RUN_TEST(tr, image::TestDamagedImage);
+    RUN_TEST(tr, image::TestUnsupportedStatement);
+    RUN_TEST(tr, image::TestLoadProgramKeepsImageUpToDate);
+}
+
+}  // namespace image
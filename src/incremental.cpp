@@ -0,0 +1,222 @@
+#include "incremental.h"
+
+#include "char_class.h"
+#include "parallel_lexer.h"
+#include "parse.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace incremental {
+
+	namespace {
+		// Enough for a few statements; the window doubles until the segments resynchronize
+		constexpr size_t FIRST_SPLIT_WINDOW = 4096;
+		// "else" and the character after it
+		constexpr size_t ELSE_SIZE = 5;
+	}
+
+	Document::Document(string source) {
+		segments_.push_back(Lex(0, 0));
+		Parse(0, 1);
+		Edit(0, 0, source);
+	}
+
+	Document::EditStats Document::Edit(size_t offset, size_t length, string_view text) {
+		if (offset > source_.size() || length > source_.size() - offset){
+			throw out_of_range("edit out of the source"s);
+		}
+
+		// The segment the edit starts in
+		auto it = upper_bound(segments_.begin(), segments_.end(), offset, [](size_t position, const Segment& segment){
+			return position < segment.begin;
+		});
+		size_t first = static_cast<size_t>(it - segments_.begin()) - 1;
+
+		const size_t old_end = offset + length;
+		const auto delta = static_cast<ptrdiff_t>(text.size()) - static_cast<ptrdiff_t>(length);
+		source_.replace(offset, length, text);
+
+		// The text before the segment is the same, so it still starts a segment unless its
+		// first characters changed into something that continues the previous one
+		const size_t begin = segments_[first].begin;
+		if (first > 0 && offset < begin + ELSE_SIZE
+			&& (begin == source_.size() || !parse::chars::IsIdentifierStart(source_[begin]) || StartsElse(begin))){
+			--first;
+		}
+
+		// A segment that started after the edit starts where it used to, shifted by delta,
+		// when the lexer state there is the same as before: the segments from there on are kept
+		size_t kept = first + 1;
+		const auto resync = [&](size_t start){
+			while (kept < segments_.size()
+				   && (segments_[kept].begin < old_end || segments_[kept].begin + delta < start)){
+				++kept;
+			}
+			return kept < segments_.size() && segments_[kept].begin + delta == start;
+		};
+		vector<size_t> starts = Split(segments_[first].begin, offset + text.size(), resync);
+		if (starts.back() == source_.size()){
+			kept = segments_.size();
+		}
+
+		EditStats stats;
+		vector<Segment> lexed;
+		for (size_t i = 0; i + 1 < starts.size();){
+			size_t next = i + 1;
+			Segment segment = Lex(starts[i], starts[next]);
+			++stats.lexed_segments;
+			while (!segment.closes_blocks && starts[next] < source_.size()){
+				if (next + 1 == starts.size()){
+					// The kept segment after this one depends on it now
+					++kept;
+					starts.push_back(kept < segments_.size() ? segments_[kept].begin + delta : source_.size());
+				}
+				++next;
+				segment = Lex(starts[i], starts[next]);
+				++stats.lexed_segments;
+			}
+			lexed.push_back(std::move(segment));
+			i = next;
+		}
+
+		bool changes_classes = false;
+		for (size_t i = first; i < kept; ++i){
+			changes_classes = changes_classes || segments_[i].declares_classes;
+		}
+		for (const Segment& segment : lexed){
+			changes_classes = changes_classes || segment.declares_classes;
+		}
+
+		const size_t lexed_count = lexed.size();
+		segments_.erase(segments_.begin() + static_cast<ptrdiff_t>(first),
+						segments_.begin() + static_cast<ptrdiff_t>(kept));
+		segments_.insert(segments_.begin() + static_cast<ptrdiff_t>(first), make_move_iterator(lexed.begin()),
+						 make_move_iterator(lexed.end()));
+		for (size_t i = first + lexed_count; i < segments_.size(); ++i){
+			segments_[i].begin += delta;
+		}
+
+		stats.parsed_segments = Parse(first, changes_classes ? segments_.size() : first + lexed_count);
+		return stats;
+	}
+
+	const string& Document::GetSource() const {
+		return source_;
+	}
+
+	size_t Document::GetSegmentCount() const {
+		return segments_.size();
+	}
+
+	vector<parse::Token> Document::GetTokens() const {
+		vector<parse::Token> result;
+		for (const Segment& segment : segments_){
+			if (segment.lex_error){
+				rethrow_exception(segment.lex_error);
+			}
+			result.insert(result.end(), segment.tokens.begin(), segment.tokens.end());
+		}
+		result.emplace_back(parse::token_type::Eof{});
+		return result;
+	}
+
+	void Document::CheckErrors() const {
+		for (const Segment& segment : segments_){
+			if (segment.lex_error){
+				rethrow_exception(segment.lex_error);
+			}
+			if (segment.parse_error){
+				rethrow_exception(segment.parse_error);
+			}
+		}
+	}
+
+	runtime::ObjectHolder Document::Execute(runtime::Closure& closure, runtime::Context& context) const {
+		CheckErrors();
+		for (const Segment& segment : segments_){
+			segment.program->Execute(closure, context);
+		}
+		return runtime::ObjectHolder::None();
+	}
+
+	Document::Segment Document::Lex(size_t begin, size_t end) const {
+		Segment result;
+		result.begin = begin;
+		try {
+			istringstream input(source_.substr(begin, end - begin));
+			parse::Lexer lexer(input);
+			for (parse::Token token = lexer.CurrentToken(); !token.Is<parse::token_type::Eof>(); token = lexer.NextToken()){
+				result.declares_classes = result.declares_classes || token.Is<parse::token_type::Class>();
+				result.tokens.push_back(std::move(token));
+			}
+			result.closes_blocks = lexer.GetIndentation() == 0;
+		} catch (...) {
+			result.lex_error = current_exception();
+		}
+		return result;
+	}
+
+	size_t Document::Parse(size_t first, size_t last) {
+		runtime::Closure classes;
+		for (size_t i = 0; i < first; ++i){
+			classes.insert(segments_[i].classes.begin(), segments_[i].classes.end());
+		}
+		for (size_t i = first; i < last; ++i){
+			Segment& segment = segments_[i];
+			segment.program.reset();
+			segment.classes.clear();
+			segment.parse_error = nullptr;
+			if (segment.lex_error){
+				continue;
+			}
+
+			vector<parse::Token> tokens = segment.tokens;
+			tokens.emplace_back(parse::token_type::Eof{});
+			parse::TokenArray stream(std::move(tokens));
+			try {
+				segment.program = ParseProgram(stream, classes, segment.classes);
+			} catch (...) {
+				segment.parse_error = current_exception();
+				segment.classes.clear();
+			}
+			classes.insert(segment.classes.begin(), segment.classes.end());
+		}
+		return last - first;
+	}
+
+	template <typename Resync>
+	vector<size_t> Document::Split(size_t begin, size_t stop_after, Resync resync) const {
+		vector<size_t> result;
+		for (size_t window = FIRST_SPLIT_WINDOW;; window *= 2){
+			const size_t end = begin + min(window, source_.size() - begin);
+			// A start only depends on the text before it and its first character, so the
+			// starts in a window are those of the whole source
+			const vector<size_t> starts = parse::SplitSource(string_view(source_).substr(begin, end - begin), 1);
+			result.clear();
+			for (const size_t start : starts){
+				const size_t position = begin + start;
+				// An else continues the if before it
+				if (position != begin && StartsElse(position)){
+					continue;
+				}
+				result.push_back(position);
+				if (position != begin && position >= stop_after && resync(position)){
+					return result;
+				}
+			}
+			if (end == source_.size()){
+				result.push_back(end);
+				return result;
+			}
+		}
+	}
+
+	bool Document::StartsElse(size_t position) const {
+		return source_.compare(position, 4, "else"sv) == 0
+			   && (position + 4 == source_.size() || !parse::chars::IsIdentifier(source_[position + 4]));
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "lexer.h"
+#include "runtime.h"
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Front end for a source that is edited while it is open, e.g. in an editor. The source is
+// kept in segments that start at top-level statements, where the lexer has no state, as
+// parse::SplitSource finds them. Every segment keeps its tokens and its parsed statements,
+// so an edit lexes and parses again only the segments it touches
+namespace incremental {
+
+	class Document {
+	public:
+		struct EditStats {
+			size_t lexed_segments = 0;
+			size_t parsed_segments = 0;
+		};
+
+		explicit Document(std::string source);
+
+		// Replaces length characters at offset with text. Lexes the segments from the one
+		// the edit starts in up to the first segment start after the edit that is still a
+		// segment start. Parses the segments lexed again, and every segment after them when
+		// the edit adds or removes a class declaration, since later statements refer to it.
+		// Errors are kept, to be reported by GetTokens and Execute
+		EditStats Edit(size_t offset, size_t length, std::string_view text);
+
+		[[nodiscard]] const std::string& GetSource() const;
+
+		[[nodiscard]] size_t GetSegmentCount() const;
+
+		// The tokens the Lexer returns for the source, ending with Eof. Throws the lexer
+		// error of the first segment that has one
+		[[nodiscard]] std::vector<parse::Token> GetTokens() const;
+
+		// Throws the first lexer or parse error of the source, as parsing it all at once would
+		void CheckErrors() const;
+
+		// Runs nothing when CheckErrors throws
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const;
+
+	private:
+		struct Segment {
+			size_t begin = 0;
+			// Without the Eof
+			std::vector<parse::Token> tokens;
+			// Otherwise the segment after it can't be lexed on its own
+			bool closes_blocks = true;
+			bool declares_classes = false;
+			std::exception_ptr lex_error;
+
+			std::unique_ptr<runtime::Executable> program;
+			// Declared by the program
+			runtime::Closure classes;
+			std::exception_ptr parse_error;
+		};
+
+		[[nodiscard]] Segment Lex(size_t begin, size_t end) const;
+		// Parses the segments in [first, last)
+		size_t Parse(size_t first, size_t last);
+		// Starts of the segments of the source from begin on, the first one is begin. The last
+		// one is where they end: the first start at or after stop_after for which resync
+		// returns true, or the size of the source
+		template <typename Resync>
+		[[nodiscard]] std::vector<size_t> Split(size_t begin, size_t stop_after, Resync resync) const;
+		[[nodiscard]] bool StartsElse(size_t position) const;
+
+	private:
+		std::string source_;
+		std::vector<Segment> segments_;
+	};
+}
@@ -0,0 +1,255 @@
+#include "incremental.h"
+#include "parse.h"
+#include "test_runner_p.h"
+
+#include <functional>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace incremental {
+
+namespace {
+
+// Strings and comments spanning the starts of lines, an if with an else, classes used by
+// the statements after them and a block that ends with a comment
+const string PROGRAM = R"--(
+class Shape:
+  def area():
+    return 0
+
+  def name():
+    return "shape
+class Fake:
+"
+
+class Square(Shape):
+  def area():
+    return self.side * self.side
+# a comment at the first column, with 'quotes
+s = Square()
+s.side = 3 # a comment after code
+print s.area(), s.name()
+if s.side > 2:
+  print 'big'
+else:
+  print "small"
+x = 'line
+x = 2
+'
+print x
+class Circle(Shape):
+  def area():
+    return 3 * self.r * self.r
+c = Circle()
+c.r = 2
+print c.area()
+# the end
+print "done"
+)--"s;
+
+// What parsing and running the source at once produces
+struct Outcome {
+    bool lexes = false;
+    vector<parse::Token> tokens;
+    bool parses = false;
+    bool runs = false;
+    string output;
+};
+
+// Addresses of instances without __str__ differ between runs
+string WithoutAddresses(const string& output) {
+    static const regex address("0x[0-9a-f]+"s);
+    return regex_replace(output, address, "0x"s);
+}
+
+void Run(const function<void(runtime::Closure&, runtime::Context&)>& program, Outcome& outcome) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    try {
+        program(closure, context);
+        outcome.runs = true;
+    } catch (const exception&) {
+    }
+    outcome.output = WithoutAddresses(context.output.str());
+}
+
+Outcome RunAtOnce(const string& source) {
+    Outcome result;
+    try {
+        istringstream input(source);
+        parse::Lexer lexer(input);
+        result.tokens.push_back(lexer.CurrentToken());
+        while (!result.tokens.back().Is<parse::token_type::Eof>()) {
+            result.tokens.push_back(lexer.NextToken());
+        }
+        result.lexes = true;
+    } catch (const exception&) {
+        result.tokens.clear();
+    }
+
+    unique_ptr<runtime::Executable> program;
+    try {
+        istringstream input(source);
+        parse::Lexer lexer(input);
+        program = ParseProgram(lexer);
+        result.parses = true;
+    } catch (const exception&) {
+        return result;
+    }
+    Run([&program](runtime::Closure& closure, runtime::Context& context) { program->Execute(closure, context); },
+        result);
+    return result;
+}
+
+Outcome RunDocument(const Document& document) {
+    Outcome result;
+    try {
+        result.tokens = document.GetTokens();
+        result.lexes = true;
+    } catch (const exception&) {
+    }
+
+    try {
+        document.CheckErrors();
+        result.parses = true;
+    } catch (const exception&) {
+        return result;
+    }
+    Run([&document](runtime::Closure& closure, runtime::Context& context) { document.Execute(closure, context); },
+        result);
+    return result;
+}
+
+// Returns whether the source parses
+bool AssertSameAsAtOnce(const Document& document, const string& hint) {
+    const Outcome expected = RunAtOnce(document.GetSource());
+    const Outcome actual = RunDocument(document);
+    AssertEqual(actual.lexes, expected.lexes, hint);
+    AssertEqual(actual.tokens, expected.tokens, hint);
+    AssertEqual(actual.parses, expected.parses, hint);
+    AssertEqual(actual.runs, expected.runs, hint);
+    AssertEqual(actual.output, expected.output, hint);
+    return expected.parses;
+}
+
+void TestSameAsAtOnce() {
+    const Document document(PROGRAM);
+    ASSERT(AssertSameAsAtOnce(document, "unedited"s));
+    ASSERT(document.GetSegmentCount() > 8U);
+}
+
+void TestRandomEdits() {
+    // Methods never call methods and no class has __init__, so no edit makes a program
+    // that recurses without end
+    const vector<string> snippets = {
+        "\n"s, " "s, "  "s, "'"s, "\""s, "\\"s, "#"s, "x"s, ":"s, "1"s, "else:\n"s, "else:\n  print 4\n"s,
+        "print x\n"s, "if x:\n"s, "if x:\n  x = 5\n"s, "class Shape:\n  def f():\n    return 1\n"s,
+        "class T(Shape):\n  def area():\n    return 7\nprint T().area()\n"s, "c = Circle()\n"s,
+        "s.side = 9\n"s, "# comment\n"s, "'a\nb'"s, "\"s\n#\"\n"s,
+    };
+
+    mt19937 random(20261018);
+    size_t parsed = 0;
+    size_t edits = 0;
+    for (int round = 0; round < 500; ++round) {
+        Document document(PROGRAM);
+        const int edit_count = uniform_int_distribution(1, 4)(random);
+        for (int i = 0; i < edit_count; ++i) {
+            const string& source = document.GetSource();
+            size_t offset = uniform_int_distribution<size_t>(0, source.size())(random);
+            string hint = "round "s + to_string(round) + ", edit "s + to_string(i);
+            switch (uniform_int_distribution(0, 3)(random)) {
+                case 0: {
+                    const size_t length = min(uniform_int_distribution<size_t>(1, 8)(random), source.size() - offset);
+                    document.Edit(offset, length, ""sv);
+                    break;
+                }
+                case 1:
+                    document.Edit(offset, 0, snippets[random() % snippets.size()]);
+                    break;
+                case 2: {
+                    // At the start of a line
+                    offset = source.rfind('\n', offset == 0 ? 0 : offset - 1);
+                    offset = offset == string::npos ? 0 : offset + 1;
+                    document.Edit(offset, 0, snippets[random() % snippets.size()]);
+                    break;
+                }
+                default: {
+                    // A whole line
+                    const size_t begin = source.rfind('\n', offset == 0 ? 0 : offset - 1);
+                    const size_t line = begin == string::npos ? 0 : begin + 1;
+                    const size_t end = source.find('\n', line);
+                    document.Edit(line, (end == string::npos ? source.size() : end + 1) - line, ""sv);
+                }
+            }
+            parsed += AssertSameAsAtOnce(document, hint + ": "s + document.GetSource());
+            ++edits;
+        }
+    }
+    // Enough of the edited programs still parse to compare their output
+    ASSERT(parsed * 10 > edits);
+}
+
+void TestEditsStayLocal() {
+    string source = "class A:\n  def f():\n    return 1\na = A()\n"s;
+    for (int i = 0; i < 1000; ++i) {
+        source += "x"s + to_string(i) + " = a.f() + "s + to_string(i) + "\n"s;
+    }
+    Document document(source);
+    ASSERT_EQUAL(document.GetSegmentCount(), 1002U);
+
+    const size_t middle = document.GetSource().find("x500 = "s);
+    Document::EditStats stats = document.Edit(middle + 1, 3, "_renamed"sv);
+    ASSERT_EQUAL(stats.lexed_segments, 1U);
+    ASSERT_EQUAL(stats.parsed_segments, 1U);
+    ASSERT(AssertSameAsAtOnce(document, "renamed"s));
+
+    // The statement becomes part of the one before it
+    stats = document.Edit(middle, 0, "  "sv);
+    ASSERT_EQUAL(stats.lexed_segments, 1U);
+    ASSERT(!AssertSameAsAtOnce(document, "indented"s));
+    stats = document.Edit(middle, 2, ""sv);
+    ASSERT(AssertSameAsAtOnce(document, "unindented"s));
+    ASSERT_EQUAL(document.GetSegmentCount(), 1002U);
+
+    // An open string reaches the end of the source, which becomes one segment
+    document.Edit(middle, 0, "'"sv);
+    ASSERT(document.GetSegmentCount() < 600U);
+    ASSERT(!AssertSameAsAtOnce(document, "open string"s));
+    stats = document.Edit(middle, 1, ""sv);
+    ASSERT(stats.lexed_segments > 400U);
+    ASSERT(AssertSameAsAtOnce(document, "closed string"s));
+    ASSERT_EQUAL(document.GetSegmentCount(), 1002U);
+
+    // The statements after a class declaration may refer to it
+    stats = document.Edit(document.GetSource().find("return 1"s), 8, "return 2"sv);
+    ASSERT_EQUAL(stats.lexed_segments, 1U);
+    ASSERT_EQUAL(stats.parsed_segments, 1002U);
+    ASSERT(AssertSameAsAtOnce(document, "class changed"s));
+}
+
+void TestEditOutOfSource() {
+    Document document("x = 1\n"s);
+    ASSERT_THROWS(document.Edit(7, 0, "y"sv), std::out_of_range);
+    ASSERT_THROWS(document.Edit(3, 4, ""sv), std::out_of_range);
+    document.Edit(6, 0, "y = 2\n"sv);
+    document.Edit(0, 12, ""sv);
+    ASSERT_EQUAL(document.GetSource(), ""s);
+    AssertSameAsAtOnce(document, "empty"s);
+}
+
+}  // namespace
+
+void RunIncrementalTests(TestRunner& tr) {
+    RUN_TEST(tr, incremental::TestSameAsAtOnce);
+    RUN_TEST(tr, incremental::TestRandomEdits);
+    RUN_TEST(tr, incremental::TestEditsStayLocal);
+    RUN_TEST(tr, incremental::TestEditOutOfSource);
+}
+
+}  // namespace incremental
@@ -0,0 +1,446 @@
+#include "pass.h"
+
+#include "isolate.h"
+#include "statement.h"
+#include "visitor.h"
+
+#include <map>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+using namespace std;
+
+namespace passes {
+
+	namespace {
+		using ast::Children;
+		using ast::Statement;
+		using Slot = Children::Slot;
+
+		const string INIT_METHOD = "__init__"s;
+		const string RUN_METHOD = "run"s;
+
+		// BOTTOM is the type of no value at all, ANY of values of several or unknown types
+		enum class Type {
+			BOTTOM,
+			NUMBER,
+			STRING,
+			BOOL,
+			ANY,
+		};
+
+		Type Join(Type lhs, Type rhs) {
+			if (lhs == Type::BOTTOM){
+				return rhs;
+			}
+			if (rhs == Type::BOTTOM){
+				return lhs;
+			}
+			return lhs == rhs ? lhs : Type::ANY;
+		}
+
+		bool IsProven(Type type) {
+			return type != Type::BOTTOM && type != Type::ANY;
+		}
+
+		// The types of the locals on a path through a body. Locals it doesn't have may be of any type
+		struct Locals {
+			unordered_map<string, Type> types;
+			// False after a return
+			bool reachable = true;
+
+			[[nodiscard]] Type Get(const string& name) const {
+				const auto it = types.find(name);
+				return it == types.end() ? Type::ANY : it->second;
+			}
+		};
+
+		Locals Join(Locals lhs, const Locals& rhs) {
+			if (!lhs.reachable){
+				return rhs;
+			}
+			if (!rhs.reachable){
+				return lhs;
+			}
+			for (auto it = lhs.types.begin(); it != lhs.types.end();){
+				const auto other = rhs.types.find(it->first);
+				if (other == rhs.types.end()){
+					it = lhs.types.erase(it);
+				}else{
+					it->second = Join(it->second, other->second);
+					++it;
+				}
+			}
+			return lhs;
+		}
+
+		// The runtime calls them with arguments of any type
+		bool IsSpecialMethod(const string& name) {
+			return name.rfind("__"s, 0) == 0 && name != INIT_METHOD;
+		}
+
+		template <typename Typed>
+		void Replace(Slot& slot) {
+			if (dynamic_cast<const Typed*>(slot.get()) != nullptr){
+				return;
+			}
+			auto children = Children::Take(*slot);
+			if constexpr (is_base_of_v<ast::UnaryOperation, Typed>){
+				slot = make_unique<Typed>(std::move(children[0]));
+			}else if constexpr (is_base_of_v<ast::IfElse, Typed>){
+				auto else_body = children.size() > 2 ? std::move(children[2]) : nullptr;
+				slot = make_unique<Typed>(std::move(children[0]), std::move(children[1]), std::move(else_body));
+			}else{
+				slot = make_unique<Typed>(std::move(children[0]), std::move(children[1]));
+			}
+		}
+
+		class TypeInference {
+		public:
+			TypeInference(Slot& program, vector<runtime::Class*> classes)
+				: program_(program)
+				, classes_(std::move(classes))
+				, closed_(IsClosed()) {
+			}
+
+			InferTypes::Stats Run() {
+				// Fields and arguments only widen, so this ends
+				for (bool changed = true; changed;){
+					const auto fields = fields_;
+					const auto arguments = arguments_;
+					Analyze();
+					changed = fields != fields_ || arguments != arguments_;
+				}
+				rewrite_ = true;
+				Analyze();
+
+				if (closed_){
+					for (const auto& [_, type] : fields_){
+						stats_.typed_fields += IsProven(type);
+					}
+				}
+				for (auto* cls : classes_){
+					for (const auto& method : cls->GetMethods()){
+						for (const auto& [_, type] : Parameters(method).types){
+							stats_.typed_parameters += IsProven(type);
+						}
+					}
+				}
+				return stats_;
+			}
+
+		private:
+			// Whether the program has every class, method body and field the analysis may meet
+			bool IsClosed() const {
+				const unordered_set<const runtime::Class*> classes(classes_.begin(), classes_.end());
+				for (const auto* cls : classes_){
+					if (cls->GetParent() != nullptr && classes.count(cls->GetParent()) == 0){
+						return false;
+					}
+					for (const auto& method : cls->GetMethods()){
+						if (dynamic_cast<const ast::MethodBody*>(method.body.get()) == nullptr){
+							return false;
+						}
+					}
+				}
+
+				class NewInstances : public ast::Visitor {
+				public:
+					explicit NewInstances(const unordered_set<const runtime::Class*>& classes)
+						: classes_(classes) {
+					}
+
+					using ast::Visitor::Visit;
+
+					bool Visit(const ast::NewInstance& node) override {
+						closed = closed && classes_.count(&node.GetClass()) != 0;
+						return true;
+					}
+
+					bool closed = true;
+
+				private:
+					const unordered_set<const runtime::Class*>& classes_;
+				};
+
+				NewInstances instances(classes);
+				instances.Walk(*program_);
+				return instances.closed;
+			}
+
+			void Analyze() {
+				Locals globals;
+				Flow(program_, globals);
+				for (auto* cls : classes_){
+					for (auto& method : cls->GetMethods()){
+						if (dynamic_cast<const ast::MethodBody*>(method.body.get()) != nullptr){
+							Locals locals = Parameters(method);
+							Flow(method.body, locals);
+						}
+					}
+				}
+			}
+
+			Locals Parameters(const runtime::Method& method) const {
+				Locals locals;
+				if (!closed_ || IsSpecialMethod(method.name)){
+					return locals;
+				}
+				const auto& params = method.formal_params;
+				const auto arguments = arguments_.find({method.name, params.size()});
+				for (size_t i = 0; i < params.size(); ++i){
+					locals.types[params[i]] = arguments == arguments_.end() ? Type::BOTTOM : arguments->second[i];
+				}
+				return locals;
+			}
+
+			Type GetField(const string& name) const {
+				if (!closed_){
+					return Type::ANY;
+				}
+				const auto it = fields_.find(name);
+				return it == fields_.end() ? Type::BOTTOM : it->second;
+			}
+
+			// Statements, recursing into blocks only
+			void Flow(Slot& slot, Locals& locals) {
+				Statement& node = *slot;
+				if (dynamic_cast<ast::Compound*>(&node) != nullptr || dynamic_cast<ast::MethodBody*>(&node) != nullptr){
+					Children::ForEach(node, [this, &locals](Slot& child) {
+						Flow(child, locals);
+					});
+				}else if (dynamic_cast<ast::IfElse*>(&node) != nullptr){
+					vector<Slot*> children;
+					Children::ForEach(node, [&children](Slot& child) {
+						children.push_back(&child);
+					});
+					const Type condition = Expression(*children[0], locals);
+					Locals else_locals = locals;
+					Flow(*children[1], locals);
+					if (children.size() > 2){
+						Flow(*children[2], else_locals);
+					}
+					locals = Join(std::move(locals), else_locals);
+					if (Count(condition == Type::BOOL)){
+						Replace<ast::BoolIfElse>(slot);
+					}
+				}else if (const auto* assignment = dynamic_cast<ast::Assignment*>(&node)){
+					locals.types[assignment->GetVarName()] = ExpressionOfChild(node, locals);
+				}else if (const auto* assignment = dynamic_cast<ast::FieldAssignment*>(&node)){
+					Type& field = fields_[assignment->GetFieldName()];
+					field = Join(field, ExpressionOfChild(node, locals));
+				}else if (dynamic_cast<ast::Return*>(&node) != nullptr){
+					ExpressionOfChild(node, locals);
+					locals.reachable = false;
+				}else if (const auto* definition = dynamic_cast<ast::ClassDefinition*>(&node)){
+					// Its methods are analyzed on their own
+					locals.types.erase(definition->GetClass().GetName());
+				}else{
+					Expression(slot, locals);
+				}
+			}
+
+			Type ExpressionOfChild(Statement& node, const Locals& locals) {
+				Type type = Type::ANY;
+				Children::ForEach(node, [this, &type, &locals](Slot& child) {
+					type = Expression(child, locals);
+				});
+				return type;
+			}
+
+			// Children before their parents, without recursion, so long expressions are fine
+			Type Expression(Slot& root, const Locals& locals) {
+				vector<Slot*> order;
+				vector<Slot*> stack{&root};
+				while (!stack.empty()){
+					Slot* slot = stack.back();
+					stack.pop_back();
+					order.push_back(slot);
+					Children::ForEach(**slot, [&stack](Slot& child) {
+						stack.push_back(&child);
+					});
+				}
+
+				unordered_map<const Statement*, Type> types;
+				for (auto it = order.rbegin(); it != order.rend(); ++it){
+					Slot& slot = **it;
+					const Type type = TypeOf(slot, types, locals);
+					types[slot.get()] = type;
+				}
+				return types.at(root.get());
+			}
+
+			// May replace the node by a typed one
+			Type TypeOf(Slot& slot, const unordered_map<const Statement*, Type>& types, const Locals& locals) {
+				const Statement& node = *slot;
+				const auto type_of = [&types](const Statement& child) {
+					return types.at(&child);
+				};
+
+				if (dynamic_cast<const ast::NumericConst*>(&node) != nullptr){
+					return Type::NUMBER;
+				}
+				if (dynamic_cast<const ast::StringConst*>(&node) != nullptr
+					|| dynamic_cast<const ast::Stringify*>(&node) != nullptr){
+					return Type::STRING;
+				}
+				if (dynamic_cast<const ast::BoolConst*>(&node) != nullptr){
+					return Type::BOOL;
+				}
+				if (const auto* variable = dynamic_cast<const ast::VariableValue*>(&node)){
+					const auto& ids = variable->GetDottedIds();
+					return ids.size() == 1 ? locals.Get(ids.front()) : GetField(ids.back());
+				}
+
+				if (const auto* operation = dynamic_cast<const ast::Not*>(&node)){
+					if (Count(type_of(operation->GetArgument()) == Type::BOOL)){
+						Replace<ast::BoolOperation<ast::Not>>(slot);
+					}
+					return Type::BOOL;
+				}
+				if (dynamic_cast<const ast::And*>(&node) != nullptr){
+					return TypeOfLogical<ast::And>(slot, type_of);
+				}
+				if (dynamic_cast<const ast::Or*>(&node) != nullptr){
+					return TypeOfLogical<ast::Or>(slot, type_of);
+				}
+				if (const auto* comparison = dynamic_cast<const ast::Comparison*>(&node)){
+					const Type lhs = type_of(comparison->GetLhs());
+					const Type rhs = type_of(comparison->GetRhs());
+					if (lhs == Type::NUMBER && rhs == Type::NUMBER){
+						ReplaceComparison<int>(slot);
+					}else if (lhs == Type::STRING && rhs == Type::STRING){
+						ReplaceComparison<string>(slot);
+					}else{
+						Count(false);
+					}
+					return Type::BOOL;
+				}
+				if (const auto* operation = dynamic_cast<const ast::Add*>(&node)){
+					const Type lhs = type_of(operation->GetLhs());
+					const Type rhs = type_of(operation->GetRhs());
+					const bool proven = lhs == rhs && (lhs == Type::NUMBER || lhs == Type::STRING);
+					if (Count(proven)){
+						if (lhs == Type::NUMBER){
+							Replace<ast::NumberOperation<ast::Add>>(slot);
+						}else{
+							Replace<ast::StringConcatenation>(slot);
+						}
+					}
+					if (proven){
+						return lhs;
+					}
+					// Adding instances calls __add__
+					return lhs == Type::BOTTOM || rhs == Type::BOTTOM ? Type::BOTTOM : Type::ANY;
+				}
+				// Nothing else passes the checks
+				if (dynamic_cast<const ast::Sub*>(&node) != nullptr){
+					return TypeOfArithmetic<ast::Sub>(slot, type_of);
+				}
+				if (dynamic_cast<const ast::Mult*>(&node) != nullptr){
+					return TypeOfArithmetic<ast::Mult>(slot, type_of);
+				}
+				if (dynamic_cast<const ast::Div*>(&node) != nullptr){
+					return TypeOfArithmetic<ast::Div>(slot, type_of);
+				}
+
+				if (const auto* call = dynamic_cast<const ast::MethodCall*>(&node)){
+					AddCall(call->GetMethod(), call->GetArgs(), type_of);
+				}else if (const auto* call = dynamic_cast<const ast::BoundMethodCall*>(&node)){
+					AddCall(call->GetCall().GetMethod(), call->GetCall().GetArgs(), type_of);
+				}else if (const auto* call = dynamic_cast<const ast::InlinedMethodCall*>(&node)){
+					AddCall(call->GetCall().GetMethod(), call->GetCall().GetArgs(), type_of);
+				}else if (const auto* instance = dynamic_cast<const ast::NewInstance*>(&node)){
+					AddCall(INIT_METHOD, instance->GetArgs(), type_of);
+				}else if (const auto* spawn = dynamic_cast<const isolate::Spawn*>(&node); spawn && !spawn->GetArgs().empty()){
+					// The arguments of run are deep copies
+					auto& arguments = arguments_[{RUN_METHOD, spawn->GetArgs().size() - 1}];
+					arguments.assign(spawn->GetArgs().size() - 1, Type::ANY);
+				}
+				return Type::ANY;
+			}
+
+			template <typename Operation, typename TypeOfChild>
+			Type TypeOfLogical(Slot& slot, const TypeOfChild& type_of) {
+				const auto& operation = static_cast<const Operation&>(*slot);
+				if (Count(type_of(operation.GetLhs()) == Type::BOOL && type_of(operation.GetRhs()) == Type::BOOL)){
+					Replace<ast::BoolOperation<Operation>>(slot);
+				}
+				return Type::BOOL;
+			}
+
+			template <typename Operation, typename TypeOfChild>
+			Type TypeOfArithmetic(Slot& slot, const TypeOfChild& type_of) {
+				const auto& operation = static_cast<const Operation&>(*slot);
+				if (Count(type_of(operation.GetLhs()) == Type::NUMBER && type_of(operation.GetRhs()) == Type::NUMBER)){
+					Replace<ast::NumberOperation<Operation>>(slot);
+				}
+				return Type::NUMBER;
+			}
+
+			template <typename T>
+			void ReplaceComparison(Slot& slot) {
+				const auto& comparison = static_cast<const ast::Comparison&>(*slot);
+				const auto compare = ast::GetValueCompare<T>(comparison.GetComparator());
+				if (!Count(compare != nullptr) || dynamic_cast<const ast::ValueComparison<T>*>(slot.get()) != nullptr){
+					return;
+				}
+				auto cmp = comparison.GetComparator();
+				auto children = Children::Take(*slot);
+				slot = make_unique<ast::ValueComparison<T>>(std::move(cmp), compare, std::move(children[0]),
+															 std::move(children[1]));
+			}
+
+			template <typename TypeOfChild>
+			void AddCall(const string& method, const vector<unique_ptr<Statement>>& args, const TypeOfChild& type_of) {
+				auto& arguments = arguments_[{method, args.size()}];
+				arguments.resize(args.size(), Type::BOTTOM);
+				for (size_t i = 0; i < args.size(); ++i){
+					arguments[i] = Join(arguments[i], type_of(*args[i]));
+				}
+			}
+
+			// Counts an operation whose operand types are checked when it runs. Returns whether
+			// to make it typed: only in the last run, once the types are final
+			bool Count(bool proven) {
+				if (!rewrite_){
+					return false;
+				}
+				++stats_.operations;
+				stats_.typed_operations += proven;
+				return proven;
+			}
+
+			Slot& program_;
+			vector<runtime::Class*> classes_;
+			// Whether fields and parameters can be typed at all
+			const bool closed_;
+			bool rewrite_ = false;
+			// Joined over the assignments of each field name, whatever the class
+			unordered_map<string, Type> fields_;
+			// Joined over the calls of each method name and arity, whatever the receiver
+			map<pair<string, size_t>, vector<Type>> arguments_;
+			InferTypes::Stats stats_;
+		};
+	}
+
+	string_view InferTypes::GetName() const {
+		return "infer-types"sv;
+	}
+
+	void InferTypes::Run(unique_ptr<runtime::Executable>& program) {
+		stats_ = TypeInference(program, ast::CollectClasses(*program)).Run();
+	}
+
+	string InferTypes::GetSummary() const {
+		return to_string(stats_.typed_operations) + " of "s + to_string(stats_.operations) + " checks skipped, "s
+			+ to_string(stats_.typed_fields) + " fields and "s + to_string(stats_.typed_parameters)
+			+ " parameters typed"s;
+	}
+
+	const InferTypes::Stats& InferTypes::GetStats() const {
+		return stats_;
+	}
+}
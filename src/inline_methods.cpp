@@ -0,0 +1,167 @@
+#include "pass.h"
+
+#include "statement.h"
+#include "visitor.h"
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+
+using namespace std;
+
+namespace passes {
+
+	namespace {
+		using Target = ast::InlinedMethodCall::Target;
+		using Value = ast::InlinedMethodCall::Value;
+
+		const string SELF = "self"s;
+
+		optional<Value> GetLeafValue(const ast::Statement& node, const vector<string>& params) {
+			Value result;
+			if (const auto* number = dynamic_cast<const ast::NumericConst*>(&node)){
+				result.constant = number->GetValue();
+				return result;
+			}
+			if (const auto* str = dynamic_cast<const ast::StringConst*>(&node)){
+				result.constant = str->GetValue();
+				return result;
+			}
+			if (const auto* b = dynamic_cast<const ast::BoolConst*>(&node)){
+				result.constant = b->GetValue();
+				return result;
+			}
+			if (dynamic_cast<const ast::None*>(&node) != nullptr){
+				return result;
+			}
+
+			const auto* variable = dynamic_cast<const ast::VariableValue*>(&node);
+			if (variable == nullptr){
+				return nullopt;
+			}
+			const auto& ids = variable->GetDottedIds();
+			// The frame of a call binds self before the parameters, so self is never a parameter
+			if (ids.size() == 2 && ids[0] == SELF){
+				result.kind = Value::Kind::FIELD;
+				result.field = ids[1];
+				return result;
+			}
+			if (ids.size() != 1){
+				return nullopt;
+			}
+			if (ids[0] == SELF){
+				result.kind = Value::Kind::SELF;
+				return result;
+			}
+			const auto param = find(params.begin(), params.end(), ids[0]);
+			if (param == params.end()){
+				return nullopt;
+			}
+			result.kind = Value::Kind::PARAMETER;
+			result.parameter = static_cast<size_t>(param - params.begin());
+			return result;
+		}
+
+		// The cls field of the result is left unset
+		optional<Target> GetLeafTarget(const runtime::Method& method) {
+			const auto* body = dynamic_cast<const ast::MethodBody*>(method.body.get());
+			if (body == nullptr){
+				return nullopt;
+			}
+			const ast::Statement* statement = &body->GetBody();
+			if (const auto* compound = dynamic_cast<const ast::Compound*>(statement)){
+				if (compound->GetStatements().size() != 1){
+					return nullopt;
+				}
+				statement = compound->GetStatements().front().get();
+			}
+
+			Target result;
+			optional<Value> value;
+			if (const auto* ret = dynamic_cast<const ast::Return*>(statement)){
+				value = GetLeafValue(ret->GetStatement(), method.formal_params);
+			}else if (const auto* assignment = dynamic_cast<const ast::FieldAssignment*>(statement)){
+				if (assignment->GetObject().GetDottedIds() != vector{SELF}){
+					return nullopt;
+				}
+				result.assigned_field = assignment->GetFieldName();
+				value = GetLeafValue(assignment->GetValue(), method.formal_params);
+			}
+			if (!value){
+				return nullopt;
+			}
+			result.value = std::move(*value);
+			return result;
+		}
+
+		class CallInliner : public ast::Rewriter {
+		public:
+			// Finds the leaves before any body is rewritten
+			explicit CallInliner(vector<runtime::Class*> classes)
+				: classes_(std::move(classes)) {
+				for (const auto* cls : classes_){
+					for (const auto& method : cls->GetMethods()){
+						if (auto leaf = GetLeafTarget(method)){
+							leaves_.emplace(&method, std::move(*leaf));
+						}
+					}
+				}
+			}
+
+			[[nodiscard]] size_t GetInlinedCount() const {
+				return inlined_count_;
+			}
+
+		protected:
+			unique_ptr<ast::Statement> Rewrite(unique_ptr<ast::Statement> node) override {
+				const auto* call = dynamic_cast<const ast::MethodCall*>(node.get());
+				if (call == nullptr){
+					return node;
+				}
+
+				vector<Target> targets;
+				for (const auto* cls : classes_){
+					const auto* method = cls->GetMethod(call->GetMethod(), call->GetArgs().size());
+					if (method == nullptr){
+						continue;
+					}
+					if (const auto leaf = leaves_.find(method); leaf != leaves_.end()){
+						targets.push_back(leaf->second);
+						targets.back().cls = cls;
+					}
+				}
+				if (targets.empty() || targets.size() > InlineMethods::MAX_TARGETS){
+					return node;
+				}
+
+				++inlined_count_;
+				unique_ptr<ast::MethodCall> method_call(static_cast<ast::MethodCall*>(node.release()));
+				return make_unique<ast::InlinedMethodCall>(std::move(method_call), std::move(targets));
+			}
+
+		private:
+			vector<runtime::Class*> classes_;
+			// Methods of other classes, e.g. of the base classes of a snapshot, are never leaves
+			unordered_map<const runtime::Method*, Target> leaves_;
+			size_t inlined_count_ = 0;
+		};
+	}
+
+	string_view InlineMethods::GetName() const {
+		return "inline-methods"sv;
+	}
+
+	void InlineMethods::Run(unique_ptr<runtime::Executable>& program) {
+		CallInliner inliner(ast::CollectClasses(*program));
+		inliner.RewriteTree(program);
+		inlined_count_ = inliner.GetInlinedCount();
+	}
+
+	size_t InlineMethods::GetInlinedCount() const {
+		return inlined_count_;
+	}
+
+	string InlineMethods::GetSummary() const {
+		return to_string(inlined_count_) + " calls inlined"s;
+	}
+}
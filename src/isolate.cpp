@@ -0,0 +1,322 @@
+#include "isolate.h"
+
+using namespace std;
+
+namespace isolate {
+
+	using runtime::Closure;
+	using runtime::Context;
+	using runtime::ObjectHolder;
+
+	namespace {
+		const string SELF = "self"s;
+		const string RUN_METHOD = "run"s;
+		const string QUEUE_FIELD = "__queue"s;
+		const string ISOLATE_FIELD = "__isolate"s;
+
+		// Method implemented in C++. Arguments are read from the method's closure
+		class NativeMethod : public runtime::Executable {
+		public:
+			using Body = ObjectHolder (*)(Closure& closure, Context& context);
+
+			explicit NativeMethod(Body body)
+				: body_(body) {
+			}
+
+			ObjectHolder Execute(Closure& closure, Context& context) const override {
+				return body_(closure, context);
+			}
+
+		private:
+			Body body_;
+		};
+
+		runtime::Method MakeMethod(string name, vector<string> params, NativeMethod::Body body) {
+			return {std::move(name), std::move(params), make_unique<NativeMethod>(body)};
+		}
+
+		template <typename T>
+		T& GetState(Closure& closure, const string& field) {
+			const auto& self = *closure.at(SELF).TryAs<runtime::ClassInstance>();
+			auto it = self.Fields().find(field);
+			T* state = it == self.Fields().end() ? nullptr : it->second.TryAs<T>();
+			if (state == nullptr){
+				throw runtime_error(self.GetClass().GetName() + " is not initialized"s);
+			}
+			return *state;
+		}
+
+		ObjectHolder ChannelInit(Closure& closure, [[maybe_unused]] Context& context) {
+			const auto* capacity = closure.at("capacity"s).TryAs<runtime::Number>();
+			if (capacity == nullptr || capacity->GetValue() <= 0){
+				throw runtime_error("Channel capacity must be a positive number"s);
+			}
+			auto& self = *closure.at(SELF).TryAs<runtime::ClassInstance>();
+			self.Fields()[QUEUE_FIELD] = ObjectHolder::Allocate<ChannelQueue>(
+					allocator<ChannelQueue>(), static_cast<size_t>(capacity->GetValue()));
+			return {};
+		}
+
+		ObjectHolder ChannelSend(Closure& closure, [[maybe_unused]] Context& context) {
+			auto& queue = GetState<ChannelQueue>(closure, QUEUE_FIELD);
+			ObjectHolder copy = runtime::DeepCopy(closure.at("value"s));
+			// The copy belongs to the receiver once it is in the queue
+			runtime::DisownInstances({copy});
+			try {
+				queue.Send(copy);
+			} catch (...) {
+				runtime::AdoptInstances({copy});
+				throw;
+			}
+			return {};
+		}
+
+		ObjectHolder ChannelReceive(Closure& closure, [[maybe_unused]] Context& context) {
+			ObjectHolder value = GetState<ChannelQueue>(closure, QUEUE_FIELD).Receive();
+			runtime::AdoptInstances({value});
+			return value;
+		}
+
+		ObjectHolder ChannelClose(Closure& closure, [[maybe_unused]] Context& context) {
+			GetState<ChannelQueue>(closure, QUEUE_FIELD).Close();
+			return {};
+		}
+
+		ObjectHolder IsolateJoin(Closure& closure, Context& context) {
+			return GetState<IsolateState>(closure, ISOLATE_FIELD).Join(context);
+		}
+
+		const ObjectHolder& GetChannelClass() {
+			static const ObjectHolder cls = []{
+				vector<runtime::Method> methods;
+				methods.push_back(MakeMethod("__init__"s, {"capacity"s}, ChannelInit));
+				methods.push_back(MakeMethod("send"s, {"value"s}, ChannelSend));
+				methods.push_back(MakeMethod("recv"s, {}, ChannelReceive));
+				methods.push_back(MakeMethod("close"s, {}, ChannelClose));
+				return ObjectHolder::Own(runtime::Class("Channel"s, std::move(methods), nullptr));
+			}();
+			return cls;
+		}
+
+		const runtime::Class& GetIsolateClass() {
+			static const ObjectHolder cls = []{
+				vector<runtime::Method> methods;
+				methods.push_back(MakeMethod("join"s, {}, IsolateJoin));
+				return ObjectHolder::Own(runtime::Class("Isolate"s, std::move(methods), nullptr));
+			}();
+			return *cls.TryAs<runtime::Class>();
+		}
+	}
+
+	ChannelQueue::ChannelQueue(size_t capacity)
+		: capacity_(capacity)
+		, cells_(make_unique<Cell[]>(capacity)) {
+		for (size_t i = 0; i < capacity_; ++i){
+			cells_[i].sequence.store(i, memory_order_relaxed);
+		}
+	}
+
+	bool ChannelQueue::TrySend(ObjectHolder& value) {
+		size_t position = send_position_.load(memory_order_relaxed);
+		while (true){
+			Cell& cell = cells_[position % capacity_];
+			const size_t sequence = cell.sequence.load(memory_order_acquire);
+			if (sequence == position){
+				if (send_position_.compare_exchange_weak(position, position + 1, memory_order_relaxed)){
+					cell.value = std::move(value);
+					cell.sequence.store(position + 1, memory_order_release);
+					return true;
+				}
+			}else if (sequence < position){
+				return false;
+			}else{
+				position = send_position_.load(memory_order_relaxed);
+			}
+		}
+	}
+
+	bool ChannelQueue::TryReceive(ObjectHolder& value) {
+		size_t position = receive_position_.load(memory_order_relaxed);
+		while (true){
+			Cell& cell = cells_[position % capacity_];
+			const size_t sequence = cell.sequence.load(memory_order_acquire);
+			if (sequence == position + 1){
+				if (receive_position_.compare_exchange_weak(position, position + 1, memory_order_relaxed)){
+					value = std::move(cell.value);
+					cell.value = {};
+					cell.sequence.store(position + capacity_, memory_order_release);
+					return true;
+				}
+			}else if (sequence < position + 1){
+				return false;
+			}else{
+				position = receive_position_.load(memory_order_relaxed);
+			}
+		}
+	}
+
+	void ChannelQueue::Send(ObjectHolder value) {
+		// Counted before the closed check: a receiver that sees the channel closed and no
+		// sender in flight knows that no value can arrive any more
+		senders_.fetch_add(1);
+		for (int attempt = 0;; ++attempt){
+			const uint64_t seen = changes_.load();
+			if (IsClosed()){
+				senders_.fetch_sub(1);
+				NotifyChange();
+				throw runtime_error("Send to a closed channel"s);
+			}
+			if (TrySend(value)){
+				senders_.fetch_sub(1);
+				NotifyChange();
+				return;
+			}
+			Wait(attempt, seen);
+		}
+	}
+
+	ObjectHolder ChannelQueue::Receive() {
+		ObjectHolder value;
+		for (int attempt = 0;; ++attempt){
+			const uint64_t seen = changes_.load();
+			if (TryReceive(value)){
+				NotifyChange();
+				return value;
+			}
+			if (IsClosed() && senders_.load() == 0){
+				// Sends that passed their check before the close have landed by now
+				TryReceive(value);
+				return value;
+			}
+			Wait(attempt, seen);
+		}
+	}
+
+	void ChannelQueue::Wait(int attempt, uint64_t seen) {
+		constexpr int SPINS = 16;
+		constexpr int YIELDS = 64;
+		if (attempt < SPINS){
+			return;
+		}
+		if (attempt < YIELDS){
+			this_thread::yield();
+			return;
+		}
+		// Counted before the check, so a change made after the check sees the waiter
+		unique_lock lock(park_mutex_);
+		parked_.fetch_add(1);
+		changed_.wait(lock, [this, seen] {
+			return changes_.load() != seen;
+		});
+		parked_.fetch_sub(1);
+	}
+
+	void ChannelQueue::NotifyChange() {
+		changes_.fetch_add(1);
+		if (parked_.load() != 0){
+			// Taken so that the notification can't fall between a check and the wait
+			lock_guard guard(park_mutex_);
+			changed_.notify_all();
+		}
+	}
+
+	void ChannelQueue::Close() {
+		closed_.store(true);
+		NotifyChange();
+	}
+
+	bool ChannelQueue::IsClosed() const {
+		return closed_.load();
+	}
+
+	size_t ChannelQueue::GetCapacity() const {
+		return capacity_;
+	}
+
+	void ChannelQueue::Print(ostream& os, [[maybe_unused]] Context& context) {
+		os << "Channel("sv << capacity_ << ')';
+	}
+
+	IsolateState::IsolateState(ObjectHolder instance, const runtime::Method* method,
+							   vector<ObjectHolder> args)
+		: outcome_(make_shared<Outcome>())
+		, thread_([outcome = outcome_, instance = std::move(instance), method, args = std::move(args)] {
+			try {
+				runtime::AdoptInstances({instance});
+				runtime::AdoptInstances(args);
+				runtime::SimpleContext context{outcome->output};
+				outcome->result = instance.TryAs<runtime::ClassInstance>()->Call(method, args, context);
+			} catch (...) {
+				outcome->error = current_exception();
+			}
+		}) {
+	}
+
+	IsolateState::~IsolateState() {
+		if (!thread_.joinable()){
+			return;
+		}
+		// The last handle may be released by the isolate itself
+		if (thread_.get_id() == this_thread::get_id()){
+			thread_.detach();
+		}else{
+			thread_.join();
+		}
+	}
+
+	ObjectHolder IsolateState::Join(Context& context) {
+		lock_guard guard(join_mutex_);
+		if (!joined_){
+			thread_.join();
+			joined_ = true;
+			context.GetOutputStream() << outcome_->output.str();
+		}
+		if (outcome_->error){
+			rethrow_exception(outcome_->error);
+		}
+		// The isolate is finished, so the result is usually moved as a whole. It is handed
+		// out once: the handle may have been passed on to other isolates. Adopted first, so
+		// that the instances left behind by the copy are collected by this thread
+		runtime::AdoptInstances({outcome_->result});
+		return runtime::DeepMove(std::move(outcome_->result));
+	}
+
+	void IsolateState::Print(ostream& os, [[maybe_unused]] Context& context) {
+		os << "Isolate"sv;
+	}
+
+	const Closure& GetBuiltinClasses() {
+		static const Closure classes = {
+			{"Channel"s, GetChannelClass()},
+		};
+		return classes;
+	}
+
+	Spawn::Spawn(vector<unique_ptr<ast::Statement>> args)
+		: args_(std::move(args)) {
+	}
+
+	ObjectHolder Spawn::Execute(Closure& closure, Context& context) const {
+		vector<ObjectHolder> values;
+		values.reserve(args_.size());
+		for (const auto& arg : args_){
+			values.push_back(arg->Execute(closure, context));
+		}
+
+		const auto* instance = values.front().TryAs<runtime::ClassInstance>();
+		if (instance == nullptr){
+			throw runtime_error("spawn() expects a class instance"s);
+		}
+		const runtime::Method* run = instance->GetMethod(RUN_METHOD, values.size() - 1);
+
+		vector<ObjectHolder> copies = runtime::DeepMove(std::move(values));
+		runtime::DisownInstances(copies);
+		ObjectHolder target = std::move(copies.front());
+		copies.erase(copies.begin());
+
+		ObjectHolder handle = GetIsolateClass().NewInstance();
+		handle.TryAs<runtime::ClassInstance>()->Fields()[ISOLATE_FIELD] = ObjectHolder::Allocate<IsolateState>(
+				allocator<IsolateState>(), std::move(target), run, std::move(copies));
+		return handle;
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "statement.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace isolate {
+
+	// Bounded multi-producer multi-consumer queue (D. Vyukov's algorithm): senders and
+	// receivers claim a cell with a CAS on their position. A lock is only taken to park a
+	// sender or receiver that has waited for a while, and to wake it up.
+	// The queue itself is shared by every isolate that has a copy of its channel
+	class ChannelQueue : public runtime::Object {
+	public:
+		explicit ChannelQueue(size_t capacity);
+
+		// On success the value is moved into the queue
+		bool TrySend(runtime::ObjectHolder& value);
+		bool TryReceive(runtime::ObjectHolder& value);
+
+		// Waits while the queue is full, throws once the channel is closed
+		void Send(runtime::ObjectHolder value);
+		// Waits while the queue is empty, returns None once it is closed and drained. A send
+		// that succeeds is always received, even when the channel is closed during the send
+		runtime::ObjectHolder Receive();
+
+		void Close();
+		[[nodiscard]] bool IsClosed() const;
+		[[nodiscard]] size_t GetCapacity() const;
+
+		void Print(std::ostream& os, runtime::Context& context) override;
+
+	private:
+		struct Cell {
+			std::atomic<size_t> sequence;
+			runtime::ObjectHolder value;
+		};
+
+		// Spins, then yields, then parks until the queue has changed since seen
+		void Wait(int attempt, uint64_t seen);
+		// Wakes up the parked senders and receivers
+		void NotifyChange();
+
+		size_t capacity_;
+		std::unique_ptr<Cell[]> cells_;
+		alignas(64) std::atomic<size_t> send_position_ = 0;
+		alignas(64) std::atomic<size_t> receive_position_ = 0;
+		std::atomic<bool> closed_ = false;
+		// Sends that may still put a value into the queue
+		std::atomic<size_t> senders_ = 0;
+		// Counts sends, receives and closes, so that a waiter can tell whether it missed one
+		std::atomic<uint64_t> changes_ = 0;
+		std::atomic<size_t> parked_ = 0;
+		std::mutex park_mutex_;
+		std::condition_variable changed_;
+	};
+
+	// An interpreter running one method call on its own thread, with its own context and
+	// objects. Its output is appended to the output of the isolate that joins it
+	class IsolateState : public runtime::Object {
+	public:
+		IsolateState(runtime::ObjectHolder instance, const runtime::Method* method,
+					 std::vector<runtime::ObjectHolder> args);
+		~IsolateState() override;
+
+		// Waits for the call to finish and returns its result, None when joined again.
+		// Rethrows its error
+		runtime::ObjectHolder Join(runtime::Context& context);
+
+		void Print(std::ostream& os, runtime::Context& context) override;
+
+	private:
+		// Owned by the thread as well, so the isolate may outlive its last handle
+		struct Outcome {
+			std::ostringstream output;
+			runtime::ObjectHolder result;
+			std::exception_ptr error;
+		};
+
+		std::mutex join_mutex_;
+		bool joined_ = false;
+		std::shared_ptr<Outcome> outcome_;
+		std::thread thread_;
+	};
+
+	// Classes every program can use without declaring them:
+	//   Channel(capacity) with send(value), recv() and close()
+	const runtime::Closure& GetBuiltinClasses();
+
+	// spawn(instance, args...) starts a new isolate that calls instance.run(args...).
+	// The instance and the arguments are deep-copied into the isolate, or moved when nothing
+	// else owns them, as in spawn(Worker(), Job()). Values sent through a channel are
+	// deep-copied as well; only the channels themselves are shared.
+	// The result is a handle whose join() waits for the isolate and returns its result
+	class Spawn : public ast::Statement {
+	public:
+		explicit Spawn(std::vector<std::unique_ptr<ast::Statement>> args);
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const std::vector<std::unique_ptr<ast::Statement>>& GetArgs() const {
+			return args_;
+		}
+
+	private:
+		friend class ast::Children;
+
+		std::vector<std::unique_ptr<ast::Statement>> args_;
+	};
+}
@@ -0,0 +1,102 @@
+#include "bench_runner_p.h"
+#include "isolate.h"
+#include "lexer.h"
+#include "parse.h"
+
+#include <thread>
+
+using namespace std;
+
+namespace isolate {
+
+namespace {
+
+const string WORKER_CLASS = R"(
+class Worker:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+  def run(n):
+    return self.fib(n)
+
+)"s;
+
+double RunProgram(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    auto tree = ParseProgram(lexer);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    return MeasureSeconds([&] {
+        tree->Execute(closure, context);
+    });
+}
+
+// The same amount of work done by one interpreter and split between isolates
+void BenchmarkIsolateSpeedup() {
+    const int isolates = static_cast<int>(max(2U, thread::hardware_concurrency()));
+    constexpr int FIB_ARGUMENT = 17;
+
+    string sequential = WORKER_CLASS + "w = Worker()\n"s;
+    string parallel = WORKER_CLASS;
+    for (int i = 0; i < isolates; ++i) {
+        sequential += "r"s + to_string(i) + " = w.run("s + to_string(FIB_ARGUMENT) + ")\n"s;
+        parallel += "h"s + to_string(i) + " = spawn(Worker(), "s + to_string(FIB_ARGUMENT) + ")\n"s;
+    }
+    for (int i = 0; i < isolates; ++i) {
+        parallel += "r"s + to_string(i) + " = h"s + to_string(i) + ".join()\n"s;
+    }
+
+    const double sequential_seconds = RunProgram(sequential);
+    const double parallel_seconds = RunProgram(parallel);
+    cerr << "  "sv << isolates << " isolates: sequential "sv << sequential_seconds * 1000
+         << " ms, parallel "sv << parallel_seconds * 1000 << " ms, speedup "sv
+         << sequential_seconds / parallel_seconds << endl;
+}
+
+// Round trips of a small instance between two isolates
+void BenchmarkChannelPingPong() {
+    constexpr int ROUND_TRIPS = 2000;
+
+    const string program = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+class Echo:
+  def run(input, output, count):
+    if count > 0:
+      output.send(input.recv())
+      self.run(input, output, count - 1)
+
+class Driver:
+  def run(input, output, count):
+    if count > 0:
+      output.send(Point(count, count))
+      p = input.recv()
+      self.run(input, output, count - 1)
+
+requests = Channel(1)
+replies = Channel(1)
+echo = spawn(Echo(), requests, replies, )"s + to_string(ROUND_TRIPS) + R"()
+driver = Driver()
+driver.run(replies, requests, )"s + to_string(ROUND_TRIPS) + R"()
+echo.join()
+)"s;
+
+    const double seconds = RunProgram(program);
+    cerr << "  "sv << ROUND_TRIPS / seconds << " round trips/s"sv << endl;
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, isolate::BenchmarkIsolateSpeedup);
+    RUN_BENCHMARK(br, isolate::BenchmarkChannelPingPong);
+}
+
+}  // namespace isolate
@@ -0,0 +1,418 @@
+#include "isolate.h"
+#include "lexer.h"
+#include "parse.h"
+#include "test_runner_p.h"
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+using namespace std;
+
+namespace isolate {
+
+using runtime::Closure;
+using runtime::ObjectHolder;
+
+namespace {
+
+string RunProgram(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    auto tree = ParseProgram(lexer);
+
+    runtime::DummyContext context;
+    Closure closure;
+    tree->Execute(closure, context);
+    return context.output.str();
+}
+
+int GetNumber(const ObjectHolder& object) {
+    return object.TryAs<runtime::Number>()->GetValue();
+}
+
+void TestChannelQueue() {
+    ChannelQueue queue(3);
+    for (int i = 1; i <= 3; ++i) {
+        ObjectHolder value = ObjectHolder::Own(runtime::Number(i));
+        ASSERT(queue.TrySend(value));
+        ASSERT(!value);
+    }
+    ObjectHolder extra = ObjectHolder::Own(runtime::Number(4));
+    ASSERT(!queue.TrySend(extra));
+    ASSERT(extra);
+
+    ASSERT_EQUAL(GetNumber(queue.Receive()), 1);
+    ASSERT(queue.TrySend(extra));
+    ASSERT_EQUAL(GetNumber(queue.Receive()), 2);
+
+    queue.Close();
+    ASSERT_THROWS(queue.Send(ObjectHolder::Own(runtime::Number(5))), std::runtime_error);
+    ASSERT_EQUAL(GetNumber(queue.Receive()), 3);
+    ASSERT_EQUAL(GetNumber(queue.Receive()), 4);
+    ASSERT(!queue.Receive());
+}
+
+void TestChannelQueueConcurrent() {
+    constexpr int PRODUCERS = 4;
+    constexpr int CONSUMERS = 3;
+    constexpr int VALUES_PER_PRODUCER = 2000;
+
+    ChannelQueue queue(8);
+    atomic<long long> sum = 0;
+    atomic<int> received = 0;
+
+    vector<thread> consumers;
+    for (int i = 0; i < CONSUMERS; ++i) {
+        consumers.emplace_back([&] {
+            while (ObjectHolder value = queue.Receive()) {
+                sum += GetNumber(value);
+                ++received;
+            }
+        });
+    }
+    vector<thread> producers;
+    for (int i = 0; i < PRODUCERS; ++i) {
+        producers.emplace_back([&queue] {
+            for (int value = 1; value <= VALUES_PER_PRODUCER; ++value) {
+                queue.Send(ObjectHolder::Own(runtime::Number(value)));
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    queue.Close();
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+
+    ASSERT_EQUAL(received.load(), PRODUCERS * VALUES_PER_PRODUCER);
+    ASSERT_EQUAL(sum.load(), PRODUCERS * (VALUES_PER_PRODUCER * (VALUES_PER_PRODUCER + 1LL) / 2));
+}
+
+// Every send that returns is received, even when the channel is closed meanwhile
+void TestCloseWhileSending() {
+    constexpr int ROUNDS = 50;
+    constexpr int PRODUCERS = 3;
+
+    for (int round = 0; round < ROUNDS; ++round) {
+        ChannelQueue queue(4);
+        atomic<int> sent = 0;
+        atomic<int> received = 0;
+
+        thread consumer([&] {
+            while (queue.Receive()) {
+                ++received;
+            }
+        });
+        vector<thread> producers;
+        for (int i = 0; i < PRODUCERS; ++i) {
+            producers.emplace_back([&] {
+                try {
+                    while (true) {
+                        queue.Send(ObjectHolder::Own(runtime::Number(1)));
+                        ++sent;
+                    }
+                } catch (const runtime_error&) {
+                }
+            });
+        }
+        while (received.load() < round) {
+            this_thread::yield();
+        }
+        queue.Close();
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        consumer.join();
+
+        ASSERT_EQUAL(received.load(), sent.load());
+    }
+}
+
+double GetThreadCpuSeconds() {
+    timespec time{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// A receiver waiting on a slow producer is parked rather than burning its core
+void TestReceiveWaitsForSlowSender() {
+    constexpr auto DELAY = chrono::milliseconds(300);
+
+    ChannelQueue queue(1);
+    thread producer([&queue, DELAY] {
+        this_thread::sleep_for(DELAY);
+        queue.Send(ObjectHolder::Own(runtime::Number(1)));
+        this_thread::sleep_for(DELAY);
+        queue.Close();
+    });
+
+    const double cpu_start = GetThreadCpuSeconds();
+    const auto start = chrono::steady_clock::now();
+    ASSERT_EQUAL(GetNumber(queue.Receive()), 1);
+    ASSERT(!queue.Receive());
+    const chrono::duration<double> waited = chrono::steady_clock::now() - start;
+    const double cpu = GetThreadCpuSeconds() - cpu_start;
+    producer.join();
+
+    ASSERT(waited.count() >= 0.5);
+    ASSERT(cpu < waited.count() / 10);
+}
+
+void TestDeepCopy() {
+    runtime::Class cls("Node"s, {}, nullptr);
+    ObjectHolder shared = cls.NewInstance();
+    ObjectHolder root = cls.NewInstance();
+    ObjectHolder name = ObjectHolder::Own(runtime::String("root"s));
+
+    auto& root_fields = root.TryAs<runtime::ClassInstance>()->Fields();
+    root_fields["left"s] = shared;
+    root_fields["right"s] = shared;
+    root_fields["name"s] = name;
+    root_fields["self"s] = root;
+    shared.TryAs<runtime::ClassInstance>()->Fields()["value"s] = ObjectHolder::Own(runtime::Number(1));
+
+    ObjectHolder copy = runtime::DeepCopy(root);
+    auto& copy_fields = copy.TryAs<runtime::ClassInstance>()->Fields();
+    ASSERT(copy.Get() != root.Get());
+    ASSERT(copy_fields.at("self"s).Get() == copy.Get());
+    ASSERT(copy_fields.at("left"s).Get() != shared.Get());
+    ASSERT(copy_fields.at("left"s).Get() == copy_fields.at("right"s).Get());
+    ASSERT(copy_fields.at("name"s).Get() == name.Get());
+
+    copy_fields.at("left"s).TryAs<runtime::ClassInstance>()->Fields()["value"s] =
+        ObjectHolder::Own(runtime::Number(2));
+    ASSERT_EQUAL(GetNumber(shared.TryAs<runtime::ClassInstance>()->Fields().at("value"s)), 1);
+
+    // Break the cycles so that the instances are released
+    root_fields.clear();
+    copy_fields.clear();
+}
+
+void TestDeepCopyKeepsNonOwningReferences() {
+    runtime::Class cls("Node"s, {}, nullptr);
+    ObjectHolder root = cls.NewInstance();
+    ObjectHolder next = cls.NewInstance();
+    ObjectHolder outside = cls.NewInstance();
+
+    auto& root_fields = root.TryAs<runtime::ClassInstance>()->Fields();
+    root_fields["me"s] = ObjectHolder::Share(*root);
+    root_fields["next"s] = next;
+    root_fields["outside"s] = ObjectHolder::Share(*outside);
+    next.TryAs<runtime::ClassInstance>()->Fields()["prev"s] = ObjectHolder::Share(*root);
+
+    ObjectHolder copy = runtime::DeepCopy(ObjectHolder::Share(*root));
+    ASSERT(copy.IsOwning());
+    const auto& copy_fields = copy.TryAs<runtime::ClassInstance>()->Fields();
+    ASSERT(copy_fields.at("me"s).Get() == copy.Get());
+    ASSERT(!copy_fields.at("me"s).IsOwning());
+    ASSERT(copy_fields.at("next"s).IsOwning());
+    const auto& prev = copy_fields.at("next"s).TryAs<runtime::ClassInstance>()->Fields().at("prev"s);
+    ASSERT(prev.Get() == copy.Get());
+    ASSERT(!prev.IsOwning());
+    // Nothing else in the copy owns the copy of outside
+    ASSERT(copy_fields.at("outside"s).Get() != outside.Get());
+    ASSERT(copy_fields.at("outside"s).IsOwning());
+
+    vector<weak_ptr<runtime::ClassInstance>> copies;
+    for (const string& name : {"me"s, "next"s, "outside"s}) {
+        copies.push_back(copy_fields.at(name).TryAs<runtime::ClassInstance>()->weak_from_this());
+    }
+    copy = ObjectHolder::None();
+    for (const auto& instance : copies) {
+        ASSERT(instance.expired());
+    }
+}
+
+void TestDeepMove() {
+    runtime::Class cls("Node"s, {}, nullptr);
+    ObjectHolder root = cls.NewInstance();
+    ObjectHolder child = cls.NewInstance();
+    ObjectHolder shared = cls.NewInstance();
+    ObjectHolder grandchild = cls.NewInstance();
+
+    auto& root_fields = root.TryAs<runtime::ClassInstance>()->Fields();
+    root_fields["child"s] = child;
+    root_fields["shared"s] = shared;
+    root_fields["me"s] = ObjectHolder::Share(*root);
+    child.TryAs<runtime::ClassInstance>()->Fields()["parent"s] = ObjectHolder::Share(*root);
+    shared.TryAs<runtime::ClassInstance>()->Fields()["child"s] = grandchild;
+
+    const runtime::Object* root_object = root.Get();
+    const runtime::Object* child_object = child.Get();
+    const runtime::Object* grandchild_object = grandchild.Get();
+    child = ObjectHolder::None();
+    grandchild = ObjectHolder::None();
+
+    // Still owned by the caller, so copied
+    ObjectHolder copy = runtime::DeepMove(root);
+    ASSERT(copy.Get() != root_object);
+
+    ObjectHolder moved = runtime::DeepMove(std::move(root));
+    ASSERT(moved.Get() == root_object);
+    const auto& fields = moved.TryAs<runtime::ClassInstance>()->Fields();
+    ASSERT(fields.at("child"s).Get() == child_object);
+    ASSERT(fields.at("me"s).Get() == root_object);
+    ASSERT(!fields.at("me"s).IsOwning());
+    ASSERT(fields.at("child"s).TryAs<runtime::ClassInstance>()->Fields().at("parent"s).Get() == root_object);
+    // Owned by the test as well, and so is what it refers to
+    ASSERT(fields.at("shared"s).Get() != shared.Get());
+    const auto& shared_copy = fields.at("shared"s).TryAs<runtime::ClassInstance>()->Fields();
+    ASSERT(shared_copy.at("child"s).Get() != grandchild_object);
+    ASSERT(shared.TryAs<runtime::ClassInstance>()->Fields().at("child"s).Get() == grandchild_object);
+}
+
+void TestSpawnWithChannels() {
+    const string program = R"(
+class Squarer:
+  def run(input, output, count):
+    if count > 0:
+      x = input.recv()
+      output.send(x * x)
+      self.run(input, output, count - 1)
+    print "squared", count
+
+inbox = Channel(2)
+outbox = Channel(2)
+worker = spawn(Squarer(), inbox, outbox, 3)
+inbox.send(2)
+inbox.send(3)
+print outbox.recv()
+inbox.send(4)
+print outbox.recv(), outbox.recv()
+worker.join()
+print "done"
+)"s;
+
+    ASSERT_EQUAL(RunProgram(program), "4\n9 16\nsquared 0\nsquared 1\nsquared 2\nsquared 3\ndone\n"s);
+}
+
+void TestSpawnCopiesValues() {
+    const string program = R"(
+class Point:
+  def __init__(x):
+    self.x = x
+
+class Mutator:
+  def run(p, channel):
+    p.x = p.x + 1
+    q = channel.recv()
+    q.x = q.x + 10
+    return q
+
+p = Point(1)
+channel = Channel(1)
+h = spawn(Mutator(), p, channel)
+channel.send(p)
+q = h.join()
+print p.x, q.x, h.join()
+)"s;
+
+    ASSERT_EQUAL(RunProgram(program), "1 11 None\n"s);
+}
+
+void TestCyclesMoveBetweenIsolates() {
+    const string program = R"(
+class Node:
+  def __init__(value):
+    self.value = value
+    self.me = self
+
+class Worker:
+  def run(channel):
+    channel.send(Node(2))
+    return Node(1)
+
+channel = Channel(1)
+worker = spawn(Worker(), channel)
+received = channel.recv()
+result = worker.join()
+)"s;
+
+    runtime::CollectCycles();
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    runtime::DummyContext context;
+    Closure closure;
+    ParseProgram(lexer)->Execute(closure, context);
+
+    // The received values belong to this thread now. The result was copied by join(), which
+    // leaves the cycle of the original here as well
+    ASSERT_EQUAL(runtime::CollectCycles(), 1U);
+    for (const auto& [name, value] : {pair{"received"s, 2}, pair{"result"s, 1}}) {
+        const auto& node = closure.at(name).TryAs<runtime::ClassInstance>()->Fields();
+        ASSERT(node.at("me"s).Get() == closure.at(name).Get());
+        ASSERT_EQUAL(GetNumber(node.at("value"s)), value);
+    }
+    closure.clear();
+    ASSERT_EQUAL(runtime::CollectCycles(), 2U);
+}
+
+void TestProgramClassShadowsChannel() {
+    const string program = R"(
+class Channel:
+  def __init__(name):
+    self.name = name
+
+  def send(value):
+    print self.name, value
+
+class Pipe(Channel):
+  def open():
+    return Channel(self.name + '!')
+
+c = Channel('user')
+c.send(1)
+p = Pipe('pipe')
+d = p.open()
+d.send(2)
+)"s;
+
+    ASSERT_EQUAL(RunProgram(program), "user 1\npipe! 2\n"s);
+
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    runtime::DummyContext context;
+    Closure closure;
+    ParseProgram(lexer, ParseOptions{.lazy_methods = true})->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "user 1\npipe! 2\n"s);
+}
+
+void TestSpawnErrors() {
+    ASSERT_THROWS(RunProgram("x = spawn(1)\n"s), std::runtime_error);
+    ASSERT_THROWS(RunProgram("class A:\n  def go():\n    return 1\n\nx = spawn(A())\n"s),
+                  std::runtime_error);
+
+    const string program = R"(
+class Failing:
+  def run():
+    x = missing
+
+h = spawn(Failing())
+h.join()
+)"s;
+    ASSERT_THROWS(RunProgram(program), std::runtime_error);
+    ASSERT_THROWS(RunProgram("c = Channel(0)\n"s), std::runtime_error);
+}
+
+}  // namespace
+
+void RunIsolateTests(TestRunner& tr) {
+    RUN_TEST(tr, isolate::TestChannelQueue);
+    RUN_TEST(tr, isolate::TestChannelQueueConcurrent);
+    RUN_TEST(tr, isolate::TestCloseWhileSending);
+    RUN_TEST(tr, isolate::TestReceiveWaitsForSlowSender);
+    RUN_TEST(tr, isolate::TestDeepCopy);
+    RUN_TEST(tr, isolate::TestDeepCopyKeepsNonOwningReferences);
+    RUN_TEST(tr, isolate::TestDeepMove);
+    RUN_TEST(tr, isolate::TestSpawnWithChannels);
+    RUN_TEST(tr, isolate::TestSpawnCopiesValues);
+    RUN_TEST(tr, isolate::TestCyclesMoveBetweenIsolates);
+    RUN_TEST(tr, isolate::TestProgramClassShadowsChannel);
+    RUN_TEST(tr, isolate::TestSpawnErrors);
+}
+
+}  // namespace isolate
@@ -0,0 +1,580 @@
+#include "jit.h"
+
+#include "parse.h"
+#include "statement.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <optional>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+using namespace std;
+
+namespace jit {
+
+	namespace {
+		using runtime::Closure;
+		using runtime::Context;
+		using runtime::ObjectHolder;
+
+		// What the code and the helpers it calls return
+		enum Status : int {
+			NEXT = 0,
+			// The result of the frame is set
+			RETURNED = 1,
+			// The error of the frame is set
+			FAILED = 2,
+		};
+
+		// Passed to the code in rdi. Helpers that read a number put it into number
+		struct Frame {
+			int number;
+			Closure* closure;
+			Context* context;
+			ObjectHolder* result;
+			exception_ptr* error;
+		};
+
+		static_assert(offsetof(Frame, number) == 0);
+
+		// Helpers called by the code. The code has no unwind info, so no exception may leave them
+
+		template <typename Function>
+		int Guard(Frame* frame, Function function) noexcept {
+			try{
+				return function();
+			}catch(ObjectHolder& value) {
+				*frame->result = std::move(value);
+				return RETURNED;
+			}catch(...) {
+				*frame->error = current_exception();
+				return FAILED;
+			}
+		}
+
+		int RunStatement(Frame* frame, const ast::Statement* node) noexcept {
+			return Guard(frame, [&] {
+				node->Execute(*frame->closure, *frame->context);
+				return NEXT;
+			});
+		}
+
+		int ReturnValue(Frame* frame, const ast::Statement* value) noexcept {
+			return Guard(frame, [&] {
+				*frame->result = value->Execute(*frame->closure, *frame->context);
+				return RETURNED;
+			});
+		}
+
+		int ReturnNumber(Frame* frame, int value) noexcept {
+			return Guard(frame, [&] {
+				*frame->result = ObjectHolder::Own(runtime::Number{value});
+				return RETURNED;
+			});
+		}
+
+		// Returns 0 or 1 for the truth of the condition, FAILED when evaluating it throws
+		int TestCondition(Frame* frame, const ast::Statement* condition) noexcept {
+			return Guard(frame, [&] {
+				return runtime::IsTrue(condition->Execute(*frame->closure, *frame->context)) ? 1 : 0;
+			});
+		}
+
+		// Returns 1 when the variable isn't a number. The code then runs the whole statement
+		// in the interpreter, which reports any error
+		int LoadNumber(Frame* frame, const ast::VariableValue* variable) noexcept {
+			try{
+				auto value = variable->Execute(*frame->closure, *frame->context);
+				if (const auto* number = value.TryAs<runtime::Number>()){
+					frame->number = number->GetValue();
+					return 0;
+				}
+			}catch(...) {
+			}
+			return 1;
+		}
+
+		int StoreNumber(Frame* frame, const ast::Assignment* assignment, int value) noexcept {
+			return Guard(frame, [&] {
+				(*frame->closure)[assignment->GetVarName()] = ObjectHolder::Own(runtime::Number{value});
+				return NEXT;
+			});
+		}
+
+		// Any object but an instance is left to the interpreter, which reports the error.
+		// Evaluating the value again doesn't change anything
+		int StoreField(Frame* frame, const ast::FieldAssignment* assignment, int value) noexcept {
+			return Guard(frame, [&] {
+				auto object = assignment->GetObject().Execute(*frame->closure, *frame->context);
+				auto instance = object.TryAs<runtime::ClassInstance>();
+				if (instance == nullptr){
+					assignment->Execute(*frame->closure, *frame->context);
+				}else{
+					instance->Fields()[assignment->GetFieldName()] = ObjectHolder::Own(runtime::Number{value});
+				}
+				return NEXT;
+			});
+		}
+
+		// Emits machine code with jumps to labels, which are resolved by Finish
+		class Assembler {
+		public:
+			using Label = size_t;
+
+			// Second opcode byte of the jumps taken on the flags of cmp
+			enum Condition : uint8_t {
+				EQUAL = 0x84,
+				NOT_EQUAL = 0x85,
+				LESS = 0x8C,
+				GREATER_OR_EQUAL = 0x8D,
+				LESS_OR_EQUAL = 0x8E,
+				GREATER = 0x8F,
+			};
+
+			Label NewLabel() {
+				labels_.push_back(UNBOUND);
+				return labels_.size() - 1;
+			}
+
+			void Bind(Label label) {
+				labels_[label] = code_.size();
+			}
+
+			void Emit(initializer_list<uint8_t> bytes) {
+				code_.insert(code_.end(), bytes);
+			}
+
+			void Emit32(uint32_t value) {
+				for (int i = 0; i < 4; ++i){
+					code_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+				}
+			}
+
+			void Emit64(uint64_t value) {
+				for (int i = 0; i < 8; ++i){
+					code_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+				}
+			}
+
+			void Jump(Label target) {
+				Emit({0xE9});
+				AddFixup(target);
+			}
+
+			void JumpIf(Condition condition, Label target) {
+				Emit({0x0F, condition});
+				AddFixup(target);
+			}
+
+			vector<uint8_t> Finish() {
+				for (const auto& [offset, label] : fixups_){
+					assert(labels_[label] != UNBOUND);
+					const auto relative = static_cast<uint32_t>(labels_[label] - (offset + 4));
+					for (int i = 0; i < 4; ++i){
+						code_[offset + i] = static_cast<uint8_t>(relative >> (8 * i));
+					}
+				}
+				return std::move(code_);
+			}
+
+		private:
+			static constexpr size_t UNBOUND = static_cast<size_t>(-1);
+
+			void AddFixup(Label target) {
+				fixups_.emplace_back(code_.size(), target);
+				Emit32(0);
+			}
+
+			vector<uint8_t> code_;
+			vector<size_t> labels_;
+			vector<pair<size_t, Label>> fixups_;
+		};
+
+		using Label = Assembler::Label;
+
+		// Numbers are computed in eax and ecx with 32-bit instructions, so they wrap like the
+		// int of runtime::Number. r12 holds the frame and r13 the stack pointer between
+		// statements, so that a slow path may drop the operands pushed so far
+		class BodyCompiler {
+		public:
+			explicit BodyCompiler(CompiledBody::Stats& stats)
+				: stats_(stats)
+			{}
+
+			vector<uint8_t> Compile(const ast::MethodBody& body) {
+				exit_ = as_.NewLabel();
+				// rbx is saved only to keep the stack aligned for calls
+				as_.Emit({0x53, 0x41, 0x54, 0x41, 0x55});        // push rbx; push r12; push r13
+				as_.Emit({0x49, 0x89, 0xFC});                    // mov r12, rdi
+				as_.Emit({0x49, 0x89, 0xE5});                    // mov r13, rsp
+				CompileStatement(body.GetBody());
+				as_.Emit({0x31, 0xC0});                          // xor eax, eax
+				as_.Bind(exit_);
+				as_.Emit({0x4C, 0x89, 0xEC});                    // mov rsp, r13
+				as_.Emit({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});  // pop r13; pop r12; pop rbx; ret
+				return as_.Finish();
+			}
+
+		private:
+			// Deeper operations are left to the interpreter, which keeps the pushed operands few
+			static constexpr size_t MAX_DEPTH = 32;
+
+			static bool IsOperation(const ast::Statement& node) {
+				return (dynamic_cast<const ast::Add*>(&node) != nullptr
+						&& dynamic_cast<const ast::StringConcatenation*>(&node) == nullptr)
+					|| dynamic_cast<const ast::Sub*>(&node) != nullptr
+					|| dynamic_cast<const ast::Mult*>(&node) != nullptr
+					|| dynamic_cast<const ast::Div*>(&node) != nullptr;
+			}
+
+			// Arithmetic on numeric constants and variables. Whether the variables hold numbers
+			// is checked when the code runs
+			static bool IsArithmetic(const ast::Statement& node, size_t depth = 0) {
+				if (dynamic_cast<const ast::NumericConst*>(&node) != nullptr
+						|| dynamic_cast<const ast::VariableValue*>(&node) != nullptr){
+					return true;
+				}
+				if (depth == MAX_DEPTH || !IsOperation(node)){
+					return false;
+				}
+				const auto& operation = static_cast<const ast::BinaryOperation&>(node);
+				return IsArithmetic(operation.GetLhs(), depth + 1) && IsArithmetic(operation.GetRhs(), depth + 1);
+			}
+
+			static bool IsArithmeticOperation(const ast::Statement& node) {
+				return IsOperation(node) && IsArithmetic(node);
+			}
+
+			// The jump taken when the comparison of two numbers is false
+			static optional<Assembler::Condition> GetJumpIfFalse(const ast::Comparison& comparison) {
+				using RuntimeComparator = bool (*)(const ObjectHolder&, const ObjectHolder&, Context&);
+				const auto* comparator = comparison.GetComparator().target<RuntimeComparator>();
+				if (comparator == nullptr){
+					return nullopt;
+				}
+				if (*comparator == runtime::Equal){
+					return Assembler::NOT_EQUAL;
+				}
+				if (*comparator == runtime::NotEqual){
+					return Assembler::EQUAL;
+				}
+				if (*comparator == runtime::Less){
+					return Assembler::GREATER_OR_EQUAL;
+				}
+				if (*comparator == runtime::Greater){
+					return Assembler::LESS_OR_EQUAL;
+				}
+				if (*comparator == runtime::LessOrEqual){
+					return Assembler::GREATER;
+				}
+				if (*comparator == runtime::GreaterOrEqual){
+					return Assembler::LESS;
+				}
+				return nullopt;
+			}
+
+			template <typename Helper>
+			void CallHelper(Helper helper, const void* argument) {
+				const bool pad = pushed_ % 2 != 0;
+				if (pad){
+					as_.Emit({0x48, 0x83, 0xEC, 0x08});          // sub rsp, 8
+				}
+				as_.Emit({0x4C, 0x89, 0xE7});                    // mov rdi, r12
+				if (argument != nullptr){
+					as_.Emit({0x48, 0xBE});                      // mov rsi, argument
+					as_.Emit64(reinterpret_cast<uint64_t>(argument));
+				}
+				as_.Emit({0x48, 0xB8});                          // mov rax, helper
+				as_.Emit64(reinterpret_cast<uint64_t>(helper));
+				as_.Emit({0xFF, 0xD0});                          // call rax
+				if (pad){
+					as_.Emit({0x48, 0x83, 0xC4, 0x08});          // add rsp, 8
+				}
+			}
+
+			void ExitUnlessNext() {
+				as_.Emit({0x85, 0xC0});                          // test eax, eax
+				as_.JumpIf(Assembler::NOT_EQUAL, exit_);
+			}
+
+			void DropOperands() {
+				as_.Emit({0x4C, 0x89, 0xEC});                    // mov rsp, r13
+			}
+
+			void CompileStatement(const ast::Statement& node) {
+				if (const auto* compound = dynamic_cast<const ast::Compound*>(&node)){
+					for (const auto& statement : compound->GetStatements()){
+						CompileStatement(*statement);
+					}
+					return;
+				}
+
+				++stats_.statements;
+				if (const auto* ret = dynamic_cast<const ast::Return*>(&node)){
+					CompileReturn(*ret);
+				}else if (const auto* if_else = dynamic_cast<const ast::IfElse*>(&node)){
+					CompileIfElse(*if_else);
+				}else if (const auto* assignment = dynamic_cast<const ast::Assignment*>(&node);
+						assignment != nullptr && IsArithmeticOperation(assignment->GetValue())){
+					CompileStore(*assignment, &StoreNumber);
+				}else if (const auto* field = dynamic_cast<const ast::FieldAssignment*>(&node);
+						field != nullptr && IsArithmeticOperation(field->GetValue())){
+					CompileStore(*field, &StoreField);
+				}else{
+					CallHelper(&RunStatement, &node);
+					ExitUnlessNext();
+					return;
+				}
+				++stats_.compiled_statements;
+			}
+
+			void CompileReturn(const ast::Return& ret) {
+				const auto& value = ret.GetStatement();
+				if (IsArithmeticOperation(value)){
+					const Label slow = as_.NewLabel();
+					CompileNumber(value, slow);
+					as_.Emit({0x89, 0xC6});                      // mov esi, eax
+					CallHelper(&ReturnNumber, nullptr);
+					as_.Jump(exit_);
+					as_.Bind(slow);
+					DropOperands();
+				}
+				CallHelper(&ReturnValue, &value);
+				as_.Jump(exit_);
+			}
+
+			template <typename Assignment, typename Store>
+			void CompileStore(const Assignment& assignment, Store store) {
+				const Label slow = as_.NewLabel();
+				const Label done = as_.NewLabel();
+				CompileNumber(assignment.GetValue(), slow);
+				as_.Emit({0x89, 0xC2});                          // mov edx, eax
+				CallHelper(store, &assignment);
+				ExitUnlessNext();
+				as_.Jump(done);
+				as_.Bind(slow);
+				DropOperands();
+				CallHelper(&RunStatement, &assignment);
+				ExitUnlessNext();
+				as_.Bind(done);
+			}
+
+			void CompileIfElse(const ast::IfElse& if_else) {
+				const Label then = as_.NewLabel();
+				const Label otherwise = as_.NewLabel();
+				const Label end = as_.NewLabel();
+
+				const auto& condition = if_else.GetCondition();
+				const auto* comparison = dynamic_cast<const ast::Comparison*>(&condition);
+				const auto jump_if_false = comparison != nullptr ? GetJumpIfFalse(*comparison) : nullopt;
+				if (jump_if_false && IsArithmetic(comparison->GetLhs()) && IsArithmetic(comparison->GetRhs())){
+					const Label slow = as_.NewLabel();
+					CompileOperands(*comparison, slow);
+					as_.Emit({0x39, 0xC8});                      // cmp eax, ecx
+					as_.JumpIf(*jump_if_false, otherwise);
+					as_.Jump(then);
+					as_.Bind(slow);
+					DropOperands();
+				}
+				CallHelper(&TestCondition, &condition);
+				as_.Emit({0x83, 0xF8, 0x01});                    // cmp eax, 1
+				as_.JumpIf(Assembler::EQUAL, then);
+				ExitUnlessNext();
+
+				as_.Bind(otherwise);
+				if (const auto* else_body = if_else.GetElseBody()){
+					CompileStatement(*else_body);
+				}
+				as_.Jump(end);
+				as_.Bind(then);
+				CompileStatement(if_else.GetIfBody());
+				as_.Bind(end);
+			}
+
+			// Leaves the left operand in eax and the right one in ecx
+			void CompileOperands(const ast::BinaryOperation& operation, Label slow) {
+				CompileNumber(operation.GetLhs(), slow);
+				as_.Emit({0x50});                                // push rax
+				++pushed_;
+				CompileNumber(operation.GetRhs(), slow);
+				as_.Emit({0x89, 0xC1});                          // mov ecx, eax
+				as_.Emit({0x58});                                // pop rax
+				--pushed_;
+			}
+
+			// Leaves the number in eax. Jumps to slow when a variable isn't a number or the
+			// division would fail
+			void CompileNumber(const ast::Statement& node, Label slow) {
+				if (const auto* constant = dynamic_cast<const ast::NumericConst*>(&node)){
+					as_.Emit({0xB8});                            // mov eax, value
+					as_.Emit32(static_cast<uint32_t>(constant->GetValue().TryAs<runtime::Number>()->GetValue()));
+					return;
+				}
+				if (const auto* variable = dynamic_cast<const ast::VariableValue*>(&node)){
+					CallHelper(&LoadNumber, variable);
+					as_.Emit({0x85, 0xC0});                      // test eax, eax
+					as_.JumpIf(Assembler::NOT_EQUAL, slow);
+					as_.Emit({0x41, 0x8B, 0x04, 0x24});          // mov eax, [r12]
+					return;
+				}
+
+				CompileOperands(static_cast<const ast::BinaryOperation&>(node), slow);
+				if (dynamic_cast<const ast::Add*>(&node) != nullptr){
+					as_.Emit({0x01, 0xC8});                      // add eax, ecx
+				}else if (dynamic_cast<const ast::Sub*>(&node) != nullptr){
+					as_.Emit({0x29, 0xC8});                      // sub eax, ecx
+				}else if (dynamic_cast<const ast::Mult*>(&node) != nullptr){
+					as_.Emit({0x0F, 0xAF, 0xC1});                // imul eax, ecx
+				}else{
+					const Label divide = as_.NewLabel();
+					as_.Emit({0x85, 0xC9});                      // test ecx, ecx
+					as_.JumpIf(Assembler::EQUAL, slow);
+					as_.Emit({0x83, 0xF9, 0xFF});                // cmp ecx, -1
+					as_.JumpIf(Assembler::NOT_EQUAL, divide);
+					as_.Emit({0x3D, 0x00, 0x00, 0x00, 0x80});    // cmp eax, INT_MIN
+					as_.JumpIf(Assembler::EQUAL, slow);
+					as_.Bind(divide);
+					as_.Emit({0x99, 0xF7, 0xF9});                // cdq; idiv ecx
+				}
+			}
+
+			CompiledBody::Stats& stats_;
+			Assembler as_;
+			Label exit_ = 0;
+			// Operands pushed since the statement began
+			size_t pushed_ = 0;
+		};
+	}
+
+	struct CompiledBody::Code {
+		using Entry = int (*)(Frame* frame);
+
+		Code(void* memory, size_t size)
+			: memory(memory)
+			, size(size)
+		{}
+
+		Code(const Code&) = delete;
+		Code& operator=(const Code&) = delete;
+
+		~Code() {
+#if JIT_SUPPORTED
+			munmap(memory, size);
+#endif
+		}
+
+		[[nodiscard]] Entry GetEntry() const {
+			return reinterpret_cast<Entry>(memory);
+		}
+
+		void* memory;
+		size_t size;
+	};
+
+	namespace {
+		atomic<uint32_t> current_threshold = 0;
+
+		// Copies the code to pages that are made executable once written
+		unique_ptr<CompiledBody::Code> Load([[maybe_unused]] const vector<uint8_t>& bytes) {
+#if JIT_SUPPORTED
+			const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			const size_t size = (bytes.size() + page_size - 1) / page_size * page_size;
+			void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED){
+				return nullptr;
+			}
+			auto code = make_unique<CompiledBody::Code>(memory, size);
+			memcpy(memory, bytes.data(), bytes.size());
+			if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0){
+				return nullptr;
+			}
+			return code;
+#else
+			return nullptr;
+#endif
+		}
+	}
+
+	bool IsSupported() {
+		return JIT_SUPPORTED != 0;
+	}
+
+	void Enable(uint32_t threshold) {
+		if (IsSupported()){
+			threshold = max(threshold, 1u);
+			runtime::SetMethodCompiler(&Compile, threshold);
+			current_threshold.store(threshold, memory_order_relaxed);
+		}
+	}
+
+	void Disable() {
+		runtime::SetMethodCompiler(nullptr, DEFAULT_THRESHOLD);
+		current_threshold.store(0, memory_order_relaxed);
+	}
+
+	uint32_t GetThreshold() {
+		return current_threshold.load(memory_order_relaxed);
+	}
+
+	CompiledBody::CompiledBody(unique_ptr<Code> code, Stats stats)
+		: code_(std::move(code))
+		, stats_(stats)
+	{}
+
+	CompiledBody::~CompiledBody() = default;
+
+	ObjectHolder CompiledBody::Execute(Closure& closure, Context& context) const {
+		ObjectHolder result;
+		exception_ptr error;
+		Frame frame{0, &closure, &context, &result, &error};
+		switch (code_->GetEntry()(&frame)){
+			case RETURNED:
+				return result;
+			case FAILED:
+				rethrow_exception(error);
+			default:
+				return ObjectHolder::None();
+		}
+	}
+
+	unique_ptr<runtime::Executable> Compile(const runtime::Executable& body) {
+		if (!IsSupported()){
+			return nullptr;
+		}
+		const runtime::Executable* parsed = &body;
+		if (const auto* lazy = dynamic_cast<const LazyMethodBody*>(&body)){
+			// A body that fails to parse reports the error when the interpreter runs it
+			try{
+				parsed = &lazy->GetBody();
+			}catch(const exception&) {
+				return nullptr;
+			}
+		}
+		const auto* method_body = dynamic_cast<const ast::MethodBody*>(parsed);
+		if (method_body == nullptr){
+			return nullptr;
+		}
+
+		CompiledBody::Stats stats;
+		const auto bytes = BodyCompiler(stats).Compile(*method_body);
+		auto code = Load(bytes);
+		if (code == nullptr){
+			return nullptr;
+		}
+		stats.code_size = bytes.size();
+		return make_unique<CompiledBody>(std::move(code), stats);
+	}
+}
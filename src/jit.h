@@ -0,0 +1,53 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <cstdint>
+#include <memory>
+
+// Baseline compiler of method bodies to x86-64 machine code. A method is compiled on its
+// threshold-th call, see runtime::MethodProfile. The code has a template for each kind of
+// statement and calls back into the interpreter for every node it has no template for
+namespace jit {
+
+	constexpr uint32_t DEFAULT_THRESHOLD = 100;
+
+	// False anywhere but on x86-64 Linux, where nothing is compiled
+	[[nodiscard]] bool IsSupported();
+
+	// Compiles methods once they are hot. Does nothing when the JIT isn't supported
+	void Enable(uint32_t threshold = DEFAULT_THRESHOLD);
+	void Disable();
+	// The threshold methods are compiled at, 0 when the JIT is disabled
+	[[nodiscard]] uint32_t GetThreshold();
+
+	// A method body together with the code that runs it
+	class CompiledBody final : public runtime::Executable {
+	public:
+		struct Code;
+
+		struct Stats {
+			size_t statements = 0;
+			// Statements run by their template rather than by the interpreter
+			size_t compiled_statements = 0;
+			size_t code_size = 0;
+		};
+
+		CompiledBody(std::unique_ptr<Code> code, Stats stats);
+		~CompiledBody() override;
+
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const Stats& GetStats() const {
+			return stats_;
+		}
+
+	private:
+		std::unique_ptr<Code> code_;
+		Stats stats_;
+	};
+
+	// Returns nullptr for a body that isn't a method body of the parser, when the JIT isn't
+	// supported or when the system doesn't allow executable memory
+	std::unique_ptr<runtime::Executable> Compile(const runtime::Executable& body);
+}
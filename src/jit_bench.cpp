@@ -0,0 +1,59 @@
+#include "bench_runner_p.h"
+#include "jit.h"
+#include "lexer.h"
+#include "parse.h"
+
+using namespace std;
+
+namespace jit {
+
+namespace {
+
+const string FIB_PROGRAM = R"(
+class Fib:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+f = Fib()
+x = f.fib(20)
+)"s;
+
+double RunProgram(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    auto tree = ParseProgram(lexer);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    return MeasureSeconds([&] {
+        tree->Execute(closure, context);
+    });
+}
+
+// The same recursive calls interpreted and compiled once hot
+void BenchmarkCompiledMethods() {
+    const uint32_t threshold = GetThreshold();
+
+    Disable();
+    const double interpreted_seconds = RunProgram(FIB_PROGRAM);
+    Enable();
+    const double compiled_seconds = RunProgram(FIB_PROGRAM);
+
+    if (threshold == 0) {
+        Disable();
+    } else {
+        Enable(threshold);
+    }
+    cerr << "  fib(20): interpreted "sv << interpreted_seconds * 1000 << " ms, compiled "sv
+         << compiled_seconds * 1000 << " ms"sv << (IsSupported() ? ""sv : " (not supported)"sv) << endl;
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, jit::BenchmarkCompiledMethods);
+}
+
+}  // namespace jit
@@ -0,0 +1,264 @@
+#include "jit.h"
+#include "lexer.h"
+#include "parse.h"
+#include "pass.h"
+#include "test_runner_p.h"
+#include "visitor.h"
+
+using namespace std;
+
+namespace jit {
+
+namespace {
+
+// Restores the threshold the tests were started with
+class ThresholdGuard {
+public:
+    ThresholdGuard()
+        : threshold_(GetThreshold()) {
+    }
+
+    ~ThresholdGuard() {
+        if (threshold_ == 0) {
+            Disable();
+        } else {
+            Enable(threshold_);
+        }
+    }
+
+private:
+    uint32_t threshold_;
+};
+
+// The output of the program followed by the error it stopped at, if any
+string RunProgram(const string& program, runtime::Closure& closure) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    auto tree = ParseProgram(lexer);
+
+    runtime::DummyContext context;
+    try {
+        tree->Execute(closure, context);
+    } catch (const runtime_error& e) {
+        context.output << "error: "sv << e.what() << '\n';
+    }
+    return context.output.str();
+}
+
+string RunProgram(const string& program) {
+    runtime::Closure closure;
+    return RunProgram(program, closure);
+}
+
+string RunInterpreted(const string& program) {
+    Disable();
+    return RunProgram(program);
+}
+
+// Every method is compiled on its first call
+string RunCompiled(const string& program) {
+    Enable(1);
+    return RunProgram(program);
+}
+
+const runtime::Method& GetMethod(const runtime::Class& cls, const string& method) {
+    return *cls.GetMethod(method);
+}
+
+const runtime::Method& GetMethod(const runtime::Closure& closure, const string& cls, const string& method) {
+    return GetMethod(*closure.at(cls).TryAs<runtime::Class>(), method);
+}
+
+const CompiledBody* GetCompiled(const runtime::Method& method) {
+    return dynamic_cast<const CompiledBody*>(method.profile.GetCompiled(*method.body));
+}
+
+const string ARITHMETIC = R"(
+class Calc:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+  def mix(a, b):
+    c = a * b - a / b
+    if c >= 10:
+      return c + 1
+    else:
+      if a == b:
+        return 0 - c
+    return c * 2
+
+  def nothing(x):
+    y = x + 1
+    print y
+
+  def count(n):
+    self.n = self.n + n
+    return self.n
+
+c = Calc()
+c.n = 0
+print c.fib(15), c.mix(7, 2), c.mix(1, 1), c.mix(2, 3), c.mix(-7, 2), c.nothing(1)
+print c.count(1), c.count(2), c.n
+)"s;
+
+const string DYNAMIC = R"(
+class Money:
+  def __init__(amount):
+    self.amount = amount
+
+  def __add__(other):
+    return self.amount + other.amount
+
+  def __str__():
+    return str(self.amount) + ' EUR'
+
+class Any:
+  def add(a, b):
+    return a + b
+
+  def less(a, b):
+    if a < b:
+      return 'less'
+    return 'not less'
+
+  def same(a, b):
+    if a == b:
+      return True
+    return False
+
+  def set(object, x):
+    object.v = x * 2
+    return object.v
+
+  def pick(flag, a, b):
+    if flag:
+      return a
+    return b
+
+a = Any()
+print a.add(1, 2), a.add('x', 'y'), a.add(Money(3), Money(4))
+print a.less(1, 2), a.less(2, 1), a.less('b', 'a'), a.less('a', 'b')
+print a.same(1, 1), a.same(None, None), a.same('a', 'a')
+print a.set(a, 4), a.v, a.pick(1, 'one', 'two'), a.pick('', 'one', 'two'), a.pick(None, 3, 4)
+)"s;
+
+const string ERRORS = R"(
+class Bad:
+  def div(a, b):
+    return a / b
+
+  def missing():
+    return nope + 1
+
+  def field(x):
+    x.f = x + 1
+
+b = Bad()
+print b.div(7, 2), b.div(-7, 2)
+)"s;
+
+void TestCompiledMethodsMatchInterpreter() {
+    ThresholdGuard guard;
+    for (const string& program : {ARITHMETIC, DYNAMIC}) {
+        ASSERT_EQUAL(RunCompiled(program), RunInterpreted(program));
+    }
+    ASSERT_EQUAL(RunCompiled(ARITHMETIC), "610 12 0 12 -22 2\nNone\n1 3 3\n"s);
+}
+
+void TestCompiledErrorsMatchInterpreter() {
+    ThresholdGuard guard;
+    for (const string& last : {"b.div(1, 0)"s, "b.missing()"s, "b.field(1)"s, "b.div('a', 1)"s}) {
+        const string program = ERRORS + "print "s + last + '\n';
+        const string compiled = RunCompiled(program);
+        ASSERT_EQUAL(compiled, RunInterpreted(program));
+        ASSERT(compiled.find("error: "sv) != string::npos);
+    }
+}
+
+void TestMethodsCompileAtThreshold() {
+    if (!IsSupported()) {
+        return;
+    }
+    ThresholdGuard guard;
+    Enable(3);
+    runtime::Closure closure;
+    ASSERT_EQUAL(RunProgram(ARITHMETIC + "print c.mix(1, 2)\nc.nothing(2)\nc.nothing(3)\n"s, closure),
+                 "610 12 0 12 -22 2\nNone\n1 3 3\n4\n3\n4\n"s);
+
+    const auto& fib = GetMethod(closure, "Calc"s, "fib"s);
+    ASSERT(GetCompiled(fib) != nullptr);
+    ASSERT_EQUAL(GetCompiled(fib)->GetStats().statements, 3U);
+    ASSERT_EQUAL(GetCompiled(fib)->GetStats().compiled_statements, 3U);
+    ASSERT(GetCompiled(fib)->GetStats().code_size > 0U);
+
+    // The print is run by the interpreter
+    const auto& nothing = GetMethod(closure, "Calc"s, "nothing"s);
+    ASSERT_EQUAL(GetCompiled(nothing)->GetStats().statements, 2U);
+    ASSERT_EQUAL(GetCompiled(nothing)->GetStats().compiled_statements, 1U);
+
+    // Called five times, counted up to the threshold
+    const auto& mix = GetMethod(closure, "Calc"s, "mix"s);
+    ASSERT_EQUAL(mix.profile.GetCalls(), 3U);
+    ASSERT(GetCompiled(mix) != nullptr);
+    ASSERT_EQUAL(GetCompiled(mix)->GetStats().statements, 6U);
+    ASSERT_EQUAL(GetCompiled(mix)->GetStats().compiled_statements, 6U);
+
+    // Called twice
+    ASSERT(GetCompiled(GetMethod(closure, "Calc"s, "count"s)) == nullptr);
+    ASSERT_EQUAL(GetMethod(closure, "Calc"s, "count"s).profile.GetCalls(), 2U);
+}
+
+void TestDisabledJitInterprets() {
+    ThresholdGuard guard;
+    Disable();
+    ASSERT_EQUAL(GetThreshold(), 0U);
+    runtime::Closure closure;
+    RunProgram(ARITHMETIC, closure);
+    const auto& fib = GetMethod(closure, "Calc"s, "fib"s);
+    ASSERT(GetCompiled(fib) == nullptr);
+    ASSERT_EQUAL(fib.profile.GetCalls(), 0U);
+}
+
+void TestPassesDropCompiledCode() {
+    if (!IsSupported()) {
+        return;
+    }
+    ThresholdGuard guard;
+    Enable(1);
+    istringstream input(ARITHMETIC);
+    parse::Lexer lexer(input);
+    unique_ptr<runtime::Executable> program = ParseProgram(lexer);
+    const auto run = [&program] {
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+        return context.output.str();
+    };
+    const string expected = run();
+    const auto& fib = GetMethod(*ast::CollectClasses(*program).front(), "fib"s);
+    ASSERT(GetCompiled(fib) != nullptr);
+
+    // Walking the tree only reads it
+    ASSERT(ast::CountNodes(*program) > 0U);
+    ASSERT(GetCompiled(fib) != nullptr);
+
+    passes::PassManager("infer-types,fuse-statements"sv).Run(program);
+    ASSERT(GetCompiled(fib) == nullptr);
+    ASSERT_EQUAL(fib.profile.GetCalls(), 0U);
+    ASSERT_EQUAL(run(), expected);
+    ASSERT(GetCompiled(fib) != nullptr);
+}
+
+}  // namespace
+
+void RunJitTests(TestRunner& tr) {
+    RUN_TEST(tr, jit::TestCompiledMethodsMatchInterpreter);
+    RUN_TEST(tr, jit::TestCompiledErrorsMatchInterpreter);
+    RUN_TEST(tr, jit::TestMethodsCompileAtThreshold);
+    RUN_TEST(tr, jit::TestDisabledJitInterprets);
+    RUN_TEST(tr, jit::TestPassesDropCompiledCode);
+}
+
+}  // namespace jit
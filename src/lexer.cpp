@@ -1,13 +1,131 @@
 #include "lexer.h"
 
+#include "char_class.h"
+
 #include <algorithm>
+#include <array>
 #include <charconv>
+#include <climits>
 #include <unordered_map>
 
 using namespace std;
 
 namespace parse {
 
+	namespace {
+		// Gives access to the characters a stream buffer has read ahead
+		class BufferWindow : public streambuf {
+		public:
+			static const char* Begin(streambuf& buffer) {
+				return (buffer.*&BufferWindow::gptr)();
+			}
+
+			static const char* End(streambuf& buffer) {
+				return (buffer.*&BufferWindow::egptr)();
+			}
+
+			static void Skip(streambuf& buffer, int count) {
+				(buffer.*&BufferWindow::gbump)(count);
+			}
+		};
+
+		// Takes the characters of the input before the first one at which find stops,
+		// appends them to out unless it is null and returns how many there were. find
+		// searches the characters the buffer has read ahead, those of an unbuffered input
+		// are looked at one at a time
+		template <typename Find>
+		size_t TakeUntil(streambuf& buffer, Find find, string* out) {
+			size_t taken = 0;
+			while (true){
+				if (BufferWindow::Begin(buffer) == BufferWindow::End(buffer)){
+					const int next = buffer.sgetc();
+					if (next == char_traits<char>::eof()){
+						return taken;
+					}
+					if (BufferWindow::Begin(buffer) == BufferWindow::End(buffer)){
+						const char ch = static_cast<char>(next);
+						if (find(&ch, &ch + 1) == &ch){
+							return taken;
+						}
+						if (out){
+							out->push_back(ch);
+						}
+						buffer.sbumpc();
+						++taken;
+						continue;
+					}
+				}
+
+				const char* begin = BufferWindow::Begin(buffer);
+				const char* end = begin + min<ptrdiff_t>(BufferWindow::End(buffer) - begin, INT_MAX);
+				const char* stop = find(begin, end);
+				if (out){
+					out->append(begin, stop);
+				}
+				BufferWindow::Skip(buffer, static_cast<int>(stop - begin));
+				taken += stop - begin;
+				if (stop != end){
+					return taken;
+				}
+			}
+		}
+
+		struct Keyword {
+			string_view word;
+			Token (*make)();
+		};
+
+		template <typename T>
+		Token MakeToken() {
+			return T{};
+		}
+
+		constexpr size_t KEYWORD_TABLE_SIZE = 16;
+
+		// Perfect for the keywords below: no two of them land in one slot of the table
+		constexpr size_t HashKeyword(string_view word) {
+			return (static_cast<unsigned char>(word.front()) + 11 * static_cast<unsigned char>(word.back())
+					+ 4 * word.size()) % KEYWORD_TABLE_SIZE;
+		}
+
+		constexpr auto KEYWORDS = []{
+			const Keyword keywords[] = {
+				{"class"sv, MakeToken<token_type::Class>},
+				{"return"sv, MakeToken<token_type::Return>},
+				{"if"sv, MakeToken<token_type::If>},
+				{"else"sv, MakeToken<token_type::Else>},
+				{"def"sv, MakeToken<token_type::Def>},
+				{"print"sv, MakeToken<token_type::Print>},
+				{"and"sv, MakeToken<token_type::And>},
+				{"or"sv, MakeToken<token_type::Or>},
+				{"not"sv, MakeToken<token_type::Not>},
+				{"None"sv, MakeToken<token_type::None>},
+				{"True"sv, MakeToken<token_type::True>},
+				{"False"sv, MakeToken<token_type::False>},
+			};
+			array<Keyword, KEYWORD_TABLE_SIZE> result{};
+			for (const Keyword& keyword : keywords){
+				Keyword& slot = result[HashKeyword(keyword.word)];
+				if (!slot.word.empty()){
+					throw logic_error("keyword hash collision");
+				}
+				slot = keyword;
+			}
+			return result;
+		}();
+	}
+
+	optional<Token> FindKeyword(string_view word) {
+		if (word.empty()){
+			return nullopt;
+		}
+		const Keyword& keyword = KEYWORDS[HashKeyword(word)];
+		if (keyword.word != word){
+			return nullopt;
+		}
+		return keyword.make();
+	}
+
 	bool operator==(const Token& lhs, const Token& rhs) {
 		using namespace token_type;
 
@@ -75,8 +193,9 @@ namespace parse {
 		return os << "Unknown token :("sv;
 	}
 
-	Lexer::Lexer(std::istream& input)
+	Lexer::Lexer(std::istream& input, const scan::Scanner& scanner)
 		: input_(input)
+		, scanner_(scanner)
 	{
 		while (input_.peek() == '\n'){
 			input_.get();
@@ -93,6 +212,10 @@ namespace parse {
 		return CurrentToken();
 	}
 
+	int Lexer::GetIndentation() const {
+		return count_indent_;
+	}
+
 	bool Lexer::CheckBeforeParse(){
 		if (current_token_ == token_type::Eof{}){
 			return false;
@@ -147,81 +270,58 @@ namespace parse {
 		}
 	}
 
-	// mb wrong
 	bool Lexer::ParseKeyword(const std::string& s){
-		if (s == "class"){
-			current_token_ = token_type::Class{};
-		}else if (s == "return"){
-			current_token_ = token_type::Return{};
-		}else if (s == "if"){
-			current_token_ = token_type::If{};
-		}else if (s == "else"){
-			current_token_ = token_type::Else{};
-		}else if (s == "def"){
-			current_token_ = token_type::Def{};
-		}else if (s == "print"){
-			current_token_ = token_type::Print{};
-		}else if (s == "and"){
-			current_token_ = token_type::And{};
-		}else if (s == "or"){
-			current_token_ = token_type::Or{};
-		}else if (s == "not"){
-			current_token_ = token_type::Not{};
-		}else if (s == "None"){
-			current_token_ = token_type::None{};
-		}else if (s == "True"){
-			current_token_ = token_type::True{};
-		}else if (s == "False"){
-			current_token_ = token_type::False{};
-		}else{
+		optional<Token> keyword = FindKeyword(s);
+		if (!keyword){
 			return false;
 		}
-
+		current_token_ = std::move(*keyword);
 		return true;
 	}
 
 	void Lexer::ParseString(char input){
 		std::string s;
-		for (char ch; (ch = static_cast<char>(input_.get())) != input;){
-			 if (ch == '\\'){
-				 const char escaped_char = static_cast<char>(input_.get());
-				 HandleCharCases(s, escaped_char, ch);
-			 }else{
-				 s.push_back(ch);
-			 }
+		streambuf& buffer = *input_.rdbuf();
+		const auto find_stop = [this, input](const char* begin, const char* end){
+			return scanner_.string_stop(begin, end, input);
+		};
+		while (true){
+			TakeUntil(buffer, find_stop, &s);
+			const int ch = buffer.sbumpc();
+			if (ch == input){
+				break;
+			}
+			// Otherwise it is '\\'
+			const int escaped_char = ch == char_traits<char>::eof() ? ch : buffer.sbumpc();
+			if (escaped_char == char_traits<char>::eof()){
+				throw LexerError("unterminated string"s);
+			}
+			HandleCharCases(s, static_cast<char>(escaped_char), static_cast<char>(ch));
 		}
-		current_token_ = token_type::String{s};
+		current_token_ = token_type::String{std::move(s)};
 	}
 
 	void Lexer::ParseNumber(){
 		std::string parsed_num;
-		while (isdigit(input_.peek())){
-			parsed_num += static_cast<char>(input_.get());
-		}
+		TakeUntil(*input_.rdbuf(), scanner_.digits_end, &parsed_num);
 		current_token_ = token_type::Number{std::stoi(parsed_num)};
 	}
 
 	void Lexer::ParseIdentifier(){
 		std::string s;
-		while (isalnum(input_.peek()) || input_.peek() == '_'){
-			s += static_cast<char>(input_.get());
-		}
+		TakeUntil(*input_.rdbuf(), scanner_.identifier_end, &s);
 		if(!ParseKeyword(s)){
-			current_token_ = token_type::Id{s};
+			current_token_ = token_type::Id{std::move(s)};
 		}
 	}
 
 	void Lexer::ParseIndent(){
+		const size_t spaces = TakeUntil(*input_.rdbuf(), scanner_.spaces_end, nullptr);
 		if (!current_token_.Is<token_type::Newline>()){
-			input_.get();
 			return ParseToken();
 		}
 
-		int count_spaces = 0;
-		while (input_.peek() == ' '){
-			++count_spaces;
-			input_.get();
-		}
+		const int count_spaces = static_cast<int>(spaces);
 
 		if (count_spaces == count_indent_){
 			is_code_block_ = true;
@@ -280,8 +380,9 @@ namespace parse {
 
 		const char ch = static_cast<char>(input_.get());
 		if (ch == '#'){
-			std::string temp;
-			getline(input_, temp);
+			streambuf& buffer = *input_.rdbuf();
+			TakeUntil(buffer, scanner_.line_end, nullptr);
+			buffer.sbumpc();
 			current_token_ = token_type::Newline{};
 			if (is_start_line_){
 				ParseToken();
@@ -309,10 +410,10 @@ namespace parse {
 			return;
 		}else if (ch == '\'' || ch == '\"'){
 			ParseString(ch);
-		}else if (isdigit(ch)){
+		}else if (chars::IsDigit(ch)){
 			input_.putback(ch);
 			ParseNumber();
-		}else if (isalpha(ch) || ch == '_'){
+		}else if (chars::IsIdentifierStart(ch)){
 			input_.putback(ch);
 			ParseIdentifier();
 		}else if (ch == ' '){
@@ -1,10 +1,13 @@
 #pragma once
 
+#include "scan.h"
+
 #include <iosfwd>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <variant>
 
 namespace parse {
@@ -81,26 +84,30 @@ namespace parse {
 
 	std::ostream& operator<<(std::ostream& os, const Token& rhs);
 
+	// The token of a keyword, nothing for any other word
+	std::optional<Token> FindKeyword(std::string_view word);
+
 	class LexerError : public std::runtime_error {
 	public:
 		using std::runtime_error::runtime_error;
 	};
 
-	class Lexer {
+	// Sequence of tokens the parser reads from
+	class TokenStream {
 	public:
-		explicit Lexer(std::istream& input);
+		virtual ~TokenStream() = default;
 
-		[[nodiscard]] const Token& CurrentToken() const;
+		[[nodiscard]] virtual const Token& CurrentToken() const = 0;
 
-		Token NextToken();
+		virtual Token NextToken() = 0;
 
 		template <typename T>
 		const T& Expect() const {
 			using namespace std::literals;
-			if (!current_token_.Is<T>()){
+			if (!CurrentToken().Is<T>()){
 				throw LexerError("token type error"s);
 			}
-			return current_token_.As<T>();
+			return CurrentToken().As<T>();
 		}
 
 		template <typename T, typename U>
@@ -124,6 +131,21 @@ namespace parse {
 				throw LexerError("next token value error"s);
 			}
 		}
+	};
+
+	class Lexer : public TokenStream {
+	public:
+		// The scanner searches the input for the ends of strings, identifiers, numbers,
+		// comments and indentation
+		explicit Lexer(std::istream& input, const scan::Scanner& scanner = scan::Best());
+
+		[[nodiscard]] const Token& CurrentToken() const override;
+
+		Token NextToken() override;
+
+		// Spaces of indentation of the current block. At the end of the input every block is
+		// closed and it is zero, unless the indentation of the input was inconsistent
+		[[nodiscard]] int GetIndentation() const;
 
 	private:
 		bool CheckBeforeParse();
@@ -138,6 +160,7 @@ namespace parse {
 
 	private:
 		std::istream& input_;
+		const scan::Scanner& scanner_;
 		Token current_token_{};
 		int count_indent_ = 0;
 		int dedent_count_ = 0;
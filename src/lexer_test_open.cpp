@@ -350,6 +350,17 @@ abc#
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
     }
 }
+void TestKeywordLookalikes() {
+    // Words of the lengths of keywords and sharing their first and last letters
+    for (const string& word : {"classs"s, "cls"s, "If"s, "iff"s, "elze"s, "dEf"s, "pint"s, "ad"s, "o"s,
+                               "nut"s, "NONE"s, "Tree"s, "Falls"s, "_"s}) {
+        ASSERT(!FindKeyword(word));
+        istringstream input(word);
+        ASSERT_EQUAL(Lexer(input).CurrentToken(), Token(token_type::Id{word}));
+    }
+    ASSERT_EQUAL(*FindKeyword("False"sv), Token(token_type::False{}));
+    ASSERT(!FindKeyword(""sv));
+}
 }  // namespace
 
 void RunOpenLexerTests(TestRunner& tr) {
@@ -366,6 +377,7 @@ void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestMythonProgram);
     RUN_TEST(tr, parse::TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine);
     RUN_TEST(tr, parse::TestCommentsAreIgnored);
+    RUN_TEST(tr, parse::TestKeywordLookalikes);
 }
 
 }  // namespace parse
@@ -1,25 +1,89 @@
+#include "batch.h"
+#include "checkpoint.h"
+#include "image.h"
+#include "jit.h"
 #include "lexer.h"
 #include "parse.h"
+#include "pass.h"
 #include "runtime.h"
+#include "server.h"
+#include "snapshot.h"
 #include "statement.h"
 #include "test_runner_p.h"
+#include "bench_runner_p.h"
 
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <string_view>
+#include <thread>
 
 using namespace std;
 
 namespace parse {
 void RunOpenLexerTests(TestRunner& tr);
+void RunTokenPipelineTests(TestRunner& tr);
+void RunParallelLexerTests(TestRunner& tr);
+void RunScanTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
 }  // namespace parse
 
 namespace ast {
 void RunUnitTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
 }
 namespace runtime {
 void RunObjectHolderTests(TestRunner& tr);
 void RunObjectsTests(TestRunner& tr);
 }  // namespace runtime
 
+namespace batch {
+void RunBatchTests(TestRunner& tr);
+}  // namespace batch
+
+namespace incremental {
+void RunIncrementalTests(TestRunner& tr);
+}  // namespace incremental
+
+namespace passes {
+void RunPassTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
+}  // namespace passes
+
+namespace checkpoint {
+void RunCheckpointTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
+}  // namespace checkpoint
+
+namespace isolate {
+void RunIsolateTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
+}  // namespace isolate
+
+namespace image {
+void RunImageTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
+}  // namespace image
+
+namespace snapshot {
+void RunSnapshotTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
+}  // namespace snapshot
+
+namespace jit {
+void RunJitTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
+}  // namespace jit
+
+namespace server {
+void RunServerTests(TestRunner& tr);
+void RunProgramCacheTests(TestRunner& tr);
+void RunBenchmarks(BenchmarkRunner& br);
+}  // namespace server
+
 void TestParseProgram(TestRunner& tr);
 
 namespace {
@@ -114,10 +178,23 @@ print y.value
 void TestAll() {
     TestRunner tr;
     parse::RunOpenLexerTests(tr);
+    parse::RunTokenPipelineTests(tr);
+    parse::RunParallelLexerTests(tr);
+    parse::RunScanTests(tr);
     runtime::RunObjectHolderTests(tr);
     runtime::RunObjectsTests(tr);
     ast::RunUnitTests(tr);
     TestParseProgram(tr);
+    passes::RunPassTests(tr);
+    incremental::RunIncrementalTests(tr);
+    checkpoint::RunCheckpointTests(tr);
+    batch::RunBatchTests(tr);
+    isolate::RunIsolateTests(tr);
+    server::RunServerTests(tr);
+    server::RunProgramCacheTests(tr);
+    image::RunImageTests(tr);
+    snapshot::RunSnapshotTests(tr);
+    jit::RunJitTests(tr);
 
     RUN_TEST(tr, TestSimplePrints);
     RUN_TEST(tr, TestAssignments);
@@ -125,6 +202,303 @@ void TestAll() {
     RUN_TEST(tr, TestVariablesArePointers);
 }
 
+void BenchmarkAll() {
+    BenchmarkRunner br;
+    parse::RunBenchmarks(br);
+    ast::RunBenchmarks(br);
+    isolate::RunBenchmarks(br);
+    server::RunBenchmarks(br);
+    image::RunBenchmarks(br);
+    snapshot::RunBenchmarks(br);
+    checkpoint::RunBenchmarks(br);
+    passes::RunBenchmarks(br);
+    jit::RunBenchmarks(br);
+}
+
+// --run <script>
+// Runs the script from its image when the image is up to date, see image::LoadProgram
+int RunScriptWithImage(const char* script) {
+    try {
+        auto program = image::LoadProgram(script);
+        runtime::SimpleContext context{cout};
+        runtime::Closure closure;
+        program->Execute(closure, context);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// --passes <pipeline> <script>
+// Runs the script after the passes of the pipeline, see passes::PassManager. Prints the time
+// and the node count change of every pass to stderr
+int RunWithPasses(const char* pipeline, const char* script) {
+    try {
+        ifstream input(script);
+        if (!input) {
+            throw runtime_error("Cannot open script "s + script);
+        }
+        passes::PassManager manager(pipeline);
+        parse::Lexer lexer(input);
+        auto program = ParseProgram(lexer);
+        passes::PrintPassStats(cerr, manager.Run(program));
+        runtime::SimpleContext context{cout};
+        runtime::Closure closure;
+        program->Execute(closure, context);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// --stream [script]
+// Runs every top-level statement of the script, or of stdin, as soon as it is parsed
+int RunStreaming(const char* script) {
+    try {
+        ifstream file;
+        if (script != nullptr) {
+            file.open(script);
+            if (!file) {
+                throw runtime_error("Cannot open script "s + script);
+            }
+        }
+        parse::Lexer lexer(script != nullptr ? file : cin);
+        StatementStream stream(lexer);
+        runtime::SimpleContext context{cout};
+        runtime::Closure closure;
+        while (auto statement = stream.Next()) {
+            statement->Execute(closure, context);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// --watch <script>
+// Runs the script every time it is saved, resuming from the statements unchanged since the
+// previous run
+int WatchScript(const char* script) {
+    checkpoint::Runner runner;
+    filesystem::file_time_type last_run;
+    while (true) {
+        error_code error;
+        const auto modified = filesystem::last_write_time(script, error);
+        if (!error && modified != last_run) {
+            last_run = modified;
+            try {
+                ifstream input(script);
+                const auto stats = runner.Run(input, cout);
+                cerr << "resumed "sv << stats.resumed_statements << " of "sv << stats.statements << " statements"sv
+                     << endl;
+            } catch (const std::exception& e) {
+                cerr << e.what() << endl;
+            }
+        }
+        this_thread::sleep_for(chrono::milliseconds(200));
+    }
+}
+
+// --snapshot <init-script> <snapshot>
+// Runs the initialization script and saves the heap it has built
+int SaveHeapSnapshot(const char* init_script, const char* snapshot_path) {
+    try {
+        ifstream input(init_script);
+        if (!input) {
+            throw runtime_error("Cannot open script "s + init_script);
+        }
+        parse::Lexer lexer(input);
+        auto program = ParseProgram(lexer);
+        runtime::SimpleContext context{cout};
+        runtime::Closure globals;
+        program->Execute(globals, context);
+        snapshot::SaveSnapshot(globals, filesystem::path(snapshot_path));
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// --restore <snapshot> <script>
+// Runs the script with the globals and classes of the snapshot
+int RunFromSnapshot(const char* snapshot_path, const char* script) {
+    try {
+        auto heap = snapshot::Snapshot::LoadFile(snapshot_path);
+        ifstream input(script);
+        if (!input) {
+            throw runtime_error("Cannot open script "s + script);
+        }
+        parse::Lexer lexer(input);
+        auto program = ParseProgram(lexer, heap.GetClasses());
+        runtime::SimpleContext context{cout};
+        program->Execute(heap.GetGlobals(), context);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// The value of a numeric option. Prints a usage error and returns false unless the whole
+// value is a number of at least min
+bool ParseNumber(string_view option, string_view value, size_t min, size_t& number) {
+    size_t parsed = 0;
+    const auto [end, error] = from_chars(value.data(), value.data() + value.size(), parsed);
+    if (error != errc{} || end != value.data() + value.size() || parsed < min) {
+        cerr << "Invalid "sv << option << ' ' << value << ", expected a number from "sv << min << " to "sv
+             << numeric_limits<size_t>::max() << endl;
+        return false;
+    }
+    number = parsed;
+    return true;
+}
+
+// --batch <directory|manifest> [--jobs N] [--output-dir DIR]
+// Outputs go to DIR/<script path>.out, or to stdout when no directory is given.
+// The latency and throughput summary is printed to stderr
+int RunBatch(int argc, char* argv[]) {
+    try {
+        filesystem::path source = argv[2];
+        size_t jobs = thread::hardware_concurrency();
+        filesystem::path output_dir;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            if (argv[i] == "--jobs"sv) {
+                if (!ParseNumber(argv[i], argv[i + 1], 1, jobs)) {
+                    return 1;
+                }
+            } else if (argv[i] == "--output-dir"sv) {
+                output_dir = argv[i + 1];
+            } else {
+                cerr << "Unknown option "sv << argv[i] << endl;
+                return 1;
+            }
+        }
+
+        batch::Summary summary;
+        const auto results = batch::RunScripts(batch::CollectScripts(source), jobs, &summary);
+
+        const filesystem::path base = filesystem::is_directory(source) ? source : source.parent_path();
+        for (const auto& result : results) {
+            if (output_dir.empty()) {
+                cout << "==> "sv << result.path.string() << " <==\n"sv << result.output;
+            } else {
+                filesystem::path output_file = output_dir / result.path.lexically_relative(base);
+                output_file += ".out"sv;
+                filesystem::create_directories(output_file.parent_path());
+                ofstream(output_file) << result.output;
+            }
+            if (!result.error.empty()) {
+                cerr << result.path.string() << ": "sv << result.error << '\n';
+            }
+        }
+        batch::PrintSummary(cerr, summary);
+        return summary.failed_count == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// --serve <prelude> <socket> [--requests N]
+// Runs the prelude once and serves every request in a process forked from it.
+// A line per request and a summary at the end are printed to stderr
+int RunServer(int argc, char* argv[]) {
+    try {
+        size_t requests = 0;
+        if (argc > 4 && argv[4] == "--requests"sv) {
+            if (!ParseNumber(argv[4], argc > 5 ? argv[5] : ""sv, 0, requests)) {
+                return 1;
+            }
+        } else if (argc > 4) {
+            cerr << "Unknown option "sv << argv[4] << endl;
+            return 1;
+        }
+
+        ifstream prelude(argv[2]);
+        if (!prelude) {
+            cerr << "Cannot open "sv << argv[2] << endl;
+            return 1;
+        }
+        server::ForkServer server(prelude, argv[3], &cerr);
+        server.Run(requests);
+        server::PrintReports(cerr, server.GetReports());
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// --daemon <socket> [--cache N] [--jobs N] [--requests N]
+// Runs every submitted script in-process against fresh globals, keeping up to N parsed
+// programs (64 by default). Request and cache statistics are printed to stderr at the end
+int RunDaemon(int argc, char* argv[]) {
+    try {
+        size_t cache_capacity = 64;
+        size_t jobs = thread::hardware_concurrency();
+        size_t requests = 0;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            bool parsed = false;
+            if (argv[i] == "--cache"sv) {
+                parsed = ParseNumber(argv[i], argv[i + 1], 1, cache_capacity);
+            } else if (argv[i] == "--jobs"sv) {
+                parsed = ParseNumber(argv[i], argv[i + 1], 1, jobs);
+            } else if (argv[i] == "--requests"sv) {
+                parsed = ParseNumber(argv[i], argv[i + 1], 0, requests);
+            } else {
+                cerr << "Unknown option "sv << argv[i] << endl;
+            }
+            if (!parsed) {
+                return 1;
+            }
+        }
+
+        server::Daemon daemon(argv[2], cache_capacity, jobs);
+        daemon.Run(requests);
+        server::PrintDaemonStats(cerr, daemon);
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// --submit <socket>
+// Sends the script from stdin to a server or a daemon and prints its output
+int SubmitScript(const char* socket_path) {
+    cout << server::Submit(socket_path, string(istreambuf_iterator<char>(cin), {}));
+    return 0;
+}
+
+// [--no-jit | --jit-threshold N] before any other argument
+// Methods are compiled to machine code on their Nth call, 100th by default, or never with
+// --no-jit. Returns the number of arguments taken, or -1 for a threshold that isn't a number
+// from 1 to 4294967295
+int ConfigureJit(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "--no-jit"sv) {
+        jit::Disable();
+        return 1;
+    }
+    if (argc > 1 && argv[1] == "--jit-threshold"sv) {
+        const string_view value = argc > 2 ? argv[2] : ""sv;
+        uint32_t threshold = 0;
+        const auto [end, error] = from_chars(value.data(), value.data() + value.size(), threshold);
+        if (error != errc{} || end != value.data() + value.size() || threshold == 0) {
+            cerr << "Invalid --jit-threshold "sv << value << ", expected a number from 1 to "sv
+                 << numeric_limits<uint32_t>::max() << endl;
+            return -1;
+        }
+        jit::Enable(threshold);
+        return 2;
+    }
+    jit::Enable();
+    return 0;
+}
+
 }  // namespace
 
 void Test() {
@@ -137,7 +511,49 @@ x = a.b
     ASSERT_THROWS(RunMythonProgram(input, output),  std::runtime_error);
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+	const int jit_args = ConfigureJit(argc, argv);
+	if (jit_args < 0) {
+		return 1;
+	}
+	argv[jit_args] = argv[0];
+	argc -= jit_args;
+	argv += jit_args;
+
+	if (argc > 1 && argv[1] == "--bench"sv) {
+		BenchmarkAll();
+		return 0;
+	}
+	if (argc > 2 && argv[1] == "--batch"sv) {
+		return RunBatch(argc, argv);
+	}
+	if (argc > 3 && argv[1] == "--serve"sv) {
+		return RunServer(argc, argv);
+	}
+	if (argc > 2 && argv[1] == "--daemon"sv) {
+		return RunDaemon(argc, argv);
+	}
+	if (argc > 1 && argv[1] == "--stream"sv) {
+		return RunStreaming(argc > 2 ? argv[2] : nullptr);
+	}
+	if (argc > 2 && argv[1] == "--watch"sv) {
+		return WatchScript(argv[2]);
+	}
+	if (argc > 3 && argv[1] == "--snapshot"sv) {
+		return SaveHeapSnapshot(argv[2], argv[3]);
+	}
+	if (argc > 3 && argv[1] == "--restore"sv) {
+		return RunFromSnapshot(argv[2], argv[3]);
+	}
+	if (argc > 3 && argv[1] == "--passes"sv) {
+		return RunWithPasses(argv[2], argv[3]);
+	}
+	if (argc > 2 && argv[1] == "--run"sv) {
+		return RunScriptWithImage(argv[2]);
+	}
+	if (argc > 2 && argv[1] == "--submit"sv) {
+		return SubmitScript(argv[2]);
+	}
 	Test();
 	/*
     try {
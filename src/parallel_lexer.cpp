@@ -0,0 +1,163 @@
+#include "parallel_lexer.h"
+
+#include "char_class.h"
+#include "thread_pool.h"
+
+#include <exception>
+#include <istream>
+#include <streambuf>
+
+using namespace std;
+
+namespace parse {
+
+	namespace {
+		// Lets a Lexer read a part of the source without copying it
+		class MemoryBuffer : public streambuf {
+		public:
+			explicit MemoryBuffer(string_view data) {
+				char* begin = const_cast<char*>(data.data());  // NOLINT: only read
+				setg(begin, begin, begin + data.size());
+			}
+		};
+
+		struct Part {
+			vector<Token> tokens;
+			// Otherwise the Lexer doesn't start the next part in the state of a new one
+			bool closes_blocks = false;
+			exception_ptr error;
+		};
+
+		Part LexPart(string_view text) {
+			Part result;
+			try {
+				MemoryBuffer buffer(text);
+				istream input(&buffer);
+				Lexer lexer(input);
+
+				result.tokens.push_back(lexer.CurrentToken());
+				while (!result.tokens.back().Is<token_type::Eof>()){
+					result.tokens.push_back(lexer.NextToken());
+				}
+				result.closes_blocks = lexer.GetIndentation() == 0;
+			} catch (...) {
+				result.error = current_exception();
+			}
+			return result;
+		}
+
+		bool StartsStatement(char ch) {
+			return chars::IsIdentifierStart(ch);
+		}
+	}
+
+	vector<size_t> SplitSource(string_view source, size_t min_part_size) {
+		vector<size_t> result{0};
+
+		// Whether the lines since the last line of code leave the Lexer at the start of a
+		// line, outside of a block of its own making: empty lines and comments starting
+		// at the first column do. Comments after code, spaces at the end of a line and
+		// lines of spaces don't
+		bool after_code = false;
+		bool line_has_code = false;
+		size_t line_begin = 0;
+		size_t position = 0;
+		const auto start_line = [&](size_t begin){
+			line_has_code = false;
+			line_begin = position = begin;
+			if (after_code && position < source.size() && StartsStatement(source[position])
+				&& position - result.back() >= min_part_size){
+				result.push_back(position);
+			}
+		};
+		while (position < source.size()){
+			const char ch = source[position];
+			if (ch == '\n'){
+				if (position != line_begin){
+					after_code = line_has_code && source[position - 1] != ' ';
+				}
+				start_line(position + 1);
+			}else if (ch == '#'){
+				const size_t end = source.find('\n', position);
+				if (end == string_view::npos){
+					break;
+				}
+				if (position != line_begin){
+					after_code = false;
+				}
+				start_line(end + 1);
+			}else if (ch == '\'' || ch == '"'){
+				// Strings may span lines, an escape hides the next character
+				++position;
+				while (position < source.size() && source[position] != ch){
+					position += source[position] == '\\' ? 2 : 1;
+				}
+				if (position >= source.size()){
+					break;
+				}
+				++position;
+				line_has_code = true;
+			}else{
+				line_has_code = line_has_code || ch != ' ';
+				++position;
+			}
+		}
+		return result;
+	}
+
+	vector<Token> LexInParallel(string_view source, size_t thread_count, size_t min_part_size) {
+		vector<size_t> starts = SplitSource(source, min_part_size);
+		starts.push_back(source.size());
+		const size_t part_count = starts.size() - 1;
+
+		vector<Part> parts(part_count);
+		{
+			pool::WorkStealingPool workers(min(thread_count, part_count));
+			for (size_t i = 0; i < part_count; ++i){
+				workers.Submit([&, i]{
+					parts[i] = LexPart(source.substr(starts[i], starts[i + 1] - starts[i]));
+				});
+			}
+		}
+
+		size_t token_count = 0;
+		for (const auto& part : parts){
+			token_count += part.tokens.size();
+		}
+		vector<Token> result;
+		result.reserve(token_count);
+		for (size_t i = 0; i < parts.size(); ++i){
+			if (!parts[i].error && !parts[i].closes_blocks && i + 1 < parts.size()){
+				// The Lexer got the indentation wrong, so where the next part starts depends on
+				// this one: the rest of the source is lexed in one go
+				parts[i] = LexPart(source.substr(starts[i]));
+				parts.resize(i + 1);
+			}
+			// Every part up to this one starts in the state the Lexer would be in
+			if (parts[i].error){
+				rethrow_exception(parts[i].error);
+			}
+			if (!result.empty()){
+				result.pop_back();
+			}
+			result.insert(result.end(), make_move_iterator(parts[i].tokens.begin()),
+						  make_move_iterator(parts[i].tokens.end()));
+		}
+		return result;
+	}
+
+	TokenArray::TokenArray(vector<Token> tokens)
+		: tokens_(std::move(tokens)) {
+	}
+
+	const Token& TokenArray::CurrentToken() const {
+		return tokens_[position_];
+	}
+
+	Token TokenArray::NextToken() {
+		if (position_ + 1 < tokens_.size()){
+			++position_;
+		}
+		return tokens_[position_];
+	}
+}
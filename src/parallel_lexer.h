@@ -0,0 +1,38 @@
+#pragma once
+
+#include "lexer.h"
+
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace parse {
+
+	// Tokenizes the source on several threads and returns the tokens the Lexer would return,
+	// ending with Eof. The source is split at the starts of top-level statements following
+	// a line of code, where the Lexer has no state but the indentation of the block it
+	// leaves. The Dedent tokens for that block end the previous part, as they would at the
+	// end of a source, so the parts are joined by dropping their Eof.
+	// Unlike the Lexer, a lexer error is thrown before any token is returned
+	std::vector<Token> LexInParallel(std::string_view source,
+									 size_t thread_count = std::thread::hardware_concurrency(),
+									 size_t min_part_size = 64 * 1024);
+
+	// Start offsets of the parts LexInParallel lexes, the first one is 0
+	std::vector<size_t> SplitSource(std::string_view source, size_t min_part_size);
+
+	// Reads tokens that have already been produced, e.g. by LexInParallel
+	class TokenArray : public TokenStream {
+	public:
+		// The tokens must end with Eof
+		explicit TokenArray(std::vector<Token> tokens);
+
+		[[nodiscard]] const Token& CurrentToken() const override;
+
+		Token NextToken() override;
+
+	private:
+		std::vector<Token> tokens_;
+		size_t position_ = 0;
+	};
+}
@@ -0,0 +1,140 @@
+#include "parallel_lexer.h"
+#include "parse.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace parse {
+
+namespace {
+
+// Lines that start like top-level statements but are inside strings and comments, lines
+// that leave the lexer in unusual states and blocks closed by several Dedent tokens at once
+const string PROGRAM = R"--(
+class Shape:
+  def __init__(name):
+    self.name = name
+    if name == "":
+      if True:
+        self.name = "
+inside = 'a string' # not a comment
+class Fake:
+"
+
+  def describe():
+    return 'it\'s "' + self.name + "\"\\"
+# a comment at the first column, with 'quotes
+shape = Shape("dot")
+print shape.describe() # a comment after code
+after_comment = 1
+if after_comment:
+  x = 2
+  
+after_spaces = 3
+if x:
+  y = 4
+
+last = "#not a comment"
+)--"s;
+
+vector<Token> LexSequentially(const string& source) {
+    istringstream input(source);
+    Lexer lexer(input);
+    vector<Token> result{lexer.CurrentToken()};
+    while (!result.back().Is<token_type::Eof>()) {
+        result.push_back(lexer.NextToken());
+    }
+    return result;
+}
+
+void TestSameTokensAsLexer() {
+    const vector<Token> expected = LexSequentially(PROGRAM);
+    for (size_t min_part_size : {1U, 5U, 40U, 100U, 100000U}) {
+        for (size_t thread_count : {1U, 4U}) {
+            ASSERT_EQUAL(LexInParallel(PROGRAM, thread_count, min_part_size), expected);
+        }
+    }
+}
+
+void TestSplitsOutsideStringsAndComments() {
+    const vector<size_t> starts = SplitSource(PROGRAM, 1);
+    const auto is_start = [&starts](const string& line) {
+        const size_t position = PROGRAM.find("\n"s + line) + 1;
+        return find(starts.begin(), starts.end(), position) != starts.end();
+    };
+
+    ASSERT(is_start("shape = "s));
+    ASSERT(is_start("print shape"s));
+    ASSERT(is_start("if after_comment"s));
+    ASSERT(is_start("last = "s));
+
+    ASSERT(!is_start("inside = "s));
+    ASSERT(!is_start("class Fake"s));
+    // The lexer misses the Dedent tokens after a comment following code, and after a line
+    // of spaces at the indentation of its block
+    ASSERT(!is_start("after_comment"s));
+    ASSERT(!is_start("after_spaces"s));
+}
+
+void TestEverySplitOfGeneratedSource() {
+    string source;
+    for (int i = 0; i < 30; ++i) {
+        const string n = to_string(i);
+        source += "class C"s + n + ":\n  def m(x):\n    if x:\n      return '"s + n + "\n'\n"s;
+        source += i % 3 == 0 ? "    # note\n"s : ""s;
+        source += i % 4 == 0 ? "\n"s : ""s;
+        source += "v"s + n + " = C"s + n + "()\n"s;
+    }
+    const vector<Token> expected = LexSequentially(source);
+    for (size_t min_part_size = 1; min_part_size < 200; min_part_size += 13) {
+        ASSERT_EQUAL(LexInParallel(source, 3, min_part_size), expected);
+    }
+    ASSERT(SplitSource(source, 1).size() > 30U);
+}
+
+void TestInconsistentIndentation() {
+    // The lexer's indentation goes below zero or becomes odd, so the parts after these
+    // lines can't be lexed on their own
+    for (const string& line : {" odd = 1\n"s, "      jump = 1\n"s, "if x:\n   three = 1\n"s}) {
+        string source = "a = 1\n"s + line;
+        for (int i = 0; i < 5; ++i) {
+            source += "b"s + to_string(i) + " = 2\nif b:\n  c = 3\n"s;
+        }
+        ASSERT_EQUAL(LexInParallel(source, 2, 1), LexSequentially(source));
+    }
+}
+
+void TestErrorIsThrown() {
+    ASSERT_THROWS(LexInParallel("x = 1\ny = 99999999999\n"s, 2, 1), std::out_of_range);
+}
+
+void TestParsesTokenArray() {
+    TokenArray tokens(LexInParallel(PROGRAM, 4, 1));
+    auto program = ParseProgram(tokens);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "it's \"dot\"\\\n"s);
+    ASSERT(tokens.CurrentToken().Is<token_type::Eof>());
+    ASSERT(tokens.NextToken().Is<token_type::Eof>());
+}
+
+}  // namespace
+
+void RunParallelLexerTests(TestRunner& tr) {
+    RUN_TEST(tr, parse::TestSameTokensAsLexer);
+    RUN_TEST(tr, parse::TestSplitsOutsideStringsAndComments);
+    RUN_TEST(tr, parse::TestEverySplitOfGeneratedSource);
+    RUN_TEST(tr, parse::TestInconsistentIndentation);
+    RUN_TEST(tr, parse::TestErrorIsThrown);
+    RUN_TEST(tr, parse::TestParsesTokenArray);
+}
+
+}  // namespace parse
@@ -1,8 +1,13 @@
 #include "parse.h"
 
+#include "isolate.h"
 #include "lexer.h"
 #include "statement.h"
 
+#include <cstring>
+#include <limits>
+#include <optional>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -17,24 +22,500 @@ bool operator!=(const parse::Token& token, char c) {
     return !(token == c);
 }
 
+constexpr size_t ALL_CLASSES = numeric_limits<size_t>::max();
+
+// Operators of expressions, from the loosest binding to the tightest
+enum class Operator {
+    OR,
+    AND,
+    NOT,
+    LESS,
+    GREATER,
+    EQUAL,
+    NOT_EQUAL,
+    LESS_OR_EQUAL,
+    GREATER_OR_EQUAL,
+    ADD,
+    SUB,
+    MULT,
+    DIV,
+    NEGATE,
+};
+
+struct OperatorInfo {
+    int precedence;
+    bool is_unary;
+    // Comparisons don't chain: a < b < c is an error
+    bool is_comparison;
+};
+
+constexpr OperatorInfo OPERATORS[] = {
+    {1, false, false},  // OR
+    {2, false, false},  // AND
+    {3, true, false},   // NOT
+    {4, false, true},   // LESS
+    {4, false, true},   // GREATER
+    {4, false, true},   // EQUAL
+    {4, false, true},   // NOT_EQUAL
+    {4, false, true},   // LESS_OR_EQUAL
+    {4, false, true},   // GREATER_OR_EQUAL
+    {5, false, false},  // ADD
+    {5, false, false},  // SUB
+    {6, false, false},  // MULT
+    {6, false, false},  // DIV
+    {7, true, false},   // NEGATE
+};
+
+const OperatorInfo& GetInfo(Operator op) {
+    return OPERATORS[static_cast<size_t>(op)];
+}
+
+optional<Operator> GetBinaryOperator(const parse::Token& token) {
+    if (const auto* c = token.TryAs<TokenType::Char>()) {
+        switch (c->value) {
+            case '<':
+                return Operator::LESS;
+            case '>':
+                return Operator::GREATER;
+            case '+':
+                return Operator::ADD;
+            case '-':
+                return Operator::SUB;
+            case '*':
+                return Operator::MULT;
+            case '/':
+                return Operator::DIV;
+            default:
+                return nullopt;
+        }
+    }
+    if (token.Is<TokenType::Or>()) {
+        return Operator::OR;
+    }
+    if (token.Is<TokenType::And>()) {
+        return Operator::AND;
+    }
+    if (token.Is<TokenType::Eq>()) {
+        return Operator::EQUAL;
+    }
+    if (token.Is<TokenType::NotEq>()) {
+        return Operator::NOT_EQUAL;
+    }
+    if (token.Is<TokenType::LessOrEq>()) {
+        return Operator::LESS_OR_EQUAL;
+    }
+    if (token.Is<TokenType::GreaterOrEq>()) {
+        return Operator::GREATER_OR_EQUAL;
+    }
+    return nullopt;
+}
+
+// The operand of a unary operator is passed as lhs
+unique_ptr<ast::Statement> MakeOperation(Operator op, unique_ptr<ast::Statement> lhs,
+                                         unique_ptr<ast::Statement> rhs) {
+    switch (op) {
+        case Operator::OR:
+            return make_unique<ast::Or>(std::move(lhs), std::move(rhs));
+        case Operator::AND:
+            return make_unique<ast::And>(std::move(lhs), std::move(rhs));
+        case Operator::NOT:
+            return make_unique<ast::Not>(std::move(lhs));
+        case Operator::LESS:
+            return make_unique<ast::Comparison>(runtime::Less, std::move(lhs), std::move(rhs));
+        case Operator::GREATER:
+            return make_unique<ast::Comparison>(runtime::Greater, std::move(lhs), std::move(rhs));
+        case Operator::EQUAL:
+            return make_unique<ast::Comparison>(runtime::Equal, std::move(lhs), std::move(rhs));
+        case Operator::NOT_EQUAL:
+            return make_unique<ast::Comparison>(runtime::NotEqual, std::move(lhs), std::move(rhs));
+        case Operator::LESS_OR_EQUAL:
+            return make_unique<ast::Comparison>(runtime::LessOrEqual, std::move(lhs), std::move(rhs));
+        case Operator::GREATER_OR_EQUAL:
+            return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(lhs), std::move(rhs));
+        case Operator::ADD:
+            return make_unique<ast::Add>(std::move(lhs), std::move(rhs));
+        case Operator::SUB:
+            return make_unique<ast::Sub>(std::move(lhs), std::move(rhs));
+        case Operator::MULT:
+            return make_unique<ast::Mult>(std::move(lhs), std::move(rhs));
+        case Operator::DIV:
+            return make_unique<ast::Div>(std::move(lhs), std::move(rhs));
+        case Operator::NEGATE:
+            return make_unique<ast::Mult>(std::move(lhs), make_unique<ast::NumericConst>(-1));
+    }
+    throw ParseError("Unknown operator"s);
+}
+
+// The operands of an expression being parsed and the operators, parentheses and calls still
+// waiting for theirs. Keeps on the heap what the call stack of a recursive descent parser would
+class ExpressionStack {
+public:
+    void PushOperand(unique_ptr<ast::Statement> operand) {
+        operands_.push_back(std::move(operand));
+    }
+
+    void PushUnary(Operator op) {
+        pending_.push_back(Pending{op, false, {}, 0});
+    }
+
+    // Applies the operators before op that bind at least as tight. Returns false without
+    // pushing op if it is a comparison that would chain another one
+    bool PushBinary(Operator op) {
+        const OperatorInfo& info = GetInfo(op);
+        while (!pending_.empty() && pending_.back().op) {
+            const OperatorInfo& top = GetInfo(*pending_.back().op);
+            if (top.precedence < info.precedence || (top.is_comparison && info.is_comparison)) {
+                break;
+            }
+            ApplyTop();
+        }
+        if (info.is_comparison && !pending_.empty() && pending_.back().op
+            && GetInfo(*pending_.back().op).is_comparison) {
+            return false;
+        }
+        pending_.push_back(Pending{op, false, {}, 0});
+        return true;
+    }
+
+    void OpenParentheses() {
+        pending_.push_back(Pending{});
+    }
+
+    void OpenCall(vector<string> names) {
+        pending_.push_back(Pending{nullopt, true, std::move(names), operands_.size()});
+    }
+
+    // Like the grammar, lets not start only the operands of or, and, not and of groups
+    [[nodiscard]] bool AcceptsNot() const {
+        if (pending_.empty() || !pending_.back().op) {
+            return true;
+        }
+        return GetInfo(*pending_.back().op).precedence <= GetInfo(Operator::NOT).precedence;
+    }
+
+    // Applies the operators of the innermost open group, or of the whole expression
+    void CloseOperators() {
+        while (!pending_.empty() && pending_.back().op) {
+            ApplyTop();
+        }
+    }
+
+    // After CloseOperators
+    [[nodiscard]] bool HasOpenGroup() const {
+        return !pending_.empty();
+    }
+
+    [[nodiscard]] bool IsInCall() const {
+        return pending_.back().is_call;
+    }
+
+    void CloseParentheses() {
+        pending_.pop_back();
+    }
+
+    // Returns the names of the innermost call and sets args to its arguments
+    vector<string> CloseCall(vector<unique_ptr<ast::Statement>>& args) {
+        Pending call = std::move(pending_.back());
+        pending_.pop_back();
+        args.assign(make_move_iterator(operands_.begin() + static_cast<ptrdiff_t>(call.first_argument)),
+                    make_move_iterator(operands_.end()));
+        operands_.resize(call.first_argument);
+        return std::move(call.call_names);
+    }
+
+    unique_ptr<ast::Statement> TakeResult() {
+        return std::move(operands_.back());
+    }
+
+private:
+    // An operator waiting for its last operand, otherwise an open group
+    struct Pending {
+        optional<Operator> op;
+        bool is_call = false;
+        vector<string> call_names;
+        size_t first_argument = 0;
+    };
+
+    void ApplyTop() {
+        const Operator op = *pending_.back().op;
+        pending_.pop_back();
+        unique_ptr<ast::Statement> rhs;
+        if (!GetInfo(op).is_unary) {
+            rhs = std::move(operands_.back());
+            operands_.pop_back();
+        }
+        operands_.back() = MakeOperation(op, std::move(operands_.back()), std::move(rhs));
+    }
+
+    vector<unique_ptr<ast::Statement>> operands_;
+    vector<Pending> pending_;
+};
+
+// Classes a program may refer to, in the order they were declared. The table doesn't own them.
+// Lazily parsed method bodies share it and may be parsed on other threads while the program
+// is still being parsed
+class ClassTable {
+public:
+    // Returns false if a class with this name is known already. A builtin class isn't
+    // counted, a program may declare a class of the same name
+    bool Add(const string& name, const runtime::Class& cls) {
+        lock_guard guard(mutex_);
+        return classes_.insert({name, Entry{&cls, classes_.size()}}).second;
+    }
+
+    // Always visible, unless a class of the same name is
+    void AddBuiltin(const string& name, const runtime::Class& cls) {
+        lock_guard guard(mutex_);
+        builtins_.insert({name, &cls});
+    }
+
+    // Only the first visible_count classes are found
+    [[nodiscard]] const runtime::Class* Find(const string& name, size_t visible_count) const {
+        lock_guard guard(mutex_);
+        if (auto it = classes_.find(name); it != classes_.end() && it->second.order < visible_count) {
+            return it->second.cls;
+        }
+        auto it = builtins_.find(name);
+        return it == builtins_.end() ? nullptr : it->second;
+    }
+
+    [[nodiscard]] size_t GetCount() const {
+        lock_guard guard(mutex_);
+        return classes_.size();
+    }
+
+private:
+    struct Entry {
+        const runtime::Class* cls;
+        size_t order;
+    };
+
+    mutable mutex mutex_;
+    unordered_map<string, Entry> classes_;
+    unordered_map<string, const runtime::Class*> builtins_;
+};
+
+// A recorded token is the index of its type followed by its value, if it has one
+void AppendValue(const TokenType::Number& number, string& out) {
+    out.append(reinterpret_cast<const char*>(&number.value), sizeof(number.value));  // NOLINT
+}
+
+void AppendValue(const TokenType::Char& c, string& out) {
+    out.push_back(c.value);
+}
+
+void AppendText(const string& text, string& out) {
+    size_t size = text.size();
+    for (; size >= 0x80; size >>= 7) {
+        out.push_back(static_cast<char>((size & 0x7F) | 0x80));
+    }
+    out.push_back(static_cast<char>(size));
+    out += text;
+}
+
+void AppendValue(const TokenType::Id& id, string& out) {
+    AppendText(id.value, out);
+}
+
+void AppendValue(const TokenType::String& str, string& out) {
+    AppendText(str.value, out);
+}
+
+template <typename T>
+void AppendValue(const T&, string&) {
+}
+
+void AppendToken(const parse::Token& token, string& out) {
+    out.push_back(static_cast<char>(token.index()));
+    visit([&out](const auto& value) { AppendValue(value, out); },
+          static_cast<const parse::TokenBase&>(token));
+}
+
+// Reads the tokens written by AppendToken, followed by Eof
+class TokenReplay : public parse::TokenStream {
+public:
+    explicit TokenReplay(string_view tokens)
+        : tokens_(tokens) {
+        NextToken();
+    }
+
+    [[nodiscard]] const parse::Token& CurrentToken() const override {
+        return current_token_;
+    }
+
+    parse::Token NextToken() override {
+        if (tokens_.empty()) {
+            current_token_ = TokenType::Eof{};
+        } else {
+            current_token_ = MakeToken(ReadByte(), make_index_sequence<variant_size_v<parse::TokenBase>>());
+            visit([this](auto& value) { ReadValue(value); }, static_cast<parse::TokenBase&>(current_token_));
+        }
+        return current_token_;
+    }
+
+private:
+    template <size_t... Indexes>
+    static parse::Token MakeToken(size_t index, index_sequence<Indexes...>) {
+        parse::Token result;
+        ((Indexes == index ? void(result = parse::Token(in_place_index<Indexes>)) : void()), ...);
+        return result;
+    }
+
+    unsigned char ReadByte() {
+        const auto result = static_cast<unsigned char>(tokens_.front());
+        tokens_.remove_prefix(1);
+        return result;
+    }
+
+    string ReadText() {
+        size_t size = 0;
+        for (int shift = 0;; shift += 7) {
+            const unsigned char byte = ReadByte();
+            size |= static_cast<size_t>(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                break;
+            }
+        }
+        string result(tokens_.substr(0, size));
+        tokens_.remove_prefix(size);
+        return result;
+    }
+
+    void ReadValue(TokenType::Number& number) {
+        memcpy(&number.value, tokens_.data(), sizeof(number.value));
+        tokens_.remove_prefix(sizeof(number.value));
+    }
+
+    void ReadValue(TokenType::Char& c) {
+        c.value = static_cast<char>(ReadByte());
+    }
+
+    void ReadValue(TokenType::Id& id) {
+        id.value = ReadText();
+    }
+
+    void ReadValue(TokenType::String& str) {
+        str.value = ReadText();
+    }
+
+    template <typename T>
+    void ReadValue(T&) {
+    }
+
+    string_view tokens_;
+    parse::Token current_token_;
+};
+}  // namespace
+
+struct LazyMethodBody::Source {
+    string tokens;
+    shared_ptr<ClassTable> classes;
+    size_t visible_classes;
+};
+
+namespace {
 class Parser {
 public:
-    explicit Parser(parse::Lexer& lexer)
-        : lexer_(lexer) {
+    explicit Parser(parse::TokenStream& lexer, ParseOptions options = {})
+        : Parser(lexer, make_shared<ClassTable>(), ALL_CLASSES, options) {
+        for (const auto& [name, object] : isolate::GetBuiltinClasses()) {
+            declared_classes_.insert({name, object});
+            classes_->AddBuiltin(name, *object.TryAs<runtime::Class>());
+        }
+    }
+
+    Parser(parse::TokenStream& lexer, const runtime::Closure& classes)
+        : Parser(lexer) {
+        AddClasses(classes);
+    }
+
+    // Parses a part of a program, e.g. a method body, that may only use the first
+    // visible_classes classes of the table
+    Parser(parse::TokenStream& lexer, shared_ptr<ClassTable> classes, size_t visible_classes,
+           ParseOptions options = {})
+        : lexer_(lexer)
+        , options_(options)
+        , classes_(std::move(classes))
+        , visible_classes_(visible_classes) {
     }
 
     // Program -> eps
     //          | Statement \n Program
     unique_ptr<ast::Statement> ParseProgram() {
         auto result = make_unique<ast::Compound>();
-        while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
-            result->AddStatement(ParseStatement());
+        while (auto statement = ParseTopLevelStatement()) {
+            result->AddStatement(std::move(statement));
         }
 
         return result;
     }
 
+    // Returns nullptr at the end of the program
+    unique_ptr<ast::Statement> ParseTopLevelStatement() {
+        if (lexer_.CurrentToken().Is<TokenType::Eof>()) {
+            return nullptr;
+        }
+        return ParseStatement();
+    }
+
+    // The builtin and given classes as well as the declared ones, which shadow builtins
+    [[nodiscard]] const runtime::Closure& GetClasses() const {
+        return declared_classes_;
+    }
+
+    // MethodBody -> Suite
+    unique_ptr<runtime::Executable> ParseMethodBody() {
+        return make_unique<ast::MethodBody>(ParseSuite());
+    }
+
 private:
+    void AddClasses(const runtime::Closure& classes) {
+        for (const auto& [name, object] : classes) {
+            if (const auto* cls = object.TryAs<runtime::Class>()) {
+                declared_classes_[name] = object;
+                classes_->Add(name, *cls);
+            }
+        }
+    }
+
+    // Records the tokens of the suite, checking only that its indentation is balanced.
+    // A suite that declares classes is parsed right away, since the statements after it
+    // may use them
+    unique_ptr<runtime::Executable> ParseLazyMethodBody() {
+        auto source = make_unique<LazyMethodBody::Source>();
+        source->classes = classes_;
+        source->visible_classes = min(visible_classes_, classes_->GetCount());
+
+        lexer_.Expect<TokenType::Newline>();
+        AppendToken(lexer_.CurrentToken(), source->tokens);
+        lexer_.ExpectNext<TokenType::Indent>();
+        AppendToken(lexer_.CurrentToken(), source->tokens);
+
+        bool declares_classes = false;
+        for (int depth = 1; depth > 0;) {
+            lexer_.NextToken();
+            const auto& tok = lexer_.CurrentToken();
+            if (tok.Is<TokenType::Indent>()) {
+                ++depth;
+            } else if (tok.Is<TokenType::Dedent>()) {
+                --depth;
+            } else if (tok.Is<TokenType::Class>()) {
+                declares_classes = true;
+            } else if (tok.Is<TokenType::Eof>()) {
+                throw ParseError("Unexpected end of a method body"s);
+            }
+            AppendToken(tok, source->tokens);
+        }
+        lexer_.NextToken();
+
+        if (declares_classes) {
+            TokenReplay tokens(source->tokens);
+            return Parser(tokens, classes_, visible_classes_).ParseMethodBody();
+        }
+        source->tokens.shrink_to_fit();
+        return make_unique<LazyMethodBody>(std::move(source));
+    }
+
     // Suite -> NEWLINE INDENT (Statement)+ DEDENT
     unique_ptr<ast::Statement> ParseSuite()  // NOLINT
     {
@@ -76,7 +557,11 @@ private:
             lexer_.ExpectNext<TokenType::Char>(':');
             lexer_.NextToken();
 
-            m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+            if (options_.lazy_methods) {
+                m.body = ParseLazyMethodBody();
+            } else {
+                m.body = ParseMethodBody();  // NOLINT
+            }
 
             result.push_back(std::move(m));
         }
@@ -96,11 +581,10 @@ private:
             lexer_.ExpectNext<TokenType::Char>(')');
             lexer_.NextToken();
 
-            auto it = declared_classes_.find(name);
-            if (it == declared_classes_.end()) {
+            base_class = classes_->Find(name, visible_classes_);
+            if (base_class == nullptr) {
                 throw ParseError("Base class "s + name + " not found for class "s + class_name);
             }
-            base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
         }
 
         lexer_.Expect<TokenType::Char>(':');
@@ -112,16 +596,13 @@ private:
         lexer_.Expect<TokenType::Dedent>();
         lexer_.NextToken();
 
-        auto [it, inserted] = declared_classes_.insert({
-            class_name,
-            runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class)),
-        });
-
-        if (!inserted) {
+        auto cls = runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class));
+        if (!classes_->Add(class_name, *cls.TryAs<runtime::Class>())) {
             throw ParseError("Class "s + class_name + " already exists"s);
         }
+        declared_classes_[class_name] = cls;
 
-        return make_unique<ast::ClassDefinition>(it->second);
+        return make_unique<ast::ClassDefinition>(cls);
     }
 
     vector<string> ParseDottedIds() {
@@ -170,123 +651,6 @@ private:
                                             std::move(last_name), std::move(args));
     }
 
-    // Expr -> Adder ['+'/'-' Adder]*
-    unique_ptr<ast::Statement> ParseExpression()  // NOLINT
-    {
-        unique_ptr<ast::Statement> result = ParseAdder();
-        while (lexer_.CurrentToken() == '+' || lexer_.CurrentToken() == '-') {
-            char op = lexer_.CurrentToken().As<TokenType::Char>().value;
-            lexer_.NextToken();
-
-            if (op == '+') {
-                result = make_unique<ast::Add>(std::move(result), ParseAdder());
-            } else {
-                result = make_unique<ast::Sub>(std::move(result), ParseAdder());
-            }
-        }
-        return result;
-    }
-
-    // Adder -> Mult ['*'/'/' Mult]*
-    unique_ptr<ast::Statement> ParseAdder()  // NOLINT
-    {
-        unique_ptr<ast::Statement> result = ParseMult();
-        while (lexer_.CurrentToken() == '*' || lexer_.CurrentToken() == '/') {
-            char op = lexer_.CurrentToken().As<TokenType::Char>().value;
-            lexer_.NextToken();
-
-            if (op == '*') {
-                result = make_unique<ast::Mult>(std::move(result), ParseMult());
-            } else {
-                result = make_unique<ast::Div>(std::move(result), ParseMult());
-            }
-        }
-        return result;
-    }
-
-    // Mult -> '(' Expr ')'
-    //       | NUMBER
-    //       | '-' Mult
-    //       | STRING
-    //       | NONE
-    //       | TRUE
-    //       | FALSE
-    //       | DottedIds '(' ExprList ')'
-    //       | DottedIds
-    unique_ptr<ast::Statement> ParseMult()  // NOLINT
-    {
-        if (lexer_.CurrentToken() == '(') {
-            lexer_.NextToken();
-            auto result = ParseTest();
-            lexer_.Expect<TokenType::Char>(')');
-            lexer_.NextToken();
-            return result;
-        }
-        if (lexer_.CurrentToken() == '-') {
-            lexer_.NextToken();
-            return make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1));
-        }
-        if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
-            int result = num->value;
-            lexer_.NextToken();
-            return make_unique<ast::NumericConst>(result);
-        }
-        if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
-            string result = str->value;
-            lexer_.NextToken();
-            return make_unique<ast::StringConst>(std::move(result));
-        }
-        if (lexer_.CurrentToken().Is<TokenType::True>()) {
-            lexer_.NextToken();
-            return make_unique<ast::BoolConst>(runtime::Bool(true));
-        }
-        if (lexer_.CurrentToken().Is<TokenType::False>()) {
-            lexer_.NextToken();
-            return make_unique<ast::BoolConst>(runtime::Bool(false));
-        }
-        if (lexer_.CurrentToken().Is<TokenType::None>()) {
-            lexer_.NextToken();
-            return make_unique<ast::None>();
-        }
-
-        return ParseDottedIdsInMultExpr();
-    }
-
-    std::unique_ptr<ast::Statement> ParseDottedIdsInMultExpr() {
-        vector<string> names = ParseDottedIds();
-
-        if (lexer_.CurrentToken() == '(') {
-            // various calls
-            vector<unique_ptr<ast::Statement>> args;
-            if (lexer_.NextToken() != ')') {
-                args = ParseTestList();
-            }
-            lexer_.Expect<TokenType::Char>(')');
-            lexer_.NextToken();
-
-            auto method_name = names.back();
-            names.pop_back();
-
-            if (!names.empty()) {
-                return make_unique<ast::MethodCall>(
-                    make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
-                    std::move(args));
-            }
-            if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
-                return make_unique<ast::NewInstance>(
-                    static_cast<const runtime::Class&>(*it->second), std::move(args));  // NOLINT
-            }
-            if (method_name == "str"sv) {
-                if (args.size() != 1) {
-                    throw ParseError("Function str takes exactly one argument"s);
-                }
-                return make_unique<ast::Stringify>(std::move(args.front()));
-            }
-            throw ParseError("Unknown call to "s + method_name + "()"s);
-        }
-        return make_unique<ast::VariableValue>(std::move(names));
-    }
-
     vector<unique_ptr<ast::Statement>> ParseTestList()  // NOLINT
     {
         vector<unique_ptr<ast::Statement>> result;
@@ -323,77 +687,144 @@ private:
                                         std::move(else_body));
     }
 
-    // LogicalExpr -> AndTest [OR AndTest]
-    // AndTest -> NotTest [AND NotTest]
-    // NotTest -> [NOT] NotTest
-    //          | Comparison
-    unique_ptr<ast::Statement> ParseTest()  // NOLINT
-    {
-        auto result = ParseAndTest();
-        while (lexer_.CurrentToken().Is<TokenType::Or>()) {
-            lexer_.NextToken();
-            result = make_unique<ast::Or>(std::move(result), ParseAndTest());
+    // Test -> Test OR Test
+    //       | Test AND Test
+    //       | NOT Test
+    //       | Expr COMP_OP Expr
+    //       | Expr
+    // Expr -> Expr '+'/'-' Expr
+    //       | Expr '*'/'/' Expr
+    //       | '-' Expr
+    //       | Operand
+    //
+    // Operators bind as listed in Operator, all binary ones to the left. Only or, and, not and
+    // groups take a NOT operand. Parsed by precedence climbing over an ExpressionStack, so that
+    // long or deeply nested expressions don't recurse
+    unique_ptr<ast::Statement> ParseTest() {
+        ExpressionStack stack;
+        while (true) {
+            if (!ParseOperand(stack)) {
+                continue;
+            }
+            while (true) {
+                if (const auto op = GetBinaryOperator(lexer_.CurrentToken()); op && stack.PushBinary(*op)) {
+                    lexer_.NextToken();
+                    break;
+                }
+                stack.CloseOperators();
+                if (!stack.HasOpenGroup()) {
+                    return stack.TakeResult();
+                }
+                if (stack.IsInCall() && lexer_.CurrentToken() == ',') {
+                    lexer_.NextToken();
+                    break;
+                }
+                lexer_.Expect<TokenType::Char>(')');
+                lexer_.NextToken();
+                if (stack.IsInCall()) {
+                    vector<unique_ptr<ast::Statement>> args;
+                    vector<string> names = stack.CloseCall(args);
+                    stack.PushOperand(MakeCall(std::move(names), std::move(args)));
+                } else {
+                    stack.CloseParentheses();
+                }
+            }
         }
-        return result;
     }
 
-    unique_ptr<ast::Statement> ParseAndTest()  // NOLINT
-    {
-        auto result = ParseNotTest();
-        while (lexer_.CurrentToken().Is<TokenType::And>()) {
+    // Operand -> '(' Test ')'
+    //          | NUMBER
+    //          | STRING
+    //          | NONE
+    //          | TRUE
+    //          | FALSE
+    //          | DottedIds '(' [TestList] ')'
+    //          | DottedIds
+    //
+    // Pushes the unary operators and parentheses before the operand, then the operand. A call
+    // with arguments is left open instead, and false is returned: its first argument is next
+    bool ParseOperand(ExpressionStack& stack) {
+        while (true) {
+            const auto& tok = lexer_.CurrentToken();
+            if (tok == '(') {
+                stack.OpenParentheses();
+            } else if (tok == '-') {
+                stack.PushUnary(Operator::NEGATE);
+            } else if (tok.Is<TokenType::Not>() && stack.AcceptsNot()) {
+                stack.PushUnary(Operator::NOT);
+            } else {
+                break;
+            }
             lexer_.NextToken();
-            result = make_unique<ast::And>(std::move(result), ParseNotTest());
         }
-        return result;
-    }
 
-    unique_ptr<ast::Statement> ParseNotTest()  // NOLINT
-    {
-        if (lexer_.CurrentToken().Is<TokenType::Not>()) {
+        if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
+            int result = num->value;
             lexer_.NextToken();
-            return make_unique<ast::Not>(ParseNotTest());  // NOLINT
+            stack.PushOperand(make_unique<ast::NumericConst>(result));
+            return true;
         }
-        return ParseComparison();
-    }
-
-    // Comparison -> Expr [COMP_OP Expr]
-    unique_ptr<ast::Statement> ParseComparison()  // NOLINT
-    {
-        auto result = ParseExpression();
-
-        const auto tok = lexer_.CurrentToken();
-
-        if (tok == '<') {
+        if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
+            string result = str->value;
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Less, std::move(result),
-                                                ParseExpression());
+            stack.PushOperand(make_unique<ast::StringConst>(std::move(result)));
+            return true;
         }
-        if (tok == '>') {
+        if (lexer_.CurrentToken().Is<TokenType::True>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Greater, std::move(result),
-                                                ParseExpression());
+            stack.PushOperand(make_unique<ast::BoolConst>(runtime::Bool(true)));
+            return true;
         }
-        if (tok.Is<TokenType::Eq>()) {
+        if (lexer_.CurrentToken().Is<TokenType::False>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Equal, std::move(result),
-                                                ParseExpression());
+            stack.PushOperand(make_unique<ast::BoolConst>(runtime::Bool(false)));
+            return true;
         }
-        if (tok.Is<TokenType::NotEq>()) {
+        if (lexer_.CurrentToken().Is<TokenType::None>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::NotEqual, std::move(result),
-                                                ParseExpression());
+            stack.PushOperand(make_unique<ast::None>());
+            return true;
         }
-        if (tok.Is<TokenType::LessOrEq>()) {
-            lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::LessOrEqual, std::move(result),
-                                                ParseExpression());
+
+        vector<string> names = ParseDottedIds();
+        if (lexer_.CurrentToken() != '(') {
+            stack.PushOperand(make_unique<ast::VariableValue>(std::move(names)));
+            return true;
         }
-        if (tok.Is<TokenType::GreaterOrEq>()) {
+        if (lexer_.NextToken() == ')') {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
-                                                ParseExpression());
+            stack.PushOperand(MakeCall(std::move(names), {}));
+            return true;
         }
-        return result;
+        stack.OpenCall(std::move(names));
+        return false;
+    }
+
+    // A call of a method, of a class to create an instance or of a builtin function
+    unique_ptr<ast::Statement> MakeCall(vector<string> names, vector<unique_ptr<ast::Statement>> args) {
+        auto method_name = names.back();
+        names.pop_back();
+
+        if (!names.empty()) {
+            return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(std::move(names)),
+                                                std::move(method_name), std::move(args));
+        }
+        if (const auto* cls = classes_->Find(method_name, visible_classes_)) {
+            return make_unique<ast::NewInstance>(*cls, std::move(args));
+        }
+        if (method_name == "str"sv) {
+            if (args.size() != 1) {
+                throw ParseError("Function str takes exactly one argument"s);
+            }
+            return make_unique<ast::Stringify>(std::move(args.front()));
+        }
+        if (method_name == "spawn"sv) {
+            if (args.empty()) {
+                throw ParseError("Function spawn takes an instance and the arguments of its run method"s);
+            }
+            return make_unique<isolate::Spawn>(std::move(args));
+        }
+        throw ParseError("Unknown call to "s + method_name + "()"s);
     }
 
     // Statement -> SimpleStatement Newline
@@ -437,12 +868,81 @@ private:
         return ParseAssignmentOrCall();
     }
 
-    parse::Lexer& lexer_;
+    parse::TokenStream& lexer_;
+    ParseOptions options_;
+    // Owns the classes declared by this parser, the table also refers to the others
     runtime::Closure declared_classes_;
+    shared_ptr<ClassTable> classes_;
+    size_t visible_classes_;
 };
 
 }  // namespace
 
-unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
+unique_ptr<runtime::Executable> ParseProgram(parse::TokenStream& lexer) {
     return Parser{lexer}.ParseProgram();
 }
+
+unique_ptr<runtime::Executable> ParseProgram(parse::TokenStream& lexer, const runtime::Closure& classes) {
+    return Parser{lexer, classes}.ParseProgram();
+}
+
+unique_ptr<runtime::Executable> ParseProgram(parse::TokenStream& lexer, const ParseOptions& options) {
+    return Parser{lexer, options}.ParseProgram();
+}
+
+unique_ptr<runtime::Executable> ParseProgram(parse::TokenStream& lexer, const runtime::Closure& classes,
+                                             runtime::Closure& declared) {
+    Parser parser{lexer, classes};
+    auto result = parser.ParseProgram();
+    const runtime::Closure& builtins = isolate::GetBuiltinClasses();
+    for (const auto& [name, cls] : parser.GetClasses()) {
+        const auto builtin = builtins.find(name);
+        if (classes.count(name) == 0 && (builtin == builtins.end() || builtin->second.Get() != cls.Get())) {
+            declared.insert({name, cls});
+        }
+    }
+    return result;
+}
+
+LazyMethodBody::LazyMethodBody(unique_ptr<Source> source)
+    : source_(std::move(source)) {
+}
+
+LazyMethodBody::~LazyMethodBody() = default;
+
+runtime::ObjectHolder LazyMethodBody::Execute(runtime::Closure& closure, runtime::Context& context) const {
+    return GetBody().Execute(closure, context);
+}
+
+const runtime::Executable& LazyMethodBody::GetBody() const {
+    if (const auto* body = parsed_body_.load(memory_order_acquire)) {
+        return *body;
+    }
+    // A body that fails to parse stays unparsed, so every call reports the error
+    lock_guard guard(parse_mutex_);
+    if (!body_) {
+        TokenReplay tokens(source_->tokens);
+        body_ = Parser(tokens, source_->classes, source_->visible_classes).ParseMethodBody();
+        source_.reset();
+        parsed_body_.store(body_.get(), memory_order_release);
+    }
+    return *body_;
+}
+
+class StatementStream::Impl : public Parser {
+    using Parser::Parser;
+};
+
+StatementStream::StatementStream(parse::TokenStream& lexer)
+    : impl_(make_unique<Impl>(lexer)) {
+}
+
+StatementStream::StatementStream(parse::TokenStream& lexer, const runtime::Closure& classes)
+    : impl_(make_unique<Impl>(lexer, classes)) {
+}
+
+StatementStream::~StatementStream() = default;
+
+unique_ptr<runtime::Executable> StatementStream::Next() {
+    return impl_->ParseTopLevelStatement();
+}
@@ -1,18 +1,81 @@
 #pragma once
 
+#include "runtime.h"
+
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
 
 namespace parse {
-class Lexer;
-}
-
-namespace runtime {
-class Executable;
+class TokenStream;
 }
 
 struct ParseError : std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
+struct ParseOptions {
+    // Method bodies are only checked for balanced indentation and kept as tokens until the
+    // method is first called. Syntax errors in a body are reported by that call
+    bool lazy_methods = false;
+};
+
+// The program is not modified by execution: it may be run any number of times, also
+// concurrently, as long as every run has its own Closure and Context
+std::unique_ptr<runtime::Executable> ParseProgram(parse::TokenStream& lexer);
+
+// Lets the program use the classes of the given closure, e.g. the globals of a program
+// that has already been run, without declaring them. Other entries are ignored
+std::unique_ptr<runtime::Executable> ParseProgram(
+    parse::TokenStream& lexer, const std::unordered_map<std::string, runtime::ObjectHolder>& classes);
+
+std::unique_ptr<runtime::Executable> ParseProgram(parse::TokenStream& lexer, const ParseOptions& options);
+
+// Like ParseProgram with classes, and puts the classes the program declares into declared
+std::unique_ptr<runtime::Executable> ParseProgram(
+    parse::TokenStream& lexer, const std::unordered_map<std::string, runtime::ObjectHolder>& classes,
+    std::unordered_map<std::string, runtime::ObjectHolder>& declared);
+
+// Body of a method parsed with ParseOptions::lazy_methods. The first call parses it, seeing
+// the same classes it would have seen if it had been parsed with the rest of the program
+class LazyMethodBody : public runtime::Executable {
+public:
+    struct Source;
+
+    explicit LazyMethodBody(std::unique_ptr<Source> source);
+    ~LazyMethodBody() override;
+
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+    // Parses the body unless it has been parsed already
+    [[nodiscard]] const runtime::Executable& GetBody() const;
+
+private:
+    mutable std::mutex parse_mutex_;
+    mutable std::unique_ptr<Source> source_;
+    mutable std::unique_ptr<runtime::Executable> body_;
+    // Set once the body is parsed, so that later calls don't take the mutex
+    mutable std::atomic<const runtime::Executable*> parsed_body_ = nullptr;
+};
+
+// Parses a program one top-level statement at a time, so that a statement may run as soon as
+// it is complete and be released right after. Only the classes outlive their statements:
+// the stream keeps them, so it must outlive the objects of the program
+class StatementStream {
+public:
+    explicit StatementStream(parse::TokenStream& lexer);
+    StatementStream(parse::TokenStream& lexer, const std::unordered_map<std::string, runtime::ObjectHolder>& classes);
+    StatementStream(const StatementStream&) = delete;
+    StatementStream& operator=(const StatementStream&) = delete;
+    ~StatementStream();
+
+    // Returns nullptr at the end of the program
+    std::unique_ptr<runtime::Executable> Next();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,313 @@
+#include "bench_runner_p.h"
+#include "lexer.h"
+#include "parallel_lexer.h"
+#include "parse.h"
+#include "runtime.h"
+#include "scan.h"
+#include "token_pipeline.h"
+
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <functional>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace parse {
+
+namespace {
+
+// A generated script: a class and many short top-level statements using it
+string MakeGeneratedScript(int statement_count) {
+    string script = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(amount):
+    self.value = self.value + amount
+    return self.value
+
+counter = Counter()
+)"s;
+    for (int i = 0; i < statement_count; ++i) {
+        script += "x"s + to_string(i % 100) + " = counter.add("s + to_string(i % 7) + ") * 2 + "s
+                  + to_string(i) + "\n"s;
+    }
+    script += "print counter.value\n"s;
+    return script;
+}
+
+// Runs the body in a child process and returns its peak resident memory in KiB
+long MeasurePeakKilobytes(const function<void()>& body) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        body();
+        _exit(0);
+    }
+    int status = 0;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    return usage.ru_maxrss;
+}
+
+// Parsing the whole program before running it against running every statement once parsed
+void BenchmarkStreamingExecution() {
+    const string script = MakeGeneratedScript(200000);
+
+    const auto run_whole = [&script] {
+        istringstream input(script);
+        Lexer lexer(input);
+        auto program = ParseProgram(lexer);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+    };
+    const auto run_streaming = [&script] {
+        istringstream input(script);
+        Lexer lexer(input);
+        StatementStream stream(lexer);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        while (auto statement = stream.Next()) {
+            statement->Execute(closure, context);
+        }
+    };
+
+    // Measured first, before the runs below grow the heap the children inherit
+    const long baseline_peak = MeasurePeakKilobytes([] {});
+    const long whole_peak = MeasurePeakKilobytes(run_whole) - baseline_peak;
+    const long streaming_peak = MeasurePeakKilobytes(run_streaming) - baseline_peak;
+
+    const double whole_first = MeasureSeconds([&script] {
+        istringstream input(script);
+        Lexer lexer(input);
+        auto program = ParseProgram(lexer);
+    });
+    const double streaming_first = MeasureSeconds([&script] {
+        istringstream input(script);
+        Lexer lexer(input);
+        StatementStream stream(lexer);
+        auto statement = stream.Next();
+    });
+
+    const double whole_seconds = MeasureSeconds(run_whole);
+    const double streaming_seconds = MeasureSeconds(run_streaming);
+
+    cerr << "  "sv << script.size() / 1024 << " KiB script, whole program: "sv << whole_seconds * 1000
+         << " ms, first statement after "sv << whole_first * 1000 << " ms, peak +"sv << whole_peak
+         << " KiB; streaming: "sv << streaming_seconds * 1000 << " ms, first statement after "sv
+         << streaming_first * 1000 << " ms, peak +"sv << streaming_peak << " KiB"sv << endl;
+}
+
+// A class library of which the script uses a single method
+string MakeLibraryScript(int class_count, int method_count) {
+    string script;
+    for (int c = 0; c < class_count; ++c) {
+        script += "class Lib"s + to_string(c) + ":\n  def __init__():\n    self.total = 0\n"s;
+        for (int m = 0; m < method_count; ++m) {
+            script += R"(
+  def method)"s + to_string(m) + R"((a, b):
+    if a > b and not a == 0:
+      self.total = self.total + a * 2 - b / 3
+    else:
+      self.total = self.total - (a + b) * )"s + to_string(m + 1) + R"(
+    print "method", a, b, self.total
+    return self.total
+)"s;
+        }
+        script += "\n"s;
+    }
+    script += "lib = Lib0()\nprint lib.method0(1, 2)\n"s;
+    return script;
+}
+
+// Startup of a script that uses a small part of its class library, with its method
+// bodies parsed along with the program and on their first call
+void BenchmarkLazyMethods() {
+    const string script = MakeLibraryScript(500, 20);
+
+    const auto parse = [&script](const ParseOptions& options) {
+        istringstream input(script);
+        Lexer lexer(input);
+        return ParseProgram(lexer, options);
+    };
+    const auto run = [&parse](const ParseOptions& options) {
+        auto program = parse(options);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+    };
+    // Heap memory held by the program once it has run
+    const auto measure_heap = [&parse](const ParseOptions& options) {
+        const size_t before = mallinfo2().uordblks;
+        auto program = parse(options);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+        return (mallinfo2().uordblks - before) / 1024;
+    };
+
+    const double eager_seconds = MeasureSeconds([&run] { run({}); });
+    const double lazy_seconds = MeasureSeconds([&run] { run({.lazy_methods = true}); });
+    const size_t eager_heap = measure_heap({});
+    const size_t lazy_heap = measure_heap({.lazy_methods = true});
+
+    cerr << "  "sv << script.size() / 1024 << " KiB library, eager: "sv << eager_seconds * 1000
+         << " ms, "sv << eager_heap << " KiB of heap; lazy: "sv << lazy_seconds * 1000 << " ms, "sv
+         << lazy_heap << " KiB of heap"sv << endl;
+}
+
+// Parsing with the lexer on the parser's thread and on a thread of its own
+void BenchmarkPipelinedLexer() {
+    const string script = MakeGeneratedScript(200000);
+
+    // Bounds what the overlap can save
+    const double lexing_seconds = MeasureSeconds([&script] {
+        istringstream input(script);
+        Lexer lexer(input);
+        while (!lexer.NextToken().Is<token_type::Eof>()) {
+        }
+    });
+    const double sequential_seconds = MeasureSeconds([&script] {
+        istringstream input(script);
+        Lexer lexer(input);
+        auto program = ParseProgram(lexer);
+    });
+    const double pipelined_seconds = MeasureSeconds([&script] {
+        istringstream input(script);
+        PipelinedLexer lexer(input);
+        auto program = ParseProgram(lexer);
+    });
+
+    cerr << "  "sv << script.size() / 1024 << " KiB script on "sv << thread::hardware_concurrency()
+         << " cores, lexing alone: "sv << lexing_seconds * 1000 << " ms, sequential parse: "sv
+         << sequential_seconds * 1000 << " ms, pipelined: "sv
+         << pipelined_seconds * 1000 << " ms, speedup "sv << sequential_seconds / pipelined_seconds
+         << "x"sv << endl;
+}
+
+// Tokenizing a large source with one Lexer and with LexInParallel
+void BenchmarkParallelLexing() {
+    const string script = MakeGeneratedScript(200000);
+
+    const double sequential_seconds = MeasureSeconds([&script] {
+        istringstream input(script);
+        Lexer lexer(input);
+        vector<Token> tokens{lexer.CurrentToken()};
+        while (!tokens.back().Is<token_type::Eof>()) {
+            tokens.push_back(lexer.NextToken());
+        }
+    });
+    const double one_thread_seconds = MeasureSeconds([&script] {
+        auto tokens = LexInParallel(script, 1);
+    });
+    const double parallel_seconds = MeasureSeconds([&script] {
+        auto tokens = LexInParallel(script);
+    });
+
+    cerr << "  "sv << script.size() / 1024 << " KiB script in "sv << SplitSource(script, 64 * 1024).size()
+         << " parts on "sv << thread::hardware_concurrency() << " cores, Lexer: "sv
+         << sequential_seconds * 1000 << " ms, LexInParallel on 1 thread: "sv << one_thread_seconds * 1000
+         << " ms, on every core: "sv << parallel_seconds * 1000 << " ms"sv << endl;
+}
+
+// Lexing with every scanner the processor supports
+void BenchmarkScanners(const string& name, const string& script) {
+    cerr << "  "sv << script.size() / 1024 << " KiB "sv << name;
+    for (const scan::Scanner* scanner : scan::Supported()) {
+        size_t token_count = 0;
+        const double seconds = MeasureSeconds([&] {
+            istringstream input(script);
+            Lexer lexer(input, *scanner);
+            for (token_count = 1; !lexer.CurrentToken().Is<token_type::Eof>(); ++token_count) {
+                lexer.NextToken();
+            }
+        });
+        cerr << ", "sv << scanner->name << ": "sv << seconds * 1000 << " ms"sv;
+    }
+    cerr << endl;
+}
+
+// Sources where most of the characters are in comments, in strings and in identifiers
+void BenchmarkVectorizedScanning() {
+    string comments;
+    string strings;
+    string identifiers;
+    for (int i = 0; i < 50000; ++i) {
+        const string n = to_string(i);
+        comments += "# comment "s + n + ": the lexer skips this line up to its end, whatever it holds\n"s
+                    + "x = "s + n + " # and the rest of this one too\n"s;
+        strings += "s"s + n + " = 'a string literal long enough to span several blocks' + \"with \\\"escapes\\\"\"\n"s;
+        identifiers += "a_rather_long_variable_name_"s + n + " = another_long_identifier_name.field_name_"s + n
+                       + "\n"s;
+    }
+    BenchmarkScanners("comments"s, comments);
+    BenchmarkScanners("strings"s, strings);
+    BenchmarkScanners("identifiers"s, identifiers);
+}
+
+// The if-chain ParseKeyword used to be, kept to compare FindKeyword with
+bool IsKeywordByChain(const string& s) {
+    return s == "class" || s == "return" || s == "if" || s == "else" || s == "def" || s == "print"
+           || s == "and" || s == "or" || s == "not" || s == "None" || s == "True" || s == "False";
+}
+
+// Keyword recognition on the words of an identifier-heavy source, and lexing that source
+void BenchmarkKeywords() {
+    string script;
+    for (int i = 0; i < 100000; ++i) {
+        const string n = to_string(i % 1000);
+        script += "if value_"s + n + " and not other_"s + n + ":\n  result = obj.method_"s + n
+                  + "(arg, None) or True\nelse:\n  print name_"s + n + ", count\n"s;
+    }
+    vector<string> words;
+    {
+        istringstream input(script);
+        for (string word; input >> word;) {
+            words.push_back(std::move(word));
+        }
+    }
+
+    size_t chain_count = 0;
+    const double chain_seconds = MeasureSeconds([&] {
+        for (const string& word : words) {
+            chain_count += IsKeywordByChain(word);
+        }
+    });
+    size_t hash_count = 0;
+    const double hash_seconds = MeasureSeconds([&] {
+        for (const string& word : words) {
+            hash_count += FindKeyword(word).has_value();
+        }
+    });
+    const double lex_seconds = MeasureSeconds([&script] {
+        istringstream input(script);
+        Lexer lexer(input);
+        while (!lexer.CurrentToken().Is<token_type::Eof>()) {
+            lexer.NextToken();
+        }
+    });
+
+    cerr << "  "sv << words.size() << " words, "sv << chain_count << " keywords: if-chain "sv
+         << chain_seconds * 1000 << " ms, perfect hash "sv << hash_seconds * 1000 << " ms (found "sv
+         << hash_count << "); lexing "sv << script.size() / 1024 << " KiB: "sv << lex_seconds * 1000
+         << " ms"sv << endl;
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, parse::BenchmarkStreamingExecution);
+    RUN_BENCHMARK(br, parse::BenchmarkLazyMethods);
+    RUN_BENCHMARK(br, parse::BenchmarkPipelinedLexer);
+    RUN_BENCHMARK(br, parse::BenchmarkParallelLexing);
+    RUN_BENCHMARK(br, parse::BenchmarkVectorizedScanning);
+    RUN_BENCHMARK(br, parse::BenchmarkKeywords);
+}
+
+}  // namespace parse
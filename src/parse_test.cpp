@@ -3,14 +3,16 @@
 #include "statement.h"
 #include "test_runner_p.h"
 
+#include <thread>
+
 using namespace std;
 
 namespace parse {
 
-unique_ptr<ast::Statement> ParseProgramFromString(const string& program) {
+unique_ptr<ast::Statement> ParseProgramFromString(const string& program, const ParseOptions& options = {}) {
     istringstream is(program);
     parse::Lexer lexer(is);
-    return ParseProgram(lexer);
+    return ParseProgram(lexer, options);
 }
 
 void TestSimpleProgram() {
@@ -244,6 +246,363 @@ print r, c, t1, t2
                  "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n"s);
 }
 
+void TestFreshInstanceReturnsSelf() {
+    const string program = R"(
+class Counter:
+  def __init__(start):
+    self.value = start
+
+  def add(n):
+    self.value = self.value + n
+    return self
+
+class Factory:
+  def make(n):
+    counter = Counter(n)
+    return counter.add(1)
+
+factory = Factory()
+x = factory.make(1)
+y = factory.make(10)
+print x.value, y.value
+)"s;
+
+    runtime::DummyContext context;
+
+    runtime::Closure closure;
+    auto tree = ParseProgramFromString(program);
+    tree->Execute(closure, context);
+
+    ASSERT_EQUAL(context.output.str(), "2 11\n"s);
+}
+
+void TestCyclicInstancesAreReleased() {
+    const string program = R"(
+class Node:
+  def __init__(name):
+    self.name = name
+    self.me = self
+
+  def link(other):
+    self.next = other
+    other.prev = self
+    return self
+
+a = Node('a')
+b = Node('b')
+c = a.link(b)
+print c.me.name, a.next.prev.name, b.prev.next.me.name
+)"s;
+
+    runtime::DummyContext context;
+
+    runtime::CollectCycles();
+    runtime::Closure closure;
+    auto tree = ParseProgramFromString(program);
+    tree->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "a a b\n"s);
+
+    vector<weak_ptr<runtime::ClassInstance>> instances;
+    for (const char* name : {"a", "b"}) {
+        instances.push_back(closure.at(name).TryAs<runtime::ClassInstance>()->weak_from_this());
+    }
+    closure.clear();
+    ASSERT_EQUAL(runtime::CollectCycles(), 2U);
+    for (const auto& instance : instances) {
+        ASSERT(instance.expired());
+    }
+}
+
+void TestStoredSelfOutlivesItsCaller() {
+    const string program = R"(
+class Registry:
+  def __init__():
+    self.item = None
+
+class Node:
+  def __init__(v):
+    self.v = v
+
+  def register(r):
+    r.item = self
+
+class Maker:
+  def make(r):
+    n = Node(42)
+    n.register(r)
+
+r = Registry()
+m = Maker()
+m.make(r)
+k = Node(1)
+print r.item.v, k.v
+)"s;
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    ParseProgramFromString(program)->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "42 1\n"s);
+}
+
+void CheckProgramIsReentrant(const ParseOptions& options) {
+    const string program = R"--(
+class Counter:
+  def __init__(start):
+    self.value = start
+
+  def add(n):
+    self.value = self.value + n
+    return self
+
+  def __str__():
+    return "Counter(" + str(self.value) + ")"
+
+class Factory:
+  def make(n):
+    if n > 0:
+      counter = self.make(n - 1)
+      return counter.add(n)
+    return Counter(0)
+
+counter = Counter(1)
+counter.add(1)
+factory = Factory()
+other = factory.make(10)
+print counter, other, str(other.value)
+)--"s;
+    const string expected = "Counter(2) Counter(55) 55\n"s;
+
+    constexpr int THREAD_COUNT = 8;
+    constexpr int RUNS_PER_THREAD = 200;
+
+    // One tree is executed concurrently, every run with its own globals and context
+    auto tree = ParseProgramFromString(program, options);
+
+    vector<string> outputs(THREAD_COUNT);
+    vector<thread> threads;
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        threads.emplace_back([&tree, &output = outputs[i]] {
+            try {
+                for (int run = 0; run < RUNS_PER_THREAD; ++run) {
+                    runtime::DummyContext context;
+                    runtime::Closure closure;
+                    tree->Execute(closure, context);
+                    output += context.output.str();
+                }
+            } catch (const exception& e) {
+                output = e.what();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    string expected_output;
+    for (int run = 0; run < RUNS_PER_THREAD; ++run) {
+        expected_output += expected;
+    }
+    for (const auto& output : outputs) {
+        ASSERT_EQUAL(output, expected_output);
+    }
+}
+
+void TestProgramIsReentrant() {
+    CheckProgramIsReentrant({});
+}
+
+void TestLazyProgramIsReentrant() {
+    // The threads race to make the first call of every method
+    CheckProgramIsReentrant({.lazy_methods = true});
+}
+
+void TestLazyMethods() {
+    const string program = R"--(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def broken():
+    return undefined_function()
+
+  def make_later():
+    return Later()
+
+  def __str__():
+    return "(" + str(self.x) + ", " + str(self.y) + ")"
+
+class Later:
+  def __init__():
+    self.point = Point(1, 2)
+
+  def declare():
+    class Inner:
+      def get():
+        return 7
+    return Inner()
+
+later = Later()
+print later.point
+inner = Inner()
+print inner.get()
+)--"s;
+
+    ASSERT_THROWS(ParseProgramFromString(program), ParseError);
+
+    auto tree = ParseProgramFromString(program, {.lazy_methods = true});
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    tree->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "(1, 2)\n7\n"s);
+
+    // Errors in a body are reported by every call, and a body sees only the classes
+    // declared before it
+    auto& point = *closure.at("later"s).TryAs<runtime::ClassInstance>()->Fields().at("point"s)
+                       .TryAs<runtime::ClassInstance>();
+    ASSERT_THROWS(point.Call("broken"s, {}, context), ParseError);
+    ASSERT_THROWS(point.Call("broken"s, {}, context), ParseError);
+    ASSERT_THROWS(point.Call("make_later"s, {}, context), ParseError);
+}
+
+void TestLazyMethodsIndentation() {
+    const string program = R"--(
+class Nested:
+  def get():
+    if True:
+      if False:
+        return 1
+      return 2
+    return 3
+
+  def other():
+    return 4
+
+n = Nested()
+print n.get(), n.other()
+)--"s;
+    auto tree = ParseProgramFromString(program, {.lazy_methods = true});
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    tree->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "2 4\n"s);
+
+    ASSERT_THROWS(ParseProgramFromString("class Empty:\n  def get():\n"s, {.lazy_methods = true}),
+                  parse::LexerError);
+}
+
+void TestStatementStream() {
+    const string program = R"(
+class Greeter:
+  def __init__(name):
+    self.name = name
+
+  def greet():
+    return "hello, " + self.name
+
+g = Greeter("stream")
+print g.greet()
+h = Greeter("again")
+print h.name
+print (
+)"s;
+
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    StatementStream stream(lexer);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    size_t count = 0;
+    try {
+        while (auto statement = stream.Next()) {
+            statement->Execute(closure, context);
+            ++count;
+        }
+    } catch (const std::exception&) {
+    }
+
+    // Every statement before the broken one ran, and the class outlived its definition
+    ASSERT_EQUAL(count, 5U);
+    ASSERT_EQUAL(context.output.str(), "hello, stream\nagain\n"s);
+}
+
+void TestStatementStreamAtEnd() {
+    istringstream input("x = 1\n"s);
+    parse::Lexer lexer(input);
+    StatementStream stream(lexer);
+    ASSERT(stream.Next() != nullptr);
+    ASSERT(stream.Next() == nullptr);
+    ASSERT(stream.Next() == nullptr);
+}
+
+string Evaluate(const string& expression) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    ParseProgramFromString("print "s + expression + "\n"s)->Execute(closure, context);
+    return context.output.str();
+}
+
+void TestOperatorPrecedence() {
+    ASSERT_EQUAL(Evaluate("1 + 2 * 3 - 8 / 2 / 2"s), "5\n"s);
+    ASSERT_EQUAL(Evaluate("-2 * -(3 - 5) - -1"s), "-3\n"s);
+    ASSERT_EQUAL(Evaluate("1 + 1 == 2 and not 3 < 2 or False"s), "True\n"s);
+    ASSERT_EQUAL(Evaluate("not not (1 > 2) or (not 1 > 2 and 2 >= 2)"s), "True\n"s);
+    ASSERT_EQUAL(Evaluate("str(1 + 2 == 3) + str((((3))))"s), "True3\n"s);
+    ASSERT_EQUAL(Evaluate("1, (2), 3 != 4"s), "1 2 True\n"s);
+
+    // Like the grammar, comparisons don't chain and only logical operators take not
+    ASSERT_THROWS(Evaluate("1 < 2 < 3"s), parse::LexerError);
+    ASSERT_THROWS(Evaluate("1 + not 2"s), parse::LexerError);
+    ASSERT_THROWS(Evaluate("1 == not 2"s), parse::LexerError);
+    ASSERT_THROWS(Evaluate("(1 + 2"s), parse::LexerError);
+    ASSERT_THROWS(Evaluate("str(1, 2)"s), ParseError);
+}
+
+// Neither parsing nor destroying the tree recurse per operand
+void TestLongExpression() {
+    constexpr int TERMS = 100'000;
+    string expression = "0"s;
+    for (int i = 1; i < TERMS; ++i) {
+        expression += i % 2 == 1 ? " + 3 * 2"s : " - 5"s;
+    }
+
+    auto tree = ParseProgramFromString("x = "s + expression + "\nprint x\n"s);
+    const auto* assignment = dynamic_cast<const ast::Compound&>(*tree).GetStatements().front().get();
+    const ast::Statement* node = &dynamic_cast<const ast::Assignment&>(*assignment).GetValue();
+    int depth = 0;
+    while (const auto* operation = dynamic_cast<const ast::BinaryOperation*>(node)) {
+        ASSERT(dynamic_cast<const ast::Mult*>(&operation->GetRhs()) != nullptr
+               || dynamic_cast<const ast::NumericConst*>(&operation->GetRhs()) != nullptr);
+        node = &operation->GetLhs();
+        ++depth;
+    }
+    ASSERT_EQUAL(depth, TERMS - 1);
+
+    // Every odd term adds 6, every even one subtracts 5
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    tree->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), to_string(TERMS / 2 * 6 - (TERMS / 2 - 1) * 5) + "\n"s);
+}
+
+void TestDeepNesting() {
+    constexpr int DEPTH = 10'000;
+    string expression;
+    for (int i = 0; i < DEPTH; ++i) {
+        expression += "(1 + "s;
+    }
+    expression += "0"s + string(DEPTH, ')');
+    ASSERT_EQUAL(Evaluate(expression), to_string(DEPTH) + "\n"s);
+
+    expression.clear();
+    for (int i = 0; i < DEPTH; ++i) {
+        expression += "not (-str("s;
+    }
+    expression += "1"s + string(DEPTH * 2, ')');
+    ParseProgramFromString("x = "s + expression + "\n"s);
+}
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -255,4 +614,16 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestRecursion2);
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
+    RUN_TEST(tr, parse::TestFreshInstanceReturnsSelf);
+    RUN_TEST(tr, parse::TestCyclicInstancesAreReleased);
+    RUN_TEST(tr, parse::TestStoredSelfOutlivesItsCaller);
+    RUN_TEST(tr, parse::TestProgramIsReentrant);
+    RUN_TEST(tr, parse::TestLazyProgramIsReentrant);
+    RUN_TEST(tr, parse::TestLazyMethods);
+    RUN_TEST(tr, parse::TestLazyMethodsIndentation);
+    RUN_TEST(tr, parse::TestStatementStream);
+    RUN_TEST(tr, parse::TestStatementStreamAtEnd);
+    RUN_TEST(tr, parse::TestOperatorPrecedence);
+    RUN_TEST(tr, parse::TestLongExpression);
+    RUN_TEST(tr, parse::TestDeepNesting);
 }
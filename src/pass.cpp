@@ -0,0 +1,178 @@
+#include "pass.h"
+
+#include "statement.h"
+#include "visitor.h"
+
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace passes {
+
+	using Clock = chrono::steady_clock;
+
+	namespace {
+		struct PassInfo {
+			string_view name;
+			function<unique_ptr<Pass>()> create;
+		};
+
+		const vector<PassInfo>& GetPasses() {
+			static const vector<PassInfo> passes = {
+				{"fold-constants"sv, [] { return make_unique<FoldConstants>(); }},
+				{"inline-methods"sv, [] { return make_unique<InlineMethods>(); }},
+				{"devirtualize"sv, [] { return make_unique<Devirtualize>(); }},
+				{"infer-types"sv, [] { return make_unique<InferTypes>(); }},
+				{"replace-scalars"sv, [] { return make_unique<ReplaceScalars>(); }},
+				{"fuse-statements"sv, [] { return make_unique<FuseStatements>(); }},
+			};
+			return passes;
+		}
+
+		bool IsConstant(const ast::Statement& node) {
+			return dynamic_cast<const ast::NumericConst*>(&node) != nullptr
+				|| dynamic_cast<const ast::StringConst*>(&node) != nullptr
+				|| dynamic_cast<const ast::BoolConst*>(&node) != nullptr
+				|| dynamic_cast<const ast::None*>(&node) != nullptr;
+		}
+
+		// Operations whose result only depends on their operands
+		bool IsPure(const ast::Statement& node) {
+			return dynamic_cast<const ast::BinaryOperation*>(&node) != nullptr
+				|| dynamic_cast<const ast::Not*>(&node) != nullptr
+				|| dynamic_cast<const ast::Stringify*>(&node) != nullptr;
+		}
+
+		unique_ptr<ast::Statement> MakeConstant(const runtime::ObjectHolder& value) {
+			if (const auto* number = value.TryAs<runtime::Number>()){
+				return make_unique<ast::NumericConst>(*number);
+			}
+			if (const auto* str = value.TryAs<runtime::String>()){
+				return make_unique<ast::StringConst>(*str);
+			}
+			if (const auto* b = value.TryAs<runtime::Bool>()){
+				return make_unique<ast::BoolConst>(*b);
+			}
+			if (!value){
+				return make_unique<ast::None>();
+			}
+			return nullptr;
+		}
+
+		class ConstantFolder : public ast::Rewriter {
+		protected:
+			unique_ptr<ast::Statement> Rewrite(unique_ptr<ast::Statement> node) override {
+				if (!IsPure(*node)){
+					return node;
+				}
+				bool all_constant = true;
+				ast::Children::ForEach(static_cast<const ast::Statement&>(*node), [&all_constant](const ast::Statement& child) {
+					all_constant = all_constant && IsConstant(child);
+				});
+				if (!all_constant){
+					return node;
+				}
+
+				runtime::ObjectHolder value;
+				try {
+					runtime::Closure closure;
+					runtime::DummyContext context;
+					value = node->Execute(closure, context);
+				} catch (...) {
+					return node;
+				}
+				auto constant = MakeConstant(value);
+				return constant ? std::move(constant) : std::move(node);
+			}
+		};
+	}
+
+	string Pass::GetSummary() const {
+		return {};
+	}
+
+	PassManager::PassManager(string_view pipeline) {
+		while (!pipeline.empty()){
+			const size_t comma = pipeline.find(',');
+			const string_view name = pipeline.substr(0, comma);
+			auto pass = CreatePass(name);
+			if (!pass){
+				throw invalid_argument("Unknown pass "s + string(name));
+			}
+			Add(std::move(pass));
+			pipeline.remove_prefix(comma == string_view::npos ? pipeline.size() : comma + 1);
+		}
+	}
+
+	void PassManager::Add(unique_ptr<Pass> pass) {
+		passes_.push_back(std::move(pass));
+	}
+
+	vector<PassStats> PassManager::Run(unique_ptr<runtime::Executable>& program) {
+		vector<PassStats> result;
+		result.reserve(passes_.size());
+		size_t nodes = ast::CountNodes(*program);
+		for (const auto& pass : passes_){
+			PassStats stats;
+			stats.name = pass->GetName();
+			stats.nodes_before = nodes;
+			const auto start = Clock::now();
+			pass->Run(program);
+			stats.time = Clock::now() - start;
+			nodes = ast::CountNodes(*program);
+			stats.nodes_after = nodes;
+			stats.summary = pass->GetSummary();
+			result.push_back(std::move(stats));
+		}
+		if (!passes_.empty()){
+			InvalidateCompiledMethods(*program);
+		}
+		return result;
+	}
+
+	void InvalidateCompiledMethods(runtime::Executable& program) {
+		for (auto* cls : ast::CollectClasses(program)){
+			cls->InvalidateCompiledMethods();
+		}
+	}
+
+	unique_ptr<Pass> CreatePass(string_view name) {
+		for (const auto& info : GetPasses()){
+			if (info.name == name){
+				return info.create();
+			}
+		}
+		return nullptr;
+	}
+
+	vector<string_view> GetPassNames() {
+		vector<string_view> result;
+		for (const auto& info : GetPasses()){
+			result.push_back(info.name);
+		}
+		return result;
+	}
+
+	void PrintPassStats(ostream& os, const vector<PassStats>& stats) {
+		os << fixed << setprecision(3);
+		for (const auto& pass : stats){
+			os << pass.name << ": "sv << chrono::duration<double, milli>(pass.time).count() << " ms, nodes: "sv
+			   << pass.nodes_before << " -> "sv << pass.nodes_after;
+			if (!pass.summary.empty()){
+				os << ", "sv << pass.summary;
+			}
+			os << '\n';
+		}
+	}
+
+	string_view FoldConstants::GetName() const {
+		return "fold-constants"sv;
+	}
+
+	void FoldConstants::Run(unique_ptr<runtime::Executable>& program) {
+		ConstantFolder().RewriteTree(program);
+	}
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <chrono>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Analyses and transformations of a parsed program, run after ParseProgram and before the
+// program first runs. A pipeline names its passes in order, separated by commas:
+// "fold-constants,fold-constants"
+namespace passes {
+
+	class Pass {
+	public:
+		virtual ~Pass() = default;
+
+		[[nodiscard]] virtual std::string_view GetName() const = 0;
+
+		// A transformation may replace the program or any of its nodes, an analysis only
+		// records what it finds
+		virtual void Run(std::unique_ptr<runtime::Executable>& program) = 0;
+
+		// What the last run found or changed, for the report. Empty by default
+		[[nodiscard]] virtual std::string GetSummary() const;
+	};
+
+	struct PassStats {
+		std::string name;
+		std::chrono::nanoseconds time{};
+		size_t nodes_before = 0;
+		size_t nodes_after = 0;
+		std::string summary;
+	};
+
+	class PassManager {
+	public:
+		PassManager() = default;
+		// Throws std::invalid_argument for a name no pass has
+		explicit PassManager(std::string_view pipeline);
+
+		void Add(std::unique_ptr<Pass> pass);
+
+		// Returns the stats of every pass, in the order they ran. Drops the code compiled for
+		// the methods of the program before, see InvalidateCompiledMethods
+		std::vector<PassStats> Run(std::unique_ptr<runtime::Executable>& program);
+
+	private:
+		std::vector<std::unique_ptr<Pass>> passes_;
+	};
+
+	// Returns nullptr for a name no pass has
+	std::unique_ptr<Pass> CreatePass(std::string_view name);
+
+	std::vector<std::string_view> GetPassNames();
+
+	void PrintPassStats(std::ostream& os, const std::vector<PassStats>& stats);
+
+	// Drops the code compiled for the methods of the classes the program defines, see jit.h.
+	// A pass run on its own after the program has run needs it before the program runs again
+	void InvalidateCompiledMethods(runtime::Executable& program);
+
+	// "fold-constants": replaces operations on constants by their results, so 2 * 3 + 1
+	// becomes 7 and not "a" == "b" becomes True. Operations that fail, like a division by
+	// zero, are kept and fail when they run
+	class FoldConstants : public Pass {
+	public:
+		[[nodiscard]] std::string_view GetName() const override;
+		void Run(std::unique_ptr<runtime::Executable>& program) override;
+	};
+
+	// "inline-methods": calls of leaf methods become ast::InlinedMethodCall, with a target for
+	// every class of the program whose method of that name and arity is a leaf. A call that
+	// more than MAX_TARGETS classes could take stays a call
+	class InlineMethods : public Pass {
+	public:
+		static constexpr size_t MAX_TARGETS = 4;
+
+		[[nodiscard]] std::string_view GetName() const override;
+		void Run(std::unique_ptr<runtime::Executable>& program) override;
+
+		// Calls inlined by the last run
+		[[nodiscard]] size_t GetInlinedCount() const;
+		[[nodiscard]] std::string GetSummary() const override;
+
+	private:
+		size_t inlined_count_ = 0;
+	};
+
+	// "devirtualize": class hierarchy analysis over the classes of the program. A call on self
+	// in a method of a class takes the same method for the class and every subclass of it the
+	// program declares, unless one of them overrides it. Such calls become ast::BoundMethodCall.
+	// Assumes the program sees every subclass: run it on whole programs, not on ones whose
+	// classes later programs extend
+	class Devirtualize : public Pass {
+	public:
+		struct Stats {
+			// Declared by the classes of the program
+			size_t methods = 0;
+			// Not overridden by any subclass
+			size_t final_methods = 0;
+			size_t self_calls = 0;
+			size_t devirtualized_calls = 0;
+		};
+
+		[[nodiscard]] std::string_view GetName() const override;
+		void Run(std::unique_ptr<runtime::Executable>& program) override;
+		[[nodiscard]] std::string GetSummary() const override;
+
+		// Of the last run
+		[[nodiscard]] const Stats& GetStats() const;
+
+	private:
+		Stats stats_;
+	};
+
+	// "infer-types": proves the types of values along each path through the program and each
+	// method, for locals, for fields and for parameters when every call of the method passes
+	// one type. Arithmetic, comparisons and conditions on proven numbers, strings or bools
+	// become the nodes of statement.h that skip the checks of the types. The rest is kept.
+	// Like "devirtualize" it needs the whole program, run from an empty closure
+	class InferTypes : public Pass {
+	public:
+		struct Stats {
+			// Arithmetic, comparisons and conditions
+			size_t operations = 0;
+			size_t typed_operations = 0;
+			size_t typed_fields = 0;
+			size_t typed_parameters = 0;
+		};
+
+		[[nodiscard]] std::string_view GetName() const override;
+		void Run(std::unique_ptr<runtime::Executable>& program) override;
+		[[nodiscard]] std::string GetSummary() const override;
+
+		// Of the last run
+		[[nodiscard]] const Stats& GetStats() const;
+
+	private:
+		Stats stats_;
+	};
+
+	// "replace-scalars": escape analysis of the instances a method creates. An instance
+	// assigned to a local by a statement of the method body, used after it only through its
+	// fields and made by an __init__ that only sets fields to parameters or constants, never
+	// leaves the call. It isn't created: each field becomes a local of the method
+	class ReplaceScalars : public Pass {
+	public:
+		struct Stats {
+			// Of instances, in method bodies
+			size_t allocations = 0;
+			size_t replaced_allocations = 0;
+		};
+
+		[[nodiscard]] std::string_view GetName() const override;
+		void Run(std::unique_ptr<runtime::Executable>& program) override;
+		[[nodiscard]] std::string GetSummary() const override;
+
+		// Of the last run
+		[[nodiscard]] const Stats& GetStats() const;
+
+	private:
+		Stats stats_;
+	};
+
+	// "fuse-statements": replaces the statements the benchmarks run most by the
+	// superinstructions of statement.h: field increments, bodies ending in a return and ifs
+	// on comparisons. Run it after the other passes, which may not keep the fused shapes
+	class FuseStatements : public Pass {
+	public:
+		struct Stats {
+			size_t field_increments = 0;
+			size_t returning_bodies = 0;
+			size_t compare_branches = 0;
+		};
+
+		[[nodiscard]] std::string_view GetName() const override;
+		void Run(std::unique_ptr<runtime::Executable>& program) override;
+		[[nodiscard]] std::string GetSummary() const override;
+
+		// Of the last run
+		[[nodiscard]] const Stats& GetStats() const;
+
+	private:
+		Stats stats_;
+	};
+}
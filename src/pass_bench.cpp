@@ -0,0 +1,169 @@
+#include "bench_runner_p.h"
+#include "lexer.h"
+#include "parse.h"
+#include "pass.h"
+#include "visitor.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace passes {
+
+namespace {
+
+unique_ptr<runtime::Executable> Parse(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    return ParseProgram(lexer);
+}
+
+double MeasureRuns(const runtime::Executable& program, int runs) {
+    return MeasureSeconds([&] {
+        for (int i = 0; i < runs; ++i) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            program.Execute(closure, context);
+        }
+    });
+}
+
+// A thousand calls of a getter and a setter per run, as calls and inlined
+void BenchmarkInlinedAccessors() {
+    constexpr int RUNS = 1'000;
+    string script = R"(
+class Point:
+  def __init__():
+    self.x = 0
+
+  def get_x():
+    return self.x
+
+  def set_x(x):
+    self.x = x
+
+p = Point()
+)"s;
+    for (int i = 0; i < 500; ++i) {
+        script += "p.set_x(p.get_x() + 1)\n"s;
+    }
+
+    auto program = Parse(script);
+    const double call_seconds = MeasureRuns(*program, RUNS);
+    InlineMethods().Run(program);
+    InvalidateCompiledMethods(*program);
+    const double inlined_seconds = MeasureRuns(*program, RUNS);
+
+    cerr << "  1000 accessor calls: called "sv << call_seconds / RUNS * 1e3 << " ms, inlined "sv
+         << inlined_seconds / RUNS * 1e3 << " ms"sv << endl;
+}
+
+// Two thousand operations on locals and fields per run, checked and typed
+void BenchmarkInferredTypes() {
+    constexpr int RUNS = 1'000;
+    string script = R"(
+class Counter:
+  def __init__():
+    self.count = 0
+
+c = Counter()
+n = 1
+)"s;
+    for (int i = 0; i < 500; ++i) {
+        script += "c.count = c.count + n * 2\nif c.count > n:\n  n = n - 1\n"s;
+    }
+
+    auto program = Parse(script);
+    const double checked_seconds = MeasureRuns(*program, RUNS);
+    InferTypes().Run(program);
+    InvalidateCompiledMethods(*program);
+    const double typed_seconds = MeasureRuns(*program, RUNS);
+
+    cerr << "  2000 operations: checked "sv << checked_seconds / RUNS * 1e3 << " ms, typed "sv
+         << typed_seconds / RUNS * 1e3 << " ms"sv << endl;
+}
+
+// A thousand points per run, of which the replaced ones aren't created
+void BenchmarkReplacedScalars() {
+    constexpr int RUNS = 1'000;
+    string script = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+class Vectors:
+  def dot(ax, ay, bx, by):
+    a = Point(ax, ay)
+    b = Point(bx, by)
+    return a.x * b.x + a.y * b.y
+
+  def length2(ax, ay, bx, by):
+    d = Point(bx - ax, by - ay)
+    s = Point(d.x * d.x, d.y * d.y)
+    return s.x + s.y
+
+v = Vectors()
+)"s;
+    for (int i = 0; i < 250; ++i) {
+        script += "r = v.dot(1, 2, 3, 4) + v.length2(1, 2, 3, 4)\n"s;
+    }
+
+    auto program = Parse(script);
+    const runtime::Class& point = *ast::CollectClasses(*program).front();
+    size_t created = point.GetInstanceCount();
+    const double allocating_seconds = MeasureRuns(*program, RUNS);
+    const size_t allocated = (point.GetInstanceCount() - created) / RUNS;
+    ReplaceScalars().Run(program);
+    InvalidateCompiledMethods(*program);
+    created = point.GetInstanceCount();
+    const double replaced_seconds = MeasureRuns(*program, RUNS);
+    const size_t replaced_allocated = (point.GetInstanceCount() - created) / RUNS;
+
+    cerr << "  point arithmetic: "sv << allocated << " instances "sv << allocating_seconds / RUNS * 1e3
+         << " ms, replaced "sv << replaced_allocated << " instances "sv << replaced_seconds / RUNS * 1e3
+         << " ms"sv << endl;
+}
+
+// A thousand calls per run of a method made of the fused patterns
+void BenchmarkFusedStatements() {
+    constexpr int RUNS = 1'000;
+    string script = R"(
+class Counter:
+  def __init__():
+    self.n = 0
+    self.wraps = 0
+
+  def step(limit):
+    self.n = self.n + 1
+    if self.n > limit:
+      self.n = 0
+      self.wraps = self.wraps + 1
+    return self.n
+
+c = Counter()
+)"s;
+    for (int i = 0; i < 1'000; ++i) {
+        script += "c.step(7)\n"s;
+    }
+
+    auto program = Parse(script);
+    const double plain_seconds = MeasureRuns(*program, RUNS);
+    FuseStatements().Run(program);
+    InvalidateCompiledMethods(*program);
+    const double fused_seconds = MeasureRuns(*program, RUNS);
+
+    cerr << "  1000 calls: plain "sv << plain_seconds / RUNS * 1e3 << " ms, fused "sv
+         << fused_seconds / RUNS * 1e3 << " ms"sv << endl;
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, passes::BenchmarkInlinedAccessors);
+    RUN_BENCHMARK(br, passes::BenchmarkInferredTypes);
+    RUN_BENCHMARK(br, passes::BenchmarkReplacedScalars);
+    RUN_BENCHMARK(br, passes::BenchmarkFusedStatements);
+}
+
+}  // namespace passes
@@ -0,0 +1,684 @@
+#include "lexer.h"
+#include "parse.h"
+#include "pass.h"
+#include "statement.h"
+#include "test_runner_p.h"
+#include "visitor.h"
+
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace passes {
+
+namespace {
+
+const string PROGRAM = R"--(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def scale():
+    self.x = self.x * (2 + 1)
+    self.y = self.y - 10 / 5
+
+  def __str__():
+    return "(" + str(self.x) + ", " + str(self.y) + ")"
+
+p = Point(1 + 1, -4)
+p.scale()
+if not 1 > 2 and "a" + "b" == "ab":
+  print p, str(12) + "3"
+print 1 / 0
+)--"s;
+
+unique_ptr<runtime::Executable> Parse(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    return ParseProgram(lexer);
+}
+
+string Run(const runtime::Executable& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    try {
+        program.Execute(closure, context);
+    } catch (const runtime_error& e) {
+        context.output << "error: "s << e.what() << '\n';
+    }
+    return context.output.str();
+}
+
+// Runs the pass the way PassManager does, so that the program may run again afterwards
+void RunPass(Pass& pass, unique_ptr<runtime::Executable>& program) {
+    pass.Run(program);
+    InvalidateCompiledMethods(*program);
+}
+
+// Records the kinds of the nodes it walks, without walking into classes
+class KindRecorder : public ast::Visitor {
+public:
+    using ast::Visitor::Visit;
+
+    bool Visit(const ast::ClassDefinition&) override {
+        kinds.push_back("class"s);
+        return false;
+    }
+
+    bool Visit(const ast::Assignment& node) override {
+        kinds.push_back("assign "s + node.GetVarName());
+        return true;
+    }
+
+    bool Visit(const ast::NumericConst& node) override {
+        kinds.push_back(to_string(node.GetValue().TryAs<runtime::Number>()->GetValue()));
+        return true;
+    }
+
+    bool VisitNode(const ast::Statement&) override {
+        kinds.push_back("node"s);
+        return true;
+    }
+
+    void Leave(const ast::Statement&) override {
+        ++left;
+    }
+
+    vector<string> kinds;
+    size_t left = 0;
+};
+
+void TestVisitor() {
+    auto program = Parse("class A:\n  def f():\n    return 1\n\nx = 1 + 2\ny = A()\n"s);
+    KindRecorder recorder;
+    recorder.Walk(*program);
+    const vector<string> expected = {"node"s, "class"s, "assign x"s, "node"s, "1"s, "2"s, "assign y"s, "node"s};
+    ASSERT_EQUAL(recorder.kinds, expected);
+    ASSERT_EQUAL(recorder.left, expected.size());
+
+    // Method bodies count as children of their class
+    ASSERT_EQUAL(ast::CountNodes(*program), 12U);
+}
+
+// Adds one to every number
+class Increment : public ast::Rewriter {
+protected:
+    unique_ptr<ast::Statement> Rewrite(unique_ptr<ast::Statement> node) override {
+        if (const auto* number = dynamic_cast<const ast::NumericConst*>(node.get())) {
+            return make_unique<ast::NumericConst>(number->GetValue().TryAs<runtime::Number>()->GetValue() + 1);
+        }
+        return node;
+    }
+};
+
+void TestRewriter() {
+    auto program = Parse("class A:\n  def f():\n    return 10\n\na = A()\nif 0:\n  print 1\nelse:\n  print a.f(), 2 * 3\n"s);
+    ASSERT_EQUAL(Run(*program), "10 6\n"s);
+    Increment().RewriteTree(program);
+    ASSERT_EQUAL(Run(*program), "2\n"s);
+
+    auto other = Parse("class A:\n  def f():\n    return 10\n\na = A()\nprint a.f(), 2 * 3\n"s);
+    Increment().RewriteTree(other);
+    ASSERT_EQUAL(Run(*other), "11 12\n"s);
+}
+
+void TestFoldConstants() {
+    auto program = Parse(PROGRAM);
+    const string expected = Run(*program);
+    ASSERT_EQUAL(expected, "(6, -6) 123\nerror: Division by zero\n"s);
+
+    PassManager manager("fold-constants"sv);
+    const auto stats = manager.Run(program);
+    ASSERT_EQUAL(stats.size(), 1U);
+    ASSERT_EQUAL(stats[0].name, "fold-constants"s);
+    ASSERT_EQUAL(stats[0].nodes_before, ast::CountNodes(*Parse(PROGRAM)));
+    ASSERT_EQUAL(stats[0].nodes_after, ast::CountNodes(*program));
+    // 2 + 1, 10 / 5, 1 + 1, -4, not 1 > 2, "a" + "b" == "ab" and str(12) + "3" are folded
+    ASSERT_EQUAL(stats[0].nodes_before - stats[0].nodes_after, 20U);
+    ASSERT_EQUAL(Run(*program), expected);
+
+    // Nothing is left to fold
+    const auto again = manager.Run(program);
+    ASSERT_EQUAL(again[0].nodes_before, again[0].nodes_after);
+}
+
+void TestFoldsLongExpressions() {
+    string program = "print 0"s;
+    for (int i = 0; i < 100'000; ++i) {
+        program += " + 2"s;
+    }
+    auto tree = Parse(program + "\n"s);
+    PassManager manager("fold-constants"sv);
+    ASSERT_EQUAL(manager.Run(tree)[0].nodes_after, 3U);
+    ASSERT_EQUAL(Run(*tree), "200000\n"s);
+}
+
+const string ACCESSORS = R"--(
+class Counter:
+  def __init__():
+    self.value = 0
+    self.calls = 0
+
+  def get():
+    return self.value
+
+  def set(value):
+    self.value = value
+
+  def me():
+    return self
+
+  def name():
+    return "counter"
+
+  def first(a, b):
+    return a
+
+  def missing():
+    return self.nothing
+
+  def bump():
+    self.calls = self.calls + 1
+    return self.calls
+
+class Loud(Counter):
+  def get():
+    print "loud get"
+    return self.value
+
+c = Counter()
+l = Loud()
+c.set(5)
+l.set(c.get() + 1)
+print c.get(), l.get()
+print c.name(), c.first(c.bump(), c.bump()), c.calls
+x = c.me()
+print x.get()
+if c.get() > 3:
+  print "big"
+print c.missing()
+)--"s;
+
+void TestInlineMethods() {
+    auto program = Parse(ACCESSORS);
+    const string expected = Run(*program);
+    ASSERT_EQUAL(expected, "5 loud get\n6\ncounter 1 2\n5\nbig\nerror: Not find variable\n"s);
+
+    InlineMethods pass;
+    RunPass(pass, program);
+    // Every call but the two of bump, which isn't a leaf
+    ASSERT_EQUAL(pass.GetInlinedCount(), 11U);
+    ASSERT_EQUAL(Run(*program), expected);
+
+    // Calls of get on a Loud receiver fall back to the call
+    class TargetCounter : public ast::Visitor {
+    public:
+        using ast::Visitor::Visit;
+
+        bool Visit(const ast::InlinedMethodCall& node) override {
+            targets[node.GetCall().GetMethod()] = node.GetTargets().size();
+            return true;
+        }
+
+        map<string, size_t> targets;
+    };
+    TargetCounter counter;
+    counter.Walk(*program);
+    ASSERT_EQUAL(counter.targets.at("get"s), 1U);
+    ASSERT_EQUAL(counter.targets.at("set"s), 2U);
+    ASSERT_EQUAL(counter.targets.count("bump"s), 0U);
+}
+
+// A method returning self hands out an owning holder, also when it is called through a
+// non-owning one, whether the call is inlined or not
+void TestInlinedSelfIsBoundLikeCall() {
+    for (bool inline_calls : {false, true}) {
+        auto program = Parse("class Box:\n  def me():\n    return self\n\nx = b.me()\n"s);
+        if (inline_calls) {
+            InlineMethods pass;
+            RunPass(pass, program);
+            ASSERT_EQUAL(pass.GetInlinedCount(), 1U);
+        }
+        runtime::ObjectHolder box = ast::CollectClasses(*program).front()->NewInstance();
+        runtime::Closure closure = {{"b"s, runtime::ObjectHolder::Share(*box)}};
+        runtime::DummyContext context;
+        program->Execute(closure, context);
+        ASSERT(closure.at("x"s).Get() == box.Get());
+        ASSERT(closure.at("x"s).IsOwning());
+    }
+}
+
+void TestInlineMethodsOfManyClasses() {
+    string program;
+    for (size_t i = 0; i <= InlineMethods::MAX_TARGETS; ++i) {
+        program += "class C"s + to_string(i) + ":\n  def get():\n    return "s + to_string(i) + "\n\n"s;
+    }
+    program += "c = C3()\nprint c.get()\n"s;
+    auto tree = Parse(program);
+    InlineMethods pass;
+    RunPass(pass, tree);
+    ASSERT_EQUAL(pass.GetInlinedCount(), 0U);
+    ASSERT_EQUAL(Run(*tree), "3\n"s);
+}
+
+const string SHAPES = R"--(
+class Shape:
+  def __init__(size):
+    self.size = size
+
+  def area():
+    return self.size * self.size
+
+  def name():
+    return "shape"
+
+  def describe():
+    return self.name() + " " + str(self.area())
+
+  def twice():
+    return self.area() + self.area()
+
+  def scaled(k):
+    return self.size * k
+
+  def double():
+    return self.scaled(2)
+
+  def swap(other):
+    self = other
+    return self.scaled(1)
+
+class Square(Shape):
+  def name():
+    return "square"
+
+  def label():
+    return self.name()
+
+class Big(Square):
+  def area():
+    return 100
+
+s = Shape(2)
+q = Square(3)
+b = Big(4)
+print s.describe(), q.describe(), b.describe()
+print s.twice(), q.twice(), b.twice()
+print s.double(), b.double(), s.swap(q), b.label()
+)--"s;
+
+void TestDevirtualize() {
+    auto program = Parse(SHAPES);
+    const string expected = Run(*program);
+    ASSERT_EQUAL(expected, "shape 4 square 9 square 100\n8 18 200\n4 8 3 square\n"s);
+
+    Devirtualize pass;
+    RunPass(pass, program);
+    // Calls of area and of Shape.name may reach an override, swap reassigns self
+    const auto& stats = pass.GetStats();
+    ASSERT_EQUAL(stats.methods, 11U);
+    ASSERT_EQUAL(stats.final_methods, 9U);
+    ASSERT_EQUAL(stats.self_calls, 6U);
+    ASSERT_EQUAL(stats.devirtualized_calls, 2U);
+    ASSERT_EQUAL(pass.GetSummary(), "2 of 6 calls on self devirtualized, 9 of 11 methods final"s);
+    ASSERT_EQUAL(Run(*program), expected);
+
+    class BoundCalls : public ast::Visitor {
+    public:
+        using ast::Visitor::Visit;
+
+        bool Visit(const ast::BoundMethodCall& node) override {
+            targets[node.GetCall().GetMethod()] = &node.GetTarget();
+            return true;
+        }
+
+        bool Visit(const ast::ClassDefinition& node) override {
+            classes[node.GetClass().GetName()] = &node.GetClass();
+            return true;
+        }
+
+        map<string, const runtime::Method*> targets;
+        map<string, const runtime::Class*> classes;
+    };
+    BoundCalls calls;
+    calls.Walk(*program);
+    ASSERT_EQUAL(calls.targets.size(), 2U);
+    ASSERT_EQUAL(calls.targets.at("name"s), calls.classes.at("Square"s)->GetMethod("name"s, 0));
+    ASSERT_EQUAL(calls.targets.at("scaled"s), calls.classes.at("Shape"s)->GetMethod("scaled"s, 1));
+}
+
+const string TYPES = R"--(
+class Counter:
+  def __init__(start):
+    self.count = start
+    self.label = "n"
+
+  def add(step):
+    self.count = self.count + step
+    return self.count
+
+  def twice(x):
+    return x + x
+
+  def big():
+    return self.count > 10
+
+c = Counter(1)
+n = 2
+c.add(n)
+c.add(n * 3)
+s = "a" + "b"
+print c.count, c.label + s, c.twice(1), c.twice("a")
+if c.big():
+  print "big"
+flag = c.count >= 9
+if flag and not False:
+  print "flag"
+if n:
+  n = "n"
+print n + "!"
+)--"s;
+
+void TestInferTypes() {
+    auto program = Parse(TYPES);
+    const string expected = Run(*program);
+    ASSERT_EQUAL(expected, "9 nab 2 aa\nflag\nn!\n"s);
+
+    InferTypes pass;
+    RunPass(pass, program);
+    // Not typed: x + x, as twice takes numbers and strings, the conditions on c.big() and on n,
+    // and n + "!", as n may be a number or a string there
+    const auto& stats = pass.GetStats();
+    ASSERT_EQUAL(stats.operations, 13U);
+    ASSERT_EQUAL(stats.typed_operations, 9U);
+    ASSERT_EQUAL(stats.typed_fields, 2U);
+    ASSERT_EQUAL(stats.typed_parameters, 2U);
+    ASSERT_EQUAL(pass.GetSummary(), "9 of 13 checks skipped, 2 fields and 2 parameters typed"s);
+    ASSERT_EQUAL(Run(*program), expected);
+
+    class Additions : public ast::Visitor {
+    public:
+        using ast::Visitor::Visit;
+
+        bool Visit(const ast::Add& node) override {
+            if (dynamic_cast<const ast::NumberOperation<ast::Add>*>(&node) != nullptr) {
+                ++numbers;
+            } else if (dynamic_cast<const ast::StringConcatenation*>(&node) != nullptr) {
+                ++strings;
+            } else {
+                ++checked;
+            }
+            return true;
+        }
+
+        int numbers = 0;
+        int strings = 0;
+        int checked = 0;
+    };
+    Additions additions;
+    additions.Walk(*program);
+    ASSERT_EQUAL(additions.numbers, 1);
+    ASSERT_EQUAL(additions.strings, 2);
+    ASSERT_EQUAL(additions.checked, 2);
+
+    // A second run finds the same types
+    RunPass(pass, program);
+    ASSERT_EQUAL(pass.GetStats().typed_operations, 9U);
+    ASSERT_EQUAL(Run(*program), expected);
+}
+
+void TestInferTypesOfLongExpressions() {
+    string program = "n = 1\nx = n"s;
+    for (int i = 0; i < 100'000; ++i) {
+        program += " - n"s;
+    }
+    auto tree = Parse(program + "\n"s);
+    InferTypes pass;
+    RunPass(pass, tree);
+    ASSERT_EQUAL(pass.GetStats().typed_operations, 100'000U);
+}
+
+const string POINTS = R"--(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+class Swap:
+  def __init__(a, b):
+    self.first = b
+    self.second = a
+
+class Box:
+  def __init__(p):
+    self.p = p
+    self.tag = "box"
+
+class Counter:
+  def __init__():
+    self.n = 0
+
+  def bump():
+    self.n = self.n + 1
+
+class Geometry:
+  def __init__():
+    self.last = None
+
+  def dist2(ax, ay, bx, by):
+    d = Point(bx - ax, by - ay)
+    return d.x * d.x + d.y * d.y
+
+  def shifted(ax, ay):
+    p = Point(ax, ay)
+    p.x = p.x + 1
+    b = Box(p.y)
+    return p.x + b.p
+
+  def swapped(ax, ay):
+    s = Swap(ax, ay)
+    return s.first - s.second
+
+  def kept(ax, ay):
+    p = Point(ax, ay)
+    self.last = p
+    return p.x
+
+  def made(ax, ay):
+    p = Point(ax, ay)
+    return p
+
+  def called():
+    c = Counter()
+    c.bump()
+    return c.n
+
+g = Geometry()
+print g.dist2(1, 2, 4, 6), g.shifted(3, 4), g.swapped(10, 3), g.kept(7, 8), g.last.x
+m = g.made(5, 6)
+print m.y, g.called()
+)--"s;
+
+void TestReplaceScalars() {
+    auto program = Parse(POINTS);
+    const runtime::Class* point = ast::CollectClasses(*program).front();
+    ASSERT_EQUAL(point->GetName(), "Point"s);
+
+    size_t created = point->GetInstanceCount();
+    const string expected = Run(*program);
+    ASSERT_EQUAL(expected, "25 8 -7 7 7\n6 1\n"s);
+    ASSERT_EQUAL(point->GetInstanceCount() - created, 4U);
+
+    ReplaceScalars pass;
+    RunPass(pass, program);
+    // The instances of kept and made leave the call, the counter is passed to bump as self
+    ASSERT_EQUAL(pass.GetStats().allocations, 7U);
+    ASSERT_EQUAL(pass.GetStats().replaced_allocations, 4U);
+    ASSERT_EQUAL(pass.GetSummary(), "4 of 7 instances replaced by locals"s);
+
+    created = point->GetInstanceCount();
+    ASSERT_EQUAL(Run(*program), expected);
+    ASSERT_EQUAL(point->GetInstanceCount() - created, 2U);
+}
+
+void TestReplaceScalarsKeepsEscapingInstances() {
+    // Used before it is assigned, assigned twice, only assigned on one path, and an __init__
+    // that does more than set fields
+    auto program = Parse(R"--(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+class Loud:
+  def __init__():
+    print "made"
+    self.x = 1
+
+class User:
+  def before():
+    if False:
+      print p.x
+    p = Point(1, 2)
+    return p.x
+
+  def twice():
+    p = Point(1, 2)
+    p = Point(3, 4)
+    return p.x
+
+  def branch(flag):
+    if flag:
+      p = Point(1, 2)
+    return p.x
+
+  def loud():
+    l = Loud()
+    return l.x
+
+u = User()
+print u.before(), u.twice(), u.branch(True), u.loud()
+)--"s);
+    const string expected = Run(*program);
+    ASSERT_EQUAL(expected, "1 3 1 made\n1\n"s);
+
+    ReplaceScalars pass;
+    RunPass(pass, program);
+    ASSERT_EQUAL(pass.GetStats().allocations, 5U);
+    ASSERT_EQUAL(pass.GetStats().replaced_allocations, 0U);
+    ASSERT_EQUAL(Run(*program), expected);
+}
+
+const string ACCOUNT = R"--(
+class Money:
+  def __init__(v):
+    self.v = v
+
+  def __add__(other):
+    self.v = self.v + other
+    return self
+
+class Account:
+  def __init__():
+    self.balance = 0
+    self.log = ""
+    self.money = Money(1)
+
+  def deposit(amount):
+    self.balance = self.balance + amount
+    self.log = self.log + "d"
+    self.money = self.money + amount
+    return self.balance
+
+  def sign():
+    if self.balance < 0:
+      return "negative"
+    if self.log == "dd":
+      return "twice"
+    return "positive"
+
+  def count():
+    self.balance = self.balance + 1
+
+a = Account()
+print a.deposit(5), a.sign()
+print a.deposit(-10), a.sign(), a.log, a.money.v
+a.count()
+print a.balance
+)--"s;
+
+void TestFuseStatements() {
+    auto program = Parse(ACCOUNT);
+    const string expected = Run(*program);
+    ASSERT_EQUAL(expected, "5 positive\n-5 negative dd -4\n-4\n"s);
+
+    FuseStatements pass;
+    RunPass(pass, program);
+    // The increments of a string and of an instance with __add__ take the slow path, so does
+    // the comparison of strings
+    ASSERT_EQUAL(pass.GetStats().field_increments, 5U);
+    ASSERT_EQUAL(pass.GetStats().returning_bodies, 3U);
+    ASSERT_EQUAL(pass.GetStats().compare_branches, 2U);
+    ASSERT_EQUAL(pass.GetSummary(), "5 field increments, 3 returning bodies, 2 compare branches"s);
+    ASSERT_EQUAL(Run(*program), expected);
+
+    RunPass(pass, program);
+    ASSERT_EQUAL(pass.GetStats().field_increments, 0U);
+    ASSERT_EQUAL(Run(*program), expected);
+}
+
+void TestAllPasses() {
+    for (const string* script : {&ACCESSORS, &SHAPES, &TYPES, &POINTS, &ACCOUNT}) {
+        auto program = Parse(*script);
+        const string expected = Run(*program);
+        PassManager("fold-constants,inline-methods,devirtualize,infer-types,replace-scalars,fuse-statements"sv)
+            .Run(program);
+        ASSERT_EQUAL(Run(*program), expected);
+    }
+}
+
+void TestPipelines() {
+    ASSERT_THROWS(PassManager("fold-constants,unknown"sv), invalid_argument);
+    ASSERT(CreatePass("unknown"sv) == nullptr);
+    ASSERT_EQUAL(GetPassNames().front(), "fold-constants"sv);
+
+    auto program = Parse("print 1 + 2\n"s);
+    ASSERT(PassManager(""sv).Run(program).empty());
+    const auto stats = PassManager("fold-constants,fold-constants"sv).Run(program);
+    ASSERT_EQUAL(stats.size(), 2U);
+    ASSERT_EQUAL(stats[0].nodes_before, 5U);
+    ASSERT_EQUAL(stats[0].nodes_after, 3U);
+    ASSERT_EQUAL(stats[1].nodes_before, 3U);
+
+    ostringstream report;
+    PrintPassStats(report, stats);
+    ASSERT(report.str().find("fold-constants: "s) == 0);
+    ASSERT(report.str().find("nodes: 5 -> 3\n"s) != string::npos);
+}
+
+}  // namespace
+
+void RunPassTests(TestRunner& tr) {
+    RUN_TEST(tr, passes::TestVisitor);
+    RUN_TEST(tr, passes::TestRewriter);
+    RUN_TEST(tr, passes::TestFoldConstants);
+    RUN_TEST(tr, passes::TestFoldsLongExpressions);
+    RUN_TEST(tr, passes::TestInlineMethods);
+    RUN_TEST(tr, passes::TestInlinedSelfIsBoundLikeCall);
+    RUN_TEST(tr, passes::TestInlineMethodsOfManyClasses);
+    RUN_TEST(tr, passes::TestDevirtualize);
+    RUN_TEST(tr, passes::TestInferTypes);
+    RUN_TEST(tr, passes::TestInferTypesOfLongExpressions);
+    RUN_TEST(tr, passes::TestReplaceScalars);
+    RUN_TEST(tr, passes::TestReplaceScalarsKeepsEscapingInstances);
+    RUN_TEST(tr, passes::TestFuseStatements);
+    RUN_TEST(tr, passes::TestAllPasses);
+    RUN_TEST(tr, passes::TestPipelines);
+}
+
+}  // namespace passes
@@ -0,0 +1,65 @@
+#include "program_cache.h"
+
+#include "image.h"
+#include "lexer.h"
+#include "parse.h"
+#include "runtime.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace server {
+
+	ProgramCache::ProgramCache(size_t capacity)
+		: capacity_(max<size_t>(capacity, 1)) {
+	}
+
+	ProgramCache::Program ProgramCache::Get(const string& source) {
+		const uint64_t hash = Hash(source);
+		{
+			lock_guard guard(mutex_);
+			if (auto it = index_.find(hash); it != index_.end() && it->second->source == source){
+				++stats_.hits;
+				entries_.splice(entries_.begin(), entries_, it->second);
+				return it->second->program;
+			}
+			++stats_.misses;
+		}
+
+		// Parsing is done without the lock, so a miss does not hold up the other requests
+		istringstream input(source);
+		parse::Lexer lexer(input);
+		Program program = ParseProgram(lexer);
+
+		lock_guard guard(mutex_);
+		if (auto it = index_.find(hash); it != index_.end()){
+			// Parsed concurrently by another request, or a different source with the same hash
+			entries_.erase(it->second);
+			index_.erase(it);
+		}
+		entries_.push_front({hash, source, program});
+		index_[hash] = entries_.begin();
+		if (entries_.size() > capacity_){
+			index_.erase(entries_.back().hash);
+			entries_.pop_back();
+			++stats_.evictions;
+		}
+		return program;
+	}
+
+	ProgramCache::Stats ProgramCache::GetStats() const {
+		lock_guard guard(mutex_);
+		return stats_;
+	}
+
+	size_t ProgramCache::GetSize() const {
+		lock_guard guard(mutex_);
+		return entries_.size();
+	}
+
+	uint64_t ProgramCache::Hash(string_view source) {
+		return image::HashSource(source);
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace runtime {
+	class Executable;
+}
+
+namespace server {
+
+	// Parsed programs keyed by a hash of their source, least recently used ones are evicted
+	// first. Programs are reentrant, so a cached one may be run by many threads at once
+	class ProgramCache {
+	public:
+		using Program = std::shared_ptr<const runtime::Executable>;
+
+		struct Stats {
+			size_t hits = 0;
+			size_t misses = 0;
+			size_t evictions = 0;
+		};
+
+		explicit ProgramCache(size_t capacity);
+
+		// Parses the source on a miss. A source that fails to parse is not cached
+		Program Get(const std::string& source);
+
+		[[nodiscard]] Stats GetStats() const;
+		[[nodiscard]] size_t GetSize() const;
+
+		// 64-bit FNV-1a
+		static uint64_t Hash(std::string_view source);
+
+	private:
+		struct Entry {
+			uint64_t hash;
+			std::string source;
+			Program program;
+		};
+
+		mutable std::mutex mutex_;
+		size_t capacity_;
+		// The most recently used entry is the first one
+		std::list<Entry> entries_;
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+		Stats stats_;
+	};
+}
@@ -0,0 +1,77 @@
+#include "program_cache.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+
+using namespace std;
+
+namespace server {
+
+namespace {
+
+string Run(const ProgramCache::Program& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program->Execute(closure, context);
+    return context.output.str();
+}
+
+void TestCacheHitReturnsSameProgram() {
+    ProgramCache cache(4);
+    const auto first = cache.Get("print 1\n"s);
+    const auto second = cache.Get("print 1\n"s);
+    ASSERT(first == second);
+    ASSERT_EQUAL(Run(second), "1\n"s);
+
+    const auto stats = cache.GetStats();
+    ASSERT_EQUAL(stats.hits, 1U);
+    ASSERT_EQUAL(stats.misses, 1U);
+    ASSERT_EQUAL(stats.evictions, 0U);
+}
+
+void TestLeastRecentlyUsedIsEvicted() {
+    ProgramCache cache(2);
+    const auto a = cache.Get("print 'a'\n"s);
+    cache.Get("print 'b'\n"s);
+    // "a" becomes the most recently used, so "b" goes first
+    ASSERT(cache.Get("print 'a'\n"s) == a);
+    cache.Get("print 'c'\n"s);
+    ASSERT_EQUAL(cache.GetSize(), 2U);
+    ASSERT_EQUAL(cache.GetStats().evictions, 1U);
+
+    ASSERT(cache.Get("print 'a'\n"s) == a);
+    ASSERT_EQUAL(cache.GetStats().hits, 2U);
+    cache.Get("print 'b'\n"s);
+    ASSERT_EQUAL(cache.GetStats().misses, 4U);
+}
+
+void TestEvictedProgramStaysUsable() {
+    ProgramCache cache(1);
+    const auto program = cache.Get("x = 2\nprint x * 3\n"s);
+    cache.Get("print 0\n"s);
+    ASSERT_EQUAL(cache.GetStats().evictions, 1U);
+    ASSERT_EQUAL(Run(program), "6\n"s);
+}
+
+void TestParseErrorIsNotCached() {
+    ProgramCache cache(2);
+    ASSERT_THROWS(cache.Get("print (\n"s), std::runtime_error);
+    ASSERT_EQUAL(cache.GetSize(), 0U);
+}
+
+void TestHash() {
+    ASSERT_EQUAL(ProgramCache::Hash(""sv), 14695981039346656037ULL);
+    ASSERT_EQUAL(ProgramCache::Hash("a"sv), 0xaf63dc4c8601ec8cULL);
+    ASSERT(ProgramCache::Hash("print 1\n"sv) != ProgramCache::Hash("print 2\n"sv));
+}
+
+}  // namespace
+
+void RunProgramCacheTests(TestRunner& tr) {
+    RUN_TEST(tr, server::TestCacheHitReturnsSameProgram);
+    RUN_TEST(tr, server::TestLeastRecentlyUsedIsEvicted);
+    RUN_TEST(tr, server::TestEvictedProgramStaysUsable);
+    RUN_TEST(tr, server::TestParseErrorIsNotCached);
+    RUN_TEST(tr, server::TestHash);
+}
+
+}  // namespace server
@@ -0,0 +1,300 @@
+#include "pass.h"
+
+#include "statement.h"
+#include "visitor.h"
+
+#include <algorithm>
+#include <optional>
+
+using namespace std;
+
+namespace passes {
+
+	namespace {
+		using ast::Children;
+		using ast::Statement;
+		using Slot = Children::Slot;
+
+		const string SELF = "self"s;
+		const string INIT_METHOD = "__init__"s;
+
+		// Locals of a replaced instance. Names have no dots, so the program can't use them
+		string FieldLocal(const string& variable, const string& field) {
+			return variable + "."s + field;
+		}
+
+		string ParameterLocal(const string& variable, const string& param) {
+			return variable + "."s + INIT_METHOD + "."s + param;
+		}
+
+		// self.field = value in __init__, the value being a parameter or a constant
+		struct FieldInit {
+			string field;
+			const Statement* value;
+			optional<size_t> param;
+		};
+
+		unique_ptr<Statement> CopyConstant(const Statement& node) {
+			if (const auto* number = dynamic_cast<const ast::NumericConst*>(&node)){
+				return make_unique<ast::NumericConst>(*number->GetValue().TryAs<runtime::Number>());
+			}
+			if (const auto* str = dynamic_cast<const ast::StringConst*>(&node)){
+				return make_unique<ast::StringConst>(*str->GetValue().TryAs<runtime::String>());
+			}
+			if (const auto* b = dynamic_cast<const ast::BoolConst*>(&node)){
+				return make_unique<ast::BoolConst>(*b->GetValue().TryAs<runtime::Bool>());
+			}
+			if (dynamic_cast<const ast::None*>(&node) != nullptr){
+				return make_unique<ast::None>();
+			}
+			return nullptr;
+		}
+
+		optional<vector<FieldInit>> GetFieldInits(const runtime::Method& init) {
+			const auto* body = dynamic_cast<const ast::MethodBody*>(init.body.get());
+			const auto* statements = body ? dynamic_cast<const ast::Compound*>(&body->GetBody()) : nullptr;
+			if (statements == nullptr){
+				return nullopt;
+			}
+
+			const auto& params = init.formal_params;
+			vector<FieldInit> inits;
+			for (const auto& statement : statements->GetStatements()){
+				const auto* assignment = dynamic_cast<const ast::FieldAssignment*>(statement.get());
+				if (assignment == nullptr || assignment->GetObject().GetDottedIds() != vector{SELF}){
+					return nullopt;
+				}
+				FieldInit field_init{assignment->GetFieldName(), &assignment->GetValue(), nullopt};
+				if (const auto* variable = dynamic_cast<const ast::VariableValue*>(field_init.value)){
+					const auto& ids = variable->GetDottedIds();
+					const auto param = find(params.begin(), params.end(), ids.front());
+					if (ids.size() != 1 || param == params.end()){
+						return nullopt;
+					}
+					field_init.param = param - params.begin();
+				}else if (CopyConstant(*field_init.value) == nullptr){
+					return nullopt;
+				}
+				inits.push_back(std::move(field_init));
+			}
+			return inits;
+		}
+
+		// Pre-order, so f may replace a node before its children are walked. The methods of
+		// class definitions run in frames of their own and aren't walked
+		void ForEachNode(Slot& root, const function<void(Slot&)>& f) {
+			vector<Slot*> stack{&root};
+			while (!stack.empty()){
+				Slot& slot = *stack.back();
+				stack.pop_back();
+				f(slot);
+				if (dynamic_cast<const ast::ClassDefinition*>(slot.get()) == nullptr){
+					Children::ForEach(*slot, [&stack](Slot& child) {
+						stack.push_back(&child);
+					});
+				}
+			}
+		}
+
+		// Ordered, a statement uses a variable as much as its most of its nodes do
+		enum class Use {
+			NONE,
+			FIELDS,
+			// Or assigned another value
+			ESCAPES,
+		};
+
+		Use FindUses(Slot& root, const string& variable) {
+			Use use = Use::NONE;
+			ForEachNode(root, [&use, &variable](Slot& slot) {
+				Use node_use = Use::NONE;
+				if (const auto* value = dynamic_cast<const ast::VariableValue*>(slot.get())){
+					if (value->GetDottedIds().front() == variable){
+						node_use = value->GetDottedIds().size() == 1 ? Use::ESCAPES : Use::FIELDS;
+					}
+				}else if (const auto* field = dynamic_cast<const ast::FieldAssignment*>(slot.get())){
+					if (field->GetObject().GetDottedIds().front() == variable){
+						node_use = Use::FIELDS;
+					}
+				}else if (const auto* assignment = dynamic_cast<const ast::Assignment*>(slot.get())){
+					if (assignment->GetVarName() == variable){
+						node_use = Use::ESCAPES;
+					}
+				}
+				use = max(use, node_use);
+			});
+			return use;
+		}
+
+		// v.f.g becomes (v.f).g
+		vector<string> ToFieldLocal(vector<string> ids) {
+			ids[1] = FieldLocal(ids[0], ids[1]);
+			ids.erase(ids.begin());
+			return ids;
+		}
+
+		void ReplaceUses(Slot& root, const string& variable) {
+			ForEachNode(root, [&variable](Slot& slot) {
+				if (const auto* value = dynamic_cast<const ast::VariableValue*>(slot.get())){
+					if (value->GetDottedIds().front() == variable){
+						slot = make_unique<ast::VariableValue>(ToFieldLocal(value->GetDottedIds()));
+					}
+				}else if (const auto* assignment = dynamic_cast<const ast::FieldAssignment*>(slot.get())){
+					const auto& ids = assignment->GetObject().GetDottedIds();
+					if (ids.front() != variable){
+						return;
+					}
+					string field = assignment->GetFieldName();
+					auto object = ids.size() == 1 ? nullopt : optional{ToFieldLocal(ids)};
+					auto value = std::move(Children::Take(*slot).front());
+					if (object){
+						slot = make_unique<ast::FieldAssignment>(ast::VariableValue(std::move(*object)), std::move(field),
+																 std::move(value));
+					}else{
+						slot = make_unique<ast::Assignment>(FieldLocal(variable, field), std::move(value));
+					}
+				}
+			});
+		}
+
+		// The statements setting the locals of the fields as the instance and __init__ would
+		unique_ptr<Statement> InitLocals(const string& variable, const runtime::Method* init,
+										 const vector<FieldInit>& inits, vector<Slot> args) {
+			auto locals = make_unique<ast::Compound>();
+			if (init == nullptr){
+				for (auto& arg : args){
+					locals->AddStatement(std::move(arg));
+				}
+				return locals;
+			}
+
+			// The arguments run once each and in order. When the fields take every parameter in
+			// that order the arguments are assigned to them directly
+			vector<size_t> params;
+			for (const auto& field_init : inits){
+				if (field_init.param){
+					params.push_back(*field_init.param);
+				}
+			}
+			bool direct = params.size() == args.size();
+			for (size_t i = 0; direct && i < params.size(); ++i){
+				direct = params[i] == i;
+			}
+			if (!direct){
+				for (size_t i = 0; i < args.size(); ++i){
+					locals->AddStatement(make_unique<ast::Assignment>(ParameterLocal(variable, init->formal_params[i]),
+																	  std::move(args[i])));
+				}
+			}
+
+			for (const auto& field_init : inits){
+				unique_ptr<Statement> value;
+				if (!field_init.param){
+					value = CopyConstant(*field_init.value);
+				}else if (direct){
+					value = std::move(args[*field_init.param]);
+				}else{
+					value = make_unique<ast::VariableValue>(ParameterLocal(variable, init->formal_params[*field_init.param]));
+				}
+				locals->AddStatement(make_unique<ast::Assignment>(FieldLocal(variable, field_init.field), std::move(value)));
+			}
+			return locals;
+		}
+
+		class ScalarReplacer {
+		public:
+			ReplaceScalars::Stats Run(const vector<runtime::Class*>& classes) {
+				for (auto* cls : classes){
+					for (auto& method : cls->GetMethods()){
+						if (dynamic_cast<const ast::MethodBody*>(method.body.get()) != nullptr){
+							ForEachNode(method.body, [this](Slot& slot) {
+								stats_.allocations += dynamic_cast<const ast::NewInstance*>(slot.get()) != nullptr;
+							});
+							ReplaceInstances(method);
+						}
+					}
+				}
+				return stats_;
+			}
+
+		private:
+			// Only the instances assigned by a statement of the body itself: nothing after it
+			// runs without it
+			void ReplaceInstances(runtime::Method& method) {
+				vector<Slot*> statements;
+				Children::ForEach(*method.body, [&statements](Slot& body) {
+					if (dynamic_cast<const ast::Compound*>(body.get()) != nullptr){
+						Children::ForEach(*body, [&statements](Slot& statement) {
+							statements.push_back(&statement);
+						});
+					}
+				});
+
+				for (size_t k = 0; k < statements.size(); ++k){
+					auto* assignment = dynamic_cast<const ast::Assignment*>(statements[k]->get());
+					const auto* instance = assignment ? dynamic_cast<const ast::NewInstance*>(&assignment->GetValue()) : nullptr;
+					if (instance == nullptr){
+						continue;
+					}
+					const string variable = assignment->GetVarName();
+					const auto& params = method.formal_params;
+					if (variable == SELF || find(params.begin(), params.end(), variable) != params.end()){
+						continue;
+					}
+					const auto* init = instance->GetClass().GetMethod(INIT_METHOD, instance->GetArgs().size());
+					const auto inits = init ? GetFieldInits(*init) : vector<FieldInit>{};
+					if (!inits || !DoesNotEscape(statements, k, variable)){
+						continue;
+					}
+
+					for (size_t i = k + 1; i < statements.size(); ++i){
+						ReplaceUses(*statements[i], variable);
+					}
+					auto value = std::move(Children::Take(**statements[k]).front());
+					*statements[k] = InitLocals(variable, init, *inits, Children::Take(*value));
+					++stats_.replaced_allocations;
+				}
+			}
+
+			// Used through its fields after the statement assigning it and not at all before
+			static bool DoesNotEscape(const vector<Slot*>& statements, size_t k, const string& variable) {
+				Slot& value = *statements[k];
+				bool used_before = false;
+				Children::ForEach(*value, [&used_before, &variable](Slot& child) {
+					used_before = used_before || FindUses(child, variable) != Use::NONE;
+				});
+				for (size_t i = 0; i < k && !used_before; ++i){
+					used_before = FindUses(*statements[i], variable) != Use::NONE;
+				}
+				if (used_before){
+					return false;
+				}
+				for (size_t i = k + 1; i < statements.size(); ++i){
+					if (FindUses(*statements[i], variable) == Use::ESCAPES){
+						return false;
+					}
+				}
+				return true;
+			}
+
+			ReplaceScalars::Stats stats_;
+		};
+	}
+
+	string_view ReplaceScalars::GetName() const {
+		return "replace-scalars"sv;
+	}
+
+	void ReplaceScalars::Run(unique_ptr<runtime::Executable>& program) {
+		stats_ = ScalarReplacer().Run(ast::CollectClasses(*program));
+	}
+
+	string ReplaceScalars::GetSummary() const {
+		return to_string(stats_.replaced_allocations) + " of "s + to_string(stats_.allocations)
+			+ " instances replaced by locals"s;
+	}
+
+	const ReplaceScalars::Stats& ReplaceScalars::GetStats() const {
+		return stats_;
+	}
+}
@@ -1,9 +1,13 @@
 #include "runtime.h"
 
 #include <cassert>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <optional>
 #include <sstream>
 #include <algorithm>
+#include <utility>
 
 using namespace std;
 
@@ -18,6 +22,299 @@ namespace runtime {
 		static const std::string STR("__str__"s);
 		static const std::string EQ("__eq__"s);
 		static const std::string LT("__lt__"s);
+
+		static std::atomic<MethodCompiler> method_compiler = nullptr;
+		static std::atomic<uint32_t> compile_threshold = 1;
+
+		static thread_local FieldJournal* field_journal = nullptr;
+
+		// Free list of equally sized blocks. Every block holds a shared_ptr control block
+		// together with one ClassInstance, so all requests from a pool have the same size.
+		// The pool outlives its class while any block is still in use
+		class InstancePool {
+		public:
+			InstancePool() = default;
+			InstancePool(const InstancePool&) = delete;
+			InstancePool& operator=(const InstancePool&) = delete;
+
+			~InstancePool() {
+				for (void* block : free_blocks_){
+					::operator delete(block);
+				}
+			}
+
+			static std::shared_ptr<InstancePool> Create() {
+				return std::shared_ptr<InstancePool>(new InstancePool, [](InstancePool* pool) {
+					pool->Release();
+				});
+			}
+
+			void* Allocate(size_t bytes) {
+				used_blocks_.fetch_add(1, std::memory_order_relaxed);
+				allocated_blocks_.fetch_add(1, std::memory_order_relaxed);
+				{
+					std::lock_guard guard(lock_);
+					if (block_size_ == 0){
+						block_size_ = bytes;
+					}
+					if (bytes == block_size_ && !free_blocks_.empty()){
+						void* block = free_blocks_.back();
+						free_blocks_.pop_back();
+						return block;
+					}
+				}
+				return ::operator new(bytes);
+			}
+
+			void Deallocate(void* block, size_t bytes) {
+				{
+					std::lock_guard guard(lock_);
+					if (bytes == block_size_ && free_blocks_.size() < MAX_FREE_BLOCKS){
+						free_blocks_.push_back(block);
+						block = nullptr;
+					}
+				}
+				if (block != nullptr){
+					::operator delete(block);
+				}
+				Release();
+			}
+
+			[[nodiscard]] size_t GetAllocatedCount() const {
+				return allocated_blocks_.load(std::memory_order_relaxed);
+			}
+
+		private:
+			class SpinLock {
+			public:
+				void lock() {
+					while (flag_.test_and_set(std::memory_order_acquire)){
+						std::this_thread::yield();
+					}
+				}
+
+				void unlock() {
+					flag_.clear(std::memory_order_release);
+				}
+
+			private:
+				std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+			};
+
+			// The owning class counts as one more user of the pool
+			void Release() {
+				if (used_blocks_.fetch_sub(1, std::memory_order_acq_rel) == 0){
+					delete this;
+				}
+			}
+
+			static constexpr size_t MAX_FREE_BLOCKS = 1024;
+
+			SpinLock lock_;
+			std::atomic<size_t> used_blocks_ = 0;
+			std::atomic<size_t> allocated_blocks_ = 0;
+			size_t block_size_ = 0;
+			std::vector<void*> free_blocks_;
+		};
+
+		template <typename T>
+		class PoolAllocator {
+		public:
+			using value_type = T;
+
+			explicit PoolAllocator(InstancePool* pool)
+				: pool_(pool) {
+			}
+
+			template <typename U>
+			PoolAllocator(const PoolAllocator<U>& other)  // NOLINT(google-explicit-constructor)
+				: pool_(other.GetPool()) {
+			}
+
+			T* allocate(size_t n) {
+				return static_cast<T*>(pool_->Allocate(n * sizeof(T)));
+			}
+
+			void deallocate(T* p, size_t n) {
+				pool_->Deallocate(p, n * sizeof(T));
+			}
+
+			[[nodiscard]] InstancePool* GetPool() const {
+				return pool_;
+			}
+
+			template <typename U>
+			bool operator==(const PoolAllocator<U>& other) const {
+				return pool_ == other.GetPool();
+			}
+
+		private:
+			InstancePool* pool_;
+		};
+
+		// The instances a thread has created or adopted, for the cycle collector. Every
+		// instance is tracked by the registry of the thread it belongs to, if any, so no
+		// thread looks into instances another thread may be changing
+		class InstanceRegistry {
+		public:
+			InstanceRegistry() = default;
+			InstanceRegistry(const InstanceRegistry&) = delete;
+			InstanceRegistry& operator=(const InstanceRegistry&) = delete;
+
+			// Instances that outlive the thread, like the result of an isolate, are left to
+			// the thread that adopts them
+			~InstanceRegistry() {
+				Collect();
+				for (ClassInstance* instance : instances_){
+					instance->registry_ = nullptr;
+				}
+			}
+
+			void Track(ClassInstance& instance) {
+				Add(instance);
+				if (instances_.size() >= next_collection_){
+					Collect();
+				}
+			}
+
+			// Called by the instance when it is released or disowned
+			void Remove(ClassInstance& instance) {
+				ClassInstance* last = instances_.back();
+				instances_[instance.registry_index_] = last;
+				last->registry_index_ = instance.registry_index_;
+				instances_.pop_back();
+				instance.registry_ = nullptr;
+			}
+
+			// Trial deletion: an instance referenced from anywhere but the fields of tracked
+			// instances is alive, and so is everything reachable from it. The fields of the
+			// rest are cleared, which releases them
+			size_t Collect() {
+				// Locked for the whole collection, so that no instance is released halfway.
+				// Indexed like instances_
+				std::vector<std::shared_ptr<ClassInstance>> instances;
+				instances.reserve(instances_.size());
+				for (ClassInstance* instance : instances_){
+					instances.push_back(instance->weak_from_this().lock());
+				}
+				const auto find = [this](const ObjectHolder& value) -> const ClassInstance* {
+					const auto* instance = value.TryAs<ClassInstance>();
+					return instance != nullptr && instance->registry_ == this ? instance : nullptr;
+				};
+
+				// Our own lock doesn't count
+				std::vector<long> outside(instances.size());
+				for (size_t i = 0; i < instances.size(); ++i){
+					outside[i] = instances[i].use_count() - 1;
+				}
+				for (const auto& instance : instances){
+					if (instance == nullptr){
+						continue;
+					}
+					for (const auto& [name, value] : instance->closure_){
+						if (const auto* field = find(value); field != nullptr && value.IsOwning()){
+							--outside[field->registry_index_];
+						}
+					}
+				}
+
+				std::vector<bool> alive(instances.size());
+				std::vector<size_t> pending;
+				for (size_t i = 0; i < instances.size(); ++i){
+					if (instances[i] == nullptr || outside[i] > 0){
+						alive[i] = true;
+						pending.push_back(i);
+					}
+				}
+				while (!pending.empty()){
+					const size_t i = pending.back();
+					pending.pop_back();
+					if (instances[i] == nullptr){
+						continue;
+					}
+					for (const auto& [name, value] : instances[i]->closure_){
+						if (const auto* field = find(value); field != nullptr && !alive[field->registry_index_]){
+							alive[field->registry_index_] = true;
+							pending.push_back(field->registry_index_);
+						}
+					}
+				}
+
+				std::vector<Closure> released;
+				for (size_t i = 0; i < instances.size(); ++i){
+					if (!alive[i]){
+						released.push_back(std::exchange(instances[i]->closure_, {}));
+					}
+				}
+				next_collection_ = std::max(MIN_COLLECTION, 2 * (instances_.size() - released.size()));
+				// The fields go first, the instances themselves with the last lock
+				const size_t count = released.size();
+				released.clear();
+				instances.clear();
+				return count;
+			}
+
+			static void Disown(const std::vector<ObjectHolder>& objects) {
+				Walk(objects, [](ClassInstance& instance) {
+					if (instance.registry_ == nullptr){
+						return false;
+					}
+					instance.registry_->Remove(instance);
+					return true;
+				});
+			}
+
+			void Adopt(const std::vector<ObjectHolder>& objects) {
+				Walk(objects, [this](ClassInstance& instance) {
+					if (instance.registry_ == this){
+						return false;
+					}
+					Add(instance);
+					return true;
+				});
+				if (instances_.size() >= next_collection_){
+					Collect();
+				}
+			}
+
+		private:
+			static constexpr size_t MIN_COLLECTION = 1024;
+
+			void Add(ClassInstance& instance) {
+				instance.registry_ = this;
+				instance.registry_index_ = instances_.size();
+				instances_.push_back(&instance);
+			}
+
+			// Visits the instances reachable from the objects, going on through the fields
+			// of the instances for which visit returns true
+			template <typename Visit>
+			static void Walk(const std::vector<ObjectHolder>& objects, Visit visit) {
+				std::vector<ClassInstance*> pending;
+				for (const auto& object : objects){
+					if (auto* instance = object.TryAs<ClassInstance>()){
+						pending.push_back(instance);
+					}
+				}
+				while (!pending.empty()){
+					ClassInstance* instance = pending.back();
+					pending.pop_back();
+					if (!visit(*instance)){
+						continue;
+					}
+					for (const auto& field : instance->closure_){
+						if (auto* next = field.second.TryAs<ClassInstance>()){
+							pending.push_back(next);
+						}
+					}
+				}
+			}
+
+			std::vector<ClassInstance*> instances_;
+			size_t next_collection_ = MIN_COLLECTION;
+		};
+
+		static thread_local InstanceRegistry instance_registry;
 	}
 
 	ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
@@ -28,8 +325,16 @@ namespace runtime {
 		assert(data_ != nullptr);
 	}
 
+	namespace {
+		// Tells the holders made by Share apart
+		struct NonOwningDeleter {
+			void operator()([[maybe_unused]] Object* object) const {
+			}
+		};
+	}
+
 	ObjectHolder ObjectHolder::Share(Object& object) {
-		return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+		return ObjectHolder(std::shared_ptr<Object>(&object, NonOwningDeleter{}));
 	}
 
 	ObjectHolder ObjectHolder::None() {
@@ -54,6 +359,14 @@ namespace runtime {
 		return Get() != nullptr;
 	}
 
+	bool ObjectHolder::IsOwning() const {
+		return std::get_deleter<NonOwningDeleter>(data_) == nullptr;
+	}
+
+	bool ObjectHolder::IsUnique() const {
+		return data_.use_count() == 1 && IsOwning();
+	}
+
 	bool IsTrue(const ObjectHolder& object) {
 		if (object){
 			if (const Number* num = object.TryAs<Number>()){
@@ -96,6 +409,9 @@ namespace runtime {
 	}
 
 	Closure& ClassInstance::Fields() {
+		if (detail::field_journal != nullptr){
+			detail::field_journal->BeforeChange(*this);
+		}
 		return closure_;
 	}
 
@@ -103,16 +419,40 @@ namespace runtime {
 		return closure_;
 	}
 
+	const Class& ClassInstance::GetClass() const {
+		return cls_;
+	}
+
 	ClassInstance::ClassInstance(const Class& cls)
 		: cls_(cls)
 	{}
 
+	ClassInstance::ClassInstance(const ClassInstance& other)
+		: Object(other)
+		, std::enable_shared_from_this<ClassInstance>(other)
+		, cls_(other.cls_)
+		, closure_(other.closure_)
+	{}
+
+	ClassInstance::~ClassInstance() {
+		if (registry_ != nullptr){
+			registry_->Remove(*this);
+		}
+	}
+
+	ObjectHolder ClassInstance::Self() {
+		if (auto self = weak_from_this().lock()){
+			return ObjectHolder(std::move(self));
+		}
+		return ObjectHolder::Share(*this);
+	}
+
 	Closure ClassInstance::CreateLocalClosure(
 			const std::vector<std::string>& formal_params,
 			const std::vector<ObjectHolder>& actual_args){
 		assert(formal_params.size() == actual_args.size());
 		Closure closure;
-		closure.emplace(runtime::detail::SELF, ObjectHolder::Share(*this));
+		closure.emplace(runtime::detail::SELF, Self());
 		for (size_t i = 0; i < formal_params.size(); ++i){
 			closure.emplace(formal_params.at(i), actual_args.at(i));
 		}
@@ -122,7 +462,7 @@ namespace runtime {
 
 	ObjectHolder ClassInstance::Call(const Method* method, const std::vector<ObjectHolder>& actual_args, Context& context){
 		Closure local_closure = CreateLocalClosure(method->formal_params, actual_args);
-		return method->body.get()->Execute(local_closure, context);
+		return method->profile.Select(*method->body).Execute(local_closure, context);
 	}
 
 	ObjectHolder ClassInstance::Call(const std::string& method,
@@ -132,10 +472,71 @@ namespace runtime {
 		return Call(ptr_method, actual_args, context);
 	}
 
+	Method::Method(std::string name, std::vector<std::string> formal_params, std::unique_ptr<Executable> body)
+		: name(std::move(name))
+		, formal_params(std::move(formal_params))
+		, body(std::move(body))
+	{}
+
+	void SetMethodCompiler(MethodCompiler compiler, uint32_t threshold){
+		detail::compile_threshold.store(std::max(threshold, 1u), std::memory_order_relaxed);
+		detail::method_compiler.store(compiler, std::memory_order_relaxed);
+	}
+
+	MethodProfile::MethodProfile([[maybe_unused]] MethodProfile&& other) noexcept
+	{}
+
+	MethodProfile& MethodProfile::operator=([[maybe_unused]] MethodProfile&& other) noexcept{
+		Reset();
+		return *this;
+	}
+
+	const Executable& MethodProfile::Select(const Executable& body) const{
+		if (const auto* compiled = compiled_.load(std::memory_order_acquire)){
+			// A pass may have replaced the body the code was compiled from
+			return source_ == &body ? *compiled : body;
+		}
+		const auto compiler = detail::method_compiler.load(std::memory_order_relaxed);
+		if (compiler == nullptr){
+			return body;
+		}
+		// Only the call that reaches the threshold compiles, so a body that can't be compiled
+		// is tried once
+		const uint32_t threshold = detail::compile_threshold.load(std::memory_order_relaxed);
+		if (calls_.load(std::memory_order_relaxed) >= threshold
+				|| calls_.fetch_add(1, std::memory_order_relaxed) + 1 != threshold){
+			return body;
+		}
+		code_ = compiler(body);
+		if (code_ == nullptr){
+			return body;
+		}
+		source_ = &body;
+		compiled_.store(code_.get(), std::memory_order_release);
+		return *code_;
+	}
+
+	uint32_t MethodProfile::GetCalls() const{
+		return calls_.load(std::memory_order_relaxed);
+	}
+
+	const Executable* MethodProfile::GetCompiled(const Executable& body) const{
+		const auto* compiled = compiled_.load(std::memory_order_acquire);
+		return compiled != nullptr && source_ == &body ? compiled : nullptr;
+	}
+
+	void MethodProfile::Reset(){
+		calls_.store(0, std::memory_order_relaxed);
+		compiled_.store(nullptr, std::memory_order_relaxed);
+		code_.reset();
+		source_ = nullptr;
+	}
+
 	Class::Class(std::string name, std::vector<Method> methods, const Class* parent)
 		: name_(name)
 		, methods_(std::move(methods))
 		, parent_(parent)
+		, pool_(detail::InstancePool::Create())
 	{}
 
 	[[nodiscard]] const Method* Class::GetMethod(const std::string& name) const {
@@ -162,6 +563,35 @@ namespace runtime {
 		return name_;
 	}
 
+	const vector<Method>& Class::GetMethods() const {
+		return methods_;
+	}
+
+	vector<Method>& Class::GetMethods() {
+		return methods_;
+	}
+
+	void Class::InvalidateCompiledMethods() {
+		for (auto& method : methods_){
+			method.profile.Reset();
+		}
+	}
+
+	const Class* Class::GetParent() const {
+		return parent_;
+	}
+
+	ObjectHolder Class::NewInstance() const {
+		ObjectHolder instance = ObjectHolder::Allocate<ClassInstance>(
+				detail::PoolAllocator<ClassInstance>(pool_.get()), *this);
+		detail::instance_registry.Track(static_cast<ClassInstance&>(*instance));
+		return instance;
+	}
+
+	size_t Class::GetInstanceCount() const {
+		return pool_->GetAllocatedCount();
+	}
+
 	void Class::Print(ostream& os, [[maybe_unused]] Context& context) {
 		os << runtime::detail::CLASS << " "s << name_;
 	}
@@ -170,6 +600,141 @@ namespace runtime {
 		os << (GetValue() ? runtime::detail::TRUE : runtime::detail::FALSE);
 	}
 
+	namespace {
+		// Copies instances once each. A reference that doesn't own its instance, like a stored
+		// self, doesn't own the copy either, unless nothing else in the copy would own it.
+		// When moving, an instance whose only owner is a root or a moved instance is kept
+		class GraphCopier {
+		public:
+			explicit GraphCopier(const FieldsOf* fields_of)
+				: fields_of_(fields_of) {
+			}
+
+			// The copy of a root is always owned
+			ObjectHolder CopyRoot(const ObjectHolder& object, bool may_move) {
+				return CopyReference(object, true, may_move);
+			}
+
+			// Gives ownership to the first reference of every copy that isn't owned otherwise
+			void Finish() {
+				for (auto [reference, copy] : shares_){
+					if (!copy->owned){
+						*reference = copy->holder;
+						copy->owned = true;
+					}
+				}
+			}
+
+		private:
+			struct Copy {
+				ObjectHolder holder;
+				bool owned = false;
+			};
+
+			ObjectHolder CopyReference(const ObjectHolder& object, bool owning, bool may_move) {
+				auto* instance = object.TryAs<ClassInstance>();
+				if (instance == nullptr){
+					return object;
+				}
+				auto [it, inserted] = copies_.try_emplace(instance);
+				Copy& copy = it->second;
+				if (inserted && may_move && owning && object.IsUnique()){
+					copy.holder = object;
+					MoveFields(*instance);
+				}else if (inserted){
+					copy.holder = instance->GetClass().NewInstance();
+					CopyFields(*instance, *copy.holder.TryAs<ClassInstance>());
+				}
+				if (owning){
+					copy.owned = true;
+					return copy.holder;
+				}
+				return ObjectHolder::Share(*copy.holder);
+			}
+
+			void CopyFields(const ClassInstance& source, ClassInstance& target) {
+				for (const auto& [name, value] : fields_of_ != nullptr ? (*fields_of_)(source) : source.Fields()){
+					const bool owning = value.IsOwning();
+					ObjectHolder& field = target.Fields()[name] = CopyReference(value, owning, false);
+					RecordShare(field, value, owning);
+				}
+			}
+
+			// Nothing outside the moved instances can reach their fields
+			void MoveFields(ClassInstance& instance) {
+				for (auto& [name, field] : instance.Fields()){
+					const ObjectHolder value = std::move(field);
+					const bool owning = value.IsOwning();
+					field = CopyReference(value, owning, true);
+					RecordShare(field, value, owning);
+				}
+			}
+
+			void RecordShare(ObjectHolder& field, const ObjectHolder& value, bool owning) {
+				if (!owning && field.TryAs<ClassInstance>() != nullptr){
+					shares_.emplace_back(&field, &copies_.at(value.TryAs<ClassInstance>()));
+				}
+			}
+
+			const FieldsOf* fields_of_;
+			// Node-based, so the references stay valid while the copy grows
+			std::unordered_map<const ClassInstance*, Copy> copies_;
+			std::vector<std::pair<ObjectHolder*, Copy*>> shares_;
+		};
+	}
+
+	namespace {
+		std::vector<ObjectHolder> CopyGraph(const std::vector<ObjectHolder>& objects, bool may_move,
+											const FieldsOf* fields_of = nullptr) {
+			GraphCopier copier(fields_of);
+			std::vector<ObjectHolder> result;
+			result.reserve(objects.size());
+			for (const auto& object : objects){
+				result.push_back(copier.CopyRoot(object, may_move));
+			}
+			copier.Finish();
+			return result;
+		}
+	}
+
+	ObjectHolder DeepCopy(const ObjectHolder& object) {
+		return std::move(CopyGraph({object}, false).front());
+	}
+
+	std::vector<ObjectHolder> DeepCopy(const std::vector<ObjectHolder>& objects) {
+		return CopyGraph(objects, false);
+	}
+
+	ObjectHolder DeepMove(ObjectHolder object) {
+		std::vector<ObjectHolder> objects;
+		objects.push_back(std::move(object));
+		return std::move(DeepMove(std::move(objects)).front());
+	}
+
+	std::vector<ObjectHolder> DeepMove(std::vector<ObjectHolder> objects) {
+		return CopyGraph(objects, true);
+	}
+
+	std::vector<ObjectHolder> DeepCopy(const std::vector<ObjectHolder>& objects, const FieldsOf& fields_of) {
+		return CopyGraph(objects, false, &fields_of);
+	}
+
+	FieldJournal* SetFieldJournal(FieldJournal* journal) {
+		return std::exchange(detail::field_journal, journal);
+	}
+
+	size_t CollectCycles() {
+		return detail::instance_registry.Collect();
+	}
+
+	void DisownInstances(const std::vector<ObjectHolder>& objects) {
+		detail::InstanceRegistry::Disown(objects);
+	}
+
+	void AdoptInstances(const std::vector<ObjectHolder>& objects) {
+		detail::instance_registry.Adopt(objects);
+	}
+
 	template <typename Compare>
 	bool MakeComparison(const ObjectHolder& lhs, const ObjectHolder& rhs,
 			Context& context, const std::string& func_name, Compare cmp){
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -31,6 +34,11 @@ namespace runtime {
 			return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
 		}
 
+		template <typename T, typename Allocator, typename... Args>
+		[[nodiscard]] static ObjectHolder Allocate(const Allocator& allocator, Args&&... args) {
+			return ObjectHolder(std::allocate_shared<T>(allocator, std::forward<Args>(args)...));
+		}
+
 		[[nodiscard]] static ObjectHolder Share(Object& object);
 		[[nodiscard]] static ObjectHolder None();
 
@@ -52,7 +60,14 @@ namespace runtime {
 
 		explicit operator bool() const;
 
+		// False for a holder made by Share, which doesn't keep its object alive
+		[[nodiscard]] bool IsOwning() const;
+		// The only holder that owns its object
+		[[nodiscard]] bool IsUnique() const;
+
 	private:
+		friend class ClassInstance;
+
 		explicit ObjectHolder(std::shared_ptr<Object> data);
 		void AssertIsValid() const;
 
@@ -85,7 +100,7 @@ namespace runtime {
 	class Executable {
 	public:
 		virtual ~Executable() = default;
-		virtual ObjectHolder Execute(Closure& closure, Context& context) = 0;
+		virtual ObjectHolder Execute(Closure& closure, Context& context) const = 0;
 	};
 
 	using String = ValueObject<std::string>;
@@ -98,10 +113,50 @@ namespace runtime {
 		void Print(std::ostream& os, Context& context) override;
 	};
 
+	namespace detail {
+		class InstancePool;
+		class InstanceRegistry;
+	}
+
+	// Compiles the body of a hot method, see jit.h. nullptr keeps the body interpreted
+	using MethodCompiler = std::unique_ptr<Executable> (*)(const Executable& body);
+
+	// A method is compiled on its threshold-th call. A compiler of nullptr turns compilation off
+	void SetMethodCompiler(MethodCompiler compiler, uint32_t threshold);
+
+	// Calls of a method and the body compiled from it. A moved profile starts over
+	class MethodProfile {
+	public:
+		MethodProfile() = default;
+		MethodProfile(MethodProfile&& other) noexcept;
+		MethodProfile& operator=(MethodProfile&& other) noexcept;
+
+		// The body to run for a call of the method whose body is body
+		[[nodiscard]] const Executable& Select(const Executable& body) const;
+
+		[[nodiscard]] uint32_t GetCalls() const;
+		// nullptr until body has been compiled
+		[[nodiscard]] const Executable* GetCompiled(const Executable& body) const;
+
+		// Drops the compiled body and starts counting again. The method must not be running
+		void Reset();
+
+	private:
+		mutable std::atomic<uint32_t> calls_ = 0;
+		// Set once, by the call that reaches the threshold
+		mutable std::atomic<const Executable*> compiled_ = nullptr;
+		mutable std::unique_ptr<Executable> code_;
+		mutable const Executable* source_ = nullptr;
+	};
+
 	struct Method {
+		Method() = default;
+		Method(std::string name, std::vector<std::string> formal_params, std::unique_ptr<Executable> body);
+
 		std::string name;
 		std::vector<std::string> formal_params;
 		std::unique_ptr<Executable> body;
+		MethodProfile profile;
 	};
 
 	class Class : public Object {
@@ -112,6 +167,20 @@ namespace runtime {
 		[[nodiscard]] const Method* GetMethod(const std::string& name, size_t args_count) const;
 
 		[[nodiscard]] const std::string& GetName() const;
+		// Methods declared by the class itself, without the inherited ones
+		[[nodiscard]] const std::vector<Method>& GetMethods() const;
+		// Lets passes over a program replace method bodies before the program first runs
+		[[nodiscard]] std::vector<Method>& GetMethods();
+		// Drops the code compiled for the methods of the class, which may point into nodes a
+		// pass has replaced since. No method of the class may be running
+		void InvalidateCompiledMethods();
+		[[nodiscard]] const Class* GetParent() const;
+
+		// Creates an instance whose storage is recycled from released instances of this class.
+		// The instance is tracked by the cycle collector of the calling thread, see CollectCycles
+		[[nodiscard]] ObjectHolder NewInstance() const;
+		// Instances created so far, released ones included
+		[[nodiscard]] size_t GetInstanceCount() const;
 
 		void Print(std::ostream& os, Context& context) override;
 
@@ -119,11 +188,15 @@ namespace runtime {
 		std::string name_;
 		std::vector<Method> methods_;
 		const Class* parent_;
+		std::shared_ptr<detail::InstancePool> pool_;
 	};
 
-	class ClassInstance : public Object {
+	class ClassInstance : public Object, public std::enable_shared_from_this<ClassInstance> {
 	public:
 		explicit ClassInstance(const Class& cls);
+		// The copy has the fields of other but isn't tracked by a cycle collector
+		ClassInstance(const ClassInstance& other);
+		~ClassInstance() override;
 
 		const Method* GetMethod(const std::string& method, size_t argument_count) const;
 		const Method* TryMethod(const std::string& method, size_t argument_count) const;
@@ -135,10 +208,20 @@ namespace runtime {
 
 		[[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
 
+		// Reported to the field journal of the thread, see SetFieldJournal. Only read fields
+		// through the const overload
 		[[nodiscard]] Closure& Fields();
 		[[nodiscard]] const Closure& Fields() const;
 
+		[[nodiscard]] const Class& GetClass() const;
+
+		// The self of a method call. Owning when the instance is managed by an ObjectHolder, so
+		// methods may return or store self
+		[[nodiscard]] ObjectHolder Self();
+
 	private:
+		friend class detail::InstanceRegistry;
+
 		Closure CreateLocalClosure(
 				const std::vector<std::string>& formal_params,
 				const std::vector<ObjectHolder>& actual_args);
@@ -146,8 +229,48 @@ namespace runtime {
 	private:
 		const Class& cls_;
 		Closure closure_;
+		// The registry of the thread the instance belongs to, nullptr while it is handed over
+		detail::InstanceRegistry* registry_ = nullptr;
+		size_t registry_index_ = 0;
 	};
 
+	// Releases the instances of the calling thread that are only reachable from each other,
+	// e.g. an instance that stored self. Runs by itself once the thread tracks twice as many
+	// instances as were alive after the last collection. Returns the number of instances
+	// released
+	size_t CollectCycles();
+	// An instance is collected by the thread it belongs to. Values passed to another thread
+	// are disowned before they are published, and adopted by the thread that receives them,
+	// together with every instance reachable through their fields
+	void DisownInstances(const std::vector<ObjectHolder>& objects);
+	void AdoptInstances(const std::vector<ObjectHolder>& objects);
+
+	// Copies the instance together with every instance reachable through its fields, keeping
+	// shared references and cycles. Other objects are immutable and are shared with the copy.
+	// A non-owning reference, made by ObjectHolder::Share, stays non-owning if the copy is owned otherwise
+	ObjectHolder DeepCopy(const ObjectHolder& object);
+	// Copies the objects as a whole: an instance reachable from several of them is copied once
+	std::vector<ObjectHolder> DeepCopy(const std::vector<ObjectHolder>& objects);
+	// Like DeepCopy, but an instance owned by nothing except the given holders or instances
+	// moved along with it is moved rather than copied
+	ObjectHolder DeepMove(ObjectHolder object);
+	std::vector<ObjectHolder> DeepMove(std::vector<ObjectHolder> objects);
+	// The fields an instance is copied with
+	using FieldsOf = std::function<const Closure&(const ClassInstance& instance)>;
+	std::vector<ObjectHolder> DeepCopy(const std::vector<ObjectHolder>& objects, const FieldsOf& fields_of);
+
+	// Told about every instance whose fields are about to change, see checkpoint.h
+	class FieldJournal {
+	public:
+		virtual void BeforeChange(const ClassInstance& instance) = 0;
+
+	protected:
+		~FieldJournal() = default;
+	};
+
+	// Sets the journal of the calling thread, nullptr for none. Returns the previous one
+	FieldJournal* SetFieldJournal(FieldJournal* journal);
+
 	bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 	bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 	bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
@@ -98,7 +98,7 @@ struct TestMethodBody : Executable {
         : body(std::move(body)) {
     }
 
-    ObjectHolder Execute(Closure& closure, Context& context) override {
+    ObjectHolder Execute(Closure& closure, Context& context) const override {
         if (body) {
             return body(closure, context);
         }
@@ -529,6 +529,41 @@ void TestClassInstance() {
     ASSERT_THROWS(instance.Call("missing_method"s, {}, ctx), runtime_error);
 }
 
+void TestCollectCycles() {
+    Class cls{"Node"s, {}, nullptr};
+    CollectCycles();
+
+    ObjectHolder kept = cls.NewInstance();
+    kept.TryAs<ClassInstance>()->Fields()["me"s] = kept;
+    weak_ptr<ClassInstance> released;
+    {
+        ObjectHolder first = cls.NewInstance();
+        ObjectHolder second = cls.NewInstance();
+        first.TryAs<ClassInstance>()->Fields()["next"s] = second;
+        second.TryAs<ClassInstance>()->Fields()["next"s] = first;
+        second.TryAs<ClassInstance>()->Fields()["kept"s] = kept;
+        released = first.TryAs<ClassInstance>()->weak_from_this();
+    }
+    ASSERT(!released.expired());
+    ASSERT_EQUAL(CollectCycles(), 2U);
+    ASSERT(released.expired());
+    ASSERT(kept.TryAs<ClassInstance>()->Fields().at("me"s).Get() == kept.Get());
+
+    // Without being asked, once enough cycles have piled up
+    const auto make_cycle = [&cls] {
+        ObjectHolder cycle = cls.NewInstance();
+        cycle.TryAs<ClassInstance>()->Fields()["me"s] = cycle;
+        return cycle.TryAs<ClassInstance>()->weak_from_this();
+    };
+    released = make_cycle();
+    for (int i = 0; i < 10000 && !released.expired(); ++i) {
+        make_cycle();
+    }
+    ASSERT(released.expired());
+
+    kept.TryAs<ClassInstance>()->Fields().clear();
+}
+
 }  // namespace
 
 void RunObjectsTests(TestRunner& tr) {
@@ -540,6 +575,7 @@ void RunObjectsTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestComparison); // OK
     RUN_TEST(tr, runtime::TestClass); // OK
     RUN_TEST(tr, runtime::TestClassInstance); // OK
+    RUN_TEST(tr, runtime::TestCollectCycles);
 }
 
 void RunObjectHolderTests(TestRunner& tr) {
@@ -0,0 +1,180 @@
+#include "scan.h"
+
+#include "char_class.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MYTHON_SCAN_X86 1
+#endif
+
+using namespace std;
+
+namespace parse::scan {
+
+	namespace {
+		enum class Stop {
+			LINE_END,
+			STRING_END,
+			NOT_IDENTIFIER,
+			NOT_DIGIT,
+			NOT_SPACE,
+		};
+
+		template <Stop stop>
+		constexpr bool IsStop(char ch, char quote) {
+			if constexpr (stop == Stop::LINE_END){
+				return ch == '\n';
+			}else if constexpr (stop == Stop::STRING_END){
+				return ch == quote || ch == '\\';
+			}else if constexpr (stop == Stop::NOT_IDENTIFIER){
+				return !chars::IsIdentifier(ch);
+			}else if constexpr (stop == Stop::NOT_DIGIT){
+				return !chars::IsDigit(ch);
+			}else{
+				return ch != ' ';
+			}
+		}
+
+		template <Stop stop>
+		const char* FindScalar(const char* begin, const char* end, char quote) {
+			while (begin != end && !IsStop<stop>(*begin, quote)){
+				++begin;
+			}
+			return begin;
+		}
+
+#ifdef MYTHON_SCAN_X86
+		// Characters are compared as signed bytes, so the ones above 127 are below every
+		// range of ASCII characters
+
+		__m128i InRangeSse2(__m128i block, char low, char high) {
+			return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(static_cast<char>(low - 1))),
+								 _mm_cmplt_epi8(block, _mm_set1_epi8(static_cast<char>(high + 1))));
+		}
+
+		// A bit for every character of the block, set for the ones that stop the search
+		template <Stop stop>
+		uint32_t StopMaskSse2(__m128i block, char quote) {
+			__m128i matches;
+			if constexpr (stop == Stop::LINE_END){
+				matches = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+			}else if constexpr (stop == Stop::STRING_END){
+				matches = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(quote)),
+									   _mm_cmpeq_epi8(block, _mm_set1_epi8('\\')));
+			}else if constexpr (stop == Stop::NOT_IDENTIFIER){
+				// Setting 0x20 turns upper case letters into lower case ones and nothing else
+				// into a letter
+				const __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+				matches = _mm_or_si128(_mm_or_si128(InRangeSse2(lower, 'a', 'z'), InRangeSse2(block, '0', '9')),
+									   _mm_cmpeq_epi8(block, _mm_set1_epi8('_')));
+			}else if constexpr (stop == Stop::NOT_DIGIT){
+				matches = InRangeSse2(block, '0', '9');
+			}else{
+				matches = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+			}
+			const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+			return stop == Stop::LINE_END || stop == Stop::STRING_END ? mask : ~mask & 0xFFFF;
+		}
+
+		template <Stop stop>
+		const char* FindSse2(const char* begin, const char* end, char quote) {
+			for (; end - begin >= 16; begin += 16){
+				const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+				if (const uint32_t mask = StopMaskSse2<stop>(block, quote)){
+					return begin + __builtin_ctz(mask);
+				}
+			}
+			return FindScalar<stop>(begin, end, quote);
+		}
+
+		__attribute__((target("avx2")))
+		__m256i InRangeAvx2(__m256i block, char low, char high) {
+			return _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8(static_cast<char>(low - 1))),
+									_mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(high + 1)), block));
+		}
+
+		template <Stop stop>
+		__attribute__((target("avx2")))
+		uint32_t StopMaskAvx2(__m256i block, char quote) {
+			__m256i matches;
+			if constexpr (stop == Stop::LINE_END){
+				matches = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'));
+			}else if constexpr (stop == Stop::STRING_END){
+				matches = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(quote)),
+										  _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\')));
+			}else if constexpr (stop == Stop::NOT_IDENTIFIER){
+				const __m256i lower = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+				matches = _mm256_or_si256(_mm256_or_si256(InRangeAvx2(lower, 'a', 'z'), InRangeAvx2(block, '0', '9')),
+										  _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_')));
+			}else if constexpr (stop == Stop::NOT_DIGIT){
+				matches = InRangeAvx2(block, '0', '9');
+			}else{
+				matches = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+			}
+			const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+			return stop == Stop::LINE_END || stop == Stop::STRING_END ? mask : ~mask;
+		}
+
+		template <Stop stop>
+		__attribute__((target("avx2")))
+		const char* FindAvx2(const char* begin, const char* end, char quote) {
+			for (; end - begin >= 32; begin += 32){
+				const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+				if (const uint32_t mask = StopMaskAvx2<stop>(block, quote)){
+					return begin + __builtin_ctz(mask);
+				}
+			}
+			// The rest is shorter than a block, but may be as long as an SSE2 one
+			return FindSse2<stop>(begin, end, quote);
+		}
+#endif
+
+		// Fills a Scanner with the instances of the search template for every Stop
+	#define MAKE_SCANNER(name, Find) Scanner{ \
+			name, \
+			[](const char* begin, const char* end){ return Find<Stop::LINE_END>(begin, end, '\n'); }, \
+			[](const char* begin, const char* end, char quote){ return Find<Stop::STRING_END>(begin, end, quote); }, \
+			[](const char* begin, const char* end){ return Find<Stop::NOT_IDENTIFIER>(begin, end, '\0'); }, \
+			[](const char* begin, const char* end){ return Find<Stop::NOT_DIGIT>(begin, end, '\0'); }, \
+			[](const char* begin, const char* end){ return Find<Stop::NOT_SPACE>(begin, end, '\0'); }, \
+		}
+
+		constexpr Scanner SCALAR = MAKE_SCANNER("scalar"sv, FindScalar);
+#ifdef MYTHON_SCAN_X86
+		constexpr Scanner SSE2 = MAKE_SCANNER("SSE2"sv, FindSse2);
+		constexpr Scanner AVX2 = MAKE_SCANNER("AVX2"sv, FindAvx2);
+#endif
+
+	#undef MAKE_SCANNER
+
+		bool HasAvx2() {
+#ifdef MYTHON_SCAN_X86
+			return __builtin_cpu_supports("avx2");
+#else
+			return false;
+#endif
+		}
+	}
+
+	const Scanner& Scalar() {
+		return SCALAR;
+	}
+
+	const Scanner& Best() {
+		static const Scanner& best = *Supported().back();
+		return best;
+	}
+
+	vector<const Scanner*> Supported() {
+		vector<const Scanner*> result{&SCALAR};
+#ifdef MYTHON_SCAN_X86
+		result.push_back(&SSE2);
+		if (HasAvx2()){
+			result.push_back(&AVX2);
+		}
+#endif
+		return result;
+	}
+}
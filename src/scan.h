@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace parse::scan {
+
+	// Searches of the Lexer over the characters in [begin, end). Each returns the first
+	// character at which the Lexer stops taking characters, or end if there is none
+	struct Scanner {
+		std::string_view name;
+
+		// '\n'
+		const char* (*line_end)(const char* begin, const char* end);
+		// The closing quote or '\\'
+		const char* (*string_stop)(const char* begin, const char* end, char quote);
+		// A character that is not a letter, a digit or '_'
+		const char* (*identifier_end)(const char* begin, const char* end);
+		// A character that is not a digit
+		const char* (*digits_end)(const char* begin, const char* end);
+		// A character that is not ' '
+		const char* (*spaces_end)(const char* begin, const char* end);
+	};
+
+	// Looks at one character at a time
+	const Scanner& Scalar();
+
+	// The fastest scanner the processor supports: AVX2 looks at 32 characters at a time,
+	// SSE2 at 16, and the scalar one is left for processors other than x86-64
+	const Scanner& Best();
+
+	// Every scanner the processor supports, Scalar first
+	std::vector<const Scanner*> Supported();
+}
@@ -0,0 +1,150 @@
+#include "lexer.h"
+#include "scan.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace parse {
+
+namespace {
+
+// Comments, strings with escapes and long identifiers, numbers and indentation that
+// cross the 16 and 32 character blocks of the vectorized scanners
+const string PROGRAM = R"--(
+# a comment that is longer than one block of thirty two characters, with 'quotes" and \
+class AVeryLongClassNameThatSpansMoreThanOneBlock_0123456789:
+  def method_with_a_long_name_and_digits_42(argument):
+    return "a string \"with\" escapes \\ and 'quotes' that is long enough\n\t\r"
+
+  def short(x): # a comment after code
+    return 'it\'s a string with a "double" quote and an unknown escape \q'
+print 1234567890, 0, 007, AVeryLongClassNameThatSpansMoreThanOneBlock_0123456789()
+if x:
+  y = 'é' + "ÿ" + ''
+)--"s;
+
+vector<Token> LexAll(istream& input, const scan::Scanner& scanner) {
+    Lexer lexer(input, scanner);
+    vector<Token> result{lexer.CurrentToken()};
+    while (!result.back().Is<token_type::Eof>()) {
+        result.push_back(lexer.NextToken());
+    }
+    return result;
+}
+
+vector<Token> LexAll(const string& source, const scan::Scanner& scanner) {
+    istringstream input(source);
+    return LexAll(input, scanner);
+}
+
+// Hands out one character at a time without a read-ahead buffer, like the stdio buffer of cin
+class UnbufferedInput : public streambuf {
+public:
+    explicit UnbufferedInput(string data)
+        : data_(std::move(data)) {
+    }
+
+protected:
+    int_type underflow() override {
+        return position_ < data_.size() ? traits_type::to_int_type(data_[position_]) : traits_type::eof();
+    }
+
+    int_type uflow() override {
+        const int_type result = underflow();
+        position_ += result != traits_type::eof();
+        return result;
+    }
+
+    int_type pbackfail(int_type ch) override {
+        if (position_ == 0) {
+            return traits_type::eof();
+        }
+        --position_;
+        return ch == traits_type::eof() ? traits_type::not_eof(ch) : ch;
+    }
+
+private:
+    string data_;
+    size_t position_ = 0;
+};
+
+void TestScannersAgreeWithScalar() {
+    string text;
+    for (int i = 0; i < 200; ++i) {
+        text += static_cast<char>("aZ_09 \n'\"\\#=\x80\xff/@[`{"[i * 7 % 19]);
+    }
+    const scan::Scanner& scalar = scan::Scalar();
+    for (const scan::Scanner* scanner : scan::Supported()) {
+        for (size_t begin = 0; begin < 80; ++begin) {
+            for (size_t end = begin; end <= text.size(); end += 5) {
+                const char* b = text.data() + begin;
+                const char* e = text.data() + end;
+                ASSERT_EQUAL(scanner->line_end(b, e) - b, scalar.line_end(b, e) - b);
+                ASSERT_EQUAL(scanner->string_stop(b, e, '"') - b, scalar.string_stop(b, e, '"') - b);
+                ASSERT_EQUAL(scanner->string_stop(b, e, '\'') - b, scalar.string_stop(b, e, '\'') - b);
+                ASSERT_EQUAL(scanner->identifier_end(b, e) - b, scalar.identifier_end(b, e) - b);
+                ASSERT_EQUAL(scanner->digits_end(b, e) - b, scalar.digits_end(b, e) - b);
+                ASSERT_EQUAL(scanner->spaces_end(b, e) - b, scalar.spaces_end(b, e) - b);
+            }
+        }
+    }
+}
+
+void TestCharacterClasses() {
+    for (const scan::Scanner* scanner : scan::Supported()) {
+        for (int ch = 0; ch < 256; ++ch) {
+            // Long runs, so the character is looked at by the vectorized loop
+            const string text = string(40, 'a') + static_cast<char>(ch) + string(40, 'a');
+            const char* stop = text.data() + 40;
+            const bool is_identifier = isalnum(ch) || ch == '_';
+            ASSERT_EQUAL(scanner->identifier_end(text.data(), text.data() + text.size()) == stop, !is_identifier);
+
+            const string digits = string(40, '5') + static_cast<char>(ch) + string(40, '5');
+            const char* digits_stop = digits.data() + 40;
+            ASSERT_EQUAL(scanner->digits_end(digits.data(), digits.data() + digits.size()) == digits_stop,
+                         !isdigit(ch));
+        }
+    }
+}
+
+void TestLexerTokensDoNotDependOnScanner() {
+    const vector<Token> expected = LexAll(PROGRAM, scan::Scalar());
+    ASSERT_EQUAL(expected[0], Token(token_type::Class{}));
+    ASSERT_EQUAL(expected[1], Token(token_type::Id{"AVeryLongClassNameThatSpansMoreThanOneBlock_0123456789"s}));
+    for (const scan::Scanner* scanner : scan::Supported()) {
+        ASSERT_EQUAL(LexAll(PROGRAM, *scanner), expected);
+
+        UnbufferedInput buffer(PROGRAM);
+        istream input(&buffer);
+        ASSERT_EQUAL(LexAll(input, *scanner), expected);
+    }
+}
+
+void TestStrings() {
+    const vector<Token> tokens = LexAll("'a\\'b\\\"c\\\\d\\n\\qe' \"x'y\"\n"s, scan::Best());
+    ASSERT_EQUAL(tokens[0], Token(token_type::String{"a'b\"c\\d\n\\e"s}));
+    ASSERT_EQUAL(tokens[1], Token(token_type::String{"x'y"s}));
+}
+
+void TestUnterminatedString() {
+    for (const string& source : {"x = 'abc"s, "x = 'abc\\"s, "x = \"" + string(100, 'a')}) {
+        ASSERT_THROWS(LexAll(source, scan::Best()), LexerError);
+    }
+}
+
+}  // namespace
+
+void RunScanTests(TestRunner& tr) {
+    RUN_TEST(tr, parse::TestScannersAgreeWithScalar);
+    RUN_TEST(tr, parse::TestCharacterClasses);
+    RUN_TEST(tr, parse::TestLexerTokensDoNotDependOnScanner);
+    RUN_TEST(tr, parse::TestStrings);
+    RUN_TEST(tr, parse::TestUnterminatedString);
+}
+
+}  // namespace parse
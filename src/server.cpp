@@ -0,0 +1,436 @@
+#include "server.h"
+
+#include "lexer.h"
+#include "parse.h"
+#include "thread_pool.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <streambuf>
+#include <system_error>
+
+using namespace std;
+
+namespace server {
+
+	namespace fs = std::filesystem;
+	using Clock = chrono::steady_clock;
+
+	namespace {
+		[[noreturn]] void ThrowSystemError(const string& what) {
+			throw system_error(errno, generic_category(), what);
+		}
+
+		sockaddr_un MakeAddress(const fs::path& socket_path) {
+			sockaddr_un address{};
+			address.sun_family = AF_UNIX;
+			const string path = socket_path.string();
+			if (path.size() >= sizeof(address.sun_path)){
+				throw runtime_error("Socket path is too long: "s + path);
+			}
+			copy(path.begin(), path.end(), address.sun_path);
+			return address;
+		}
+
+		bool WriteAll(int fd, const char* data, size_t size) {
+			while (size > 0){
+				const ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+				if (written < 0){
+					if (errno == EINTR){
+						continue;
+					}
+					return false;
+				}
+				data += written;
+				size -= static_cast<size_t>(written);
+			}
+			return true;
+		}
+
+		string ReadAll(int fd) {
+			string result;
+			char buffer[4096];
+			while (true){
+				const ssize_t count = read(fd, buffer, sizeof(buffer));
+				if (count < 0){
+					if (errno == EINTR){
+						continue;
+					}
+					ThrowSystemError("read"s);
+				}
+				if (count == 0){
+					return result;
+				}
+				result.append(buffer, static_cast<size_t>(count));
+			}
+		}
+
+		// Writes to a socket through a buffer and remembers when the first character arrived
+		class ConnectionBuffer : public streambuf {
+		public:
+			explicit ConnectionBuffer(int fd)
+				: fd_(fd) {
+				// No put area until the first character, so that it goes through overflow
+			}
+
+			[[nodiscard]] optional<Clock::time_point> GetFirstOutput() const {
+				return first_output_;
+			}
+
+		protected:
+			int_type overflow(int_type ch) override {
+				if (!first_output_){
+					first_output_ = Clock::now();
+				}
+				if (!Flush()){
+					return traits_type::eof();
+				}
+				setp(buffer_, buffer_ + sizeof(buffer_));
+				if (!traits_type::eq_int_type(ch, traits_type::eof())){
+					*pptr() = traits_type::to_char_type(ch);
+					pbump(1);
+				}
+				return traits_type::not_eof(ch);
+			}
+
+			int sync() override {
+				return Flush() ? 0 : -1;
+			}
+
+		private:
+			bool Flush() {
+				const bool written = WriteAll(fd_, pbase(), static_cast<size_t>(pptr() - pbase()));
+				setp(pbase(), epptr());
+				return written;
+			}
+
+			int fd_;
+			char buffer_[4096];
+			optional<Clock::time_point> first_output_;
+		};
+
+		int Listen(const fs::path& socket_path) {
+			const sockaddr_un address = MakeAddress(socket_path);
+			const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			if (listener < 0){
+				ThrowSystemError("socket"s);
+			}
+			fs::remove(socket_path);
+			if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+				|| listen(listener, SOMAXCONN) != 0){
+				const int error = errno;
+				close(listener);
+				throw system_error(error, generic_category(), "Cannot listen on "s + socket_path.string());
+			}
+			return listener;
+		}
+
+		int Accept(int listener) {
+			while (true){
+				const int connection = accept(listener, nullptr, nullptr);
+				if (connection >= 0){
+					return connection;
+				}
+				if (errno != EINTR){
+					ThrowSystemError("accept"s);
+				}
+			}
+		}
+
+		optional<MemoryUsage> ReadSmapsRollup() {
+			ifstream input("/proc/self/smaps_rollup"s);
+			if (!input){
+				return nullopt;
+			}
+			MemoryUsage usage;
+			for (string key; input >> key;){
+				size_t kilobytes = 0;
+				if (!(input >> kilobytes)){
+					input.clear();
+				} else if (key == "Rss:"sv){
+					usage.resident_bytes = kilobytes * 1024;
+				} else if (key == "Private_Clean:"sv || key == "Private_Dirty:"sv){
+					usage.private_bytes += kilobytes * 1024;
+				}
+				input.ignore(numeric_limits<streamsize>::max(), '\n');
+			}
+			return usage;
+		}
+
+		chrono::nanoseconds Percentile(vector<chrono::nanoseconds> values, double fraction) {
+			if (values.empty()){
+				return {};
+			}
+			sort(values.begin(), values.end());
+			const auto rank = static_cast<size_t>(fraction * static_cast<double>(values.size() - 1) + 0.5);
+			return values[min(rank, values.size() - 1)];
+		}
+
+		double ToMilliseconds(chrono::nanoseconds duration) {
+			return chrono::duration<double, milli>(duration).count();
+		}
+
+		double ToKilobytes(size_t bytes) {
+			return static_cast<double>(bytes) / 1024;
+		}
+	}
+
+	MemoryUsage GetMemoryUsage() {
+		if (auto usage = ReadSmapsRollup()){
+			return *usage;
+		}
+		// statm counts pages: size resident shared ...
+		ifstream input("/proc/self/statm"s);
+		size_t size = 0, resident = 0, shared = 0;
+		input >> size >> resident >> shared;
+		const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		return {resident * page_size, (resident - min(shared, resident)) * page_size};
+	}
+
+	ForkServer::ForkServer(istream& prelude, fs::path socket_path, ostream* log)
+		: socket_path_(std::move(socket_path))
+		, log_(log) {
+		parse::Lexer lexer(prelude);
+		prelude_ = ParseProgram(lexer);
+		runtime::DummyContext context;
+		prelude_->Execute(globals_, context);
+
+		int report_pipe[2];
+		if (pipe2(report_pipe, O_CLOEXEC) != 0){
+			ThrowSystemError("pipe"s);
+		}
+		report_read_ = report_pipe[0];
+		report_write_ = report_pipe[1];
+		fcntl(report_read_, F_SETFL, O_NONBLOCK);
+
+		try {
+			listener_ = Listen(socket_path_);
+		} catch (...) {
+			close(report_read_);
+			close(report_write_);
+			throw;
+		}
+	}
+
+	ForkServer::~ForkServer() {
+		close(listener_);
+		close(report_read_);
+		close(report_write_);
+		error_code ignored;
+		fs::remove(socket_path_, ignored);
+	}
+
+	void ForkServer::Run(size_t max_requests) {
+		for (size_t accepted = 0; max_requests == 0 || accepted < max_requests;){
+			const int connection = Accept(listener_);
+			const auto forked_at = Clock::now();
+			const pid_t pid = fork();
+			if (pid == 0){
+				ServeInChild(connection, forked_at);
+			}
+			close(connection);
+			if (pid < 0){
+				ThrowSystemError("fork"s);
+			}
+			++accepted;
+			++children_;
+			CollectReports(false);
+		}
+		CollectReports(true);
+	}
+
+	const vector<ChildReport>& ForkServer::GetReports() const {
+		return reports_;
+	}
+
+	void ForkServer::ServeInChild(int connection, Clock::time_point forked_at) {
+		close(listener_);
+		close(report_read_);
+
+		ChildReport report;
+		ConnectionBuffer buffer(connection);
+		{
+			ostream output(&buffer);
+			try {
+				istringstream input(ReadAll(connection));
+				parse::Lexer lexer(input);
+				auto program = ParseProgram(lexer, globals_);
+
+				runtime::SimpleContext context{output};
+				program->Execute(globals_, context);
+			} catch (const exception& e) {
+				output << "Error: "sv << e.what() << '\n';
+				report.failed = true;
+			}
+			output.flush();
+		}
+		const auto finished = Clock::now();
+		shutdown(connection, SHUT_RDWR);
+		close(connection);
+
+		report.first_output = buffer.GetFirstOutput().value_or(finished) - forked_at;
+		report.total = finished - forked_at;
+		report.memory = GetMemoryUsage();
+		// Reports are smaller than PIPE_BUF, so the writes of the children do not interleave
+		[[maybe_unused]] const ssize_t written = write(report_write_, &report, sizeof(report));
+		// The interpreter state belongs to the server: nothing is destroyed here
+		_exit(report.failed ? 1 : 0);
+	}
+
+	void ForkServer::CollectReports(bool wait_for_children) {
+		while (true){
+			ChildReport report;
+			while (read(report_read_, &report, sizeof(report)) == static_cast<ssize_t>(sizeof(report))){
+				AddReport(report);
+			}
+			if (children_ == 0){
+				return;
+			}
+
+			int status = 0;
+			const pid_t pid = waitpid(-1, &status, wait_for_children ? 0 : WNOHANG);
+			if (pid == 0 || (pid < 0 && errno != EINTR)){
+				return;
+			}
+			if (pid > 0){
+				--children_;
+				if (WIFSIGNALED(status)){
+					// The child died before it could report
+					ChildReport report;
+					report.failed = true;
+					AddReport(report);
+				}
+			}
+		}
+	}
+
+	void ForkServer::AddReport(const ChildReport& report) {
+		reports_.push_back(report);
+		if (log_ != nullptr){
+			*log_ << fixed << setprecision(3) << "request "sv << reports_.size()
+				  << (report.failed ? " failed"sv : ""sv) << ": first output "sv
+				  << ToMilliseconds(report.first_output) << " ms, total "sv << ToMilliseconds(report.total)
+				  << " ms, rss "sv << ToKilobytes(report.memory.resident_bytes) << " KiB, private "sv
+				  << ToKilobytes(report.memory.private_bytes) << " KiB"sv << endl;
+		}
+	}
+
+	Daemon::Daemon(fs::path socket_path, size_t cache_capacity, size_t thread_count)
+		: socket_path_(std::move(socket_path))
+		, thread_count_(thread_count)
+		, listener_(Listen(socket_path_))
+		, cache_(cache_capacity) {
+	}
+
+	Daemon::~Daemon() {
+		close(listener_);
+		error_code ignored;
+		fs::remove(socket_path_, ignored);
+	}
+
+	void Daemon::Run(size_t max_requests) {
+		pool::WorkStealingPool workers(thread_count_);
+		for (size_t accepted = 0; max_requests == 0 || accepted < max_requests; ++accepted){
+			const int connection = Accept(listener_);
+			workers.Submit([this, connection]{
+				Serve(connection);
+			});
+		}
+		workers.Wait();
+	}
+
+	const ProgramCache& Daemon::GetCache() const {
+		return cache_;
+	}
+
+	size_t Daemon::GetRequestCount() const {
+		return requests_.load();
+	}
+
+	size_t Daemon::GetFailedCount() const {
+		return failed_.load();
+	}
+
+	void Daemon::Serve(int connection) {
+		ConnectionBuffer buffer(connection);
+		{
+			ostream output(&buffer);
+			try {
+				const auto program = cache_.Get(ReadAll(connection));
+				runtime::SimpleContext context{output};
+				runtime::Closure globals;
+				program->Execute(globals, context);
+			} catch (const exception& e) {
+				output << "Error: "sv << e.what() << '\n';
+				++failed_;
+			}
+			output.flush();
+		}
+		++requests_;
+		shutdown(connection, SHUT_RDWR);
+		close(connection);
+	}
+
+	string Submit(const fs::path& socket_path, string_view script) {
+		const sockaddr_un address = MakeAddress(socket_path);
+		const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0){
+			ThrowSystemError("socket"s);
+		}
+		try {
+			if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0){
+				ThrowSystemError("Cannot connect to "s + socket_path.string());
+			}
+			if (!WriteAll(fd, script.data(), script.size())){
+				ThrowSystemError("send"s);
+			}
+			shutdown(fd, SHUT_WR);
+			string result = ReadAll(fd);
+			close(fd);
+			return result;
+		} catch (...) {
+			close(fd);
+			throw;
+		}
+	}
+
+	void PrintReports(ostream& os, const vector<ChildReport>& reports) {
+		vector<chrono::nanoseconds> first_outputs;
+		size_t failed = 0;
+		size_t resident = 0;
+		size_t private_bytes = 0;
+		for (const auto& report : reports){
+			first_outputs.push_back(report.first_output);
+			failed += report.failed ? 1 : 0;
+			resident += report.memory.resident_bytes;
+			private_bytes += report.memory.private_bytes;
+		}
+		const size_t count = max<size_t>(reports.size(), 1);
+
+		os << fixed << setprecision(3);
+		os << "requests: "sv << reports.size() << ", failed: "sv << failed << '\n';
+		os << "fork to first output p50: "sv << ToMilliseconds(Percentile(first_outputs, 0.50))
+		   << " ms, p99: "sv << ToMilliseconds(Percentile(first_outputs, 0.99)) << " ms\n"sv;
+		os << "child rss: "sv << ToKilobytes(resident / count) << " KiB, private: "sv
+		   << ToKilobytes(private_bytes / count) << " KiB (mean)\n"sv;
+	}
+
+	void PrintDaemonStats(ostream& os, const Daemon& daemon) {
+		const auto stats = daemon.GetCache().GetStats();
+		os << "requests: "sv << daemon.GetRequestCount() << ", failed: "sv << daemon.GetFailedCount() << '\n';
+		os << "program cache hits: "sv << stats.hits << ", misses: "sv << stats.misses
+		   << ", evictions: "sv << stats.evictions << '\n';
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "program_cache.h"
+#include "runtime.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace runtime {
+	class Executable;
+}
+
+namespace server {
+
+	// Resident memory of the calling process and the part of it not shared with other
+	// processes, i.e. the pages a forked child has written to
+	struct MemoryUsage {
+		size_t resident_bytes = 0;
+		size_t private_bytes = 0;
+	};
+
+	MemoryUsage GetMemoryUsage();
+
+	// Sent by every child to the server once its request is done
+	struct ChildReport {
+		// From the fork to the first character of output, or to the end of a request without output
+		std::chrono::nanoseconds first_output{};
+		std::chrono::nanoseconds total{};
+		MemoryUsage memory;
+		bool failed = false;
+	};
+
+	// Parses and runs a prelude once, then forks a child for every connection on a Unix
+	// socket. A connection sends a script and reads its output: the script runs in the child
+	// against the prelude's classes and globals, which the child shares with the server
+	// copy-on-write, so a request never sees the changes of another one
+	class ForkServer {
+	public:
+		// Binds the socket before returning, so clients may connect right away.
+		// Every collected report is written to log as one line
+		ForkServer(std::istream& prelude, std::filesystem::path socket_path, std::ostream* log = nullptr);
+		ForkServer(const ForkServer&) = delete;
+		ForkServer& operator=(const ForkServer&) = delete;
+		~ForkServer();
+
+		// Accepts max_requests connections (0 - no limit) and waits for their children
+		void Run(size_t max_requests = 0);
+
+		[[nodiscard]] const std::vector<ChildReport>& GetReports() const;
+
+	private:
+		[[noreturn]] void ServeInChild(int connection, std::chrono::steady_clock::time_point forked_at);
+		void CollectReports(bool wait_for_children);
+		void AddReport(const ChildReport& report);
+
+	private:
+		std::unique_ptr<runtime::Executable> prelude_;
+		runtime::Closure globals_;
+		std::filesystem::path socket_path_;
+		std::ostream* log_;
+		int listener_ = -1;
+		int report_read_ = -1;
+		int report_write_ = -1;
+		size_t children_ = 0;
+		std::vector<ChildReport> reports_;
+	};
+
+	// Keeps running and serves every connection on a Unix socket in-process: a connection
+	// sends a script and reads its output. Parsed programs are kept in a ProgramCache, so
+	// a script seen before skips lexing and parsing. Every run starts with fresh globals
+	class Daemon {
+	public:
+		Daemon(std::filesystem::path socket_path, size_t cache_capacity, size_t thread_count);
+		Daemon(const Daemon&) = delete;
+		Daemon& operator=(const Daemon&) = delete;
+		~Daemon();
+
+		// Accepts max_requests connections (0 - no limit) and waits until they are served
+		void Run(size_t max_requests = 0);
+
+		[[nodiscard]] const ProgramCache& GetCache() const;
+		[[nodiscard]] size_t GetRequestCount() const;
+		[[nodiscard]] size_t GetFailedCount() const;
+
+	private:
+		void Serve(int connection);
+
+	private:
+		std::filesystem::path socket_path_;
+		size_t thread_count_;
+		int listener_ = -1;
+		ProgramCache cache_;
+		std::atomic<size_t> requests_ = 0;
+		std::atomic<size_t> failed_ = 0;
+	};
+
+	// Sends a script to a server or a daemon and returns everything it writes back
+	std::string Submit(const std::filesystem::path& socket_path, std::string_view script);
+
+	void PrintReports(std::ostream& os, const std::vector<ChildReport>& reports);
+
+	void PrintDaemonStats(std::ostream& os, const Daemon& daemon);
+}
@@ -0,0 +1,117 @@
+#include "bench_runner_p.h"
+#include "lexer.h"
+#include "parse.h"
+#include "server.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace server {
+
+namespace {
+
+// A prelude that is expensive enough to matter: many classes and some global state
+string MakePrelude(int class_count) {
+    string prelude;
+    for (int i = 0; i < class_count; ++i) {
+        const string name = "Shape"s + to_string(i);
+        prelude += "class "s + name + ":\n"s
+                   "  def __init__(size):\n"s
+                   "    self.size = size\n"s
+                   "  def area():\n"s
+                   "    return self.size * self.size + "s + to_string(i) + "\n"s
+                   "  def __str__():\n"s
+                   "    return \""s + name + "\"\n\n"s;
+        prelude += "shape"s + to_string(i) + " = "s + name + "("s + to_string(i) + ")\n"s;
+    }
+    return prelude;
+}
+
+const string REQUEST = "s = Shape7(3)\nprint s, s.area(), shape12.area()\n"s;
+
+// Fork-per-request server against a fresh interpreter that parses the prelude every time
+void BenchmarkForkServer() {
+    constexpr int REQUEST_COUNT = 200;
+    const string prelude = MakePrelude(500);
+
+    const double fresh_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < REQUEST_COUNT; ++i) {
+            istringstream input(prelude + REQUEST);
+            parse::Lexer lexer(input);
+            auto program = ParseProgram(lexer);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            program->Execute(closure, context);
+        }
+    });
+
+    const auto socket_path = filesystem::temp_directory_path() / "mython_server_bench.sock"s;
+    istringstream prelude_input(prelude);
+    ForkServer server(prelude_input, socket_path);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        server.Run(REQUEST_COUNT);
+        PrintReports(cerr, server.GetReports());
+        _exit(0);
+    }
+
+    const double server_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < REQUEST_COUNT; ++i) {
+            Submit(socket_path, REQUEST);
+        }
+    });
+    waitpid(pid, nullptr, 0);
+
+    cerr << "  fresh interpreter: "sv << fresh_seconds / REQUEST_COUNT * 1000
+         << " ms/request, fork server: "sv << server_seconds / REQUEST_COUNT * 1000 << " ms/request"sv << endl;
+}
+
+// The same script submitted to a daemon with a warm program cache
+void BenchmarkDaemon() {
+    constexpr int REQUEST_COUNT = 200;
+    const string script = MakePrelude(500) + REQUEST;
+
+    const double fresh_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < REQUEST_COUNT; ++i) {
+            istringstream input(script);
+            parse::Lexer lexer(input);
+            auto program = ParseProgram(lexer);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            program->Execute(closure, context);
+        }
+    });
+
+    const auto socket_path = filesystem::temp_directory_path() / "mython_daemon_bench.sock"s;
+    Daemon daemon(socket_path, 16, 1);
+    thread runner([&daemon] {
+        daemon.Run(REQUEST_COUNT + 1);
+    });
+    const double miss_seconds = MeasureSeconds([&] {
+        Submit(socket_path, script);
+    });
+    const double hit_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < REQUEST_COUNT; ++i) {
+            Submit(socket_path, script);
+        }
+    });
+    runner.join();
+
+    cerr << "  fresh interpreter: "sv << fresh_seconds / REQUEST_COUNT * 1000 << " ms/request, daemon miss: "sv
+         << miss_seconds * 1000 << " ms, daemon hit: "sv << hit_seconds / REQUEST_COUNT * 1000
+         << " ms/request"sv << endl;
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, server::BenchmarkForkServer);
+    RUN_BENCHMARK(br, server::BenchmarkDaemon);
+}
+
+}  // namespace server
@@ -0,0 +1,128 @@
+#include "server.h"
+#include "test_runner_p.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace server {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const string PRELUDE = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add():
+    self.value = self.value + 1
+    return self.value
+
+counter = Counter()
+greeting = "hello"
+)"s;
+
+// Runs the server in a child process that handles the given number of requests
+pid_t StartServer(ForkServer& server, size_t requests) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        int status = 0;
+        try {
+            server.Run(requests);
+            // Every request below except the failing one must succeed
+            for (const auto& report : server.GetReports()) {
+                status += report.failed ? 1 : 0;
+            }
+        } catch (...) {
+            status = 100;
+        }
+        _exit(status);
+    }
+    return pid;
+}
+
+void TestServeRequests() {
+    const fs::path socket_path = fs::temp_directory_path() / "mython_server_test.sock"s;
+    istringstream prelude(PRELUDE);
+    ForkServer server(prelude, socket_path);
+
+    const pid_t pid = StartServer(server, 4);
+    ASSERT(pid > 0);
+
+    const string request = "counter.add()\nprint greeting, counter.value\n"s;
+    ASSERT_EQUAL(Submit(socket_path, request), "hello 1\n"s);
+    // The first request changed only its own copy of the globals
+    ASSERT_EQUAL(Submit(socket_path, request), "hello 1\n"s);
+    ASSERT_EQUAL(Submit(socket_path, "c = Counter()\nprint c.add(), c.add()\n"s), "1 2\n"s);
+
+    const string error = Submit(socket_path, "print 1\nprint missing\n"s);
+    ASSERT_EQUAL(error.substr(0, 9), "1\nError: "s);
+
+    int status = 0;
+    ASSERT_EQUAL(waitpid(pid, &status, 0), pid);
+    ASSERT(WIFEXITED(status));
+    // One failed request out of four
+    ASSERT_EQUAL(WEXITSTATUS(status), 1);
+}
+
+void TestDaemon() {
+    const fs::path socket_path = fs::temp_directory_path() / "mython_daemon_test.sock"s;
+    Daemon daemon(socket_path, 3, 2);
+    thread runner([&daemon] {
+        daemon.Run(5);
+    });
+
+    const string script = PRELUDE + "counter.add()\nprint greeting, counter.value\n"s;
+    ASSERT_EQUAL(Submit(socket_path, script), "hello 1\n"s);
+    // A cached program still runs against fresh globals
+    ASSERT_EQUAL(Submit(socket_path, script), "hello 1\n"s);
+    ASSERT_EQUAL(Submit(socket_path, "print greeting\n"s).substr(0, 7), "Error: "s);
+    ASSERT_EQUAL(Submit(socket_path, "print 'other'\n"s), "other\n"s);
+    ASSERT_EQUAL(Submit(socket_path, script), "hello 1\n"s);
+    runner.join();
+
+    const auto stats = daemon.GetCache().GetStats();
+    ASSERT_EQUAL(daemon.GetRequestCount(), 5U);
+    ASSERT_EQUAL(daemon.GetFailedCount(), 1U);
+    ASSERT_EQUAL(stats.hits, 2U);
+    ASSERT_EQUAL(stats.misses, 3U);
+}
+
+void TestPrintReports() {
+    ChildReport report;
+    report.first_output = chrono::milliseconds(2);
+    report.total = chrono::milliseconds(3);
+    report.memory = {4096, 1024};
+    ChildReport failed;
+    failed.failed = true;
+
+    ostringstream output;
+    PrintReports(output, {report, failed});
+    ASSERT_EQUAL(output.str(),
+                 "requests: 2, failed: 1\n"
+                 "fork to first output p50: 2.000 ms, p99: 2.000 ms\n"
+                 "child rss: 2.000 KiB, private: 0.500 KiB (mean)\n"s);
+}
+
+void TestMemoryUsage() {
+    const MemoryUsage usage = GetMemoryUsage();
+    ASSERT(usage.resident_bytes > 0);
+    ASSERT(usage.private_bytes <= usage.resident_bytes);
+}
+
+}  // namespace
+
+void RunServerTests(TestRunner& tr) {
+    RUN_TEST(tr, server::TestServeRequests);
+    RUN_TEST(tr, server::TestDaemon);
+    RUN_TEST(tr, server::TestPrintReports);
+    RUN_TEST(tr, server::TestMemoryUsage);
+}
+
+}  // namespace server
@@ -0,0 +1,313 @@
+#include "snapshot.h"
+
+#include "image.h"
+#include "image_io.h"
+#include "isolate.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace snapshot {
+
+	namespace fs = std::filesystem;
+
+	namespace {
+		constexpr char MAGIC[8] = {'M', 'Y', 'T', 'H', 'S', 'N', 'A', 'P'};
+		constexpr uint32_t VERSION = 1;
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t string_count;
+			uint64_t classes_size;
+			uint64_t strings_size;
+			uint64_t heap_size;
+		};
+
+		enum class Kind : uint8_t {
+			Number,
+			String,
+			Bool,
+			Class,
+			Instance,
+		};
+
+		// Objects get ids in the order they are reached, 0 stands for None. The heap is
+		// written as the objects in id order, then the fields of every instance, then the globals
+		class HeapWriter {
+		public:
+			void WriteGlobals(const runtime::Closure& globals) {
+				vector<pair<uint64_t, uint64_t>> entries;
+				entries.reserve(globals.size());
+				for (const auto& [name, object] : globals){
+					entries.emplace_back(strings_.Add(name), AddObject(object));
+				}
+
+				// Instances reached through fields are appended while the loop runs
+				for (size_t i = 0; i < instances_.size(); ++i){
+					const auto& fields = instances_[i]->Fields();
+					vector<pair<uint64_t, uint64_t>> field_entries;
+					field_entries.reserve(fields.size());
+					for (const auto& [name, object] : fields){
+						field_entries.emplace_back(strings_.Add(name), AddObject(object));
+					}
+					image::AppendUnsigned(fields_, field_entries.size());
+					for (const auto& [name, id] : field_entries){
+						image::AppendUnsigned(fields_, name);
+						image::AppendUnsigned(fields_, id);
+					}
+				}
+
+				image::AppendUnsigned(globals_, entries.size());
+				for (const auto& [name, id] : entries){
+					image::AppendUnsigned(globals_, name);
+					image::AppendUnsigned(globals_, id);
+				}
+			}
+
+			void Save(ostream& output) const {
+				ostringstream classes;
+				image::SaveClasses(classes_, 0, classes);
+				const string class_image = classes.str();
+
+				string strings;
+				strings_.Write(strings);
+
+				string heap;
+				image::AppendUnsigned(heap, ids_.size());
+				heap += objects_;
+				heap += fields_;
+				heap += globals_;
+
+				Header header{};
+				memcpy(header.magic, MAGIC, sizeof(MAGIC));
+				header.version = VERSION;
+				header.string_count = static_cast<uint32_t>(strings_.GetCount());
+				header.classes_size = class_image.size();
+				header.strings_size = strings.size();
+				header.heap_size = heap.size();
+
+				output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				output.write(class_image.data(), static_cast<streamsize>(class_image.size()));
+				output.write(strings.data(), static_cast<streamsize>(strings.size()));
+				output.write(heap.data(), static_cast<streamsize>(heap.size()));
+			}
+
+		private:
+			uint64_t AddObject(const runtime::ObjectHolder& object) {
+				if (!object){
+					return 0;
+				}
+				auto [it, inserted] = ids_.emplace(object.Get(), ids_.size() + 1);
+				if (!inserted){
+					return it->second;
+				}
+
+				if (const auto* number = object.TryAs<runtime::Number>()){
+					WriteKind(Kind::Number);
+					image::AppendSigned(objects_, number->GetValue());
+				}else if (const auto* str = object.TryAs<runtime::String>()){
+					WriteKind(Kind::String);
+					image::AppendUnsigned(objects_, strings_.Add(str->GetValue()));
+				}else if (const auto* boolean = object.TryAs<runtime::Bool>()){
+					WriteKind(Kind::Bool);
+					image::AppendUnsigned(objects_, boolean->GetValue() ? 1 : 0);
+				}else if (const auto* cls = object.TryAs<runtime::Class>()){
+					WriteKind(Kind::Class);
+					image::AppendUnsigned(objects_, AddClass(*cls));
+				}else if (const auto* instance = object.TryAs<runtime::ClassInstance>()){
+					WriteKind(Kind::Instance);
+					image::AppendUnsigned(objects_, AddClass(instance->GetClass()));
+					instances_.push_back(instance);
+				}else{
+					ostringstream name;
+					runtime::DummyContext context;
+					object->Print(name, context);
+					throw SnapshotError("Cannot save "s + name.str() + " in a snapshot"s);
+				}
+				return it->second;
+			}
+
+			uint64_t AddClass(const runtime::Class& cls) {
+				auto [it, inserted] = classes_by_name_.emplace(cls.GetName(), &cls);
+				if (inserted){
+					classes_.push_back(&cls);
+				}else if (it->second != &cls){
+					throw SnapshotError("The heap holds two classes named "s + cls.GetName());
+				}
+				return strings_.Add(cls.GetName());
+			}
+
+			void WriteKind(Kind kind) {
+				objects_ += static_cast<char>(kind);
+			}
+
+		private:
+			image::StringTable strings_;
+			unordered_map<const runtime::Object*, uint64_t> ids_;
+			unordered_map<string, const runtime::Class*> classes_by_name_;
+			vector<const runtime::Class*> classes_;
+			vector<const runtime::ClassInstance*> instances_;
+			string objects_;
+			string fields_;
+			string globals_;
+		};
+
+		class HeapReader {
+		public:
+			HeapReader(vector<string_view> strings, string_view heap, const runtime::Closure& classes)
+				: strings_(std::move(strings))
+				, reader_(heap)
+				, classes_(classes) {
+			}
+
+			runtime::Closure ReadGlobals() {
+				objects_.resize(reader_.ReadCount() + 1);
+				for (size_t id = 1; id < objects_.size(); ++id){
+					objects_[id] = ReadObject();
+				}
+
+				for (runtime::ClassInstance* instance : instances_){
+					auto& fields = instance->Fields();
+					for (size_t count = reader_.ReadCount(); count > 0; --count){
+						string name(ReadString());
+						fields[std::move(name)] = ReadReference();
+					}
+				}
+
+				runtime::Closure globals;
+				for (size_t count = reader_.ReadCount(); count > 0; --count){
+					string name(ReadString());
+					globals[std::move(name)] = ReadReference();
+				}
+				if (reader_.GetRemaining() != 0){
+					throw image::ImageError("The snapshot has data after the heap"s);
+				}
+				return globals;
+			}
+
+		private:
+			runtime::ObjectHolder ReadObject() {
+				switch (static_cast<Kind>(reader_.ReadByte())){
+				case Kind::Number:
+					return runtime::ObjectHolder::Own(runtime::Number(static_cast<int>(reader_.ReadSigned())));
+				case Kind::String:
+					return runtime::ObjectHolder::Own(runtime::String(string(ReadString())));
+				case Kind::Bool:
+					return runtime::ObjectHolder::Own(runtime::Bool(reader_.ReadUnsigned() != 0));
+				case Kind::Class:
+					return FindClass(ReadString());
+				case Kind::Instance: {
+					runtime::ObjectHolder instance = FindClass(ReadString()).TryAs<runtime::Class>()->NewInstance();
+					instances_.push_back(instance.TryAs<runtime::ClassInstance>());
+					return instance;
+				}
+				}
+				throw image::ImageError("The snapshot contains an unknown object"s);
+			}
+
+			runtime::ObjectHolder ReadReference() {
+				const uint64_t id = reader_.ReadUnsigned();
+				if (id >= objects_.size()){
+					throw image::ImageError("The snapshot refers to an unknown object"s);
+				}
+				return objects_[id];
+			}
+
+			string_view ReadString() {
+				const uint64_t index = reader_.ReadUnsigned();
+				if (index >= strings_.size()){
+					throw image::ImageError("The snapshot refers to an unknown string"s);
+				}
+				return strings_[index];
+			}
+
+			const runtime::ObjectHolder& FindClass(string_view name) const {
+				const string key(name);
+				if (auto it = classes_.find(key); it != classes_.end()){
+					return it->second;
+				}
+				const auto& builtins = isolate::GetBuiltinClasses();
+				if (auto it = builtins.find(key); it != builtins.end()){
+					return it->second;
+				}
+				throw image::ImageError("The snapshot refers to an unknown class "s + key);
+			}
+
+		private:
+			vector<string_view> strings_;
+			image::ByteReader reader_;
+			const runtime::Closure& classes_;
+			// Indexed by id, the first one is None
+			vector<runtime::ObjectHolder> objects_;
+			vector<runtime::ClassInstance*> instances_;
+		};
+	}
+
+	void SaveSnapshot(const runtime::Closure& globals, ostream& output) {
+		HeapWriter writer;
+		writer.WriteGlobals(globals);
+		writer.Save(output);
+	}
+
+	void SaveSnapshot(const runtime::Closure& globals, const fs::path& path) {
+		ofstream output(path, ios::binary | ios::trunc);
+		if (!output){
+			throw SnapshotError("Cannot write "s + path.string());
+		}
+		SaveSnapshot(globals, output);
+		if (!output.flush()){
+			throw SnapshotError("Cannot write "s + path.string());
+		}
+	}
+
+	Snapshot Snapshot::Load(string_view data) {
+		Header header{};
+		if (data.size() < sizeof(header)){
+			throw image::ImageError("The snapshot is truncated"s);
+		}
+		memcpy(&header, data.data(), sizeof(header));
+		if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION){
+			throw image::ImageError("Not a snapshot of this version"s);
+		}
+
+		image::ByteReader reader(data.substr(sizeof(header)));
+		const string_view class_image = reader.ReadBytes(header.classes_size);
+		image::ByteReader strings_reader(reader.ReadBytes(header.strings_size));
+		const string_view heap = reader.ReadBytes(header.heap_size);
+		if (reader.GetRemaining() != 0){
+			throw image::ImageError("The snapshot has data after the heap"s);
+		}
+
+		Snapshot snapshot;
+		snapshot.class_definitions_ = image::LoadImage(class_image, 0);
+		if (snapshot.class_definitions_ == nullptr){
+			throw image::ImageError("The snapshot has no classes"s);
+		}
+		runtime::DummyContext context;
+		snapshot.class_definitions_->Execute(snapshot.classes_, context);
+
+		HeapReader heap_reader(image::StringTable::Read(strings_reader, header.string_count), heap,
+							   snapshot.classes_);
+		snapshot.globals_ = heap_reader.ReadGlobals();
+		return snapshot;
+	}
+
+	Snapshot Snapshot::LoadFile(const fs::path& path) {
+		const image::MappedFile file(path);
+		return Load(file.GetData());
+	}
+
+	const runtime::Closure& Snapshot::GetClasses() const {
+		return classes_;
+	}
+
+	runtime::Closure& Snapshot::GetGlobals() {
+		return globals_;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <filesystem>
+#include <iosfwd>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+
+// Heap snapshots: the globals of an interpreter together with every object reachable from
+// them and the classes of those objects. A process that restores a snapshot starts with the
+// heap an initialization phase has built, without running that phase again
+namespace snapshot {
+
+	struct SnapshotError : std::runtime_error {
+		using std::runtime_error::runtime_error;
+	};
+
+	// Shared references and cycles are kept. Throws SnapshotError when the heap holds an
+	// object that has no snapshot form, such as a channel or an isolate
+	void SaveSnapshot(const runtime::Closure& globals, std::ostream& output);
+	void SaveSnapshot(const runtime::Closure& globals, const std::filesystem::path& path);
+
+	// A restored heap. Its classes belong to it, so objects and programs that use them must
+	// not outlive it. A program runs against a snapshot like this:
+	//   ParseProgram(lexer, snapshot.GetClasses())->Execute(snapshot.GetGlobals(), context)
+	class Snapshot {
+	public:
+		// Throw image::ImageError when the snapshot is damaged
+		static Snapshot Load(std::string_view data);
+		static Snapshot LoadFile(const std::filesystem::path& path);
+
+		[[nodiscard]] const runtime::Closure& GetClasses() const;
+		[[nodiscard]] runtime::Closure& GetGlobals();
+
+	private:
+		Snapshot() = default;
+
+	private:
+		// Owns the classes, so it is destroyed after the objects
+		std::unique_ptr<runtime::Executable> class_definitions_;
+		runtime::Closure classes_;
+		runtime::Closure globals_;
+	};
+}
@@ -0,0 +1,83 @@
+#include "bench_runner_p.h"
+#include "lexer.h"
+#include "parse.h"
+#include "snapshot.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace snapshot {
+
+namespace {
+
+// Builds a configuration table of entry_count linked entries, one global per hundred
+string MakeInitScript(int entry_count) {
+    string script = R"(
+class Entry:
+  def __init__(key, value, next):
+    self.key = key
+    self.value = value
+    self.next = next
+    self.enabled = value > 10
+
+class Table:
+  def __init__(name):
+    self.name = name
+    self.head = None
+    self.size = 0
+
+  def add(key, value):
+    self.head = Entry(key, value, self.head)
+    self.size = self.size + 1
+
+)"s;
+    for (int group = 0; group * 100 < entry_count; ++group) {
+        const string table = "table"s + to_string(group);
+        script += table + " = Table(\"group "s + to_string(group) + "\")\n"s;
+        for (int i = 0; i < 100 && group * 100 + i < entry_count; ++i) {
+            script += table + ".add(\"key "s + to_string(i) + "\", "s + to_string(group * 100 + i) + ")\n"s;
+        }
+    }
+    return script;
+}
+
+// Running an initialization phase against restoring the heap it has built
+void BenchmarkWarmStart() {
+    constexpr int RUNS = 10;
+    const string init = MakeInitScript(20000);
+
+    string data;
+    const double init_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < RUNS; ++i) {
+            istringstream input(init);
+            parse::Lexer lexer(input);
+            auto program = ParseProgram(lexer);
+            runtime::DummyContext context;
+            runtime::Closure globals;
+            program->Execute(globals, context);
+            if (i == 0) {
+                ostringstream output;
+                SaveSnapshot(globals, output);
+                data = output.str();
+            }
+        }
+    });
+
+    const double restore_seconds = MeasureSeconds([&] {
+        for (int i = 0; i < RUNS; ++i) {
+            auto restored = Snapshot::Load(data);
+        }
+    });
+
+    cerr << "  20000 entries, "sv << data.size() / 1024 << " KiB snapshot: initialization "sv
+         << init_seconds / RUNS * 1000 << " ms, restore "sv << restore_seconds / RUNS * 1000 << " ms"sv << endl;
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, snapshot::BenchmarkWarmStart);
+}
+
+}  // namespace snapshot
@@ -0,0 +1,169 @@
+#include "snapshot.h"
+#include "image.h"
+#include "lexer.h"
+#include "parse.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace snapshot {
+
+namespace {
+
+const string INIT = R"--(
+class Node:
+  def __init__(value):
+    self.value = value
+    self.next = None
+
+class Factory:
+  def make(value):
+    return Node(value)
+
+class Base:
+  def describe():
+    return "base " + self.name
+
+class Settings(Base):
+  def __init__(name):
+    self.name = name
+    self.enabled = True
+
+  def __str__():
+    return "Settings(" + self.name + ")"
+
+a = Node(1)
+b = Node(2)
+a.next = b
+b.next = a
+shared = Node("shared")
+settings = Settings("prod")
+settings.left = shared
+settings.right = shared
+factory = Factory()
+kind = Node
+count = -42
+flag = False
+nothing = None
+label = "config"
+)--"s;
+
+const string CHECK = R"--(
+print a.value, a.next.value, a.next.next.value
+settings.left.value = "changed"
+print settings.right.value, shared.value
+print settings, settings.describe(), settings.enabled
+n = factory.make(7)
+print n.value
+m = Settings("new")
+print m.describe()
+print kind, count, flag, nothing, label
+)--"s;
+
+string Run(const string& source, const runtime::Closure& classes, runtime::Closure& globals) {
+    istringstream input(source);
+    parse::Lexer lexer(input);
+    auto program = ParseProgram(lexer, classes);
+    runtime::DummyContext context;
+    program->Execute(globals, context);
+    return context.output.str();
+}
+
+// a and b refer to each other, so they are only released once the cycle is broken
+void BreakCycle(runtime::Closure& globals) {
+    if (auto it = globals.find("b"s); it != globals.end()) {
+        if (auto* node = it->second.TryAs<runtime::ClassInstance>()) {
+            node->Fields().erase("next"s);
+        }
+    }
+}
+
+// Holds the initialization program, which owns the classes of the heap it builds
+struct InitializedHeap {
+    unique_ptr<runtime::Executable> program;
+    runtime::Closure globals;
+
+    explicit InitializedHeap(const string& source) {
+        istringstream input(source);
+        parse::Lexer lexer(input);
+        program = ParseProgram(lexer);
+        runtime::DummyContext context;
+        program->Execute(globals, context);
+    }
+
+    ~InitializedHeap() {
+        BreakCycle(globals);
+    }
+
+    string Save() const {
+        ostringstream output;
+        SaveSnapshot(globals, output);
+        return output.str();
+    }
+};
+
+void TestRestoreHeap() {
+    InitializedHeap heap(INIT);
+    const string data = heap.Save();
+
+    auto snapshot = Snapshot::Load(data);
+    ASSERT_EQUAL(Run(CHECK, snapshot.GetClasses(), snapshot.GetGlobals()),
+                 "1 2 1\n"
+                 "changed changed\n"
+                 "Settings(prod) base prod True\n"
+                 "7\n"
+                 "base new\n"
+                 "Class Node -42 False None config\n"s);
+    BreakCycle(snapshot.GetGlobals());
+}
+
+void TestRestoredHeapsAreIndependent() {
+    InitializedHeap heap(INIT);
+    const string data = heap.Save();
+
+    auto first = Snapshot::Load(data);
+    auto second = Snapshot::Load(data);
+    Run("shared.value = 0\ncount = 1\n"s, first.GetClasses(), first.GetGlobals());
+    ASSERT_EQUAL(Run("print shared.value, count\n"s, second.GetClasses(), second.GetGlobals()),
+                 "shared -42\n"s);
+    // The heap of the initialization is not touched either
+    ASSERT_EQUAL(Run("print shared.value\n"s, {}, heap.globals), "shared\n"s);
+
+    BreakCycle(first.GetGlobals());
+    BreakCycle(second.GetGlobals());
+}
+
+void TestOnlyUsedClassesAreSaved() {
+    InitializedHeap heap("class Unused:\n  def f():\n    return 1\n\nUnused = None\nx = 1\n"s);
+    auto snapshot = Snapshot::Load(heap.Save());
+    ASSERT(snapshot.GetClasses().empty());
+    ASSERT_EQUAL(Run("print x\n"s, snapshot.GetClasses(), snapshot.GetGlobals()), "1\n"s);
+}
+
+void TestUnsupportedObjects() {
+    InitializedHeap heap("c = Channel(1)\n"s);
+    ASSERT_THROWS(heap.Save(), SnapshotError);
+}
+
+void TestDamagedSnapshot() {
+    InitializedHeap heap(INIT);
+    const string data = heap.Save();
+    for (size_t size = 0; size < data.size(); ++size) {
+        ASSERT_THROWS(Snapshot::Load(string_view(data).substr(0, size)), image::ImageError);
+    }
+    ASSERT_THROWS(Snapshot::Load(data + "x"s), image::ImageError);
+}
+
+}  // namespace
+
+void RunSnapshotTests(TestRunner& tr) {
+    RUN_TEST(tr, snapshot::TestRestoreHeap);
+    RUN_TEST(tr, snapshot::TestRestoredHeapsAreIndependent);
+    RUN_TEST(tr, snapshot::TestOnlyUsedClassesAreSaved);
+    RUN_TEST(tr, snapshot::TestUnsupportedObjects);
+    RUN_TEST(tr, snapshot::TestDamagedSnapshot);
+}
+
+}  // namespace snapshot
@@ -1,7 +1,10 @@
 #include "statement.h"
 
+#include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
 #include <utility>
 
 using namespace std;
@@ -15,6 +18,76 @@ namespace ast{
 	namespace{
 		const string ADD_METHOD = "__add__"s;
 		const string INIT_METHOD = "__init__"s;
+		const string STR_METHOD = "__str__"s;
+
+		// Results of str() for integers in this range are preallocated and shared
+		constexpr int SMALL_INT_MIN = -128;
+		constexpr int SMALL_INT_MAX = 1024;
+
+		ObjectHolder MakeString(string str){
+			return ObjectHolder::Own(runtime::String(std::move(str)));
+		}
+
+		string FormatNumber(int value){
+			char buffer[16];
+			auto [ptr, _] = to_chars(begin(buffer), end(buffer), value);
+			return string(buffer, ptr);
+		}
+
+		const vector<ObjectHolder>& SmallIntStrings(){
+			static const vector<ObjectHolder> cache = []{
+				vector<ObjectHolder> result;
+				result.reserve(SMALL_INT_MAX - SMALL_INT_MIN + 1);
+				for (int value = SMALL_INT_MIN; value <= SMALL_INT_MAX; ++value){
+					result.push_back(MakeString(FormatNumber(value)));
+				}
+				return result;
+			}();
+			return cache;
+		}
+
+		ObjectHolder NumberToString(int value){
+			if (value >= SMALL_INT_MIN && value <= SMALL_INT_MAX){
+				return SmallIntStrings()[value - SMALL_INT_MIN];
+			}
+			return MakeString(FormatNumber(value));
+		}
+
+		ObjectHolder BoolToString(bool value){
+			static const ObjectHolder true_str = MakeString("True"s);
+			static const ObjectHolder false_str = MakeString("False"s);
+			return value ? true_str : false_str;
+		}
+
+		ObjectHolder NoneToString(){
+			static const ObjectHolder none_str = MakeString("None"s);
+			return none_str;
+		}
+
+		// Strings are never modified, so one object can back every equal str() result
+		ObjectHolder ToString(const ObjectHolder& obj, Context& context){
+			if (!obj){
+				return NoneToString();
+			}
+			if (obj.IsType<runtime::String>()){
+				return obj;
+			}
+			if (const auto* num = obj.TryAs<runtime::Number>()){
+				return NumberToString(num->GetValue());
+			}
+			if (const auto* b = obj.TryAs<runtime::Bool>()){
+				return BoolToString(b->GetValue());
+			}
+			if (auto* instance = obj.TryAs<runtime::ClassInstance>()){
+				if (const auto* method = instance->TryMethod(STR_METHOD, 0)){
+					return ToString(instance->Call(method, {}, context), context);
+				}
+			}
+
+			stringstream strm;
+			obj->Print(strm, context);
+			return MakeString(strm.str());
+		}
 	}
 
 
@@ -27,14 +100,17 @@ namespace ast{
 		: dotted_ids_(std::move(dotted_ids)){
 	}
 
-	ObjectHolder VariableValue::Execute(Closure& closure, [[maybe_unused]] Context& context){
-		auto found_object = closure.find(dotted_ids_.front());
+	ObjectHolder VariableValue::Execute(Closure& closure, [[maybe_unused]] Context& context) const{
+		Closure::const_iterator found_object = closure.find(dotted_ids_.front());
 		if (found_object == closure.end()){
 			throw std::runtime_error("Not find variable");
 		}
 		for (size_t i = 1; i < dotted_ids_.size(); ++i){
-			auto instance = found_object->second.TryAs<runtime::ClassInstance>();
-			Closure& fields = instance->Fields();
+			const auto* instance = found_object->second.TryAs<runtime::ClassInstance>();
+			if (instance == nullptr){
+				throw std::runtime_error("Only class instances have fields");
+			}
+			const Closure& fields = instance->Fields();
 			found_object = fields.find(dotted_ids_[i]);
 			if (found_object == fields.end()) {
 				throw std::runtime_error("Not find variable");
@@ -52,7 +128,7 @@ namespace ast{
 		, rv_(std::move(rv))
 	{}
 
-	ObjectHolder Assignment::Execute(Closure& closure, Context& context){
+	ObjectHolder Assignment::Execute(Closure& closure, Context& context) const{
 		auto found_object = closure.find(var_name_);
 		if (found_object != closure.end()) {
 			return found_object->second = rv_->Execute(closure, context);
@@ -68,9 +144,12 @@ namespace ast{
 		, rv_(std::move(rv))
 	{}
 
-	ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context){
+	ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context) const{
 		auto ex = object_.Execute(closure, context);
 		auto instance = ex.TryAs<runtime::ClassInstance>();
+		if (instance == nullptr){
+			throw std::runtime_error("Only class instances have fields");
+		}
 
 		Closure& fields = instance->Fields();
 		auto found_field = fields.find(field_name_);
@@ -96,7 +175,7 @@ namespace ast{
 		return make_unique<Print>(std::move(value));
 	}
 
-	ObjectHolder Print::Execute(Closure& closure, Context& context){
+	ObjectHolder Print::Execute(Closure& closure, Context& context) const{
 		ostream& out = context.GetOutputStream();
 		if (args_.empty()){
 			out << '\n';
@@ -123,15 +202,8 @@ namespace ast{
 		return {};
 	}
 
-	ObjectHolder Stringify::Execute(Closure& closure, Context& context){
-		stringstream strm;
-		auto obj = argument_->Execute(closure, context);
-		if (obj){
-			obj->Print(strm, context);
-		}else{
-			strm << "None";
-		}
-		return runtime::ObjectHolder::Own(runtime::String(strm.str()));
+	ObjectHolder Stringify::Execute(Closure& closure, Context& context) const{
+		return ToString(argument_->Execute(closure, context), context);
 	}
 
 	MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
@@ -141,50 +213,152 @@ namespace ast{
 		, args_(std::move(args)){
 	}
 
-	ObjectHolder MethodCall::Execute(Closure& closure, Context& context){
+	ObjectHolder MethodCall::Execute(Closure& closure, Context& context) const{
 		auto obj = object_->Execute(closure, context);
 		auto instance = obj.TryAs<runtime::ClassInstance>();
+		if (instance == nullptr){
+			throw std::runtime_error("Only class instances have methods");
+		}
+		return Call(*instance, closure, context);
+	}
+
+	ObjectHolder MethodCall::Call(runtime::ClassInstance& instance, Closure& closure, Context& context) const{
+		return instance.Call(method_, EvaluateArgs(closure, context), context);
+	}
 
+	vector<ObjectHolder> MethodCall::EvaluateArgs(Closure& closure, Context& context) const{
 		vector<ObjectHolder> actual_args;
+		actual_args.reserve(args_.size());
 		for (const auto& arg : args_){
-			auto temp_obj = arg->Execute(closure, context);
-			actual_args.push_back(temp_obj);
+			actual_args.push_back(arg->Execute(closure, context));
 		}
+		return actual_args;
+	}
+
+	BoundMethodCall::BoundMethodCall(unique_ptr<MethodCall> call, const runtime::Method& method)
+		: call_(std::move(call))
+		, method_(method)
+	{}
 
-		return instance->Call(method_, actual_args, context);
+	ObjectHolder BoundMethodCall::Execute(Closure& closure, Context& context) const{
+		auto obj = call_->GetObject().Execute(closure, context);
+		auto instance = obj.TryAs<runtime::ClassInstance>();
+		if (instance == nullptr){
+			throw std::runtime_error("Only class instances have methods");
+		}
+		return instance->Call(&method_, call_->EvaluateArgs(closure, context), context);
 	}
 
-	ObjectHolder Add::Execute(Closure& closure, Context& context){
-		auto lhs = lhs_->Execute(closure, context);
-		auto rhs = rhs_->Execute(closure, context);
+	InlinedMethodCall::InlinedMethodCall(unique_ptr<MethodCall> call, vector<Target> targets)
+		: call_(std::move(call))
+		, targets_(std::move(targets))
+	{}
 
-		auto lhs_number = lhs.TryAs<runtime::Number>();
-		auto rhs_number = rhs.TryAs<runtime::Number>();
-		if (lhs_number != nullptr && rhs_number != nullptr){
-			int number = lhs_number->GetValue() + rhs_number->GetValue();
-			return runtime::ObjectHolder::Own(runtime::Number{number});
+	ObjectHolder InlinedMethodCall::Execute(Closure& closure, Context& context) const{
+		auto obj = call_->GetObject().Execute(closure, context);
+		auto instance = obj.TryAs<runtime::ClassInstance>();
+		if (instance == nullptr){
+			throw std::runtime_error("Only class instances have methods");
+		}
+		const auto target = std::find_if(targets_.begin(), targets_.end(), [instance](const Target& t) {
+			return t.cls == &instance->GetClass();
+		});
+		if (target == targets_.end()){
+			return call_->Call(*instance, closure, context);
 		}
 
-		auto lhs_string = lhs.TryAs<runtime::String>();
-		auto rhs_string = rhs.TryAs<runtime::String>();
-		if (lhs_string != nullptr && rhs_string != nullptr){
-			string str = lhs_string->GetValue() + rhs_string->GetValue();
-			return runtime::ObjectHolder::Own(runtime::String{std::move(str)});
+		// The arguments run as they would for the call, only the one the body uses is kept
+		ObjectHolder argument;
+		for (size_t i = 0; i < call_->GetArgs().size(); ++i){
+			auto value = call_->GetArgs()[i]->Execute(closure, context);
+			if (target->value.kind == Value::Kind::PARAMETER && i == target->value.parameter){
+				argument = std::move(value);
+			}
 		}
 
-		auto lhs_instance = lhs.TryAs<runtime::ClassInstance>();
-		if (lhs_instance != nullptr && lhs_instance->HasMethod(ADD_METHOD, 1)){
-			std::vector<ObjectHolder> actual_args = { rhs };
-			return lhs_instance->Call(ADD_METHOD, actual_args, context);
+		ObjectHolder result;
+		switch (target->value.kind){
+			case Value::Kind::CONSTANT:
+				result = target->value.constant;
+				break;
+			case Value::Kind::SELF:
+				// Bound like the self of the call
+				result = instance->Self();
+				break;
+			case Value::Kind::FIELD: {
+				const Closure& fields = std::as_const(*instance).Fields();
+				const auto field = fields.find(target->value.field);
+				if (field == fields.end()){
+					throw std::runtime_error("Not find variable");
+				}
+				result = field->second;
+				break;
+			}
+			case Value::Kind::PARAMETER:
+				result = std::move(argument);
+				break;
 		}
+		if (target->assigned_field){
+			instance->Fields()[*target->assigned_field] = std::move(result);
+			return ObjectHolder::None();
+		}
+		return result;
+	}
+
+	namespace{
+		ObjectHolder AddObjects(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context){
+			auto lhs_number = lhs.TryAs<runtime::Number>();
+			auto rhs_number = rhs.TryAs<runtime::Number>();
+			if (lhs_number != nullptr && rhs_number != nullptr){
+				int number = lhs_number->GetValue() + rhs_number->GetValue();
+				return runtime::ObjectHolder::Own(runtime::Number{number});
+			}
 
-		throw std::runtime_error("No __add__ method"s);
+			auto lhs_string = lhs.TryAs<runtime::String>();
+			auto rhs_string = rhs.TryAs<runtime::String>();
+			if (lhs_string != nullptr && rhs_string != nullptr){
+				string str = lhs_string->GetValue() + rhs_string->GetValue();
+				return runtime::ObjectHolder::Own(runtime::String{std::move(str)});
+			}
+
+			auto lhs_instance = lhs.TryAs<runtime::ClassInstance>();
+			if (lhs_instance != nullptr && lhs_instance->HasMethod(ADD_METHOD, 1)){
+				std::vector<ObjectHolder> actual_args = { rhs };
+				return lhs_instance->Call(ADD_METHOD, actual_args, context);
+			}
+
+			throw std::runtime_error("No __add__ method"s);
+		}
 	}
 
-	ObjectHolder Sub::Execute(Closure& closure, Context& context){
-		auto lhs = lhs_->Execute(closure, context);
-		auto rhs = rhs_->Execute(closure, context);
+	ObjectHolder BinaryOperation::Execute(Closure& closure, Context& context) const{
+		const auto* lhs_operation = dynamic_cast<const BinaryOperation*>(lhs_.get());
+		if (lhs_operation == nullptr){
+			auto lhs = lhs_->Execute(closure, context);
+			auto rhs = rhs_->Execute(closure, context);
+			return Apply(lhs, rhs, context);
+		}
 
+		// The chain of left operands, like that of a long sum, is evaluated from its innermost
+		// operation outwards in a loop instead of recursively
+		vector<const BinaryOperation*> operations = {this};
+		while (lhs_operation != nullptr){
+			operations.push_back(lhs_operation);
+			lhs_operation = dynamic_cast<const BinaryOperation*>(lhs_operation->lhs_.get());
+		}
+		auto value = operations.back()->lhs_->Execute(closure, context);
+		for (auto it = operations.rbegin(); it != operations.rend(); ++it){
+			auto rhs = (*it)->rhs_->Execute(closure, context);
+			value = (*it)->Apply(value, rhs, context);
+		}
+		return value;
+	}
+
+	ObjectHolder Add::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) const{
+		return AddObjects(lhs, rhs, context);
+	}
+
+	ObjectHolder Sub::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, [[maybe_unused]] Context& context) const{
 		auto lhs_number = lhs.TryAs<runtime::Number>();
 		auto rhs_number = rhs.TryAs<runtime::Number>();
 		if (lhs_number != nullptr && rhs_number != nullptr){
@@ -195,10 +369,7 @@ namespace ast{
 		throw std::runtime_error("lhs or rhs not Number"s);
 	}
 
-	ObjectHolder Mult::Execute(Closure& closure, Context& context){
-		auto lhs = lhs_->Execute(closure, context);
-		auto rhs = rhs_->Execute(closure, context);
-
+	ObjectHolder Mult::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, [[maybe_unused]] Context& context) const{
 		auto lhs_number = lhs.TryAs<runtime::Number>();
 		auto rhs_number = rhs.TryAs<runtime::Number>();
 		if (lhs_number != nullptr && rhs_number != nullptr){
@@ -209,10 +380,7 @@ namespace ast{
 		throw std::runtime_error("lhs or rhs not Number"s);
 	}
 
-	ObjectHolder Div::Execute(Closure& closure, Context& context){
-		auto lhs = lhs_->Execute(closure, context);
-		auto rhs = rhs_->Execute(closure, context);
-
+	ObjectHolder Div::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, [[maybe_unused]] Context& context) const{
 		auto lhs_number = lhs.TryAs<runtime::Number>();
 		auto rhs_number = rhs.TryAs<runtime::Number>();
 		if (lhs_number != nullptr && rhs_number != nullptr){
@@ -227,27 +395,64 @@ namespace ast{
 		throw std::runtime_error("lhs or rhs not Number"s);
 	}
 
-	ObjectHolder Or::Execute(Closure& closure, Context& context){
-		auto lhs = lhs_->Execute(closure, context);
-		auto rhs = rhs_->Execute(closure, context);
+	class OperandStack {
+	public:
+		OperandStack() = default;
+		OperandStack(const OperandStack&) = delete;
+		OperandStack& operator=(const OperandStack&) = delete;
+
+		~OperandStack() {
+			while (!operands_.empty()){
+				auto operand = std::move(operands_.back());
+				operands_.pop_back();
+				if (auto* unary = dynamic_cast<UnaryOperation*>(operand.get())){
+					Push(unary->argument_);
+				}else if (auto* binary = dynamic_cast<BinaryOperation*>(operand.get())){
+					Push(binary->lhs_);
+					Push(binary->rhs_);
+				}
+			}
+		}
+
+		// Only operations are taken, other statements are destroyed by their owners
+		void Push(unique_ptr<Statement>& operand) {
+			if (dynamic_cast<UnaryOperation*>(operand.get()) || dynamic_cast<BinaryOperation*>(operand.get())){
+				operands_.push_back(std::move(operand));
+			}
+		}
+
+	private:
+		vector<unique_ptr<Statement>> operands_;
+	};
+
+	UnaryOperation::~UnaryOperation() {
+		OperandStack operands;
+		operands.Push(argument_);
+	}
+
+	BinaryOperation::~BinaryOperation() {
+		OperandStack operands;
+		operands.Push(lhs_);
+		operands.Push(rhs_);
+	}
+
+	ObjectHolder Or::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, [[maybe_unused]] Context& context) const{
 		bool result = (runtime::IsTrue(lhs) || runtime::IsTrue(rhs));
 		return runtime::ObjectHolder::Own(runtime::Bool{result});
 	}
 
-	ObjectHolder And::Execute(Closure& closure, Context& context){
-		auto lhs = lhs_->Execute(closure, context);
-		auto rhs = rhs_->Execute(closure, context);
+	ObjectHolder And::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, [[maybe_unused]] Context& context) const{
 		bool result = (runtime::IsTrue(lhs) && runtime::IsTrue(rhs));
 		return runtime::ObjectHolder::Own(runtime::Bool{result});
 	}
 
-	ObjectHolder Not::Execute(Closure& closure, Context& context){
+	ObjectHolder Not::Execute(Closure& closure, Context& context) const{
 		auto arg = argument_->Execute(closure, context);
 		bool result = !runtime::IsTrue(arg);
 		return runtime::ObjectHolder::Own(runtime::Bool{result});
 	}
 
-	ObjectHolder Compound::Execute(Closure& closure, Context& context){
+	ObjectHolder Compound::Execute(Closure& closure, Context& context) const{
 		for (const auto& stmt : statements_) {
 			stmt->Execute(closure, context);
 		}
@@ -258,7 +463,7 @@ namespace ast{
 		: body_(std::move(body))
 	{}
 
-	ObjectHolder MethodBody::Execute(Closure& closure, Context& context){
+	ObjectHolder MethodBody::Execute(Closure& closure, Context& context) const{
 		try{
 			body_->Execute(closure, context);
 			return runtime::ObjectHolder::None();
@@ -267,7 +472,7 @@ namespace ast{
 		}
 	}
 
-	ObjectHolder Return::Execute(Closure& closure, Context& context){
+	ObjectHolder Return::Execute(Closure& closure, Context& context) const{
 		throw statement_->Execute(closure, context);
 	}
 
@@ -275,7 +480,7 @@ namespace ast{
 		: cls_(std::move(cls))
 	{}
 
-	ObjectHolder ClassDefinition::Execute(Closure& closure, [[maybe_unused]] Context& context){
+	ObjectHolder ClassDefinition::Execute(Closure& closure, [[maybe_unused]] Context& context) const{
 		const auto obj_cls = cls_.TryAs<const runtime::Class>();
 		std::string name = obj_cls->GetName();
 		const auto [it, _] = closure.emplace(name, cls_);
@@ -289,7 +494,7 @@ namespace ast{
 		, else_body_(std::move(else_body))
 	{}
 
-	ObjectHolder IfElse::Execute(Closure& closure, Context& context){
+	ObjectHolder IfElse::Execute(Closure& closure, Context& context) const{
 		if (runtime::IsTrue(condition_->Execute(closure, context))){
 			return if_body_->Execute(closure, context);
 		}else if (else_body_ != nullptr){
@@ -304,32 +509,251 @@ namespace ast{
 		, cmp_(std::move(cmp))
 	{}
 
-	ObjectHolder Comparison::Execute(Closure& closure, Context& context){
-		auto lhs = lhs_->Execute(closure, context);
-		auto rhs = rhs_->Execute(closure, context);
+	ObjectHolder Comparison::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) const{
 		bool result = cmp_(lhs, rhs, context);
 		return runtime::ObjectHolder::Own(runtime::Bool{result});
 	}
 
 	NewInstance::NewInstance(const runtime::Class& cls)
-		: instance_(cls)
+		: cls_(cls)
 	{}
 
 	NewInstance::NewInstance(const runtime::Class& cls, std::vector<std::unique_ptr<Statement>> args)
-		: instance_(cls)
+		: cls_(cls)
 		, args_(std::move(args))
 	{}
 
-	ObjectHolder NewInstance::Execute(Closure& closure, Context& context){
+	ObjectHolder NewInstance::Execute(Closure& closure, Context& context) const{
 		std::vector<ObjectHolder> actual_args;
+		actual_args.reserve(args_.size());
 		for (const auto& arg : args_){
 			actual_args.push_back(arg->Execute(closure, context));
 		}
 
-		if (instance_.HasMethod(INIT_METHOD, actual_args.size())){
-			instance_.Call(INIT_METHOD, actual_args, context);
+		ObjectHolder result = cls_.NewInstance();
+		auto& instance = static_cast<runtime::ClassInstance&>(*result);
+		if (const auto* init = instance.TryMethod(INIT_METHOD, actual_args.size())){
+			instance.Call(init, actual_args, context);
+		}
+
+		return result;
+	}
+
+	// The typed nodes still check the types of their operands: a value of another type, which
+	// a wrong inference would let through, gets what the untyped node does with it
+	namespace{
+		// nullptr unless the object holds a T
+		template <typename T>
+		const T* ValueOf(const ObjectHolder& object){
+			const auto* value = object.TryAs<runtime::ValueObject<T>>();
+			return value != nullptr ? &value->GetValue() : nullptr;
+		}
+
+		bool IsTrueValue(const ObjectHolder& object){
+			const bool* value = ValueOf<bool>(object);
+			return value != nullptr ? *value : runtime::IsTrue(object);
 		}
 
-		return ObjectHolder::Share(instance_);
+		ObjectHolder ApplyObjects(const Add&, const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context){
+			return AddObjects(lhs, rhs, context);
+		}
+
+		// Sub, Mult and Div
+		ObjectHolder ApplyObjects(const BinaryOperation&, [[maybe_unused]] const ObjectHolder& lhs,
+								  [[maybe_unused]] const ObjectHolder& rhs, [[maybe_unused]] Context& context){
+			throw std::runtime_error("lhs or rhs not Number"s);
+		}
+
+		int ApplyValues(const Add&, int lhs, int rhs){
+			return lhs + rhs;
+		}
+
+		int ApplyValues(const Sub&, int lhs, int rhs){
+			return lhs - rhs;
+		}
+
+		int ApplyValues(const Mult&, int lhs, int rhs){
+			return lhs * rhs;
+		}
+
+		int ApplyValues(const Div&, int lhs, int rhs){
+			if (rhs == 0){
+				throw std::runtime_error("Division by zero"s);
+			}
+			return lhs / rhs;
+		}
+
+		bool ApplyValues(const And&, bool lhs, bool rhs){
+			return lhs && rhs;
+		}
+
+		bool ApplyValues(const Or&, bool lhs, bool rhs){
+			return lhs || rhs;
+		}
+	}
+
+	template <typename Operation>
+	ObjectHolder NumberOperation<Operation>::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs,
+												   Context& context) const{
+		const int* lhs_number = ValueOf<int>(lhs);
+		const int* rhs_number = ValueOf<int>(rhs);
+		if (lhs_number == nullptr || rhs_number == nullptr){
+			return ApplyObjects(*this, lhs, rhs, context);
+		}
+		int number = ApplyValues(*this, *lhs_number, *rhs_number);
+		return runtime::ObjectHolder::Own(runtime::Number{number});
+	}
+
+	template class NumberOperation<Add>;
+	template class NumberOperation<Sub>;
+	template class NumberOperation<Mult>;
+	template class NumberOperation<Div>;
+
+	ObjectHolder StringConcatenation::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) const{
+		const string* lhs_string = ValueOf<string>(lhs);
+		const string* rhs_string = ValueOf<string>(rhs);
+		if (lhs_string == nullptr || rhs_string == nullptr){
+			return AddObjects(lhs, rhs, context);
+		}
+		return MakeString(*lhs_string + *rhs_string);
+	}
+
+	template <typename Operation>
+	ObjectHolder BoolOperation<Operation>::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs,
+												 [[maybe_unused]] Context& context) const{
+		bool result = ApplyValues(*this, IsTrueValue(lhs), IsTrueValue(rhs));
+		return runtime::ObjectHolder::Own(runtime::Bool{result});
+	}
+
+	template class BoolOperation<And>;
+	template class BoolOperation<Or>;
+
+	ObjectHolder BoolOperation<Not>::Execute(Closure& closure, Context& context) const{
+		bool result = !IsTrueValue(argument_->Execute(closure, context));
+		return runtime::ObjectHolder::Own(runtime::Bool{result});
+	}
+
+	template <typename T>
+	ValueComparison<T>::ValueComparison(Comparator cmp, Compare compare, unique_ptr<Statement> lhs,
+			unique_ptr<Statement> rhs)
+		: Comparison(std::move(cmp), std::move(lhs), std::move(rhs))
+		, compare_(compare)
+	{}
+
+	template <typename T>
+	ObjectHolder ValueComparison<T>::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) const{
+		const T* lhs_value = ValueOf<T>(lhs);
+		const T* rhs_value = ValueOf<T>(rhs);
+		bool result = lhs_value != nullptr && rhs_value != nullptr
+			? compare_(*lhs_value, *rhs_value)
+			: GetComparator()(lhs, rhs, context);
+		return runtime::ObjectHolder::Own(runtime::Bool{result});
+	}
+
+	template class ValueComparison<int>;
+	template class ValueComparison<string>;
+
+	template <typename T>
+	typename ValueComparison<T>::Compare GetValueCompare(const Comparison::Comparator& cmp){
+		using RuntimeComparator = bool (*)(const ObjectHolder&, const ObjectHolder&, Context&);
+		const auto* comparator = cmp.target<RuntimeComparator>();
+		if (comparator == nullptr){
+			return nullptr;
+		}
+		if (*comparator == runtime::Equal){
+			return [](const T& lhs, const T& rhs) { return lhs == rhs; };
+		}
+		if (*comparator == runtime::NotEqual){
+			return [](const T& lhs, const T& rhs) { return lhs != rhs; };
+		}
+		if (*comparator == runtime::Less){
+			return [](const T& lhs, const T& rhs) { return lhs < rhs; };
+		}
+		if (*comparator == runtime::Greater){
+			return [](const T& lhs, const T& rhs) { return lhs > rhs; };
+		}
+		if (*comparator == runtime::LessOrEqual){
+			return [](const T& lhs, const T& rhs) { return lhs <= rhs; };
+		}
+		if (*comparator == runtime::GreaterOrEqual){
+			return [](const T& lhs, const T& rhs) { return lhs >= rhs; };
+		}
+		return nullptr;
+	}
+
+	template NumberComparison::Compare GetValueCompare<int>(const Comparison::Comparator& cmp);
+	template StringComparison::Compare GetValueCompare<string>(const Comparison::Comparator& cmp);
+
+	ObjectHolder BoolIfElse::Execute(Closure& closure, Context& context) const{
+		if (IsTrueValue(condition_->Execute(closure, context))){
+			return if_body_->Execute(closure, context);
+		}else if (else_body_ != nullptr){
+			return else_body_->Execute(closure, context);
+		}else{
+			return ObjectHolder::None();
+		}
+	}
+
+	ObjectHolder FieldIncrement::Execute(Closure& closure, Context& context) const{
+		auto object = object_.Execute(closure, context);
+		auto instance = object.TryAs<runtime::ClassInstance>();
+		if (instance == nullptr){
+			throw std::runtime_error("Only class instances have fields"s);
+		}
+
+		Closure& fields = instance->Fields();
+		auto found_field = fields.find(field_name_);
+		if (found_field == fields.end()){
+			throw std::runtime_error("Not find variable");
+		}
+		// Reading a constant or a variable doesn't change the fields
+		auto delta = static_cast<const Add&>(*rv_).GetRhs().Execute(closure, context);
+		auto lhs_number = found_field->second.TryAs<runtime::Number>();
+		auto rhs_number = delta.TryAs<runtime::Number>();
+		if (lhs_number != nullptr && rhs_number != nullptr){
+			int number = lhs_number->GetValue() + rhs_number->GetValue();
+			return found_field->second = runtime::ObjectHolder::Own(runtime::Number{number});
+		}
+
+		// __add__ may change them
+		auto result = AddObjects(ObjectHolder(found_field->second), delta, context);
+		return fields[field_name_] = std::move(result);
+	}
+
+	ObjectHolder ReturningMethodBody::Execute(Closure& closure, Context& context) const{
+		const auto& statements = static_cast<const Compound&>(*body_).GetStatements();
+		try{
+			for (size_t i = 0; i + 1 < statements.size(); ++i){
+				statements[i]->Execute(closure, context);
+			}
+		}catch(runtime::ObjectHolder& obj) {
+			return obj;
+		}
+		return static_cast<const Return&>(*statements.back()).GetStatement().Execute(closure, context);
+	}
+
+	CompareBranch::CompareBranch(NumberComparison::Compare compare, unique_ptr<Statement> condition,
+			unique_ptr<Statement> if_body, unique_ptr<Statement> else_body)
+		: IfElse(std::move(condition), std::move(if_body), std::move(else_body))
+		, compare_(compare)
+	{}
+
+	ObjectHolder CompareBranch::Execute(Closure& closure, Context& context) const{
+		const auto& condition = static_cast<const Comparison&>(*condition_);
+		auto lhs = condition.GetLhs().Execute(closure, context);
+		auto rhs = condition.GetRhs().Execute(closure, context);
+		auto lhs_number = lhs.TryAs<runtime::Number>();
+		auto rhs_number = rhs.TryAs<runtime::Number>();
+		const bool result = lhs_number != nullptr && rhs_number != nullptr
+			? compare_(lhs_number->GetValue(), rhs_number->GetValue())
+			: condition.GetComparator()(lhs, rhs, context);
+
+		if (result){
+			return if_body_->Execute(closure, context);
+		}else if (else_body_ != nullptr){
+			return else_body_->Execute(closure, context);
+		}else{
+			return ObjectHolder::None();
+		}
 	}
 }
@@ -2,25 +2,35 @@
 #include "runtime.h"
 
 #include <functional>
+#include <optional>
 
 namespace ast{
 
 	using Statement = runtime::Executable;
 
+	// Gives passes access to the child nodes, see visitor.h
+	class Children;
+
+	// The constant is owned by the statement and shared by every evaluation, so results
+	// stay valid after the program is destroyed and no evaluation writes to the tree
 	template <typename T>
 	class ValueStatement : public Statement {
 	public:
 		explicit ValueStatement(T v)
-			: value_(std::move(v)){
+			: value_(runtime::ObjectHolder::Own(std::move(v))){
 		}
 
 		runtime::ObjectHolder Execute([[maybe_unused]] runtime::Closure& closure,
-				[[maybe_unused]] runtime::Context& context) override {
-			return runtime::ObjectHolder::Share(value_);
+				[[maybe_unused]] runtime::Context& context) const override {
+			return value_;
+		}
+
+		[[nodiscard]] const runtime::ObjectHolder& GetValue() const {
+			return value_;
 		}
 
 	private:
-		T value_;
+		runtime::ObjectHolder value_;
 	};
 
 	using NumericConst = ValueStatement<runtime::Number>;
@@ -31,7 +41,11 @@ namespace ast{
 	public:
 		explicit VariableValue(const std::string& var_name);
 		explicit VariableValue(std::vector<std::string> dotted_ids);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const std::vector<std::string>& GetDottedIds() const {
+			return dotted_ids_;
+		}
 
 	private:
 		std::vector<std::string> dotted_ids_;
@@ -40,9 +54,18 @@ namespace ast{
 	class Assignment : public Statement {
 	public:
 		Assignment(std::string var_name, std::unique_ptr<Statement> rv);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const std::string& GetVarName() const {
+			return var_name_;
+		}
+		[[nodiscard]] const Statement& GetValue() const {
+			return *rv_;
+		}
 
 	private:
+		friend class Children;
+
 		std::string var_name_;
 		std::unique_ptr<Statement> rv_;
 	};
@@ -50,18 +73,31 @@ namespace ast{
 	class FieldAssignment : public Statement {
 	public:
 		FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
 
-	private:
+		[[nodiscard]] const VariableValue& GetObject() const {
+			return object_;
+		}
+		[[nodiscard]] const std::string& GetFieldName() const {
+			return field_name_;
+		}
+		[[nodiscard]] const Statement& GetValue() const {
+			return *rv_;
+		}
+
+	protected:
 		VariableValue object_;
 		std::string field_name_;
 		std::unique_ptr<Statement> rv_;
+
+	private:
+		friend class Children;
 	};
 
 	class None : public Statement {
 	public:
 		runtime::ObjectHolder Execute([[maybe_unused]] runtime::Closure& closure,
-				[[maybe_unused]] runtime::Context& context) override {
+				[[maybe_unused]] runtime::Context& context) const override {
 			return {};
 		}
 	};
@@ -71,9 +107,15 @@ namespace ast{
 		explicit Print(std::unique_ptr<Statement> argument);
 		explicit Print(std::vector<std::unique_ptr<Statement>> args);
 		static std::unique_ptr<Print> Variable(const std::string& name);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+			return args_;
+		}
 
 	private:
+		friend class Children;
+
 		std::vector<std::unique_ptr<Statement>> args_;
 	};
 
@@ -81,39 +123,144 @@ namespace ast{
 	public:
 		MethodCall(std::unique_ptr<Statement> object, std::string method,
 				std::vector<std::unique_ptr<Statement>> args);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		// Evaluates the arguments and calls the method on the instance the object evaluated to
+		runtime::ObjectHolder Call(runtime::ClassInstance& instance, runtime::Closure& closure,
+				runtime::Context& context) const;
+		std::vector<runtime::ObjectHolder> EvaluateArgs(runtime::Closure& closure, runtime::Context& context) const;
+
+		[[nodiscard]] const Statement& GetObject() const {
+			return *object_;
+		}
+		[[nodiscard]] const std::string& GetMethod() const {
+			return method_;
+		}
+		[[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+			return args_;
+		}
 
 	private:
+		friend class Children;
+
 		std::unique_ptr<Statement> object_;
 		std::string method_;
 		std::vector<std::unique_ptr<Statement>> args_;
 	};
 
+	// A call whose method is known before the program runs, see passes::Devirtualize. The
+	// method isn't looked up by its name
+	class BoundMethodCall : public Statement {
+	public:
+		BoundMethodCall(std::unique_ptr<MethodCall> call, const runtime::Method& method);
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const MethodCall& GetCall() const {
+			return *call_;
+		}
+		[[nodiscard]] const runtime::Method& GetTarget() const {
+			return method_;
+		}
+
+	private:
+		friend class Children;
+
+		std::unique_ptr<MethodCall> call_;
+		const runtime::Method& method_;
+	};
+
+	// A call of leaf methods, whose bodies only return or assign to a field of self a constant,
+	// self, a field of self or a parameter. When the receiver is an instance of one of the
+	// target classes, the body of its method runs in place, without a frame. Any other receiver
+	// gets the call
+	class InlinedMethodCall : public Statement {
+	public:
+		struct Value {
+			enum class Kind {
+				CONSTANT,
+				SELF,
+				FIELD,
+				PARAMETER,
+			};
+
+			Kind kind = Kind::CONSTANT;
+			runtime::ObjectHolder constant;
+			std::string field;
+			size_t parameter = 0;
+		};
+
+		struct Target {
+			const runtime::Class* cls = nullptr;
+			// A setter assigns the value to this field and returns None
+			std::optional<std::string> assigned_field;
+			Value value;
+		};
+
+		InlinedMethodCall(std::unique_ptr<MethodCall> call, std::vector<Target> targets);
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const MethodCall& GetCall() const {
+			return *call_;
+		}
+		[[nodiscard]] const std::vector<Target>& GetTargets() const {
+			return targets_;
+		}
+
+	private:
+		friend class Children;
+
+		std::unique_ptr<MethodCall> call_;
+		std::vector<Target> targets_;
+	};
+
 	class NewInstance : public Statement {
 	public:
 		explicit NewInstance(const runtime::Class& cls);
 		NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const runtime::Class& GetClass() const {
+			return cls_;
+		}
+		[[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+			return args_;
+		}
 
 	private:
-		runtime::ClassInstance instance_;
+		friend class Children;
+
+		const runtime::Class& cls_;
 		std::vector<std::unique_ptr<Statement>> args_;
 	};
 
+	// Operations destroy the operations nested in their operands in a loop, so that the tree of
+	// a long sum or of deeply nested parentheses doesn't overflow the stack. A binary operation
+	// evaluates the operations nested in its left operand in a loop as well
+	class OperandStack;
+
 	class UnaryOperation : public Statement {
 	public:
 		explicit UnaryOperation(std::unique_ptr<Statement> argument)
 			: argument_(std::move(argument))
 		{}
+		~UnaryOperation() override;
+
+		[[nodiscard]] const Statement& GetArgument() const {
+			return *argument_;
+		}
 
 	protected:
 		std::unique_ptr<Statement> argument_;
+
+	private:
+		friend class Children;
+		friend class OperandStack;
 	};
 
 	class Stringify : public UnaryOperation {
 	public:
 		using UnaryOperation::UnaryOperation;
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
 	};
 
 	class BinaryOperation : public Statement {
@@ -122,52 +269,89 @@ namespace ast{
 			: lhs_(std::move(lhs))
 			, rhs_(std::move(rhs))
 		{}
+		~BinaryOperation() override;
+
+		[[nodiscard]] const Statement& GetLhs() const {
+			return *lhs_;
+		}
+		[[nodiscard]] const Statement& GetRhs() const {
+			return *rhs_;
+		}
+
+		// Evaluates the operands and applies the operation to their values
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const final;
 
 	protected:
+		// The result of the operation for the values of its operands
+		virtual runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+											runtime::Context& context) const = 0;
+
 		std::unique_ptr<Statement> lhs_;
 		std::unique_ptr<Statement> rhs_;
+
+	private:
+		friend class Children;
+		friend class OperandStack;
 	};
 
 	class Add : public BinaryOperation {
 	public:
 		using BinaryOperation::BinaryOperation;
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
 	};
 
 	class Sub : public BinaryOperation {
 	public:
 		using BinaryOperation::BinaryOperation;
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
 	};
 
 	class Mult : public BinaryOperation {
 	public:
 		using BinaryOperation::BinaryOperation;
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
 	};
 
 	class Div : public BinaryOperation {
 	public:
 		using BinaryOperation::BinaryOperation;
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
 	};
 
 	class Or : public BinaryOperation {
 	public:
 		using BinaryOperation::BinaryOperation;
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
 	};
 
 	class And : public BinaryOperation {
 	public:
 		using BinaryOperation::BinaryOperation;
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
 	};
 
 	class Not : public UnaryOperation {
 	public:
 		using UnaryOperation::UnaryOperation;
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
 	};
 
 	class Compound : public Statement {
@@ -183,9 +367,15 @@ namespace ast{
 			AddStatementInVector(std::move(stmt));
 		}
 
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetStatements() const {
+			return statements_;
+		}
 
 	private:
+		friend class Children;
+
 		template <typename T0, typename... Ts>
 		void AddStatementInVector(T0&& v0, Ts&&... vs) {
 			statements_.push_back(std::forward<T0>(v0));
@@ -200,10 +390,17 @@ namespace ast{
 	class MethodBody : public Statement {
 	public:
 		explicit MethodBody(std::unique_ptr<Statement>&& body);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
 
-	private:
+		[[nodiscard]] const Statement& GetBody() const {
+			return *body_;
+		}
+
+	protected:
 		std::unique_ptr<Statement> body_;
+
+	private:
+		friend class Children;
 	};
 
 	class Return : public Statement {
@@ -212,18 +409,34 @@ namespace ast{
 			: statement_(std::move(statement))
 		{}
 
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const Statement& GetStatement() const {
+			return *statement_;
+		}
 
 	private:
+		friend class Children;
+
 		std::unique_ptr<Statement> statement_;
 	};
 
 	class ClassDefinition : public Statement {
 	public:
 		explicit ClassDefinition(runtime::ObjectHolder cls);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+		[[nodiscard]] const runtime::Class& GetClass() const {
+			return *cls_.TryAs<runtime::Class>();
+		}
+		// For passes, which may replace the bodies of its methods
+		[[nodiscard]] runtime::Class& GetClass() {
+			return *cls_.TryAs<runtime::Class>();
+		}
 
 	private:
+		friend class Children;
+
 		runtime::ObjectHolder cls_;
 	};
 
@@ -231,12 +444,26 @@ namespace ast{
 	public:
 		IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> if_body,
 				std::unique_ptr<Statement> else_body);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
 
-	private:
+		[[nodiscard]] const Statement& GetCondition() const {
+			return *condition_;
+		}
+		[[nodiscard]] const Statement& GetIfBody() const {
+			return *if_body_;
+		}
+		// nullptr when there is no else branch
+		[[nodiscard]] const Statement* GetElseBody() const {
+			return else_body_.get();
+		}
+
+	protected:
 		std::unique_ptr<Statement> condition_;
 		std::unique_ptr<Statement> if_body_;
 		std::unique_ptr<Statement> else_body_;
+
+	private:
+		friend class Children;
 	};
 
 	class Comparison : public BinaryOperation {
@@ -244,9 +471,118 @@ namespace ast{
 		using Comparator = std::function<bool(const runtime::ObjectHolder&,
 				  const runtime::ObjectHolder&, runtime::Context&)>;
 		Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
-		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+		[[nodiscard]] const Comparator& GetComparator() const {
+			return cmp_;
+		}
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
 
 	private:
 		Comparator cmp_;
 	};
+
+	// The nodes below are made by passes::InferTypes for operands proven to be of one type.
+	// Each is the node it derives from without the checks of the types of its operands
+
+	// Operation is Add, Sub, Mult or Div
+	template <typename Operation>
+	class NumberOperation final : public Operation {
+	public:
+		using Operation::Operation;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
+	};
+
+	class StringConcatenation final : public Add {
+	public:
+		using Add::Add;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
+	};
+
+	// Operation is And, Or or Not
+	template <typename Operation>
+	class BoolOperation final : public Operation {
+	public:
+		using Operation::Operation;
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
+	};
+
+	template <>
+	class BoolOperation<Not> final : public Not {
+	public:
+		using Not::Not;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+	};
+
+	// T is int or std::string. The comparator is kept for passes, compare does the work
+	template <typename T>
+	class ValueComparison final : public Comparison {
+	public:
+		using Compare = bool (*)(const T& lhs, const T& rhs);
+
+		ValueComparison(Comparator cmp, Compare compare, std::unique_ptr<Statement> lhs,
+						std::unique_ptr<Statement> rhs);
+
+	protected:
+		runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+									 runtime::Context& context) const override;
+
+	private:
+		Compare compare_;
+	};
+
+	using NumberComparison = ValueComparison<int>;
+	using StringComparison = ValueComparison<std::string>;
+
+	// What cmp does to two T values when it is one of the comparisons of runtime, else nullptr
+	template <typename T>
+	typename ValueComparison<T>::Compare GetValueCompare(const Comparison::Comparator& cmp);
+
+	class BoolIfElse final : public IfElse {
+	public:
+		using IfElse::IfElse;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+	};
+
+	// Superinstructions made by passes::FuseStatements. Each keeps the children of the node it
+	// derives from and runs them in one Execute
+
+	// object.field = object.field + delta, where delta is a constant or a variable. The object
+	// is looked up once and numbers are added without the Add node
+	class FieldIncrement final : public FieldAssignment {
+	public:
+		using FieldAssignment::FieldAssignment;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+	};
+
+	// A body whose last statement is a return. The value of that return is the result of the
+	// body, it isn't thrown
+	class ReturningMethodBody final : public MethodBody {
+	public:
+		using MethodBody::MethodBody;
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+	};
+
+	// An if whose condition is a comparison. Numbers are compared without making a Bool, other
+	// values by the comparator of the condition
+	class CompareBranch final : public IfElse {
+	public:
+		CompareBranch(NumberComparison::Compare compare, std::unique_ptr<Statement> condition,
+					  std::unique_ptr<Statement> if_body, std::unique_ptr<Statement> else_body);
+		runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) const override;
+
+	private:
+		NumberComparison::Compare compare_;
+	};
 }
@@ -0,0 +1,45 @@
+#include "bench_runner_p.h"
+#include "statement.h"
+
+using namespace std;
+
+namespace ast {
+
+using runtime::Closure;
+using runtime::ObjectHolder;
+
+namespace {
+
+// One million short-lived instances with an __init__ that sets a field
+void BenchmarkShortLivedInstances() {
+    constexpr int INSTANCE_COUNT = 1'000'000;
+
+    vector<runtime::Method> methods;
+    methods.push_back({"__init__"s,
+                       {"value"s},
+                       make_unique<MethodBody>(make_unique<FieldAssignment>(
+                           VariableValue{"self"s}, "value"s, make_unique<VariableValue>("value"s)))});
+    runtime::Class cls("Point"s, std::move(methods), nullptr);
+
+    vector<unique_ptr<Statement>> args;
+    args.push_back(make_unique<VariableValue>("x"s));
+    NewInstance new_instance(cls, std::move(args));
+
+    runtime::DummyContext context;
+    Closure closure = {{"x"s, ObjectHolder::Own(runtime::Number(42))}};
+
+    const double seconds = MeasureSeconds([&] {
+        for (int i = 0; i < INSTANCE_COUNT; ++i) {
+            ObjectHolder instance = new_instance.Execute(closure, context);
+        }
+    });
+    cerr << "  "sv << INSTANCE_COUNT / seconds / 1e6 << " M instances/s"sv << endl;
+}
+
+}  // namespace
+
+void RunBenchmarks(BenchmarkRunner& br) {
+    RUN_BENCHMARK(br, ast::BenchmarkShortLivedInstances);
+}
+
+}  // namespace ast
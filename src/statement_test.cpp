@@ -211,6 +211,30 @@ void TestStringify() {
         Stringify str(make_unique<None>());
         ASSERT_OBJECT_VALUE_EQUAL(str.Execute(empty, context), "None"s);
     }
+    {
+        Stringify str_true(make_unique<BoolConst>(runtime::Bool(true)));
+        Stringify str_false(make_unique<BoolConst>(runtime::Bool(false)));
+        ASSERT_OBJECT_VALUE_EQUAL(str_true.Execute(empty, context), "True"s);
+        ASSERT_OBJECT_VALUE_EQUAL(str_false.Execute(empty, context), "False"s);
+    }
+    {
+        for (int value : {0, -1, -128, 1024, -129, 1025, 123456789, -2147483647 - 1}) {
+            auto result = Stringify(make_unique<NumericConst>(value)).Execute(empty, context);
+            ASSERT_OBJECT_VALUE_EQUAL(result, to_string(value));
+            ASSERT(result.TryAs<runtime::String>());
+        }
+    }
+    {
+        vector<runtime::Method> methods;
+        methods.push_back({"__str__"s, {},
+                           make_unique<MethodBody>(make_unique<Return>(
+                               make_unique<BoolConst>(runtime::Bool(false))))});
+        runtime::Class cls("BoxedBool"s, std::move(methods), nullptr);
+
+        auto result = Stringify(make_unique<NewInstance>(cls)).Execute(empty, context);
+        ASSERT_OBJECT_VALUE_EQUAL(result, "False"s);
+        ASSERT(result.TryAs<runtime::String>());
+    }
 
     ASSERT(context.output.str().empty());
 }
@@ -407,6 +431,40 @@ void TestInheritance() {
     ASSERT(!cls.GetMethod("AsStringValue"s));
 }
 
+void TestNewInstance() {
+    runtime::DummyContext context;
+
+    vector<runtime::Method> methods;
+    {
+        auto body = make_unique<Compound>();
+        body->AddStatement(make_unique<FieldAssignment>(VariableValue{"self"s}, "value"s,
+                                                        make_unique<VariableValue>("value"s)));
+        methods.push_back({"__init__"s, {"value"s}, make_unique<MethodBody>(std::move(body))});
+    }
+    runtime::Class cls("Counter"s, std::move(methods), nullptr);
+
+    vector<unique_ptr<Statement>> args;
+    args.push_back(make_unique<VariableValue>("x"s));
+    NewInstance new_instance(cls, std::move(args));
+
+    Closure closure = {{"x"s, ObjectHolder::Own(runtime::Number(1))}};
+    ObjectHolder first = new_instance.Execute(closure, context);
+    closure["x"s] = ObjectHolder::Own(runtime::Number(2));
+    ObjectHolder second = new_instance.Execute(closure, context);
+
+    ASSERT(first.Get() != second.Get());
+    ASSERT_OBJECT_VALUE_EQUAL(first.TryAs<runtime::ClassInstance>()->Fields().at("value"s), 1);
+    ASSERT_OBJECT_VALUE_EQUAL(second.TryAs<runtime::ClassInstance>()->Fields().at("value"s), 2);
+
+    // Storage of a released instance is reused for the next one
+    const runtime::Object* released = second.Get();
+    second = {};
+    ObjectHolder third = new_instance.Execute(closure, context);
+    ASSERT(third.Get() == released);
+    ASSERT(third.TryAs<runtime::ClassInstance>()->Fields().size() == 1);
+    ASSERT(first.TryAs<runtime::ClassInstance>()->Fields().size() == 1);
+}
+
 void TestOr() {
     auto test_or = [](bool lhs, bool rhs) {
         Or or_statement{make_unique<BoolConst>(lhs), make_unique<BoolConst>(rhs)};
@@ -453,6 +511,33 @@ void TestNot() {
     test_not(false);
 }
 
+// Typed nodes given values of other types do what the untyped nodes do
+void TestTypedNodesCheckOperands() {
+    const auto str = [](const string& value) {
+        return make_unique<StringConst>(runtime::String(value));
+    };
+    const auto num = [](int value) {
+        return make_unique<NumericConst>(runtime::Number(value));
+    };
+    Closure closure;
+    runtime::DummyContext context;
+
+    ASSERT_OBJECT_VALUE_EQUAL(NumberOperation<Add>(str("a"s), str("b"s)).Execute(closure, context), "ab"s);
+    ASSERT_THROWS(NumberOperation<Sub>(str("a"s), num(1)).Execute(closure, context), runtime_error);
+    ASSERT_OBJECT_VALUE_EQUAL(StringConcatenation(num(1), num(2)).Execute(closure, context), 3);
+    ASSERT_OBJECT_VALUE_EQUAL(BoolOperation<Not>(num(0)).Execute(closure, context), "True"s);
+    ASSERT_OBJECT_VALUE_EQUAL(BoolOperation<And>(str("x"s), num(2)).Execute(closure, context), "True"s);
+
+    const Comparison::Comparator less = runtime::Less;
+    ASSERT_OBJECT_VALUE_EQUAL(
+        NumberComparison(less, GetValueCompare<int>(less), str("a"s), str("b"s)).Execute(closure, context),
+        "True"s);
+    ASSERT_THROWS(
+        NumberComparison(less, GetValueCompare<int>(less), num(1), str("b"s)).Execute(closure, context),
+        runtime_error);
+    ASSERT_OBJECT_VALUE_EQUAL(BoolIfElse(str("yes"s), num(1), num(2)).Execute(closure, context), 1);
+}
+
 }  // namespace
 
 void RunUnitTests(TestRunner& tr) {
@@ -473,9 +558,11 @@ void RunUnitTests(TestRunner& tr) {
     RUN_TEST(tr, ast::TestFields);
     RUN_TEST(tr, ast::TestBaseClass);
     RUN_TEST(tr, ast::TestInheritance);
+    RUN_TEST(tr, ast::TestNewInstance);
     RUN_TEST(tr, ast::TestOr);
     RUN_TEST(tr, ast::TestAnd);
     RUN_TEST(tr, ast::TestNot);
+    RUN_TEST(tr, ast::TestTypedNodesCheckOperands);
 }
 
 }  // namespace ast
@@ -0,0 +1,129 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace pool {
+
+	namespace {
+		constexpr size_t NOT_A_WORKER = static_cast<size_t>(-1);
+
+		// Identifies the pool and the worker the current thread belongs to
+		thread_local const WorkStealingPool* current_pool = nullptr;
+		thread_local size_t current_worker = NOT_A_WORKER;
+	}
+
+	WorkStealingPool::WorkStealingPool(size_t thread_count) {
+		thread_count = max<size_t>(thread_count, 1);
+		workers_.reserve(thread_count);
+		for (size_t i = 0; i < thread_count; ++i){
+			workers_.push_back(make_unique<Worker>());
+		}
+		threads_.reserve(thread_count);
+		for (size_t i = 0; i < thread_count; ++i){
+			threads_.emplace_back([this, i]{ WorkerLoop(i); });
+		}
+	}
+
+	WorkStealingPool::~WorkStealingPool() {
+		Wait();
+		{
+			lock_guard guard(state_mutex_);
+			stopping_ = true;
+		}
+		work_available_.notify_all();
+		for (auto& t : threads_){
+			t.join();
+		}
+	}
+
+	void WorkStealingPool::Submit(Task task) {
+		size_t index = current_worker;
+		if (current_pool != this){
+			index = next_worker_.fetch_add(1, memory_order_relaxed) % workers_.size();
+		}
+		// Counted before it can be taken, or an awake worker could finish it first and let
+		// Wait return while its submitter is still running
+		{
+			lock_guard guard(state_mutex_);
+			++queued_;
+			++unfinished_;
+		}
+		{
+			lock_guard guard(workers_[index]->mutex);
+			workers_[index]->tasks.push_back(std::move(task));
+		}
+		work_available_.notify_one();
+	}
+
+	void WorkStealingPool::Wait() {
+		unique_lock lock(state_mutex_);
+		all_done_.wait(lock, [this]{ return unfinished_ == 0; });
+	}
+
+	size_t WorkStealingPool::GetThreadCount() const {
+		return threads_.size();
+	}
+
+	bool WorkStealingPool::TryPop(size_t index, Task& task) {
+		Worker& worker = *workers_[index];
+		lock_guard guard(worker.mutex);
+		if (worker.tasks.empty()){
+			return false;
+		}
+		task = std::move(worker.tasks.back());
+		worker.tasks.pop_back();
+		return true;
+	}
+
+	bool WorkStealingPool::TrySteal(size_t thief, Task& task) {
+		for (size_t offset = 1; offset < workers_.size(); ++offset){
+			Worker& victim = *workers_[(thief + offset) % workers_.size()];
+			lock_guard guard(victim.mutex);
+			if (!victim.tasks.empty()){
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WorkStealingPool::WorkerLoop(size_t index) {
+		current_pool = this;
+		current_worker = index;
+
+		while (true){
+			{
+				unique_lock lock(state_mutex_);
+				work_available_.wait(lock, [this]{ return queued_ > 0 || stopping_; });
+				if (queued_ == 0){
+					return;
+				}
+			}
+
+			Task task;
+			if (!TryPop(index, task) && !TrySteal(index, task)){
+				// Another worker took the task between the wakeup and the lookup
+				this_thread::yield();
+				continue;
+			}
+			{
+				lock_guard guard(state_mutex_);
+				--queued_;
+			}
+
+			task();
+
+			bool done = false;
+			{
+				lock_guard guard(state_mutex_);
+				done = --unfinished_ == 0;
+			}
+			if (done){
+				all_done_.notify_all();
+			}
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pool {
+
+	// Every worker owns a deque of tasks: it takes work from the back of its own deque
+	// and, when that is empty, steals from the front of the other workers' deques
+	class WorkStealingPool {
+	public:
+		using Task = std::function<void()>;
+
+		explicit WorkStealingPool(size_t thread_count = std::thread::hardware_concurrency());
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+		~WorkStealingPool();
+
+		// Tasks submitted from a worker go to that worker's deque, the others are
+		// distributed round robin. A task must not let exceptions escape
+		void Submit(Task task);
+
+		// Blocks until every submitted task, including the ones submitted by tasks, is done
+		void Wait();
+
+		[[nodiscard]] size_t GetThreadCount() const;
+
+	private:
+		struct Worker {
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		bool TryPop(size_t index, Task& task);
+		bool TrySteal(size_t thief, Task& task);
+		void WorkerLoop(size_t index);
+
+	private:
+		std::vector<std::unique_ptr<Worker>> workers_;
+		std::vector<std::thread> threads_;
+		std::atomic<size_t> next_worker_ = 0;
+
+		std::mutex state_mutex_;
+		std::condition_variable work_available_;
+		std::condition_variable all_done_;
+		size_t queued_ = 0;
+		size_t unfinished_ = 0;
+		bool stopping_ = false;
+	};
+}
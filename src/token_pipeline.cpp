@@ -0,0 +1,91 @@
+#include "token_pipeline.h"
+
+using namespace std;
+
+namespace parse {
+
+	namespace {
+		// Spins for a short while, then gives the core to the other side of the queue
+		void Backoff(int& attempt) {
+			if (++attempt > 64){
+				this_thread::yield();
+			}
+		}
+	}
+
+	PipelinedLexer::PipelinedLexer(istream& input, size_t capacity)
+		: queue_(capacity)
+		, thread_([this, &input]{ Produce(input); }) {
+		// Like Lexer, the first token is read by the constructor
+		try {
+			ReadToken();
+		} catch (...) {
+			Stop();
+			throw;
+		}
+	}
+
+	PipelinedLexer::~PipelinedLexer() {
+		Stop();
+	}
+
+	const Token& PipelinedLexer::CurrentToken() const {
+		return current_token_;
+	}
+
+	Token PipelinedLexer::NextToken() {
+		if (!current_token_.Is<token_type::Eof>()){
+			ReadToken();
+		}
+		return current_token_;
+	}
+
+	void PipelinedLexer::Produce(istream& input) {
+		try {
+			Lexer lexer(input);
+			Token token = lexer.CurrentToken();
+			while (true){
+				const bool is_last = token.Is<token_type::Eof>();
+				for (int attempt = 0; !queue_.TryPush(token); Backoff(attempt)){
+					if (stopping_.load(memory_order_relaxed)){
+						return;
+					}
+				}
+				if (is_last){
+					break;
+				}
+				token = lexer.NextToken();
+			}
+		} catch (...) {
+			error_ = current_exception();
+		}
+		finished_.store(true, memory_order_release);
+	}
+
+	void PipelinedLexer::ReadToken() {
+		for (int attempt = 0;; Backoff(attempt)){
+			if (queue_.TryPop(current_token_)){
+				return;
+			}
+			if (finished_.load(memory_order_acquire)){
+				// The last tokens may have been pushed between the failed pop and the check
+				if (queue_.TryPop(current_token_)){
+					return;
+				}
+				if (error_){
+					rethrow_exception(error_);
+				}
+				// Nothing is left after the Eof token
+				current_token_ = token_type::Eof{};
+				return;
+			}
+		}
+	}
+
+	void PipelinedLexer::Stop() {
+		stopping_.store(true, memory_order_relaxed);
+		if (thread_.joinable()){
+			thread_.join();
+		}
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "lexer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+
+namespace parse {
+
+	namespace detail {
+		// The smallest power of two that isn't less than the value
+		constexpr size_t RoundUpToPowerOfTwo(size_t value) {
+			size_t result = 1;
+			while (result < value){
+				result <<= 1;
+			}
+			return result;
+		}
+	}
+
+	// Bounded single-producer single-consumer queue. Each side writes only its own position
+	// and reads the other's, so neither takes a lock
+	template <typename T>
+	class SpscQueue {
+	public:
+		// The capacity is rounded up to a power of two
+		explicit SpscQueue(size_t capacity)
+			: mask_(detail::RoundUpToPowerOfTwo(std::max<size_t>(capacity, 2)) - 1)
+			, items_(std::make_unique<T[]>(mask_ + 1)) {
+		}
+
+		// On success the value is moved into the queue
+		bool TryPush(T& value) {
+			const size_t tail = tail_.load(std::memory_order_relaxed);
+			if (tail - cached_head_ > mask_){
+				cached_head_ = head_.load(std::memory_order_acquire);
+				if (tail - cached_head_ > mask_){
+					return false;
+				}
+			}
+			items_[tail & mask_] = std::move(value);
+			tail_.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool TryPop(T& value) {
+			const size_t head = head_.load(std::memory_order_relaxed);
+			if (head == cached_tail_){
+				cached_tail_ = tail_.load(std::memory_order_acquire);
+				if (head == cached_tail_){
+					return false;
+				}
+			}
+			value = std::move(items_[head & mask_]);
+			head_.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		size_t mask_;
+		std::unique_ptr<T[]> items_;
+		// Each side's position shares a cache line only with that side's last seen value of
+		// the other position
+		alignas(64) std::atomic<size_t> head_ = 0;
+		size_t cached_tail_ = 0;
+		alignas(64) std::atomic<size_t> tail_ = 0;
+		size_t cached_head_ = 0;
+	};
+
+	// Runs a Lexer on its own thread, so that the input is tokenized while the tokens read
+	// before are parsed. A lexer error is thrown by the call that would have returned the
+	// broken token. The input must not be used by anything else until the Eof token is read
+	class PipelinedLexer : public TokenStream {
+	public:
+		explicit PipelinedLexer(std::istream& input, size_t capacity = 4096);
+		PipelinedLexer(const PipelinedLexer&) = delete;
+		PipelinedLexer& operator=(const PipelinedLexer&) = delete;
+		~PipelinedLexer() override;
+
+		[[nodiscard]] const Token& CurrentToken() const override;
+
+		Token NextToken() override;
+
+	private:
+		void Produce(std::istream& input);
+		void ReadToken();
+		void Stop();
+
+	private:
+		SpscQueue<Token> queue_;
+		std::atomic<bool> stopping_ = false;
+		std::atomic<bool> finished_ = false;
+		// Written by the lexer thread before it sets finished_
+		std::exception_ptr error_;
+		Token current_token_{};
+		std::thread thread_;
+	};
+}
@@ -0,0 +1,149 @@
+#include "parse.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+#include "token_pipeline.h"
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace parse {
+
+namespace {
+
+const string PROGRAM = R"--(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(amount):
+    self.value = self.value + amount  # "comment"
+    return self.value
+
+counter = Counter()
+if counter.add(2) >= 2 and not False:
+  print "two", counter.value
+else:
+  print None
+)--"s;
+
+template <typename Stream>
+vector<Token> ReadAll(Stream& stream) {
+    vector<Token> result{stream.CurrentToken()};
+    while (!result.back().Is<token_type::Eof>()) {
+        result.push_back(stream.NextToken());
+    }
+    return result;
+}
+
+void TestSpscQueue() {
+    SpscQueue<int> queue(3);
+    int value = 0;
+    ASSERT(!queue.TryPop(value));
+    for (int i = 0; i < 4; ++i) {
+        ASSERT(queue.TryPush(value = i));
+    }
+    ASSERT(!queue.TryPush(value = 4));
+    for (int i = 0; i < 4; ++i) {
+        ASSERT(queue.TryPop(value));
+        ASSERT_EQUAL(value, i);
+    }
+    ASSERT(!queue.TryPop(value));
+}
+
+void TestSpscQueueAcrossThreads() {
+    constexpr int COUNT = 100000;
+    SpscQueue<int> queue(16);
+    thread producer([&queue] {
+        for (int i = 0; i < COUNT; ++i) {
+            int value = i;
+            while (!queue.TryPush(value)) {
+                this_thread::yield();
+            }
+        }
+    });
+
+    int expected = 0;
+    bool in_order = true;
+    while (expected < COUNT) {
+        int value = 0;
+        if (queue.TryPop(value)) {
+            in_order = in_order && value == expected;
+            ++expected;
+        } else {
+            this_thread::yield();
+        }
+    }
+    producer.join();
+    ASSERT(in_order);
+}
+
+void TestSameTokensAsLexer() {
+    istringstream sequential_input(PROGRAM);
+    Lexer lexer(sequential_input);
+    const vector<Token> expected = ReadAll(lexer);
+
+    // A small queue makes both threads wait for each other
+    for (size_t capacity : {1U, 4U, 4096U}) {
+        istringstream input(PROGRAM);
+        PipelinedLexer pipelined(input, capacity);
+        ASSERT_EQUAL(ReadAll(pipelined), expected);
+        ASSERT_EQUAL(pipelined.NextToken(), Token(token_type::Eof{}));
+    }
+}
+
+void TestParsesProgram() {
+    istringstream input(PROGRAM);
+    PipelinedLexer lexer(input, 8);
+    auto program = ParseProgram(lexer);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "two 2\n"s);
+}
+
+void TestErrorIsThrownInOrder() {
+    istringstream input("x = 1\ny = 99999999999\n"s);
+    PipelinedLexer lexer(input);
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+    for (int i = 0; i < 4; ++i) {
+        lexer.NextToken();
+    }
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    ASSERT_THROWS(lexer.NextToken(), std::out_of_range);
+
+    istringstream first("99999999999"s);
+    ASSERT_THROWS(PipelinedLexer{first}, std::out_of_range);
+}
+
+void TestStopsEarly() {
+    string source;
+    for (int i = 0; i < 10000; ++i) {
+        source += "x = "s + to_string(i) + "\n"s;
+    }
+    istringstream input(source);
+    {
+        // The lexer thread is blocked on the full queue when the parser gives up
+        PipelinedLexer lexer(input, 2);
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    }
+    const streamoff position = input.tellg();
+    ASSERT(position > 0 && position < static_cast<streamoff>(source.size()));
+}
+
+}  // namespace
+
+void RunTokenPipelineTests(TestRunner& tr) {
+    RUN_TEST(tr, parse::TestSpscQueue);
+    RUN_TEST(tr, parse::TestSpscQueueAcrossThreads);
+    RUN_TEST(tr, parse::TestSameTokensAsLexer);
+    RUN_TEST(tr, parse::TestParsesProgram);
+    RUN_TEST(tr, parse::TestErrorIsThrownInOrder);
+    RUN_TEST(tr, parse::TestStopsEarly);
+}
+
+}  // namespace parse
@@ -0,0 +1,324 @@
+#include "visitor.h"
+
+#include "isolate.h"
+#include "parse.h"
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace ast {
+
+	namespace {
+		template <typename Node>
+		bool TryVisit(const Statement& node, Visitor& visitor, bool& walk_children) {
+			if (const auto* p = dynamic_cast<const Node*>(&node)){
+				walk_children = visitor.Visit(*p);
+				return true;
+			}
+			return false;
+		}
+
+		template <typename... Nodes>
+		bool VisitAs(const Statement& node, Visitor& visitor) {
+			bool walk_children = true;
+			if (!(TryVisit<Nodes>(node, visitor, walk_children) || ...)){
+				walk_children = visitor.VisitNode(node);
+			}
+			return walk_children;
+		}
+
+		// Returns whether to walk the children of the node
+		bool Dispatch(const Statement& node, Visitor& visitor) {
+			return VisitAs<NumericConst, StringConst, BoolConst, None, VariableValue, Assignment, FieldAssignment,
+						   Print, MethodCall, InlinedMethodCall, BoundMethodCall, NewInstance, Stringify, Add, Sub, Mult, Div, Or, And, Not, Comparison,
+						   Compound, MethodBody, Return, ClassDefinition, IfElse, LazyMethodBody, isolate::Spawn>(
+				node, visitor);
+		}
+
+		// T with the constness of Node
+		template <typename Node, typename T>
+		using Like = conditional_t<is_const_v<Node>, const T, T>;
+
+		template <typename Slots, typename Call>
+		void ForEachSlot(Slots& slots, const Call& call) {
+			for (auto& slot : slots){
+				call(slot);
+			}
+		}
+	}
+
+	template <typename Node, typename Call>
+	void Children::VisitSlots(Node& node, const Call& f) {
+		const auto call = [&f](auto& slot) {
+			if (slot){
+				f(slot);
+			}
+		};
+
+		if (auto* p = dynamic_cast<Like<Node, Assignment>*>(&node)){
+			call(p->rv_);
+		}else if (auto* p = dynamic_cast<Like<Node, FieldAssignment>*>(&node)){
+			call(p->rv_);
+		}else if (auto* p = dynamic_cast<Like<Node, Print>*>(&node)){
+			ForEachSlot(p->args_, call);
+		}else if (auto* p = dynamic_cast<Like<Node, MethodCall>*>(&node)){
+			call(p->object_);
+			ForEachSlot(p->args_, call);
+		}else if (auto* p = dynamic_cast<Like<Node, InlinedMethodCall>*>(&node)){
+			VisitSlots<Like<Node, Statement>>(*p->call_, f);
+		}else if (auto* p = dynamic_cast<Like<Node, BoundMethodCall>*>(&node)){
+			VisitSlots<Like<Node, Statement>>(*p->call_, f);
+		}else if (auto* p = dynamic_cast<Like<Node, NewInstance>*>(&node)){
+			ForEachSlot(p->args_, call);
+		}else if (auto* p = dynamic_cast<Like<Node, UnaryOperation>*>(&node)){
+			call(p->argument_);
+		}else if (auto* p = dynamic_cast<Like<Node, BinaryOperation>*>(&node)){
+			call(p->lhs_);
+			call(p->rhs_);
+		}else if (auto* p = dynamic_cast<Like<Node, Compound>*>(&node)){
+			ForEachSlot(p->statements_, call);
+		}else if (auto* p = dynamic_cast<Like<Node, MethodBody>*>(&node)){
+			call(p->body_);
+		}else if (auto* p = dynamic_cast<Like<Node, Return>*>(&node)){
+			call(p->statement_);
+		}else if (auto* p = dynamic_cast<Like<Node, ClassDefinition>*>(&node)){
+			Like<Node, runtime::Class>& cls = p->GetClass();
+			for (auto& method : cls.GetMethods()){
+				call(method.body);
+			}
+		}else if (auto* p = dynamic_cast<Like<Node, IfElse>*>(&node)){
+			call(p->condition_);
+			call(p->if_body_);
+			call(p->else_body_);
+		}else if (auto* p = dynamic_cast<Like<Node, isolate::Spawn>*>(&node)){
+			ForEachSlot(p->args_, call);
+		}
+	}
+
+	void Children::ForEach(Statement& node, const function<void(Slot&)>& f) {
+		VisitSlots(node, f);
+	}
+
+	void Children::ForEach(const Statement& node, const function<void(const Statement&)>& f) {
+		VisitSlots(node, [&f](const Slot& slot) {
+			f(*slot);
+		});
+	}
+
+	vector<Children::Slot> Children::Take(Statement& node) {
+		vector<Slot> children;
+		ForEach(node, [&children](Slot& child) {
+			children.push_back(std::move(child));
+		});
+		return children;
+	}
+
+	void Visitor::Walk(const Statement& root) {
+		struct Entry {
+			const Statement* node;
+			bool leaving;
+		};
+		vector<Entry> stack{{&root, false}};
+		vector<const Statement*> children;
+		while (!stack.empty()){
+			const Entry entry = stack.back();
+			stack.pop_back();
+			if (entry.leaving){
+				Leave(*entry.node);
+				continue;
+			}
+			stack.push_back({entry.node, true});
+			if (Dispatch(*entry.node, *this)){
+				children.clear();
+				Children::ForEach(*entry.node, [&children](const Statement& child) {
+					children.push_back(&child);
+				});
+				for (auto it = children.rbegin(); it != children.rend(); ++it){
+					stack.push_back({*it, false});
+				}
+			}
+		}
+	}
+
+	bool Visitor::Visit(const NumericConst& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const StringConst& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const BoolConst& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const None& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const VariableValue& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Assignment& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const FieldAssignment& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Print& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const MethodCall& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const InlinedMethodCall& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const BoundMethodCall& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const NewInstance& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Stringify& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Add& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Sub& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Mult& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Div& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Or& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const And& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Not& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Comparison& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Compound& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const MethodBody& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const Return& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const ClassDefinition& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const IfElse& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const LazyMethodBody& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::Visit(const isolate::Spawn& node) {
+		return VisitNode(node);
+	}
+
+	bool Visitor::VisitNode([[maybe_unused]] const Statement& node) {
+		return true;
+	}
+
+	void Visitor::Leave([[maybe_unused]] const Statement& node) {
+	}
+
+	void Rewriter::RewriteTree(unique_ptr<Statement>& root) {
+		struct Entry {
+			unique_ptr<Statement>* slot;
+			bool children_done;
+		};
+		vector<Entry> stack{{&root, false}};
+		vector<unique_ptr<Statement>*> children;
+		while (!stack.empty()){
+			const Entry entry = stack.back();
+			stack.pop_back();
+			if (entry.children_done){
+				*entry.slot = Rewrite(std::move(*entry.slot));
+				continue;
+			}
+			stack.push_back({entry.slot, true});
+			children.clear();
+			Children::ForEach(**entry.slot, [&children](Children::Slot& child) {
+				children.push_back(&child);
+			});
+			for (auto it = children.rbegin(); it != children.rend(); ++it){
+				stack.push_back({*it, false});
+			}
+		}
+	}
+
+	size_t CountNodes(const Statement& root) {
+		class Counter : public Visitor {
+		public:
+			bool VisitNode([[maybe_unused]] const Statement& node) override {
+				++count;
+				return true;
+			}
+
+			size_t count = 0;
+		};
+
+		Counter counter;
+		counter.Walk(root);
+		return counter.count;
+	}
+
+	vector<runtime::Class*> CollectClasses(Statement& root) {
+		vector<runtime::Class*> result;
+		vector<Statement*> stack{&root};
+		vector<Statement*> children;
+		while (!stack.empty()){
+			Statement* node = stack.back();
+			stack.pop_back();
+			if (auto* definition = dynamic_cast<ClassDefinition*>(node)){
+				result.push_back(&definition->GetClass());
+			}
+			children.clear();
+			Children::ForEach(*node, [&children](Children::Slot& child) {
+				children.push_back(child.get());
+			});
+			stack.insert(stack.end(), children.rbegin(), children.rend());
+		}
+		return result;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "statement.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class LazyMethodBody;
+
+namespace isolate {
+	class Spawn;
+}
+
+// Traversal and transformation of parsed programs, for the passes run between ParseProgram
+// and execution. Neither recurses, so they handle trees as deep as the parser does
+namespace ast {
+
+	// The child nodes of a node, in the order they run. The bodies of the methods of a class
+	// definition are its children. A lazily parsed method body has none
+	class Children {
+	public:
+		using Slot = std::unique_ptr<Statement>;
+
+		static void ForEach(Statement& node, const std::function<void(Slot&)>& f);
+		static void ForEach(const Statement& node, const std::function<void(const Statement&)>& f);
+		// Moves the children out, in the same order, for a pass that rebuilds the node
+		static std::vector<Slot> Take(Statement& node);
+
+	private:
+		// Node is Statement or const Statement, call gets the non-empty slots of its children
+		template <typename Node, typename Call>
+		static void VisitSlots(Node& node, const Call& call);
+	};
+
+	// Walks a tree in pre-order. Every Visit returns whether to walk the children of its node,
+	// by default it calls VisitNode, which returns true. Leave is called after the children
+	class Visitor {
+	public:
+		virtual ~Visitor() = default;
+
+		void Walk(const Statement& root);
+
+		virtual bool Visit(const NumericConst& node);
+		virtual bool Visit(const StringConst& node);
+		virtual bool Visit(const BoolConst& node);
+		virtual bool Visit(const None& node);
+		virtual bool Visit(const VariableValue& node);
+		virtual bool Visit(const Assignment& node);
+		virtual bool Visit(const FieldAssignment& node);
+		virtual bool Visit(const Print& node);
+		virtual bool Visit(const MethodCall& node);
+		virtual bool Visit(const InlinedMethodCall& node);
+		virtual bool Visit(const BoundMethodCall& node);
+		virtual bool Visit(const NewInstance& node);
+		virtual bool Visit(const Stringify& node);
+		virtual bool Visit(const Add& node);
+		virtual bool Visit(const Sub& node);
+		virtual bool Visit(const Mult& node);
+		virtual bool Visit(const Div& node);
+		virtual bool Visit(const Or& node);
+		virtual bool Visit(const And& node);
+		virtual bool Visit(const Not& node);
+		virtual bool Visit(const Comparison& node);
+		virtual bool Visit(const Compound& node);
+		virtual bool Visit(const MethodBody& node);
+		virtual bool Visit(const Return& node);
+		virtual bool Visit(const ClassDefinition& node);
+		virtual bool Visit(const IfElse& node);
+		virtual bool Visit(const LazyMethodBody& node);
+		virtual bool Visit(const isolate::Spawn& node);
+
+		// Every kind of node whose Visit isn't overridden, and nodes of other kinds
+		virtual bool VisitNode(const Statement& node);
+		virtual void Leave(const Statement& node);
+	};
+
+	// Transforms a tree bottom-up: Rewrite gets every node after its children have been
+	// rewritten and returns the node to put in its place, usually the same one
+	class Rewriter {
+	public:
+		virtual ~Rewriter() = default;
+
+		void RewriteTree(std::unique_ptr<Statement>& root);
+
+	protected:
+		virtual std::unique_ptr<Statement> Rewrite(std::unique_ptr<Statement> node) = 0;
+	};
+
+	// Nodes of the tree, method bodies of the classes it defines included
+	size_t CountNodes(const Statement& root);
+
+	// Classes the tree defines, in method bodies too, in the order of their definitions
+	std::vector<runtime::Class*> CollectClasses(Statement& root);
+}